@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Measure SMPP PDU encoding and decoding speed with `test/test_smpp_pdu'.
+
+set -e
+
+case "$1" in
+--fast) times=10000; shift ;;
+*) times=1000000 ;;
+esac
+
+rm -f bench_smpp_pdu.log
+test/test_smpp_pdu -v 1 -n $times 2> bench_smpp_pdu.log
+
+rows=`awk '/INFO: .* (encode|decode): / {
+    sub(":", "", $7)
+    printf "<row><entry>%s</entry><entry>%s</entry><entry>%s</entry><entry>%s</entry></row>\\\\n", $6, $7, $13, $15
+}' bench_smpp_pdu.log`
+
+sed "s/#TIMES#/$times/g; s|#ROWS#|$rows|" benchmarks/bench_smpp_pdu.txt
+
+rm -f bench_smpp_pdu.log
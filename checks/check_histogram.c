@@ -0,0 +1,139 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_histogram.c - Check that Histogram objects work
+ *
+ * This is a test program for checking Histogram objects. Several threads
+ * count the same values at the same time, and the totals and percentiles
+ * are checked against what was counted.
+ */
+
+#ifndef THREADS
+#define THREADS 16
+#endif
+
+#ifndef PER_THREAD
+#define PER_THREAD (10000)
+#endif
+
+#include "gwlib/gwlib.h"
+
+static void record(void *arg) {
+	Histogram *h;
+	long i;
+
+	h = arg;
+	for (i = 1; i <= PER_THREAD; ++i)
+		histogram_record(h, i * 100);
+}
+
+
+static void check_percentile(Histogram *h, double percentile) {
+	long long got, wanted;
+
+	got = histogram_percentile(h, percentile);
+	wanted = (long long) (percentile / 100 * PER_THREAD) * 100;
+	if (got < wanted * 0.97 || got > wanted * 1.03)
+		panic(0, "percentile %.1f is %lld, expected about %lld",
+		      percentile, got, wanted);
+}
+
+
+int main(void) {
+	Histogram *h;
+	long threads[THREADS];
+	long i;
+	long long v, got;
+
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+
+	/* small values are exact, the rest within the bucket precision */
+	for (v = 0; v < 100000000; v = v * 3 / 2 + 1) {
+		h = histogram_create();
+		histogram_record(h, v);
+		histogram_record(h, v + 1);
+		got = histogram_percentile(h, 50);
+		if ((v < 64 && got != v) || got < v * 0.97 || got > v * 1.03)
+			panic(0, "value %lld reported as %lld", v, got);
+		histogram_destroy(h);
+	}
+
+	h = histogram_create();
+	for (i = 0; i < THREADS; ++i)
+		threads[i] = gwthread_create(record, h);
+	for (i = 0; i < THREADS; ++i)
+		gwthread_join(threads[i]);
+
+	if (histogram_count(h) != THREADS * PER_THREAD)
+		panic(0, "counted %lu values instead of %d",
+		      histogram_count(h), THREADS * PER_THREAD);
+	if (histogram_sum(h) != (long long) THREADS * 100 *
+	    PER_THREAD * (PER_THREAD + 1) / 2)
+		panic(0, "sum of values is %lld", histogram_sum(h));
+	if (histogram_max(h) != PER_THREAD * 100)
+		panic(0, "largest value is %lld", histogram_max(h));
+
+	check_percentile(h, 50);
+	check_percentile(h, 90);
+	check_percentile(h, 99);
+	check_percentile(h, 99.9);
+	histogram_destroy(h);
+
+	gwlib_shutdown();
+	return 0;
+}
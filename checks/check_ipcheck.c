@@ -55,7 +55,7 @@
  */ 
 
 /*
- * check_ipcheck.c - check the is_allowed_ip function
+ * check_ipcheck.c - check the is_allowed_ip and is_allowed_ip_patterns functions
  *
  * Lars Wirzenius
  */
@@ -83,7 +83,24 @@ int main(void)
 	{ "127.0.0.1", "*.*.*.*", "1.2.3.4", 0 },
 	{ "127.0.0.1", "127.0.0.*", "1.2.3.4", 1 },
 	{ "127.0.0.1", "127.0.0.*", "127.0.0.2", 0 },
+	{ "", "*.*.*.*", "1.2.3.4", 0 },
+	{ "", "10.*.*.*;192.168.1.1*", "192.168.1.15", 0 },
+	{ "", "10.*.*.*;192.168.1.1*", "192.168.2.15", 1 },
+	{ "", "10.*.*.*;192.168.1.1*", "10.0.0.1", 0 },
+	{ "", "10.*.*.*;192.168.1.1*", "10.0.0", 1 },
+	{ "", "1.2.3.*", "1.2.3.", 1 },
+	{ "", "1.*.3.4", "1..3.4", 0 },
+	{ "", "1*.2", "1.2", 0 },
+	{ "", "1.2*", "1.2", 1 },
+	{ "", "1.2.3.4**", "1.2.3.45", 1 },
+	{ "", "1.2**.3.4", "1.25.3.4", 0 },
+	{ "", "1.2*3.3.4", "1.253.3.4", 1 },
+	{ "", "1.2.3.4", "1.2.3.4.5", 1 },
+	{ "127.0.0.1", "127.0.0.*;10.*.*.*", "10.1.2.3", 0 },
+	{ "::1", "*", "::1", 1 },
+	{ "::1", "*", "::2", 0 },
     };
+    IPPatternList *allowed_patterns, *denied_patterns;
     
     gwlib_init();
     log_set_output_level(GW_INFO);
@@ -103,6 +120,21 @@ int main(void)
 		     result,
 		     tab[i].should_be_allowed);
 	}
+	allowed_patterns = ip_pattern_list_create(allowed);
+	denied_patterns = ip_pattern_list_create(denied);
+	result = is_allowed_ip_patterns(allowed_patterns, denied_patterns, ip);
+	if (!!result != !!tab[i].should_be_allowed) {
+	    panic(0, "is_allowed_ip_patterns did not work for "
+	    	     "allowed=<%s> denied=<%s> ip=<%s>, "
+		     "returned %d should be %d",
+		     octstr_get_cstr(allowed),
+		     octstr_get_cstr(denied),
+		     octstr_get_cstr(ip),
+		     result,
+		     tab[i].should_be_allowed);
+	}
+	ip_pattern_list_destroy(allowed_patterns);
+	ip_pattern_list_destroy(denied_patterns);
     }
 
     gwlib_shutdown();
@@ -0,0 +1,174 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_meta_data.c - Check the meta-data functions working on a Msg
+ *
+ * Values set and read through the parsed meta-data kept with the
+ * message have to match those of the packed sms.meta_data, even when
+ * the field is changed directly in between.
+ */
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+#include "gw/meta_data.h"
+
+static void check_value(Msg *msg, const char *group, const char *key,
+                        const char *expected)
+{
+    Octstr *cached, *packed;
+
+    cached = meta_data_msg_get_value(msg, group, octstr_imm(key));
+    packed = meta_data_get_value(msg->sms.meta_data, group, octstr_imm(key));
+    if (expected == NULL) {
+        if (cached != NULL || packed != NULL)
+            panic(0, "%s/%s is set", group, key);
+    } else if (octstr_str_compare(cached, expected) != 0 ||
+               octstr_str_compare(packed, expected) != 0)
+        panic(0, "%s/%s is `%s'/`%s', not `%s'", group, key,
+              octstr_get_cstr(cached), octstr_get_cstr(packed), expected);
+    octstr_destroy(cached);
+    octstr_destroy(packed);
+}
+
+int main(void)
+{
+    Msg *msg, *copy;
+    Dict *tlv, *values;
+
+    gwlib_init();
+    log_set_output_level(GW_INFO);
+
+    msg = msg_create(sms);
+    check_value(msg, "smpp", "foo", NULL);
+    /* reading leaves the message alone */
+    if (meta_data_msg_get_values(msg, "smpp") != NULL ||
+        msg->sms.meta_data != NULL || msg->meta_cache != NULL)
+        panic(0, "get changed a message without meta-data");
+
+    /* setters write back to the packed form */
+    meta_data_msg_set_value(msg, "smpp", octstr_imm("foo"), octstr_imm("1"), 1);
+    meta_data_msg_set_value(msg, "smpp", octstr_imm("foo"), octstr_imm("2"), 0);
+    meta_data_msg_set_value(msg, "dlr", octstr_imm("errorcode"), octstr_imm("a b?c"), 1);
+    check_value(msg, "smpp", "foo", "1");
+    check_value(msg, "SMPP", "foo", "1");
+    check_value(msg, "dlr", "errorcode", "a b?c");
+
+    tlv = dict_create(10, octstr_destroy_item);
+    dict_put(tlv, octstr_imm("bar"), octstr_create("3"));
+    dict_put(tlv, octstr_imm("foo"), octstr_create("4"));
+    meta_data_msg_set_value(msg, "smpp", octstr_imm("baz"), octstr_imm("0"), 1);
+    meta_data_msg_set_values(msg, tlv, "smpp", 0);
+    check_value(msg, "smpp", "foo", "4");
+    check_value(msg, "smpp", "bar", "3");
+    check_value(msg, "smpp", "baz", "0");
+    /* the caller's dictionary is left alone */
+    if (dict_key_count(tlv) != 2)
+        panic(0, "set_values changed the given dictionary");
+    meta_data_msg_set_values(msg, tlv, "smpp", 1);
+    check_value(msg, "smpp", "baz", NULL);
+    dict_destroy(tlv);
+
+    values = meta_data_msg_get_values(msg, "smpp");
+    if (values == NULL || dict_key_count(values) != 2 ||
+        octstr_str_compare(dict_get(values, octstr_imm("bar")), "3") != 0)
+        panic(0, "get_values returned wrong values");
+    dict_destroy(values);
+
+    /* the field changed behind the cache's back */
+    meta_data_set_value(msg->sms.meta_data, "smpp", octstr_imm("foo"), octstr_imm("5"), 1);
+    check_value(msg, "smpp", "foo", "5");
+    octstr_destroy(msg->sms.meta_data);
+    msg->sms.meta_data = octstr_create("?smpp?baz=6&");
+    check_value(msg, "smpp", "foo", NULL);
+    check_value(msg, "smpp", "baz", "6");
+    check_value(msg, "dlr", "errorcode", NULL);
+
+    /*
+     * A message from smsbox had no setter called. One get_values call
+     * unpacks it once and gives all the values msg_to_pdu() reads.
+     */
+    copy = msg_create(sms);
+    copy->sms.meta_data = octstr_create("?smpp?source_addr_ton=5&"
+                                        "dest_addr_npi=1&data_coding=8&");
+    values = meta_data_msg_get_values(copy, "smpp");
+    if (values == NULL || dict_key_count(values) != 3 ||
+        octstr_str_compare(dict_get(values, octstr_imm("source_addr_ton")), "5") != 0 ||
+        octstr_str_compare(dict_get(values, octstr_imm("dest_addr_npi")), "1") != 0 ||
+        octstr_str_compare(dict_get(values, octstr_imm("data_coding")), "8") != 0)
+        panic(0, "get_values did not return the whole group");
+    if (copy->meta_cache != NULL)
+        panic(0, "get_values changed a message without a setter");
+    dict_destroy(values);
+    msg_destroy(copy);
+
+    /* a copy has its own cache */
+    copy = msg_duplicate(msg);
+    meta_data_msg_set_value(copy, "smpp", octstr_imm("baz"), octstr_imm("7"), 1);
+    check_value(copy, "smpp", "baz", "7");
+    check_value(msg, "smpp", "baz", "6");
+    msg_destroy(copy);
+
+    octstr_destroy(msg->sms.meta_data);
+    msg->sms.meta_data = NULL;
+    check_value(msg, "smpp", "baz", NULL);
+    if (msg->sms.meta_data != NULL)
+        panic(0, "get replaced the missing meta-data");
+    msg_destroy(msg);
+
+    gwlib_shutdown();
+    return 0;
+}
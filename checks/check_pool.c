@@ -0,0 +1,173 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_pool.c - Check that the worker pool and the thread table work
+ *
+ * This is a test program for checking gw_pool_t objects. Lots of small
+ * tasks are queued from outside and from within the pool, and tasks
+ * wait for the results of other tasks. Then more threads than the
+ * initial size of the thread table are started at the same time.
+ */
+
+#ifndef WORKERS
+#define WORKERS 4
+#endif
+
+#ifndef TASKS
+#define TASKS (20000)
+#endif
+
+#ifndef SLEEPERS
+#define SLEEPERS 1500
+#endif
+
+#include "gwlib/gwlib.h"
+
+static gw_pool_t *pool;
+static Counter *done;
+
+
+static void count(void *arg) {
+	counter_increase(done);
+}
+
+
+static void *square(void *arg) {
+	long n = (long) arg;
+
+	return (void *) (n * n);
+}
+
+
+/* Sum up squares of 1..n by tasks waiting for subtasks. */
+static void *sum_squares(void *arg) {
+	long n = (long) arg;
+	gw_future_t *rest;
+	long sum;
+
+	if (n == 0)
+		return (void *) 0;
+	rest = gw_pool_submit(pool, sum_squares, (void *) (n - 1));
+	sum = (long) gw_future_wait(gw_pool_submit(pool, square, arg));
+	return (void *) (sum + (long) gw_future_wait(rest));
+}
+
+
+static void spread(void *arg) {
+	long i;
+
+	for (i = 0; i < (long) arg; ++i)
+		gw_pool_execute(pool, count, NULL);
+}
+
+
+static void sleeper(void *arg) {
+	counter_increase(done);
+	gwthread_sleep(-1);
+}
+
+
+int main(void) {
+	gw_future_t *futures[100];
+	long threads[SLEEPERS];
+	long i, n;
+
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+
+	pool = gw_pool_create(WORKERS);
+	done = counter_create();
+
+	for (i = 0; i < TASKS; ++i)
+		gw_pool_execute(pool, count, NULL);
+	for (i = 0; i < 10; ++i)
+		gw_pool_execute(pool, spread, (void *) (TASKS / 10));
+
+	for (i = 0; i < 100; ++i)
+		futures[i] = gw_pool_submit(pool, square, (void *) i);
+	for (i = 0; i < 100; ++i) {
+		n = (long) gw_future_wait(futures[i]);
+		if (n != i * i)
+			panic(0, "square of %ld is %ld", i, n);
+	}
+
+	n = (long) gw_future_wait(gw_pool_submit(pool, sum_squares,
+	                                         (void *) 100));
+	if (n != 100 * 101 * 201 / 6)
+		panic(0, "sum of squares is %ld", n);
+
+	gw_pool_destroy(pool);
+	if (counter_value(done) != 2 * TASKS)
+		panic(0, "ran %lu tasks instead of %d", counter_value(done),
+		      2 * TASKS);
+
+	/* the thread table grows beyond its initial size */
+	counter_set(done, 0);
+	for (i = 0; i < SLEEPERS; ++i)
+		if ((threads[i] = gwthread_create(sleeper, NULL)) == -1)
+			panic(0, "could not start thread %ld", i);
+	while (counter_value(done) < SLEEPERS)
+		gwthread_sleep(0.1);
+	for (i = 0; i < SLEEPERS; ++i)
+		gwthread_wakeup(threads[i]);
+	for (i = 0; i < SLEEPERS; ++i)
+		gwthread_join(threads[i]);
+
+	counter_destroy(done);
+	gwlib_shutdown();
+	return 0;
+}
@@ -0,0 +1,193 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * check_timer.c - Check that Timer objects work
+ *
+ * This is a test program for checking Timer objects. Lots of timers
+ * are started with intervals of up to a few seconds, some of them are
+ * stopped or started again, and every timer still running has to elapse
+ * exactly once, neither early nor much too late.
+ */
+
+#ifndef TIMERS
+#define TIMERS (20000)
+#endif
+
+#ifndef MAX_INTERVAL
+#define MAX_INTERVAL (3000)
+#endif
+
+/* milliseconds a timer may elapse late on a busy machine */
+#ifndef MAX_LATE
+#define MAX_LATE (500)
+#endif
+
+#include <sys/time.h>
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-timer.h"
+
+struct item {
+	Timer *timer;
+	long long due;
+	long elapsed;
+	int stopped;
+};
+
+static Counter *elapsed;
+
+
+static long long now_msec(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+static void elapse(void *data) {
+	struct item *item = data;
+	long long now;
+
+	/* both clocks count whole milliseconds */
+	now = now_msec();
+	if (now < item->due - 1)
+		panic(0, "timer elapsed %lld ms early", item->due - now);
+	if (now > item->due + MAX_LATE)
+		panic(0, "timer elapsed %lld ms late", now - item->due);
+	item->elapsed++;
+	counter_increase(elapsed);
+}
+
+
+static void start(struct item *item, long msec) {
+	item->due = now_msec() + msec;
+	gw_timer_start_ms(item->timer, msec, item);
+}
+
+
+int main(void) {
+	Timerset *set;
+	struct item *items;
+	List *output;
+	long i, running;
+	int seconds;
+
+	gwlib_init();
+	log_set_output_level(GW_INFO);
+
+	elapsed = counter_create();
+	set = gw_timerset_create();
+	items = gw_malloc(TIMERS * sizeof(*items));
+
+	for (i = 0; i < TIMERS; ++i) {
+		items[i].timer = gw_timer_create(set, NULL, elapse);
+		items[i].elapsed = 0;
+		items[i].stopped = 0;
+		start(&items[i], gw_rand() % MAX_INTERVAL);
+	}
+
+	/* stop every third, start every fifth again */
+	running = TIMERS;
+	for (i = 0; i < TIMERS; i += 3) {
+		gw_timer_stop(items[i].timer);
+		if (items[i].elapsed == 0) {
+			items[i].stopped = 1;
+			running--;
+		}
+	}
+	for (i = 0; i < TIMERS; i += 5) {
+		if (items[i].elapsed == 0) {
+			if (items[i].stopped)
+				running++;
+			items[i].stopped = 0;
+			start(&items[i], gw_rand() % MAX_INTERVAL);
+		}
+	}
+	running -= counter_value(elapsed);
+
+	for (seconds = 0; gw_timerset_count(set) > 0 && seconds < 30; seconds++)
+		gwthread_sleep(1.0);
+	if (gw_timerset_count(set) > 0)
+		panic(0, "%ld timers did not elapse", gw_timerset_count(set));
+
+	for (i = 0; i < TIMERS; ++i) {
+		if (items[i].elapsed > 1)
+			panic(0, "timer %ld elapsed %ld times", i, items[i].elapsed);
+		if (items[i].elapsed == 0 && !items[i].stopped)
+			panic(0, "timer %ld did not elapse", i);
+		if (items[i].elapsed == 1 && items[i].stopped)
+			panic(0, "stopped timer %ld elapsed", i);
+	}
+
+	/* the seconds API works through output lists */
+	output = gwlist_create();
+	items[0].timer = gw_timer_create(set, output, NULL);
+	gw_timer_start(items[0].timer, 1, &items[1]);
+	if (gwlist_consume(output) != &items[1])
+		panic(0, "wrong event on the output list");
+	gw_timer_destroy(items[0].timer);
+	gwlist_destroy(output, NULL);
+
+	for (i = 1; i < TIMERS; ++i)
+		gw_timer_destroy(items[i].timer);
+	gw_free(items);
+	gw_timerset_destroy(set);
+	counter_destroy(elapsed);
+
+	gwlib_shutdown();
+	return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# Use `test/wml_tester' to check that gw/wml_compiler.c still encodes the
+# WML decks in test/ into exactly the binaries stored next to them.
+
+set -e
+
+for deck in test/hello test/testcase test/stringtable
+do
+	if ! test/wml_tester -b $deck.wml | cmp - $deck.wmlc \
+		> check_wml_corpus.log 2>&1
+	then
+		echo check_wml_corpus failed for $deck.wml 1>&2
+		echo See check_wml_corpus.log for info 1>&2
+		exit 1
+	fi
+done
+
+rm -f check_wml_corpus.log
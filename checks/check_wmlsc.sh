@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# Use `wmlscript/wmlsc' to compile test/testcase.wmls over and over again
+# with the same compiler, it fails if any compilation gives different
+# byte-code than the first one.
+
+set -e
+
+wmlscript/wmlsc -b 50 test/testcase.wmls > check_wmlsc.log 2>&1
+ret=$?
+
+if [ "$ret" != 0 ]
+then
+	echo check_wmlsc failed 1>&2
+	echo See check_wmlsc.log for info 1>&2
+	exit 1
+fi
+
+rm -f check_wmlsc.log
@@ -79,9 +79,13 @@
 #include "msg.h"
 #include "bearerbox.h"
 #include "bb_smscconn_cb.h"
+#include "bb_store.h"
 
 #define SMSBOX_MAX_PENDING 100
 
+/* seconds between two credit announcements to the smsboxes */
+#define SMSBOX_CREDIT_INTERVAL 1.0
+
 /* passed from bearerbox core */
 
 extern volatile sig_atomic_t bb_status;
@@ -121,6 +125,12 @@ static int wapbox_port_ssl;
 /* max pending messages on the line to smsbox */
 static long smsbox_max_pending;
 
+/* messages the smsboxes may have queued with us, -1 if not announced */
+static long smsbox_credit_window;
+
+/* smsbox_credit_thread thread-id */
+static long smsbox_credit_id = -1;
+
 static Octstr *box_allow_ip;
 static Octstr *box_deny_ip;
 
@@ -147,11 +157,14 @@ typedef struct _boxc {
     Octstr        *boxc_id; /* identifies the connected smsbox instance */
     /* used to mark connection usable or still waiting for ident. msg */
     volatile int routable;
+    Histogram *accept_latency;  /* sms read from box until acked to it */
+    Histogram *deliver_latency; /* sms written to box until it acked */
 } Boxc;
 
 
 /* forward declaration */
 static void sms_to_smsboxes(void *arg);
+static void smsbox_credit_thread(void *arg);
 static int send_msg(Boxc *boxconn, Msg *pmsg);
 static void boxc_sent_push(Boxc*, Msg*);
 static void boxc_sent_pop(Boxc*, Msg*, Msg**);
@@ -214,6 +227,10 @@ static void deliver_sms_to_queue(Msg *msg, Boxc *conn)
 {
     Msg *mack;
     int rc;
+    long long received;
+
+    received = histogram_now();
+    msg->queued_usec = received;
 
     /*
      * save modifies ID and time, so if the smsbox uses it, save
@@ -295,6 +312,8 @@ static void deliver_sms_to_queue(Msg *msg, Boxc *conn)
     /* put ack into incoming queue of conn */
     send_msg(conn, mack);
     msg_destroy(mack);
+
+    histogram_record(conn->accept_latency, histogram_now() - received);
 }
 
 
@@ -484,13 +503,16 @@ static void boxc_sent_push(Boxc *conn, Msg *m)
 {
     Octstr *os;
     char id[UUID_STR_LEN + 1];
+    Msg *copy;
 
     if (conn->is_wap || !conn->sent || !m || msg_type(m) != sms)
         return;
 
     uuid_unparse(m->sms.id, id);
     os = octstr_create(id);
-    dict_put(conn->sent, os, msg_duplicate(m));
+    copy = msg_duplicate(m);
+    copy->submitted_usec = histogram_now();
+    dict_put(conn->sent, os, copy);
     semaphore_down(conn->pending);
     octstr_destroy(os);
 }
@@ -521,6 +543,8 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
         msg_dump(m, 0);
         return;
     }
+    histogram_record(conn->deliver_latency,
+                     histogram_now() - msg->submitted_usec);
     semaphore_up(conn->pending);
     if (orig == NULL)
         msg_destroy(msg);
@@ -598,6 +622,8 @@ static Boxc *boxc_create(int fd, Octstr *ip, int ssl)
     boxc->connect_time = time(NULL);
     boxc->boxc_id = NULL;
     boxc->routable = 0;
+    boxc->accept_latency = histogram_create();
+    boxc->deliver_latency = histogram_create();
     return boxc;
 }
 
@@ -612,6 +638,8 @@ static void boxc_destroy(Boxc *boxc)
 	    conn_destroy(boxc->conn);
     octstr_destroy(boxc->client_ip);
     octstr_destroy(boxc->boxc_id);
+    histogram_destroy(boxc->accept_latency);
+    histogram_destroy(boxc->deliver_latency);
     gw_free(boxc);
 }
 
@@ -1049,6 +1077,12 @@ static void smsboxc_run(void *arg)
     /* close listen socket */
     close(fd);
 
+    if (smsbox_credit_id != -1) {
+        gwthread_wakeup(smsbox_credit_id);
+        gwthread_join(smsbox_credit_id);
+        smsbox_credit_id = -1;
+    }
+
     gwthread_wakeup(sms_dequeue_thread);
     gwthread_join(sms_dequeue_thread);
 
@@ -1251,6 +1285,11 @@ int smsbox_start(Cfg *cfg)
         info(0, "BOXC: 'smsbox-max-pending' not set, using default (%ld).", smsbox_max_pending);
     }
 
+    if (cfg_get_integer(&smsbox_credit_window, grp, octstr_imm("smsbox-credit-window")) == -1)
+        smsbox_credit_window = -1;
+    else if (smsbox_credit_window < 0)
+        panic(0, "BOXC: 'smsbox-credit-window' may not be negative.");
+
     box_allow_ip = cfg_get(grp, octstr_imm("box-allow-ip"));
     if (box_allow_ip == NULL)
         box_allow_ip = octstr_create("");
@@ -1282,6 +1321,10 @@ int smsbox_start(Cfg *cfg)
     if ((sms_dequeue_thread = gwthread_create(sms_to_smsboxes, NULL)) == -1)
  	    panic(0, "Failed to start a new thread for smsbox routing");
 
+    if (smsbox_credit_window >= 0 &&
+        (smsbox_credit_id = gwthread_create(smsbox_credit_thread, NULL)) == -1)
+ 	    panic(0, "Failed to start a new thread for smsbox credits");
+
     if (gwthread_create(smsboxc_run, NULL) == -1)
 	    panic(0, "Failed to start a new thread for smsbox connections");
 
@@ -1469,6 +1512,59 @@ Octstr *boxc_status(int status_type)
 }
 
 
+void boxc_metrics(Octstr *os)
+{
+    Octstr *queue, *accept, *deliver, *labels, *id;
+    Boxc *bi;
+    int i;
+
+    queue = octstr_create(
+        "# HELP kannel_smsbox_queue Messages waiting for or sent to the "
+        "smsbox and not yet acked.\n"
+        "# TYPE kannel_smsbox_queue gauge\n");
+    accept = octstr_create(
+        "# HELP kannel_smsbox_accept_seconds Time from reading a message from "
+        "the smsbox until it was acked to it.\n"
+        "# TYPE kannel_smsbox_accept_seconds summary\n");
+    deliver = octstr_create(
+        "# HELP kannel_smsbox_deliver_seconds Time from writing a message to "
+        "the smsbox until it acked it.\n"
+        "# TYPE kannel_smsbox_deliver_seconds summary\n");
+
+    if (smsbox_list) {
+        gw_rwlock_rdlock(smsbox_list_rwlock);
+        for (i = 0; i < gwlist_len(smsbox_list); i++) {
+            bi = gwlist_get(smsbox_list, i);
+            if (bi->alive == 0)
+                continue;
+
+            labels = octstr_create("");
+            id = octstr_format("%ld", bi->id);
+            bb_metrics_label(labels, "box", id);
+            bb_metrics_label(labels, "smsbox_id", bi->boxc_id);
+            bb_metrics_label(labels, "ip", bi->client_ip);
+            octstr_destroy(id);
+
+            octstr_format_append(queue, "kannel_smsbox_queue{%S} %ld\n", labels,
+                gwlist_len(bi->incoming) + dict_key_count(bi->sent));
+            histogram_append_summary(accept, "kannel_smsbox_accept_seconds",
+                labels, bi->accept_latency);
+            histogram_append_summary(deliver, "kannel_smsbox_deliver_seconds",
+                labels, bi->deliver_latency);
+            octstr_destroy(labels);
+        }
+        gw_rwlock_unlock(smsbox_list_rwlock);
+    }
+
+    octstr_append(os, queue);
+    octstr_append(os, accept);
+    octstr_append(os, deliver);
+    octstr_destroy(queue);
+    octstr_destroy(accept);
+    octstr_destroy(deliver);
+}
+
+
 int boxc_incoming_wdp_queue(void)
 {
     int i, q = 0;
@@ -1670,6 +1766,58 @@ int route_incoming_to_boxc(Msg *msg)
 }
 
 
+/*
+ * Announce to every smsbox how many messages it may pass us until the
+ * next announcement. The credit is what is left of the window after the
+ * messages waiting in the outgoing queue or in the store, split evenly
+ * among the connected smsboxes. The remainder goes one message each to
+ * some of them, others every round, so a window smaller than the number
+ * of smsboxes still lets them all send. It is sent as heartbeat
+ * message, whose load value carries the credit.
+ */
+static void smsbox_credit_thread(void *arg)
+{
+    Boxc *boxc;
+    Msg *msg;
+    long i, j, boxes, backlog, credit;
+    long turn = 0;
+
+    while (bb_status != BB_SHUTDOWN && bb_status != BB_DEAD &&
+           gwlist_producer_count(smsbox_list) > 0) {
+
+        backlog = gwlist_len(outgoing_sms);
+        if (store_messages() > backlog)
+            backlog = store_messages();
+
+        if (bb_status == BB_RUNNING && backlog < smsbox_credit_window)
+            credit = smsbox_credit_window - backlog;
+        else
+            credit = 0;
+
+        gw_rwlock_rdlock(smsbox_list_rwlock);
+        for (boxes = 0, i = 0; i < gwlist_len(smsbox_list); i++) {
+            boxc = gwlist_get(smsbox_list, i);
+            if (boxc->alive && boxc->routable)
+                boxes++;
+        }
+        for (j = 0, i = 0; boxes > 0 && i < gwlist_len(smsbox_list); i++) {
+            boxc = gwlist_get(smsbox_list, i);
+            if (!boxc->alive || !boxc->routable)
+                continue;
+            msg = msg_create(heartbeat);
+            msg->heartbeat.load = credit / boxes +
+                                  ((j++ + turn) % boxes < credit % boxes);
+            send_msg(boxc, msg);
+            msg_destroy(msg);
+        }
+        gw_rwlock_unlock(smsbox_list_rwlock);
+        turn++;
+
+        gwthread_sleep(SMSBOX_CREDIT_INTERVAL);
+    }
+}
+
+
 static void sms_to_smsboxes(void *arg)
 {
     Msg *newmsg, *startmsg, *msg;
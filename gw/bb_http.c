@@ -144,6 +144,13 @@ static Octstr *httpd_status(List *cgivars, int status_type)
     return bb_print_status(status_type);
 }
 
+static Octstr *httpd_metrics(List *cgivars, int status_type)
+{
+    Octstr *reply;
+    if ((reply = httpd_check_authorization(cgivars, 1))!= NULL) return reply;
+    return bb_print_metrics();
+}
+
 static Octstr *httpd_store_status(List *cgivars, int status_type)
 {
     Octstr *reply;
@@ -373,6 +380,7 @@ static struct httpd_command {
     Octstr * (*function)(List *cgivars, int status_type);
 } httpd_commands[] = {
     { "status", httpd_status },
+    { "metrics", httpd_metrics },
     { "store-status", httpd_store_status },
     { "log-level", httpd_loglevel },
     { "shutdown", httpd_shutdown },
@@ -447,6 +455,10 @@ static void httpd_serve(HTTPClient *client, Octstr *ourl, List *headers,
         octstr_destroy(tmp);
     }
 
+    /* metrics come in the Prometheus text format only */
+    if (octstr_str_compare(url, "metrics") == 0)
+        status_type = BBSTATUS_TEXT;
+
     for (i=0; httpd_commands[i].command != NULL; i++) {
         if (octstr_str_compare(url, httpd_commands[i].command) == 0) {
             reply = httpd_commands[i].function(cgivars, status_type);
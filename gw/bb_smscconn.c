@@ -81,6 +81,7 @@
 
 
 #include "gwlib/gwlib.h"
+#include "gwlib/gw-timer.h"
 #include "msg.h"
 #include "sms.h"
 #include "bearerbox.h"
@@ -130,6 +131,7 @@ static RWLock smsc_list_lock;
 static Cfg *cfg_reloaded;
 static List *smsc_groups;
 static Octstr *unified_prefix;
+static gw_pool_t *smsc_pool;
 
 static RWLock white_black_list_lock;
 static Octstr *black_list_sender_url;
@@ -162,6 +164,8 @@ Counter *split_msg_counter;
 static volatile sig_atomic_t handle_concatenated_mo;
 /* How long to wait for message parts */
 static long concatenated_mo_timeout;
+/* Flag for combining message parts loaded from the store */
+static int concat_persistent;
 /* Flag for return value of check_concat */
 enum {concat_error = -1, concat_complete = 0, concat_pending = 1, concat_none};
 
@@ -196,6 +200,13 @@ void bb_smscconn_connected(SMSCConn *conn)
 }
 
 
+gw_pool_t *bb_smscconn_pool(void)
+{
+    gw_assert(smsc_pool != NULL);
+    return smsc_pool;
+}
+
+
 void bb_smscconn_killed(void)
 {
     /* NOTE: after status has been set to SMSCCONN_DEAD, bearerbox
@@ -284,6 +295,10 @@ void bb_smscconn_sent(SMSCConn *conn, Msg *sms, Octstr *reply)
         return;
     }
 
+    if (conn != NULL && sms->submitted_usec > 0)
+        histogram_record(conn->submit_latency,
+                         histogram_now() - sms->submitted_usec);
+
     /* write ACK to store file */
     store_save_ack(sms, ack_success);
 
@@ -332,6 +347,11 @@ void bb_smscconn_send_failed(SMSCConn *conn, Msg *sms, int reason, Octstr *reply
         octstr_destroy(reply);
         return;
     }
+
+    if (conn != NULL && sms->submitted_usec > 0 &&
+            reason != SMSCCONN_FAILED_SHUTDOWN)
+        histogram_record(conn->submit_latency,
+                         histogram_now() - sms->submitted_usec);
     
     switch (reason) {
     case SMSCCONN_FAILED_TEMPORARILY:
@@ -497,6 +517,11 @@ long bb_smscconn_receive(SMSCConn *conn, Msg *sms)
     uf = unified_prefix ? octstr_get_cstr(unified_prefix) : NULL;
     normalize_number(uf, &(sms->sms.sender));
 
+    /* a final DLR found by dlr_find() carries its message's submit time */
+    if (conn != NULL && sms->sms.sms_type == report_mo && sms->submitted_usec > 0)
+        histogram_record(conn->dlr_latency,
+                         histogram_now() - sms->submitted_usec);
+
     /*
      * We don't perform white/black-listing for DLRs.
      * Fix sms type if not set already.
@@ -652,14 +677,12 @@ static void sms_router(void *arg)
 {
     Msg *msg, *startmsg, *newmsg;
     long ret;
-    time_t concat_mo_check;
 
     gwlist_add_producer(flow_threads);
     gwthread_wakeup(MAIN_THREAD_ID);
 
     startmsg = newmsg = NULL;
     ret = SMSCCONN_SUCCESS;
-    concat_mo_check = time(NULL);
 
     while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
@@ -671,15 +694,10 @@ static void sms_router(void *arg)
                 gwthread_sleep(sleep_time);
                 debug("bb.sms", 0, "sms_router: gwlist_len = %ld", gwlist_len(outgoing_sms));
             }
-            startmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
+            startmsg = msg = gwlist_timed_consume(outgoing_sms, sms_resend_frequency);
             newmsg = NULL;
         } else {
-            newmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
-        }
-
-        if (difftime(time(NULL), concat_mo_check) > concatenated_mo_timeout) {
-            concat_mo_check = time(NULL);
-            concat_handling_clear_old_parts(0);
+            newmsg = msg = gwlist_timed_consume(outgoing_sms, sms_resend_frequency);
         }
 
         /* shutdown or timeout */
@@ -817,6 +835,9 @@ int smsc2_start(Cfg *cfg)
 
     /* create split sms counter */
     split_msg_counter = counter_create();
+
+    /* workers shared by the connections, one per CPU */
+    smsc_pool = gw_pool_create(0);
     
     /* create smsc list and rwlock for it */
     smsc_list = gwlist_create();
@@ -911,6 +932,10 @@ int smsc2_start(Cfg *cfg)
     if (cfg_get_integer(&concatenated_mo_timeout, grp, octstr_imm("sms-combine-concatenated-mo-timeout")) == -1)
         concatenated_mo_timeout = 1800;
 
+    if (cfg_get_bool(&concat_persistent, grp,
+            octstr_imm("sms-combine-concatenated-mo-persistent")) == -1)
+        concat_persistent = 0;
+
     if (handle_concatenated_mo)
         concat_handling_init();
 
@@ -1341,6 +1366,8 @@ void smsc2_cleanup(void)
         gw_regex_destroy(black_list_receiver_regex);
     /* destroy msg split counter */
     counter_destroy(split_msg_counter);
+    gw_pool_destroy(smsc_pool);
+    smsc_pool = NULL;
     gw_rwlock_destroy(&smsc_list_lock);
     gw_rwlock_destroy(&white_black_list_lock);
 
@@ -1519,6 +1546,86 @@ Octstr *smsc2_status(int status_type)
 }
 
 
+void smsc2_metrics(Octstr *os)
+{
+    enum { M_UP, M_RECEIVED, M_SENT, M_FAILED, M_QUEUE, M_QUEUE_WAIT,
+           M_SUBMIT, M_DLR, M_COUNT };
+    static const char *heads[M_COUNT] = {
+        "# HELP kannel_smsc_up Whether the SMSC connection is online.\n"
+        "# TYPE kannel_smsc_up gauge\n",
+        "# HELP kannel_smsc_received_total Messages received from the SMSC.\n"
+        "# TYPE kannel_smsc_received_total counter\n",
+        "# HELP kannel_smsc_sent_total Messages sent to the SMSC.\n"
+        "# TYPE kannel_smsc_sent_total counter\n",
+        "# HELP kannel_smsc_failed_total Messages the SMSC failed to send.\n"
+        "# TYPE kannel_smsc_failed_total counter\n",
+        "# HELP kannel_smsc_queue Messages queued within the SMSC connection.\n"
+        "# TYPE kannel_smsc_queue gauge\n",
+        "# HELP kannel_smsc_queue_wait_seconds Time from routing a message "
+        "until it was handed to the SMSC connection.\n"
+        "# TYPE kannel_smsc_queue_wait_seconds summary\n",
+        "# HELP kannel_smsc_submit_seconds Time from handing a message to the "
+        "SMSC connection until the SMSC answered.\n"
+        "# TYPE kannel_smsc_submit_seconds summary\n",
+        "# HELP kannel_smsc_dlr_seconds Time from handing a message to the "
+        "SMSC connection until its final DLR arrived.\n"
+        "# TYPE kannel_smsc_dlr_seconds summary\n"
+    };
+    Octstr *family[M_COUNT], *labels;
+    SMSCConn *conn;
+    StatusInfo info;
+    long i;
+    int j;
+
+    if (!smsc_running)
+        return;
+
+    for (j = 0; j < M_COUNT; j++)
+        family[j] = octstr_create(heads[j]);
+
+    gw_rwlock_rdlock(&smsc_list_lock);
+    for (i = 0; i < gwlist_len(smsc_list); i++) {
+        conn = gwlist_get(smsc_list, i);
+        if (smscconn_info(conn, &info) == -1)
+            continue;
+
+        labels = octstr_create("");
+        bb_metrics_label(labels, "smsc", smscconn_id(conn));
+        bb_metrics_label(labels, "admin_id", smscconn_admin_id(conn));
+        bb_metrics_label(labels, "name", smscconn_name(conn));
+
+        octstr_format_append(family[M_UP], "kannel_smsc_up{%S} %d\n", labels,
+            (info.status == SMSCCONN_ACTIVE || info.status == SMSCCONN_ACTIVE_RECV));
+        octstr_format_append(family[M_RECEIVED],
+            "kannel_smsc_received_total{%S,type=\"sms\"} %lu\n"
+            "kannel_smsc_received_total{%S,type=\"dlr\"} %lu\n",
+            labels, info.received, labels, info.received_dlr);
+        octstr_format_append(family[M_SENT],
+            "kannel_smsc_sent_total{%S,type=\"sms\"} %lu\n"
+            "kannel_smsc_sent_total{%S,type=\"dlr\"} %lu\n",
+            labels, info.sent, labels, info.sent_dlr);
+        octstr_format_append(family[M_FAILED], "kannel_smsc_failed_total{%S} %lu\n",
+            labels, info.failed);
+        octstr_format_append(family[M_QUEUE], "kannel_smsc_queue{%S} %ld\n",
+            labels, (info.queued > 0 ? info.queued : 0));
+        histogram_append_summary(family[M_QUEUE_WAIT], "kannel_smsc_queue_wait_seconds",
+            labels, conn->queue_latency);
+        histogram_append_summary(family[M_SUBMIT], "kannel_smsc_submit_seconds",
+            labels, conn->submit_latency);
+        histogram_append_summary(family[M_DLR], "kannel_smsc_dlr_seconds",
+            labels, conn->dlr_latency);
+
+        octstr_destroy(labels);
+    }
+    gw_rwlock_unlock(&smsc_list_lock);
+
+    for (j = 0; j < M_COUNT; j++) {
+        octstr_append(os, family[j]);
+        octstr_destroy(family[j]);
+    }
+}
+
+
 int smsc2_graceful_restart(void)
 {
     CfgGroup *grp;
@@ -1722,6 +1829,10 @@ long smsc2_rout(Msg *msg, int resend)
         return SMSCCONN_FAILED_DISCARDED;
     }
 
+    /* queue wait is taken from the first routing attempt */
+    if (msg->queued_usec == 0)
+        msg->queued_usec = histogram_now();
+
     /* check if validity period has expired */
     if (msg->sms.validity != SMS_PARAM_UNDEFINED && time(NULL) > msg->sms.validity) {
         bb_smscconn_send_failed(NULL, msg_duplicate(msg), SMSCCONN_FAILED_EXPIRED, octstr_create("validity expired"));
@@ -1978,6 +2089,15 @@ static long route_incoming_to_smsc(SMSCConn *conn, Msg *msg)
  * incoming concatenated messages handling
  */
 
+/*
+ * Pending messages live in a table split into shards with a lock each,
+ * keyed by the binary (smsc, sender, receiver, refnum, total parts, UDH)
+ * tuple. Each message has a timer restarted with every part; when it
+ * elapses the key is queued for the expiry thread, so there is no need
+ * to scan the table for old parts.
+ */
+#define CONCAT_SHARDS 16
+
 typedef struct ConcatMsg {
     int refnum;
     int total_parts;
@@ -1986,13 +2106,21 @@ typedef struct ConcatMsg {
     time_t trecv;
     Octstr *key; /* in dict. */
     int ack;     /* set to the type of ack to send when deleting. */
-    /* array of parts */
+    Timer *timer; /* elapses when waiting for parts timed out */
+    /* array of parts, allocated along with the struct */
     Msg **parts;
     Octstr *smsc_id; /* name of smsc conn where we received this msgs */
 } ConcatMsg;
 
-static Dict *incoming_concat_msgs;
-static Mutex *concat_lock;
+typedef struct ConcatShard {
+    Mutex *lock;
+    Dict *msgs;
+} ConcatShard;
+
+static ConcatShard concat_shards[CONCAT_SHARDS];
+static Timerset *concat_timers;
+static List *concat_expired;
+static long concat_expire_thread_id = -1;
 
 static void destroy_concatMsg(void *x)
 {
@@ -2000,26 +2128,202 @@ static void destroy_concatMsg(void *x)
     ConcatMsg *msg = x;
 
     gw_assert(msg);
+    gw_timer_destroy(msg->timer);
     for (i = 0; i < msg->total_parts; i++) {
         if (msg->parts[i]) {
             store_save_ack(msg->parts[i], msg->ack);
             msg_destroy(msg->parts[i]);
         }
     }
-    gw_free(msg->parts);
     octstr_destroy(msg->key);
     octstr_destroy(msg->udh);
     octstr_destroy(msg->smsc_id);
     gw_free(msg);
 }
 
+static ConcatShard *concat_shard(Octstr *key)
+{
+    return &concat_shards[octstr_hash_key(key) % CONCAT_SHARDS];
+}
+
+static void concat_key_append(Octstr *key, Octstr *os)
+{
+    long len = octstr_len(os);
+
+    octstr_append_char(key, (len >> 8) & 0xff);
+    octstr_append_char(key, len & 0xff);
+    if (os != NULL)
+        octstr_append(key, os);
+}
+
+static Octstr *concat_key(Octstr *smscid, Msg *msg, int refnum, int totalparts,
+                          Octstr *udh)
+{
+    Octstr *key;
+
+    key = octstr_create("");
+    concat_key_append(key, smscid);
+    concat_key_append(key, msg->sms.sender);
+    concat_key_append(key, msg->sms.receiver);
+    octstr_append_char(key, (refnum >> 8) & 0xff);
+    octstr_append_char(key, refnum & 0xff);
+    octstr_append_char(key, totalparts);
+    octstr_append(key, udh);
+
+    return key;
+}
+
+/* Called by the timer thread, with the timer set locked. */
+static void concat_timer_elapsed(void *data)
+{
+    ConcatMsg *cmsg = data;
+
+    gwlist_produce(concat_expired, octstr_duplicate(cmsg->key));
+}
+
+static ConcatMsg *concat_msg_create(Octstr *key, Octstr *smscid, int refnum,
+                                    int totalparts, Octstr *udh)
+{
+    ConcatMsg *cmsg;
+
+    cmsg = gw_malloc(sizeof(*cmsg) + totalparts * sizeof(*cmsg->parts));
+    cmsg->refnum = refnum;
+    cmsg->total_parts = totalparts;
+    cmsg->udh = udh;
+    cmsg->num_parts = 0;
+    cmsg->key = octstr_duplicate(key);
+    cmsg->ack = ack_success;
+    cmsg->timer = gw_timer_create(concat_timers, NULL, concat_timer_elapsed);
+    cmsg->smsc_id = octstr_duplicate(smscid);
+    cmsg->parts = (Msg**) (cmsg + 1);
+    memset(cmsg->parts, 0, totalparts * sizeof(*cmsg->parts)); /* clear it. */
+
+    return cmsg;
+}
+
+/*
+ * Remove the message with this key if it waited too long for its parts
+ * (or always, if force is set) and send the parts we got as is.
+ */
+static void concat_handling_expire(Octstr *key, int force)
+{
+    ConcatShard *shard = concat_shard(key);
+    ConcatMsg *x, *x1;
+    Msg *msg;
+    SMSCConn *conn;
+    int i, destroy = 1, smsc_index;
+    double elapsed;
+
+    mutex_lock(shard->lock);
+    x = dict_get(shard->msgs, key);
+    if (x == NULL) {
+        mutex_unlock(shard->lock);
+        return;
+    }
+    elapsed = difftime(time(NULL), x->trecv);
+    if (!force && elapsed < concatenated_mo_timeout) {
+        /*
+         * A part came in after the timer went off, or the wall clock was
+         * set back. Wait for the rest of the time-out, at most a whole one.
+         */
+        gw_timer_start(x->timer, elapsed > 0 ?
+                       concatenated_mo_timeout - elapsed : concatenated_mo_timeout, x);
+        mutex_unlock(shard->lock);
+        return;
+    }
+    dict_remove(shard->msgs, x->key);
+    mutex_unlock(shard->lock);
+    gw_timer_stop(x->timer);
+
+    /* try to find SMSCConn */
+    gw_rwlock_rdlock(&smsc_list_lock);
+    /**
+     * TODO handle cases where we goes down and have to clean concat parts for rerouting
+     */
+    smsc_index = smsc2_find(x->smsc_id, 0);
+    if (smsc_index != -1) {
+        conn = gwlist_get(smsc_list, smsc_index);
+        for (i = 0; x->parts[i] == NULL; i++)
+            ;
+        warning(0, "Time-out waiting for concatenated message [ref %d] from %s to %s. "
+                "Send message parts as is.", x->refnum,
+                octstr_get_cstr(x->parts[i]->sms.sender),
+                octstr_get_cstr(x->parts[i]->sms.receiver));
+        for (i = 0; i < x->total_parts && destroy == 1; i++) {
+            if (x->parts[i] == NULL)
+                continue;
+            msg = msg_duplicate(x->parts[i]);
+            switch(bb_smscconn_receive_internal(conn, msg)) {
+            case SMSCCONN_FAILED_REJECTED:
+            case SMSCCONN_QUEUED:
+            case SMSCCONN_SUCCESS:
+                msg_destroy(x->parts[i]);
+                x->parts[i] = NULL;
+                x->num_parts--;
+                break;
+            case SMSCCONN_FAILED_TEMPORARILY:
+            case SMSCCONN_FAILED_QFULL:
+            default:
+                /* oops put it back into dict and retry on next time-out */
+                store_save(x->parts[i]);
+                destroy = 0;
+                break;
+            }
+        }
+    }
+    gw_rwlock_unlock(&smsc_list_lock);
+
+    if (destroy) {
+        destroy_concatMsg(x);
+        return;
+    }
+
+    mutex_lock(shard->lock);
+    x1 = dict_get(shard->msgs, x->key);
+    if (x1 != NULL) { /* oops we have new part */
+        for (i = 0; i < x->total_parts; i++) {
+            if (x->parts[i] == NULL)
+                continue;
+            if (x1->parts[i] == NULL) {
+                x1->parts[i] = x->parts[i];
+                x->parts[i] = NULL;
+                x1->num_parts++;
+            }
+        }
+        destroy_concatMsg(x);
+    } else {
+        dict_put(shard->msgs, x->key, x);
+        gw_timer_start(x->timer, concatenated_mo_timeout, x);
+    }
+    mutex_unlock(shard->lock);
+}
+
+static void concat_expire_thread(void *arg)
+{
+    Octstr *key;
+
+    while ((key = gwlist_consume(concat_expired)) != NULL) {
+        concat_handling_expire(key, 0);
+        octstr_destroy(key);
+    }
+}
+
 static void concat_handling_init(void)
 {
-    if (incoming_concat_msgs != NULL) /* already initialised? */
+    long i, size;
+
+    if (concat_timers != NULL) /* already initialised? */
         return;
-    incoming_concat_msgs = dict_create(max_incoming_sms_qlength > 0 ? max_incoming_sms_qlength : 1024, 
-                                       destroy_concatMsg);
-    concat_lock = mutex_create();
+    size = (max_incoming_sms_qlength > 0 ? max_incoming_sms_qlength : 1024);
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        concat_shards[i].lock = mutex_create();
+        concat_shards[i].msgs = dict_create(size / CONCAT_SHARDS + 1, destroy_concatMsg);
+    }
+    concat_timers = gw_timerset_create();
+    concat_expired = gwlist_create();
+    gwlist_add_producer(concat_expired);
+    if ((concat_expire_thread_id = gwthread_create(concat_expire_thread, NULL)) == -1)
+        panic(0, "Failed to start a new thread for concatenated message time-outs");
     debug("bb.sms",0,"MO concatenated message handling enabled");
 }
 
@@ -2034,17 +2338,30 @@ static void concat_handling_shutdown(void)
 
     /* go through the queue and send messages as is */
     concat_handling_clear_old_parts(1);
+
+    gwlist_remove_producer(concat_expired);
+    gwthread_join(concat_expire_thread_id);
+    concat_expire_thread_id = -1;
 }
 
 static void concat_handling_cleanup(void)
 {
-    if (incoming_concat_msgs == NULL)
-        return;
-    dict_destroy(incoming_concat_msgs);
-    mutex_destroy(concat_lock);
+    long i;
 
-    incoming_concat_msgs = NULL;
-    concat_lock = NULL;
+    if (concat_timers == NULL)
+        return;
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        dict_destroy(concat_shards[i].msgs);
+        mutex_destroy(concat_shards[i].lock);
+        concat_shards[i].msgs = NULL;
+        concat_shards[i].lock = NULL;
+    }
+    /* the timers are gone with their messages */
+    gw_timerset_destroy(concat_timers);
+    gwlist_destroy(concat_expired, octstr_destroy_item);
+
+    concat_timers = NULL;
+    concat_expired = NULL;
     debug("bb.sms",0,"MO concatenated message handling cleaned up");
 }
 
@@ -2052,98 +2369,22 @@ static void concat_handling_clear_old_parts(int force)
 {
     List *keys;
     Octstr *key;
+    long i;
 
     /* not initialized, go away */
-    if (incoming_concat_msgs == NULL)
+    if (concat_timers == NULL)
         return;
 
     debug("bb.sms.splits", 0, "clear_old_concat_parts called");
 
-    /* Remove any pending messages that are too old. */
-    keys = dict_keys(incoming_concat_msgs);
-    while((key = gwlist_extract_first(keys)) != NULL) {
-        ConcatMsg *x;
-        Msg *msg;
-        SMSCConn *conn;
-        int i, destroy = 1, smsc_index;
-
-        mutex_lock(concat_lock);
-        x = dict_get(incoming_concat_msgs, key);
-        octstr_destroy(key);
-        if (x == NULL || (!force && difftime(time(NULL), x->trecv) < concatenated_mo_timeout)) {
-            mutex_unlock(concat_lock);
-            continue;
-        }
-        dict_remove(incoming_concat_msgs, x->key);
-        mutex_unlock(concat_lock);
-
-        /* try to find SMSCConn */
-        gw_rwlock_rdlock(&smsc_list_lock);
-        /**
-         * TODO handle cases where we goes down and have to clean concat parts for rerouting
-         */
-        smsc_index = smsc2_find(x->smsc_id, 0);
-        if (smsc_index != -1) {
-            conn = gwlist_get(smsc_list, smsc_index);
-            warning(0, "Time-out waiting for concatenated message '%s'. Send message parts as is.",
-                    octstr_get_cstr(x->key));
-            for (i = 0; i < x->total_parts && destroy == 1; i++) {
-                if (x->parts[i] == NULL)
-                    continue;
-                msg = msg_duplicate(x->parts[i]);
-                switch(bb_smscconn_receive_internal(conn, msg)) {
-                case SMSCCONN_FAILED_REJECTED:
-                case SMSCCONN_QUEUED:
-                case SMSCCONN_SUCCESS:
-                    msg_destroy(x->parts[i]);
-                    x->parts[i] = NULL;
-                    x->num_parts--;
-                    break;
-                case SMSCCONN_FAILED_TEMPORARILY:
-                case SMSCCONN_FAILED_QFULL:
-                default:
-                    /* oops put it back into dict and retry on next run */
-                    store_save(x->parts[i]);
-                    destroy = 0;
-                    break;
-                }
-            }
-        }
-        gw_rwlock_unlock(&smsc_list_lock);
-
-        if (destroy) {
-            destroy_concatMsg(x);
-        } else {
-            ConcatMsg *x1;
-            mutex_lock(concat_lock);
-            x1 = dict_get(incoming_concat_msgs, x->key);
-            if (x1 != NULL) { /* oops we have new part */
-                int i;
-                if (x->total_parts != x1->total_parts) {
-                    /* broken handset, don't know what todo here??
-                     * for now just put old concatMsg into dict with
-                     * another key and it will be cleaned up on next run.
-                     */
-                    octstr_format_append(x->key, " %d", x->total_parts);
-                    dict_put(incoming_concat_msgs, x->key, x);
-                } else {
-                    for (i = 0; i < x->total_parts; i++) {
-                        if (x->parts[i] == NULL)
-                            continue;
-                        if (x1->parts[i] == NULL) {
-                            x1->parts[i] = x->parts[i];
-                            x->parts[i] = NULL;
-                        }
-                    }
-                    destroy_concatMsg(x);
-                }
-            } else {
-                dict_put(incoming_concat_msgs, x->key, x);
-            }
-            mutex_unlock(concat_lock);
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        keys = dict_keys(concat_shards[i].msgs);
+        while ((key = gwlist_extract_first(keys)) != NULL) {
+            concat_handling_expire(key, force);
+            octstr_destroy(key);
         }
+        gwlist_destroy(keys, NULL);
     }
-    gwlist_destroy(keys, octstr_destroy_item);
 }
 
 /* Checks if message is concatenated. Returns:
@@ -2156,6 +2397,7 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
     Msg *msg = *pmsg;
     int l, iel = 0, refnum, pos, c, part, totalparts, i, sixteenbit;
     Octstr *udh = msg->sms.udhdata, *key;
+    ConcatShard *shard;
     ConcatMsg *cmsg;
     int ret = concat_complete;
 
@@ -2163,7 +2405,7 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
         return concat_none;
 
     /* ... module not initialised or there is no UDH or smscid is NULL. */
-    if (incoming_concat_msgs == NULL || (l = octstr_len(udh)) == 0 || smscid == NULL)
+    if (concat_timers == NULL || (l = octstr_len(udh)) == 0 || smscid == NULL)
         return concat_none;
 
     for (pos = 1, c = -1; pos < l - 1; pos += iel + 2) {
@@ -2200,22 +2442,13 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
      
     msg_dump(msg, 0);
      
-    key = octstr_format("'%S' '%S' '%S' '%d' '%d' '%H'", msg->sms.sender, msg->sms.receiver, smscid, refnum, totalparts, udh);
-    mutex_lock(concat_lock);
-    if ((cmsg = dict_get(incoming_concat_msgs, key)) == NULL) {
-        cmsg = gw_malloc(sizeof(*cmsg));
-        cmsg->refnum = refnum;
-        cmsg->total_parts = totalparts;
-        cmsg->udh = udh;
+    key = concat_key(smscid, msg, refnum, totalparts, udh);
+    shard = concat_shard(key);
+    mutex_lock(shard->lock);
+    if ((cmsg = dict_get(shard->msgs, key)) == NULL) {
+        cmsg = concat_msg_create(key, smscid, refnum, totalparts, udh);
         udh = NULL;
-        cmsg->num_parts = 0;
-        cmsg->key = octstr_duplicate(key);
-        cmsg->ack = ack_success;
-        cmsg->smsc_id = octstr_duplicate(smscid);
-        cmsg->parts = gw_malloc(totalparts * sizeof(*cmsg->parts));
-        memset(cmsg->parts, 0, cmsg->total_parts * sizeof(*cmsg->parts)); /* clear it. */
-
-        dict_put(incoming_concat_msgs, key, cmsg);
+        dict_put(shard->msgs, key, cmsg);
     }
     octstr_destroy(key);
     octstr_destroy(udh);
@@ -2227,7 +2460,7 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
         store_save_ack(msg, ack_success);
         msg_destroy(msg); 
         *pmsg = msg = NULL;
-        mutex_unlock(concat_lock);
+        mutex_unlock(shard->lock);
         return concat_pending;
     } else {
         cmsg->parts[part -1] = msg;
@@ -2237,8 +2470,9 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
     }
 
     if (cmsg->num_parts < cmsg->total_parts) {  /* wait for more parts. */
+        gw_timer_start(cmsg->timer, concatenated_mo_timeout, cmsg);
         *pmsg = msg = NULL;
-        mutex_unlock(concat_lock);
+        mutex_unlock(shard->lock);
         return concat_pending;
     }
 
@@ -2254,7 +2488,8 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
 
     /* Attempt to save the new one, if that fails, then reply with fail. */
     if (store_save(msg) == -1) {	  
-        mutex_unlock(concat_lock);
+        gw_timer_start(cmsg->timer, concatenated_mo_timeout, cmsg);
+        mutex_unlock(shard->lock);
         msg_destroy(msg);
         *pmsg = msg = NULL;
         return concat_error;
@@ -2268,8 +2503,8 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
 
     /* Delete it from the queue and from the Dict. */
     /* Note: dict_put with NULL value delete and destroy value */
-    dict_put(incoming_concat_msgs, cmsg->key, NULL);
-    mutex_unlock(concat_lock);
+    dict_put(shard->msgs, cmsg->key, NULL);
+    mutex_unlock(shard->lock);
 
     debug("bb.sms.splits", 0, "Got full message [ref %d] of message from %s to %s. Dumping: ",
           refnum, octstr_get_cstr(msg->sms.sender), octstr_get_cstr(msg->sms.receiver));
@@ -2278,3 +2513,16 @@ static int concat_handling_check_and_handle(Msg **pmsg, Octstr *smscid)
     return ret;
 }
 
+
+int smsc2_concat_restore(Msg **msg)
+{
+    int ret;
+
+    if (!concat_persistent || (*msg)->sms.sms_type != mo)
+        return 0;
+
+    ret = concat_handling_check_and_handle(msg, (*msg)->sms.smsc_id);
+
+    return (ret == concat_pending || ret == concat_error);
+}
+
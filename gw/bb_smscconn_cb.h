@@ -87,6 +87,15 @@ void bb_smscconn_connected(SMSCConn *conn);
 void bb_smscconn_killed(void);
 
 
+/* Pool of workers shared by all SMSC Connections, for work done on
+ * behalf of a connection that should not hold up its own threads, like
+ * handling replies. The pool lives from smsc2_start to smsc2_cleanup, so
+ * connections have to wait for their tasks before calling
+ * bb_smscconn_killed.
+ */
+gw_pool_t *bb_smscconn_pool(void);
+
+
 /*
  * Called after successful sending of Msg 'sms'. Generate dlr message if
  * DLR_SMSC_SUCCESS mask is set. 'reply' will be passed as msgdata to
@@ -71,7 +71,7 @@
 long (*store_messages)(void);
 int (*store_save)(Msg *msg);
 int (*store_save_ack)(Msg *msg, ack_status_t status);
-int (*store_load)(void(*receive_msg)(Msg*));
+int (*store_load)(int(*receive_msg)(Msg*));
 int (*store_dump)(void);
 void (*store_shutdown)(void);
 Octstr* (*store_msg_pack)(Msg *msg);
@@ -82,15 +82,25 @@ void (*store_for_each_message)(void(*callback_fn)(Msg* msg, void *data), void *d
 int store_init(Cfg *cfg, const Octstr *type, const Octstr *fname, long dump_freq,
                void *pack_func, void *unpack_func)
 {
+    CfgGroup *grp;
+    long load_threads = 1;
     int ret;
     
     store_msg_pack = pack_func;
     store_msg_unpack = unpack_func;
 
+    if (cfg != NULL &&
+        (grp = cfg_get_single_group(cfg, octstr_imm("core"))) != NULL &&
+        cfg_get_integer(&load_threads, grp, octstr_imm("store-load-threads")) != -1 &&
+        load_threads < 1) {
+        warning(0, "Invalid 'store-load-threads' value %ld, using 1.", load_threads);
+        load_threads = 1;
+    }
+
     if (type == NULL || octstr_str_compare(type, "file") == 0) {
         ret = store_file_init(fname, dump_freq);
     } else if (octstr_str_compare(type, "spool") == 0) {
-        ret = store_spool_init(fname);
+        ret = store_spool_init(fname, load_threads);
 #ifdef HAVE_REDIS
     } else if (octstr_str_compare(type, "redis") == 0) {
         ret = store_redis_init(cfg);
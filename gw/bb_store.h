@@ -80,9 +80,12 @@ extern int (*store_save_ack)(Msg *msg, ack_status_t status);
 /* load store from file; delete any messages that have been relayed,
  * and create a new store file from remaining. Calling this function
  * might take a while, depending on store size
+ * receive_msg takes over each loaded message. It may block until there
+ * is room for it and returns -1 if loading should stop (shutdown); the
+ * messages not dispatched so far stay in the store.
  * Return -1 if something fails (bb can then PANIC normally)
  */
-extern int (*store_load)(void(*receive_msg)(Msg*));
+extern int (*store_load)(int(*receive_msg)(Msg*));
 
 /* dump currently non-acknowledged messages into file. This is done
  * automatically now and then, but can be forced. Return -1 if file
@@ -113,7 +116,7 @@ extern void (*store_for_each_message)(void(*callback_fn)(Msg*, void*), void *dat
 /**
  * Init functions for different store types.
  */
-int store_spool_init(const Octstr *fname);
+int store_spool_init(const Octstr *fname, long load_threads);
 int store_file_init(const Octstr *fname, long dump_freq);
 #ifdef HAVE_REDIS
 int store_redis_init(Cfg *cfg);
@@ -115,31 +115,48 @@ static void write_msg(Msg *msg)
 }
 
 
-static int read_msg(Msg **msg, Octstr *os, long *off)
+/*
+ * Read the next record from the store file. Returns 1 if a message was
+ * read, 0 at end of file, -1 if the record could not be unpacked (the
+ * file position is past it) and -2 if the file ends in the middle of
+ * a record.
+ */
+static int read_msg(Msg **msg, FILE *f)
 {
     unsigned char buf[4];
     long i;
+    size_t n;
+    char *data;
     Octstr *pack;
 
-    gw_assert(*off >= 0);
-    if (*off + 4 > octstr_len(os)) {
+    n = fread(buf, 1, 4, f);
+    if (n == 0)
+        return 0;
+    if (n < 4) {
         error(0, "Packet too short while unpacking Msg.");
-        return -1;
+        return -2;
     }
-
-    octstr_get_many_chars((char*)buf, os, *off, 4);
     i = decode_network_long(buf);
-    *off  +=  4;
-    
-    pack = octstr_copy(os, *off, i);
-    *off += octstr_len(pack);
+    if (i < 0) {
+        error(0, "Invalid record length in store-file.");
+        return -2;
+    }
+
+    data = gw_malloc(i + 1);
+    if (fread(data, 1, i, f) != (size_t) i) {
+        error(0, "Packet too short while unpacking Msg.");
+        gw_free(data);
+        return -2;
+    }
+    pack = octstr_create_from_data(data, i);
+    gw_free(data);
     *msg = store_msg_unpack(pack);
     octstr_destroy(pack);
     
     if (!*msg)
         return -1;
     
-    return 0;
+    return 1;
 }
 
 
@@ -380,13 +397,25 @@ static int store_file_save_ack(Msg *msg, ack_status_t status)
 }
 
 
-static int store_file_load(void(*receive_msg)(Msg*))
+static FILE *open_store_file(Octstr *name)
+{
+    FILE *f;
+
+    f = fopen(octstr_get_cstr(name), "r");
+    if (f != NULL)
+        info(0, "Loading store file `%s'", octstr_get_cstr(name));
+    return f;
+}
+
+
+static int store_file_load(int(*receive_msg)(Msg*))
 {
     List *keys;
-    Octstr *store_file, *key;
+    Octstr *key;
+    FILE *store_file;
     Msg *msg;
-    int retval, msgs;
-    long end, pos;
+    int retval, rc;
+    long msgs, dispatched;
 
     if (filename == NULL)
         return 0;
@@ -397,35 +426,22 @@ static int store_file_load(void(*receive_msg)(Msg*))
         file = NULL;
     }
 
-    store_file = octstr_read_file(octstr_get_cstr(filename));
-    if (store_file != NULL)
-        info(0, "Loading store file `%s'", octstr_get_cstr(filename));
-    else {
-        store_file = octstr_read_file(octstr_get_cstr(newfile));
-        if (store_file != NULL)
-            info(0, "Loading store file `%s'", octstr_get_cstr(newfile));
-        else {
-            store_file = octstr_read_file(octstr_get_cstr(bakfile));
-            if (store_file != NULL)
-        	       info(0, "Loading store file `%s'", octstr_get_cstr(bakfile));
-            else {
-                info(0, "Cannot open any store file, starting a new one");
-                retval = open_file(filename);
-                goto end;
-            }
-        }
+    if ((store_file = open_store_file(filename)) == NULL &&
+        (store_file = open_store_file(newfile)) == NULL &&
+        (store_file = open_store_file(bakfile)) == NULL) {
+        info(0, "Cannot open any store file, starting a new one");
+        retval = open_file(filename);
+        mutex_unlock(file_mutex);
+        gwlist_remove_producer(loaded);
+        goto end;
     }
 
-    info(0, "Store-file size %ld, starting to unpack%s", octstr_len(store_file),
-        octstr_len(store_file) > 10000 ? " (may take awhile)" : "");
-
-
-    pos = 0;
+    /* the file is streamed, only the non-acknowledged messages are kept */
     msgs = 0;
-    end = octstr_len(store_file);
-    
-    while (pos < end) {
-        if (read_msg(&msg, store_file, &pos) == -1) {
+    while ((rc = read_msg(&msg, store_file)) != 0) {
+        if (rc == -2)
+            break;
+        if (rc == -1) {
             error(0, "Garbage at store-file, skipped.");
             continue;
         }
@@ -441,36 +457,42 @@ static int store_file_load(void(*receive_msg)(Msg*))
         }
         msg_destroy(msg);
     }
-    octstr_destroy(store_file);
+    fclose(store_file);
 
-    info(0, "Retrieved %d messages, non-acknowledged messages: %ld",
+    info(0, "Retrieved %ld messages, non-acknowledged messages: %ld",
         msgs, dict_key_count(sms_dict));
 
-    /* now create a new sms_store out of messages left */
-
+    /* generate new store file out of left messages */
+    retval = do_dump();
     keys = dict_keys(sms_dict);
+    mutex_unlock(file_mutex);
+
+    /*
+     * Allow using of store. Messages saved from now on are not in keys,
+     * and acks of messages not dispatched yet just remove them from
+     * the dict, so they are skipped below.
+     */
+    gwlist_remove_producer(loaded);
+
+    dispatched = 0;
     while ((key = gwlist_extract_first(keys)) != NULL) {
-        msg = dict_remove(sms_dict, key);
-        if (store_to_dict(msg) != -1) {
-            receive_msg(msg);
-        } else {
-            error(0, "Found unknown message type in store file.");
-            msg_dump(msg, 0);
-            msg_destroy(msg);
-        }
+        mutex_lock(file_mutex);
+        msg = dict_get(sms_dict, key);
+        if (msg != NULL)
+            msg = msg_duplicate(msg);
+        mutex_unlock(file_mutex);
         octstr_destroy(key);
+        if (msg == NULL)
+            continue;
+        if (receive_msg(msg) == -1) {
+            info(0, "Loading of store stopped after %ld messages.", dispatched);
+            break;
+        }
+        dispatched++;
     }
     gwlist_destroy(keys, octstr_destroy_item);
 
-    /* Finally, generate new store file out of left messages */
-    retval = do_dump();
-
 end:
-    mutex_unlock(file_mutex);
-
-    /* allow using of store */
-    gwlist_remove_producer(loaded);
-
     /* start dumper thread */
     if ((cleanup_thread = gwthread_create(store_dumper, NULL))==-1)
         panic(0, "Failed to create a cleanup thread!");
@@ -516,7 +516,7 @@ static void store_redis_for_each_message(void(*callback_fn)(Msg* msg, void *data
 static void dispatch(Octstr *msg_s, void *data)
 {
     Msg *msg;
-    void (*receive_msg)(Msg*) = data;
+    int (*receive_msg)(Msg*) = data;
 
     if (msg_s == NULL)
         return;
@@ -534,7 +534,7 @@ static void dispatch(Octstr *msg_s, void *data)
 static void dispatch_hash(Dict *msg_h, void *data)
 {
     Msg *msg;
-    void (*receive_msg)(Msg*) = data;
+    int (*receive_msg)(Msg*) = data;
 
     if (msg_h == NULL)
         return;
@@ -549,7 +549,7 @@ static void dispatch_hash(Dict *msg_h, void *data)
 }
 
 
-static int store_redis_load(void(*receive_msg)(Msg*))
+static int store_redis_load(int(*receive_msg)(Msg*))
 {
     int rc;
 
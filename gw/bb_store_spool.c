@@ -78,10 +78,18 @@
 
 /* how much subdirs allowed ? */
 #define MAX_DIRS 100
+/* how many file names may wait for a load worker */
+#define LOAD_QUEUE_MAX 1024
 
 static Octstr *spool;
 static Counter *counter;
-static List *loaded;
+static long load_threads;
+/*
+ * Ids of messages saved while the store is still being loaded. Saving
+ * doesn't wait for the load to finish, the loader just skips these.
+ */
+static Dict *saved_during_load;
+static Mutex *load_lock;
 
 
 static int store_spool_dump()
@@ -97,7 +105,11 @@ static long store_spool_messages()
 }
 
 
-static int for_each_file(const Octstr *dir_s, int ignore_err, void(*cb)(const Octstr*, void*), void *data)
+/*
+ * Call cb for each regular file below dir_s. If cb returns -1 the walk
+ * stops and -1 is returned.
+ */
+static int for_each_file(const Octstr *dir_s, int ignore_err, int(*cb)(const Octstr*, void*), void *data)
 {
     DIR *dir;
     struct dirent *ent;
@@ -119,8 +131,11 @@ static int for_each_file(const Octstr *dir_s, int ignore_err, void(*cb)(const Oc
             ret = -1;
         } else if (S_ISDIR(stat.st_mode) && for_each_file(filename, ignore_err, cb, data) == -1) {
             ret = -1;
-        } else if (S_ISREG(stat.st_mode) && cb != NULL)
-            cb(filename, data);
+        } else if (S_ISREG(stat.st_mode) && cb != NULL && cb(filename, data) == -1) {
+            octstr_destroy(filename);
+            ret = -1;
+            break;
+        }
         octstr_destroy(filename);
         if (ret == -1 && ignore_err)
             ret = 0;
@@ -139,7 +154,7 @@ struct status {
 };
 
 
-static void status_cb(const Octstr *filename, void *d)
+static int status_cb(const Octstr *filename, void *d)
 {
     struct status *data = d;
     Octstr *msg_s;
@@ -149,11 +164,13 @@ static void status_cb(const Octstr *filename, void *d)
     msg = store_msg_unpack(msg_s);
     octstr_destroy(msg_s);
     if (msg == NULL)
-        return;
+        return 0;
 
     data->callback_fn(msg, data->data);
 
     msg_destroy(msg);
+
+    return 0;
 }
 
 
@@ -172,11 +189,25 @@ static void store_spool_for_each_message(void(*callback_fn)(Msg* msg, void *data
 }
 
 
-static void dispatch(const Octstr *filename, void *data)
+/*
+ * The store is loaded by walking the spool directory in the calling
+ * thread, while load_threads workers read, unpack and dispatch the
+ * files it finds. receive_msg may block, so only LOAD_QUEUE_MAX file
+ * names are kept in memory at any time, the rest stays on disk.
+ */
+struct load {
+    int(*receive_msg)(Msg*);
+    List *files;
+    Semaphore *slots;
+    Counter *loaded;
+    volatile int stopped;
+};
+
+
+static void dispatch(const Octstr *filename, struct load *load)
 {
     Octstr *msg_s;
     Msg *msg;
-    void(*receive_msg)(Msg*) = data;
 
     /* debug("", 0, "dispatch(%s,...) called", octstr_get_cstr(filename)); */
 
@@ -185,17 +216,63 @@ static void dispatch(const Octstr *filename, void *data)
         return;
     msg = store_msg_unpack(msg_s);
     octstr_destroy(msg_s);
-    if (msg != NULL) {
-        receive_msg(msg);
-        counter_increase(counter);
-    } else {
+    if (msg == NULL) {
         error(0, "Could not unpack message `%s'", octstr_get_cstr(filename));
+        return;
+    }
+    if (load->receive_msg(msg) == -1) {
+        load->stopped = 1;
+        return;
+    }
+    counter_increase(counter);
+    counter_increase(load->loaded);
+}
+
+
+static void load_worker(void *arg)
+{
+    struct load *load = arg;
+    Octstr *filename;
+
+    while ((filename = gwlist_consume(load->files)) != NULL) {
+        semaphore_up(load->slots);
+        if (!load->stopped)
+            dispatch(filename, load);
+        octstr_destroy(filename);
     }
 }
 
 
-static int store_spool_load(void(*receive_msg)(Msg*))
+static int queue_file(const Octstr *filename, void *data)
+{
+    struct load *load = data;
+    Octstr *id;
+    int skip;
+
+    if (load->stopped)
+        return -1;
+
+    /* file name is the message id */
+    id = octstr_copy(filename, octstr_rsearch_char(filename, '/', octstr_len(filename) - 1) + 1,
+                     octstr_len(filename));
+    mutex_lock(load_lock);
+    skip = (dict_get(saved_during_load, id) != NULL);
+    mutex_unlock(load_lock);
+    octstr_destroy(id);
+    if (skip)
+        return 0;
+
+    semaphore_down(load->slots);
+    gwlist_produce(load->files, octstr_duplicate(filename));
+
+    return 0;
+}
+
+
+static int store_spool_load(int(*receive_msg)(Msg*))
 {
+    struct load load;
+    long *workers, i;
     int rc;
 
     /* check if we are active */
@@ -206,12 +283,41 @@ static int store_spool_load(void(*receive_msg)(Msg*))
     if (receive_msg == NULL)
         return -1;
 
-    rc = for_each_file(spool, 0, dispatch, receive_msg);
+    load.receive_msg = receive_msg;
+    load.files = gwlist_create();
+    load.slots = semaphore_create(LOAD_QUEUE_MAX);
+    load.loaded = counter_create();
+    load.stopped = 0;
+    gwlist_add_producer(load.files);
+
+    workers = gw_malloc(load_threads * sizeof(*workers));
+    for (i = 0; i < load_threads; i++) {
+        if ((workers[i] = gwthread_create(load_worker, &load)) == -1)
+            panic(0, "Could not start store load thread.");
+    }
+
+    rc = for_each_file(spool, 0, queue_file, &load);
+
+    gwlist_remove_producer(load.files);
+    for (i = 0; i < load_threads; i++)
+        gwthread_join(workers[i]);
+    gw_free(workers);
 
-    info(0, "Loaded %ld messages from store.", counter_value(counter));
+    if (load.stopped) {
+        info(0, "Loading of store stopped after %ld messages.", counter_value(load.loaded));
+        rc = 0;
+    } else
+        info(0, "Loaded %ld messages from store.", counter_value(load.loaded));
 
-    /* allow using of storage */
-    gwlist_remove_producer(loaded);
+    /* new messages don't need to be remembered any more */
+    mutex_lock(load_lock);
+    dict_destroy(saved_during_load);
+    saved_during_load = NULL;
+    mutex_unlock(load_lock);
+
+    gwlist_destroy(load.files, octstr_destroy_item);
+    semaphore_destroy(load.slots);
+    counter_destroy(load.loaded);
 
     return rc;
 }
@@ -232,9 +338,6 @@ static int store_spool_save(Msg *msg)
     if (spool == NULL)
         return 0;
 
-    /* blocke here if store still not loaded */
-    gwlist_consume(loaded);
-
     switch(msg_type(msg)) {
         case sms:
         {
@@ -249,6 +352,11 @@ static int store_spool_save(Msg *msg)
             }
             uuid_unparse(msg->sms.id, id);
             id_s = octstr_create(id);
+            /* remember before the file exists, so the loader never sees it unmarked */
+            mutex_lock(load_lock);
+            if (saved_during_load != NULL)
+                dict_put(saved_during_load, id_s, octstr_duplicate(id_s));
+            mutex_unlock(load_lock);
             dir = octstr_format("%S/%ld", spool, octstr_hash_key(id_s) % MAX_DIRS);
             octstr_destroy(id_s);
             if (mkdir(octstr_get_cstr(dir), S_IRUSR|S_IWUSR|S_IXUSR) == -1 && errno != EEXIST) {
@@ -331,11 +439,12 @@ static void store_spool_shutdown()
         
     counter_destroy(counter);
     octstr_destroy(spool);
-    gwlist_destroy(loaded, NULL);
+    dict_destroy(saved_during_load);
+    mutex_destroy(load_lock);
 }
 
 
-int store_spool_init(const Octstr *store_dir)
+int store_spool_init(const Octstr *store_dir, long threads)
 {
     DIR *dir;
 
@@ -357,10 +466,11 @@ int store_spool_init(const Octstr *store_dir)
     }
     closedir(dir);
 
-    loaded = gwlist_create();
-    gwlist_add_producer(loaded);
     spool = octstr_duplicate(store_dir);
     counter = counter_create();
+    load_threads = threads;
+    saved_during_load = dict_create(1024, octstr_destroy_item);
+    load_lock = mutex_create();
 
     return 0;
 }
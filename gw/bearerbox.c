@@ -146,6 +146,8 @@ static volatile sig_atomic_t bb_todo = 0;
 
 static Mutex *status_mutex;
 static time_t start_time;
+/* max messages the store load keeps in the queues, 0 for no limit */
+static long store_load_window = 0;
 volatile sig_atomic_t restart = 0;
 
 
@@ -462,6 +464,15 @@ static Cfg *init_bearerbox(Cfg *cfg)
     octstr_destroy(val);
     octstr_destroy(log);
 
+    if (cfg_get_integer(&store_load_window, grp,
+                           octstr_imm("store-load-window")) == -1)
+        store_load_window = 0;
+    else if (store_load_window < 0) {
+        warning(0, "Invalid 'store-load-window' %ld, loading store without limit.",
+                store_load_window);
+        store_load_window = 0;
+    }
+
     cfg_get_integer(&http_proxy_port, grp, octstr_imm("http-proxy-port"));
 #ifdef HAVE_LIBSSL
     cfg_get_bool(&http_proxy_ssl, grp, octstr_imm("http-proxy-ssl"));
@@ -542,6 +553,10 @@ static Cfg *init_bearerbox(Cfg *cfg)
 
     setup_signal_handlers();
     
+    /* accept loops for the HTTP ports, set before any is opened */
+    if (cfg_get_integer(&value, grp, octstr_imm("http-server-loops")) == 0)
+        http_set_server_loops(value);
+
     /* http-admin is REQUIRED */
     httpadmin_start(cfg);
 
@@ -662,9 +677,15 @@ static void empty_msg_lists(void)
 }
 
 
-static void dispatch_into_queue(Msg *msg)
+/*
+ * Put a message loaded from store into its queue. With a store-load-window
+ * we wait until the queue has room, so a big store is not read into
+ * memory at once. Returns -1 if the load should stop.
+ */
+static int dispatch_into_queue(Msg *msg)
 {
     char id[UUID_STR_LEN + 1];
+    List *queue;
 
     gw_assert(msg != NULL),
     gw_assert(msg_type(msg) == sms);
@@ -673,19 +694,46 @@ static void dispatch_into_queue(Msg *msg)
         case mt_push:
         case mt_reply:
         case report_mt:
-            gwlist_append(outgoing_sms, msg);
+            queue = outgoing_sms;
             break;
         case mo:
+            /* may be a part of a concatenated message still pending */
+            if (smsc2_concat_restore(&msg) == 1)
+                return 0;
+            /* fall through */
         case report_mo:
-            gwlist_append(incoming_sms, msg);
+            queue = incoming_sms;
             break;
         default:
             uuid_unparse(msg->sms.id, id);
             error(0, "Not handled sms_type %ld within store for message ID %s",
                   msg->sms.sms_type, id);
             msg_destroy(msg);
-            break;
+            return 0;
+    }
+
+    while (store_load_window > 0 && gwlist_len(queue) >= store_load_window) {
+        if (bb_status == BB_SHUTDOWN || bb_status == BB_DEAD) {
+            /* still in store, will be loaded on next start */
+            msg_destroy(msg);
+            return -1;
+        }
+        gwthread_sleep(0.1);
     }
+    gwlist_append(queue, msg);
+
+    return 0;
+}
+
+
+static void store_loader(void *arg)
+{
+    gwlist_add_producer(flow_threads);
+
+    if (store_load(dispatch_into_queue) == -1)
+        panic(0, "Cannot start with store-file failing");
+
+    gwlist_remove_producer(flow_threads);
 }
 
 
@@ -729,7 +777,14 @@ int main(int argc, char **argv)
 
     gwthread_sleep(5.0); /* give time to threads to register themselves */
 
-    if (store_load(dispatch_into_queue) == -1)
+    /*
+     * With a load window the queues are filled while we are already
+     * running, otherwise everything is queued before start-up is done.
+     */
+    if (store_load_window > 0) {
+        if (gwthread_create(store_loader, NULL) == -1)
+            panic(0, "Failed to start a new thread for store loading");
+    } else if (store_load(dispatch_into_queue) == -1)
         panic(0, "Cannot start with store-file failing");
     
     info(0, "MAIN: Start-up done, entering mainloop");
@@ -983,6 +1038,21 @@ int bb_remove_message(Octstr *message_id)
 #define append_status(r, s, f, x) { s = f(x); octstr_append(r, s); \
                                     octstr_destroy(s); }
 
+static char *bb_status_name(void)
+{
+    if (bb_status == BB_RUNNING)
+        return "running";
+    else if (bb_status == BB_ISOLATED)
+        return "isolated";
+    else if (bb_status == BB_SUSPENDED)
+        return "suspended";
+    else if (bb_status == BB_FULL)
+        return "filled";
+    else
+        return "going down";
+}
+
+
 Octstr *bb_print_status(int status_type)
 {
     char *s, *lb;
@@ -994,17 +1064,7 @@ Octstr *bb_print_status(int status_type)
         return octstr_create("Un-supported format");
 
     t = time(NULL) - start_time;
-    
-    if (bb_status == BB_RUNNING)
-        s = "running";
-    else if (bb_status == BB_ISOLATED)
-        s = "isolated";
-    else if (bb_status == BB_SUSPENDED)
-        s = "suspended";
-    else if (bb_status == BB_FULL)
-        s = "filled";
-    else
-        s = "going down";
+    s = bb_status_name();
 
     version = version_report_string("bearerbox");
 
@@ -1094,6 +1154,74 @@ Octstr *bb_print_status(int status_type)
 }
 
 
+Octstr *bb_print_metrics(void)
+{
+    Octstr *ret;
+    long areas, bytes, highest_bytes;
+
+    ret = octstr_format(
+        "# HELP kannel_info Version and malloc wrapper of the bearerbox.\n"
+        "# TYPE kannel_info gauge\n"
+        "kannel_info{version=\"%s\",malloc=\"%S\"} 1\n"
+        "# HELP kannel_status Current state of the bearerbox.\n"
+        "# TYPE kannel_status gauge\n"
+        "kannel_status{status=\"%s\"} 1\n"
+        "# HELP kannel_uptime_seconds Time since the bearerbox started.\n"
+        "# TYPE kannel_uptime_seconds gauge\n"
+        "kannel_uptime_seconds %ld\n",
+        GW_VERSION, gwmem_type(), bb_status_name(),
+        (long) (time(NULL) - start_time));
+
+    octstr_format_append(ret,
+        "# HELP kannel_messages_total Messages passed through the bearerbox.\n"
+        "# TYPE kannel_messages_total counter\n"
+        "kannel_messages_total{type=\"sms\",direction=\"received\"} %lu\n"
+        "kannel_messages_total{type=\"sms\",direction=\"sent\"} %lu\n"
+        "kannel_messages_total{type=\"dlr\",direction=\"received\"} %lu\n"
+        "kannel_messages_total{type=\"dlr\",direction=\"sent\"} %lu\n"
+        "kannel_messages_total{type=\"wdp\",direction=\"received\"} %lu\n"
+        "kannel_messages_total{type=\"wdp\",direction=\"sent\"} %lu\n"
+        "# HELP kannel_queue Messages waiting in the global queues.\n"
+        "# TYPE kannel_queue gauge\n"
+        "kannel_queue{type=\"sms\",direction=\"received\"} %ld\n"
+        "kannel_queue{type=\"sms\",direction=\"sent\"} %ld\n"
+        "kannel_queue{type=\"wdp\",direction=\"received\"} %ld\n"
+        "kannel_queue{type=\"wdp\",direction=\"sent\"} %ld\n"
+        "# HELP kannel_store_messages Messages kept in the store.\n"
+        "# TYPE kannel_store_messages gauge\n"
+        "kannel_store_messages %ld\n"
+        "# HELP kannel_dlr_waiting Messages waiting for a DLR.\n"
+        "# TYPE kannel_dlr_waiting gauge\n"
+        "kannel_dlr_waiting %ld\n",
+        counter_value(incoming_sms_counter), counter_value(outgoing_sms_counter),
+        counter_value(incoming_dlr_counter), counter_value(outgoing_dlr_counter),
+        counter_value(incoming_wdp_counter), counter_value(outgoing_wdp_counter),
+        gwlist_len(incoming_sms), gwlist_len(outgoing_sms),
+        gwlist_len(incoming_wdp) + boxc_incoming_wdp_queue(),
+        gwlist_len(outgoing_wdp) + udp_outgoing_queue(),
+        store_messages(), dlr_messages());
+
+    areas = bytes = highest_bytes = 0;
+    if (gwmem_stats(&areas, &bytes, &highest_bytes) == 0)
+        octstr_format_append(ret,
+            "# HELP kannel_memory_areas Memory areas currently allocated.\n"
+            "# TYPE kannel_memory_areas gauge\n"
+            "kannel_memory_areas %ld\n"
+            "# HELP kannel_memory_bytes Memory currently allocated.\n"
+            "# TYPE kannel_memory_bytes gauge\n"
+            "kannel_memory_bytes %ld\n"
+            "# HELP kannel_memory_peak_bytes Most memory allocated at a time.\n"
+            "# TYPE kannel_memory_peak_bytes gauge\n"
+            "kannel_memory_peak_bytes %ld\n",
+            areas, bytes, highest_bytes);
+
+    boxc_metrics(ret);
+    smsc2_metrics(ret);
+
+    return ret;
+}
+
+
 char *bb_status_linebreak(int status_type)
 {
     switch (status_type) {
@@ -1109,3 +1237,25 @@ char *bb_status_linebreak(int status_type)
             return NULL;
     }
 }
+
+
+void bb_metrics_label(Octstr *labels, const char *name, const Octstr *value)
+{
+    long i;
+    int c;
+
+    if (octstr_len(labels) > 0)
+        octstr_append_char(labels, ',');
+    octstr_format_append(labels, "%s=\"", name);
+    for (i = 0; i < octstr_len(value); i++) {
+        c = octstr_get_char(value, i);
+        if (c == '\\' || c == '"')
+            octstr_append_char(labels, '\\');
+        else if (c == '\n') {
+            octstr_append_cstr(labels, "\\n");
+            continue;
+        }
+        octstr_append_char(labels, c);
+    }
+    octstr_append_char(labels, '"');
+}
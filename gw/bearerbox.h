@@ -112,6 +112,8 @@ int smsbox_restart(Cfg *config);
 int wapbox_start(Cfg *config);
 
 Octstr *boxc_status(int status_type);
+/* append the smsbox connection metrics to os, see bb_print_metrics() */
+void boxc_metrics(Octstr *os);
 /* tell total number of messages in separate wapbox incoming queues */
 int boxc_incoming_wdp_queue(void);
 
@@ -158,6 +160,8 @@ int smsc2_shutdown(void);
 void smsc2_cleanup(void); /* final clean-up */
 
 Octstr *smsc2_status(int status_type);
+/* append the SMSC connection metrics to os, see bb_print_metrics() */
+void smsc2_metrics(Octstr *os);
 
 /* function to route outgoing SMS'es
  *
@@ -171,6 +175,15 @@ Octstr *smsc2_status(int status_type);
  */
 long smsc2_rout(Msg *msg, int resend);
 
+/*
+ * Pass a MO message part loaded from the store to the concatenated
+ * message handling, if sms-combine-concatenated-mo-persistent is set.
+ * Returns 1 if the part was taken, otherwise *msg is to be queued as
+ * usual; it is replaced by the combined message if this was the last
+ * missing part.
+ */
+int smsc2_concat_restore(Msg **msg);
+
 int smsc2_stop_smsc(Octstr *id);   /* shutdown a specific smsc */
 int smsc2_restart_smsc(Octstr *id);  /* re-start a specific smsc */
 int smsc2_add_smsc(Octstr *id);   /* add a new smsc */
@@ -226,6 +239,9 @@ int bb_reload_smsc_groups(void);
 /* return string of current status */
 Octstr *bb_print_status(int status_type);
 
+/* return the current metrics in the Prometheus text format */
+Octstr *bb_print_metrics(void);
+
 
 /*----------------------------------------------------------------
  * common function to all (in bearerbox.c)
@@ -235,4 +251,7 @@ Octstr *bb_print_status(int status_type);
  * not supported */
 char *bb_status_linebreak(int status_type);
 
+/* append label `name="value"' to a metrics label set, quoting value */
+void bb_metrics_label(Octstr *labels, const char *name, const Octstr *value);
+
 
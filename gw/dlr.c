@@ -96,6 +96,17 @@
 /* Our callback functions */
 static struct dlr_storage *handles = NULL;
 
+/*
+ * Submit times of the messages waiting for their final DLR, for the
+ * submit to DLR latency of the SMSC. These live only in memory, whatever
+ * the storage, in two generations: once the young one is full the old
+ * one is dropped, which bounds the memory taken by DLRs never arriving.
+ */
+#define DLR_SUBMIT_TIMES 50000
+
+static Mutex *submit_times_lock = NULL;
+static Dict *submit_times[2];
+
 /*
  * Function to allocate a new struct dlr_entry entry
  * and initialize it to zero
@@ -226,6 +237,67 @@ void dlr_db_fields_destroy(struct dlr_db_fields *fields)
 }
 
 
+static void submit_time_destroy(void *submitted)
+{
+    gw_free(submitted);
+}
+
+
+static Octstr *submit_time_key(const Octstr *smsc, const Octstr *ts)
+{
+    return octstr_format("%S %S", smsc, ts);
+}
+
+
+static void submit_time_add(const Octstr *smsc, const Octstr *ts, Msg *msg)
+{
+    Octstr *key;
+    long long *submitted;
+
+    if (submit_times_lock == NULL || msg->submitted_usec <= 0)
+        return;
+
+    key = submit_time_key(smsc, ts);
+    submitted = gw_malloc(sizeof(*submitted));
+    *submitted = msg->submitted_usec;
+
+    mutex_lock(submit_times_lock);
+    if (dict_key_count(submit_times[0]) >= DLR_SUBMIT_TIMES) {
+        dict_destroy(submit_times[1]);
+        submit_times[1] = submit_times[0];
+        submit_times[0] = dict_create(DLR_SUBMIT_TIMES, submit_time_destroy);
+    }
+    dict_put(submit_times[0], key, submitted);
+    mutex_unlock(submit_times_lock);
+
+    octstr_destroy(key);
+}
+
+
+/* return the submit time and forget about it, 0 if unknown */
+static long long submit_time_remove(const Octstr *smsc, const Octstr *ts)
+{
+    Octstr *key;
+    long long *submitted, ret;
+
+    if (submit_times_lock == NULL)
+        return 0;
+
+    key = submit_time_key(smsc, ts);
+    mutex_lock(submit_times_lock);
+    if ((submitted = dict_remove(submit_times[0], key)) == NULL)
+        submitted = dict_remove(submit_times[1], key);
+    mutex_unlock(submit_times_lock);
+    octstr_destroy(key);
+
+    if (submitted == NULL)
+        return 0;
+    ret = *submitted;
+    gw_free(submitted);
+    return ret;
+}
+
+
 /*
  * Initialize specifically dlr storage. If defined storage is unknown
  * then panic.
@@ -289,6 +361,10 @@ void dlr_init(Cfg* cfg)
     /* get info from storage */
     info(0, "DLR using storage type: %s", handles->type);
 
+    submit_times_lock = mutex_create();
+    submit_times[0] = dict_create(DLR_SUBMIT_TIMES, submit_time_destroy);
+    submit_times[1] = dict_create(DLR_SUBMIT_TIMES, submit_time_destroy);
+
     /* cleanup */
     octstr_destroy(dlr_type);
 }
@@ -300,6 +376,13 @@ void dlr_shutdown()
 {
     if (handles != NULL && handles->dlr_shutdown != NULL)
         handles->dlr_shutdown();
+
+    if (submit_times_lock != NULL) {
+        dict_destroy(submit_times[0]);
+        dict_destroy(submit_times[1]);
+        mutex_destroy(submit_times_lock);
+        submit_times_lock = NULL;
+    }
 }
 
 /* 
@@ -375,6 +458,8 @@ void dlr_add(const Octstr *smsc, const Octstr *ts, Msg *msg, int use_dst)
           dlr_type(), octstr_get_cstr(dlr->smsc), octstr_get_cstr(dlr->timestamp),
           octstr_get_cstr(dlr->source), octstr_get_cstr(dlr->destination), dlr->mask, octstr_get_cstr(dlr->boxc_id));
 	
+    submit_time_add(smsc, ts, msg);
+
     /* call registered function */
     handles->dlr_add(dlr);
 }
@@ -390,6 +475,7 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
     struct dlr_entry *dlr = NULL;
     Octstr *dst_min = NULL;
     Octstr *dlr_mask;
+    long long submitted;
     
     if(octstr_len(smsc) == 0) {
 	warning(0, "DLR[%s]: Can't find a dlr without smsc-id", dlr_type());
@@ -449,9 +535,8 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
          * resolving data to pull up this information.
          */
         dlr_mask = octstr_format("%ld", dlr->mask);
-        msg->sms.meta_data = octstr_create("");
-        meta_data_set_value(msg->sms.meta_data, METADATA_ORIG_MSG_GROUP,
-                            octstr_imm(METADATA_ORIG_MSG_GROUP_DLR_MASK), dlr_mask, 1);
+        meta_data_msg_set_value(msg, METADATA_ORIG_MSG_GROUP,
+                                octstr_imm(METADATA_ORIG_MSG_GROUP_DLR_MASK), dlr_mask, 1);
         octstr_destroy(dlr_mask);
 
         time(&msg->sms.time);
@@ -473,6 +558,10 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
             handles->dlr_update(smsc, ts, dst_min, typ);
         }
     } else {
+        submitted = submit_time_remove(smsc, ts);
+        if (msg != NULL)
+            msg->submitted_usec = submitted;
+
         if (handles != NULL && handles->dlr_remove != NULL){
             /* it's not good for internal storage, but better for all others */
             handles->dlr_remove(smsc, ts, dst_min);
@@ -495,6 +584,15 @@ void dlr_flush(void)
  
     if (handles != NULL && handles->dlr_flush != NULL)
         handles->dlr_flush();
+
+    if (submit_times_lock != NULL) {
+        mutex_lock(submit_times_lock);
+        dict_destroy(submit_times[1]);
+        dict_destroy(submit_times[0]);
+        submit_times[0] = dict_create(DLR_SUBMIT_TIMES, submit_time_destroy);
+        submit_times[1] = dict_create(DLR_SUBMIT_TIMES, submit_time_destroy);
+        mutex_unlock(submit_times_lock);
+    }
 }
 
 
@@ -528,10 +626,8 @@ Msg* create_dlr_from_msg(const Octstr *smsc, const Msg *msg, const Octstr *reply
     /* add original DLR bit-mask, as we do in dlr_find() */
     if (DLR_IS_ENABLED(msg->sms.dlr_mask)) {
         Octstr *dlr_mask = octstr_format("%ld", msg->sms.dlr_mask);
-        if (dlrmsg->sms.meta_data == NULL)
-            dlrmsg->sms.meta_data = octstr_create("");
-        meta_data_set_value(dlrmsg->sms.meta_data, METADATA_ORIG_MSG_GROUP,
-                            octstr_imm(METADATA_ORIG_MSG_GROUP_DLR_MASK), dlr_mask, 1);
+        meta_data_msg_set_value(dlrmsg, METADATA_ORIG_MSG_GROUP,
+                                octstr_imm(METADATA_ORIG_MSG_GROUP_DLR_MASK), dlr_mask, 1);
         octstr_destroy(dlr_mask);
     }
 
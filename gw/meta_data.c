@@ -63,6 +63,7 @@
  */
 
 #include "gwlib/gwlib.h"
+#include "msg.h"
 #include "meta_data.h"
 
 
@@ -72,6 +73,20 @@ struct meta_data {
     struct meta_data *next;
 };
 
+/*
+ * Parsed meta-data of a Msg along with the packed form it was parsed
+ * from. Code all over the gateway reads and sets msg->sms.meta_data
+ * directly, so the cache is only used while the field still has the
+ * same content.
+ */
+struct meta_data_cache {
+    Octstr *packed;
+    struct meta_data *mdata;
+};
+
+/* values of a group, a handful of TLVs at most */
+#define META_DATA_VALUES_SIZE 32
+
 
 static struct meta_data *meta_data_create(void)
 {
@@ -189,7 +204,7 @@ static struct meta_data *meta_data_unpack(const Octstr *data)
                 }
                 curr->group = tmp;
                 tmp = NULL;
-                curr->values = dict_create(1024, octstr_destroy_item);
+                curr->values = dict_create(META_DATA_VALUES_SIZE, octstr_destroy_item);
                 curr->next = NULL;
                 if (ret == NULL)
                     ret = curr;
@@ -232,7 +247,7 @@ static int meta_data_pack(struct meta_data *mdata, Octstr *data)
     octstr_delete(data, 0, octstr_len(data));
     do {
         octstr_format_append(data, "?%E?", mdata->group);
-        l = dict_keys(mdata->values);
+        l = (mdata->values != NULL ? dict_keys(mdata->values) : NULL);
         while(l != NULL && (tmp = gwlist_extract_first(l)) != NULL) {
             octstr_format_append(data, "%E=%E&", tmp, dict_get(mdata->values, tmp));
             octstr_destroy(tmp);
@@ -286,7 +301,11 @@ int meta_data_set_values(Octstr *data, const Dict *dict, const char *group, int
             /*
              * If we don't replace the values, copy the old Dict values to the new Dict
              */
-            if (replace == 0) {
+            if (replace == 0 && dict == NULL) {
+                /* nothing to merge, keep the old values */
+                break;
+            }
+            if (replace == 0 && curr->values != NULL) {
                 keys = dict_keys(curr->values);
                 while((key = gwlist_extract_first(keys)) != NULL) {
                     dict_put_once((Dict*)dict, key, octstr_duplicate(dict_get(curr->values, key)));
@@ -313,7 +332,9 @@ int meta_data_set_values(Octstr *data, const Dict *dict, const char *group, int
         }
     }
     i = meta_data_pack(mdata, data);
-    curr->values = NULL;
+    /* the caller keeps ownership of dict */
+    if (curr->values == dict)
+        curr->values = NULL;
 
     meta_data_destroy(mdata);
 
@@ -449,3 +470,228 @@ Octstr *meta_data_merge(const Octstr *data, const Octstr *new_data, int replace)
 
 	return ret;
 }
+
+
+static Dict *meta_data_values_duplicate(Dict *values)
+{
+    Dict *ret;
+    List *keys;
+    Octstr *key;
+
+    ret = dict_create(META_DATA_VALUES_SIZE, octstr_destroy_item);
+    if (values == NULL)
+        return ret;
+    keys = dict_keys(values);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        dict_put(ret, key, octstr_duplicate(dict_get(values, key)));
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+
+    return ret;
+}
+
+
+/*
+ * Return the parsed meta-data of the message, unpacking it only if it
+ * changed since the last call. For the setters only, which own the
+ * message for writing.
+ */
+static struct meta_data_cache *meta_data_msg_cache(Msg *msg)
+{
+    struct meta_data_cache *cache = msg->meta_cache;
+
+    gw_assert(msg_type(msg) == sms);
+
+    if (msg->sms.meta_data == NULL)
+        msg->sms.meta_data = octstr_create("");
+
+    if (cache == NULL) {
+        cache = gw_malloc(sizeof(*cache));
+        cache->packed = NULL;
+        cache->mdata = NULL;
+        msg->meta_cache = cache;
+    } else if (octstr_compare(cache->packed, msg->sms.meta_data) == 0)
+        return cache;
+
+    octstr_destroy(cache->packed);
+    meta_data_destroy(cache->mdata);
+    cache->packed = octstr_duplicate(msg->sms.meta_data);
+    cache->mdata = (octstr_len(cache->packed) > 0 ?
+                    meta_data_unpack(cache->packed) : NULL);
+
+    return cache;
+}
+
+
+/*
+ * Return the parsed meta-data of the message for reading, without
+ * touching the message. The cache is used if it is up to date, else the
+ * meta-data is unpacked into *parsed, to be destroyed by the caller.
+ */
+static struct meta_data *meta_data_msg_read(Msg *msg, struct meta_data **parsed)
+{
+    struct meta_data_cache *cache = msg->meta_cache;
+
+    gw_assert(msg_type(msg) == sms);
+
+    *parsed = NULL;
+    if (octstr_len(msg->sms.meta_data) == 0)
+        return NULL;
+    if (cache != NULL && octstr_compare(cache->packed, msg->sms.meta_data) == 0)
+        return cache->mdata;
+
+    return *parsed = meta_data_unpack(msg->sms.meta_data);
+}
+
+
+static struct meta_data *meta_data_msg_group(struct meta_data **mdata,
+                                             const char *group, int create)
+{
+    struct meta_data *curr;
+
+    for (curr = *mdata; curr != NULL; curr = curr->next) {
+        if (octstr_str_case_compare(curr->group, group) == 0)
+            return curr;
+    }
+    if (!create)
+        return NULL;
+
+    /* group doesn't exists */
+    curr = meta_data_create();
+    curr->group = octstr_create(group);
+    if (*mdata != NULL) {
+        curr->next = (*mdata)->next;
+        (*mdata)->next = curr;
+    } else {
+        *mdata = curr;
+    }
+
+    return curr;
+}
+
+
+/* Write the changed meta-data back to the message. */
+static int meta_data_msg_pack(Msg *msg, struct meta_data_cache *cache)
+{
+    if (meta_data_pack(cache->mdata, msg->sms.meta_data) == -1)
+        return -1;
+    octstr_destroy(cache->packed);
+    cache->packed = octstr_duplicate(msg->sms.meta_data);
+
+    return 0;
+}
+
+
+Octstr *meta_data_msg_get_value(Msg *msg, const char *group, const Octstr *key)
+{
+    struct meta_data *mdata, *parsed, *curr;
+    Octstr *ret = NULL;
+
+    if (msg == NULL || group == NULL || key == NULL)
+        return NULL;
+
+    mdata = meta_data_msg_read(msg, &parsed);
+    curr = meta_data_msg_group(&mdata, group, 0);
+    if (curr != NULL && curr->values != NULL)
+        ret = octstr_duplicate(dict_get(curr->values, (Octstr *) key));
+    meta_data_destroy(parsed);
+
+    return ret;
+}
+
+
+Dict *meta_data_msg_get_values(Msg *msg, const char *group)
+{
+    struct meta_data *mdata, *parsed, *curr;
+    Dict *ret = NULL;
+
+    if (msg == NULL || group == NULL)
+        return NULL;
+
+    mdata = meta_data_msg_read(msg, &parsed);
+    curr = meta_data_msg_group(&mdata, group, 0);
+    if (curr != NULL)
+        ret = meta_data_values_duplicate(curr->values);
+    meta_data_destroy(parsed);
+
+    return ret;
+}
+
+
+int meta_data_msg_set_value(Msg *msg, const char *group, const Octstr *key,
+                            const Octstr *value, int replace)
+{
+    struct meta_data_cache *cache;
+    struct meta_data *curr;
+
+    if (msg == NULL || group == NULL || value == NULL)
+        return -1;
+
+    cache = meta_data_msg_cache(msg);
+    curr = meta_data_msg_group(&cache->mdata, group, 1);
+    if (curr->values == NULL)
+        curr->values = dict_create(META_DATA_VALUES_SIZE, octstr_destroy_item);
+    if (replace) {
+        /* delete old value if any */
+        dict_put(curr->values, (Octstr *) key, NULL);
+        /* put new value */
+        dict_put(curr->values, (Octstr *) key, octstr_duplicate(value));
+    } else if (dict_get(curr->values, (Octstr *) key) == NULL) {
+        /* put new value */
+        dict_put(curr->values, (Octstr *) key, octstr_duplicate(value));
+    } else {
+        /* nothing changed */
+        return 0;
+    }
+
+    return meta_data_msg_pack(msg, cache);
+}
+
+
+int meta_data_msg_set_values(Msg *msg, const Dict *dict, const char *group, int replace)
+{
+    struct meta_data_cache *cache;
+    struct meta_data *curr;
+    Dict *values;
+    List *keys;
+    Octstr *key;
+
+    if (msg == NULL || group == NULL)
+        return -1;
+
+    cache = meta_data_msg_cache(msg);
+    curr = meta_data_msg_group(&cache->mdata, group, 0);
+    if (curr != NULL && replace == 0 && dict == NULL) {
+        /* nothing to merge, keep the old values */
+        return 0;
+    }
+    values = (dict != NULL ? meta_data_values_duplicate((Dict*) dict) : NULL);
+    if (curr == NULL)
+        curr = meta_data_msg_group(&cache->mdata, group, 1);
+    else if (replace == 0 && curr->values != NULL) {
+        /* keep the old values not given in dict */
+        keys = dict_keys(curr->values);
+        while ((key = gwlist_extract_first(keys)) != NULL) {
+            dict_put_once(values, key, octstr_duplicate(dict_get(curr->values, key)));
+            octstr_destroy(key);
+        }
+        gwlist_destroy(keys, NULL);
+    }
+    dict_destroy(curr->values);
+    curr->values = values;
+
+    return meta_data_msg_pack(msg, cache);
+}
+
+
+void meta_data_msg_cache_destroy(void *cache)
+{
+    struct meta_data_cache *c = cache;
+
+    if (c == NULL)
+        return;
+    octstr_destroy(c->packed);
+    meta_data_destroy(c->mdata);
+    gw_free(c);
+}
@@ -65,6 +65,8 @@
 #ifndef META_DATA_H
 #define META_DATA_H
 
+#include "msg.h"
+
 #define METADATA_DLR_GROUP					"dlr"
 #define METADATA_DLR_GROUP_DONETIME   		"donetime"
 #define METADATA_DLR_GROUP_SUBMITTIME 		"submittime"
@@ -80,7 +82,8 @@
  */
 Dict *meta_data_get_values(const Octstr *data, const char *group);
 /**
- * Replace Dictionary for the given group.
+ * Replace Dictionary for the given group. A NULL dict stands for
+ * an empty one.
  */
 int meta_data_set_values(Octstr *data, const Dict *dict, const char *group, int replace);
 /**
@@ -96,5 +99,23 @@ Octstr *meta_data_get_value(Octstr *data, const char *group, const Octstr *key);
  */
 Octstr *meta_data_merge(const Octstr *data, const Octstr *new_data, int replace);
 
+/*
+ * The same for the meta-data of a sms Msg. The setters keep the parsed
+ * meta-data along with the message and write msg->sms.meta_data back at
+ * once, so reading it afterwards unpacks nothing. The getters do not
+ * change the message and return NULL if it has no meta-data.
+ * Returned values and dictionaries belong to the caller.
+ */
+Octstr *meta_data_msg_get_value(Msg *msg, const char *group, const Octstr *key);
+Dict *meta_data_msg_get_values(Msg *msg, const char *group);
+int meta_data_msg_set_value(Msg *msg, const char *group, const Octstr *key,
+                            const Octstr *value, int replace);
+int meta_data_msg_set_values(Msg *msg, const Dict *dict, const char *group, int replace);
+
+/*
+ * Free the parsed meta-data of a Msg, called by msg_destroy().
+ */
+void meta_data_msg_cache_destroy(void *cache);
+
 
 #endif
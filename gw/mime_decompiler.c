@@ -91,7 +91,7 @@ int mime_decompile(Octstr *binary_mime, Octstr **mime)
     char *boundary = "kannel_boundary";
     ParseContext *context;
     long mime_parts;
-    long i, j;
+    long i;
     unsigned long headers_len, data_len;
 
     i = mime_parts = headers_len = data_len = 0;
@@ -121,7 +121,6 @@ int mime_decompile(Octstr *binary_mime, Octstr **mime)
 
     while(parse_octets_left(context) > 0) {
         Octstr *headers, *data;
-        List *gwlist_headers;
         i++;
     
         octstr_append(*mime, octstr_imm("--"));
@@ -134,11 +133,9 @@ int mime_decompile(Octstr *binary_mime, Octstr **mime)
                          "data length <0x%02lx>", i, headers_len, data_len);
 
         if((headers = parse_get_octets(context, headers_len)) != NULL) {
-            gwlist_headers = wsp_headers_unpack(headers, 1);
-            for(j=0; j<gwlist_len(gwlist_headers);j++) {
-                octstr_append(*mime, gwlist_get(gwlist_headers, j));
-                octstr_append(*mime, octstr_imm("\n"));
-            }
+            /* decoded straight into the text mime */
+            wsp_headers_unpack_text(*mime, headers, 1, "\n");
+            octstr_destroy(headers);
         } else {
             error(0, "MIMEDEC[%ld]: headers length is out of range, ending", i);
             return -1; 
@@ -70,6 +70,7 @@
 
 #include "msg.h"
 #include "gwlib/gwlib.h"
+#include "meta_data.h"
 
 /**********************************************************************
  * Prototypes for private functions.
@@ -98,6 +99,9 @@ Msg *msg_create_real(enum msg_type type, const char *file, long line,
     msg = gw_malloc_trace(sizeof(Msg), file, line, func);
 
     msg->type = type;
+    msg->queued_usec = 0;
+    msg->submitted_usec = 0;
+    msg->meta_cache = NULL;
 #define INTEGER(name) p->name = MSG_PARAM_UNDEFINED;
 #define OCTSTR(name) p->name = NULL;
 #define UUID(name) uuid_generate(p->name);
@@ -113,6 +117,8 @@ Msg *msg_duplicate(Msg *msg)
     Msg *new;
 
     new = msg_create(msg->type);
+    new->queued_usec = msg->queued_usec;
+    new->submitted_usec = msg->submitted_usec;
 
 #define INTEGER(name) p->name = q->name;
 #define OCTSTR(name) \
@@ -141,6 +147,7 @@ void msg_destroy(Msg *msg)
 #define MSG(type, stmt) { struct type *p = &msg->type; stmt }
 #include "msg-decl.h"
 
+    meta_data_msg_cache_destroy(msg->meta_cache);
     gw_free(msg);
 }
 
@@ -79,6 +79,20 @@ enum msg_type {
 typedef struct {
 	enum msg_type type;
 
+	/*
+	 * Local timestamps for the latency metrics, in microseconds of
+	 * histogram_now(), or 0 if not taken. They are copied along by
+	 * msg_duplicate(), but never packed.
+	 */
+	long long queued_usec;
+	long long submitted_usec;
+
+	/*
+	 * Parsed sms.meta_data, kept by the meta_data_msg_* functions
+	 * of meta_data.h. Never copied nor packed.
+	 */
+	void *meta_cache;
+
 	#define INTEGER(name) long name;
 	#define OCTSTR(name) Octstr *name;
 	#define UUID(name) uuid_t name;
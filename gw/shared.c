@@ -145,6 +145,36 @@ void write_to_bearerbox(Msg *pmsg)
 }
 
 
+void write_batch_to_bearerbox_real(Connection *conn, List *msgs)
+{
+    Octstr *batch, *pack;
+    unsigned char buf[4];
+    Msg *msg;
+
+    /* same framing as conn_write_withlen(), but one write for all */
+    batch = octstr_create("");
+    while ((msg = gwlist_extract_first(msgs)) != NULL) {
+        pack = msg_pack(msg);
+        encode_network_long(buf, octstr_len(pack));
+        octstr_append_data(batch, (char*) buf, 4);
+        octstr_append(batch, pack);
+        octstr_destroy(pack);
+        msg_destroy(msg);
+    }
+
+    if (octstr_len(batch) > 0 && conn_write(conn, batch) == -1)
+        error(0, "Couldn't write Msgs to bearerbox.");
+
+    octstr_destroy(batch);
+}
+
+
+void write_batch_to_bearerbox(List *msgs)
+{
+    write_batch_to_bearerbox_real(bb_conn, msgs);
+}
+
+
 int deliver_to_bearerbox_real(Connection *conn, Msg *msg) 
 {
      
@@ -114,6 +114,14 @@ void write_to_bearerbox_real(Connection *conn, Msg *pmsg);
 void write_to_bearerbox(Msg *msg);
 
 
+/*
+ * Send all Msgs of 'msgs' to the bearerbox with a single write, destroy
+ * them and leave the list empty.
+ */
+void write_batch_to_bearerbox_real(Connection *conn, List *msgs);
+void write_batch_to_bearerbox(List *msgs);
+
+
 /*
  * Delivers a SMS to the bearerbox and returns an error code: 0 if
  * successfull. -1 if transfer failed.
@@ -63,6 +63,7 @@
 #include <signal.h>
 #include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 /* libxml & xpath things */
 #include <libxml/tree.h>
@@ -98,6 +99,14 @@
 
 #define ACCOUNT_MAX_LEN 64
 
+/* bulk sendsms messages written to bearerbox at once */
+#define SENDSMS_BULK_BATCH 100
+
+/* Defaults for holding sendsms requests while bearerbox gives no credit */
+#define SENDSMS_ADMISSION_QUEUE     0
+#define SENDSMS_ADMISSION_TIMEOUT   10 /* in sec. */
+#define SENDSMS_RETRY_AFTER         "1" /* in sec., bearerbox credit interval */
+
 /* Defaults for the HTTP request queueing inside http_queue_thread */
 #define HTTP_MAX_RETRIES    0
 #define HTTP_RETRY_DELAY    10 /* in sec. */
@@ -121,6 +130,8 @@ static Octstr *smsbox_id = NULL;
 static Octstr *sendsms_url = NULL;
 static Octstr *sendota_url = NULL;
 static Octstr *xmlrpc_url = NULL;
+static Octstr *sendsms_bulk_url = NULL;
+static Octstr *sendsms_status_url = NULL;
 static Octstr *bb_host;
 static Octstr *accepted_chars = NULL;
 static int only_try_http = 0;
@@ -159,6 +170,55 @@ static int immediate_sendsms_reply = 0;
 static Dict *client_dict = NULL;
 static List *sendsms_reply_hdrs = NULL;
 
+/*
+ * A sendsms request, handed from the accept loops to the pool of
+ * sendsms workers or to the held requests.
+ */
+typedef struct SendsmsRequest {
+    HTTPClient *client;
+    Octstr *ip;
+    Octstr *url;
+    List *hdrs;
+    Octstr *body;
+    List *args;
+    time_t arrived;
+    long msgs;                  /* messages it is expected to pass */
+    long reserved;              /* credit reserved and not yet used */
+    unsigned long generation;   /* announcement the credit came from */
+} SendsmsRequest;
+
+/* workers handling the sendsms requests, see sendsms-threads */
+static gw_pool_t *sendsms_pool = NULL;
+
+/*
+ * Sendsms admission control. bb_credit is the number of messages
+ * bearerbox accepts from us until its next announcement, -1 as long as
+ * it announces none. Requests arriving without credit are held in
+ * held_requests, at most admission_queue of them, or rejected.
+ *
+ * An admitted request reserves the credit for its messages, so
+ * concurrent requests can not overshoot it. The worker running the
+ * request finds its reservation through admission_key, and gives back
+ * what is left when done, unless a new announcement came in meanwhile.
+ */
+
+static Mutex *admission_lock = NULL;
+static long bb_credit = -1;
+static long bb_announced = -1;      /* credit of the last announcement */
+static long admission_queue = SENDSMS_ADMISSION_QUEUE;
+static long admission_timeout = SENDSMS_ADMISSION_TIMEOUT;
+static long admission_held = 0;    /* held requests not yet answered */
+static List *held_requests = NULL;
+static long held_thread_id = -1;
+static unsigned long admission_generation = 0;
+static pthread_key_t admission_key;
+
+/* admission metrics */
+static unsigned long admitted_requests = 0;
+static unsigned long delayed_requests = 0;
+static unsigned long rejected_requests = 0;
+static unsigned long expired_requests = 0;
+
 /***********************************************************************
  * Communication with the bearerbox.
  */
@@ -234,6 +294,51 @@ static void delayed_http_reply(Msg *msg)
 }
 
 
+/*
+ * Take a new credit announcement from bearerbox.
+ */
+static void admission_credit_update(long credit)
+{
+    mutex_lock(admission_lock);
+    if (credit == 0 && bb_announced != 0)
+        info(0, "Bearerbox gives no credit, %s sendsms requests "
+             "(admitted %lu, delayed %lu, rejected %lu, expired %lu).",
+             admission_queue > 0 ? "holding" : "rejecting",
+             admitted_requests, delayed_requests, rejected_requests,
+             expired_requests);
+    else if (credit > 0 && bb_announced <= 0)
+        info(0, "Bearerbox gives credit for %ld messages, admitting "
+             "sendsms requests.", credit);
+    bb_credit = bb_announced = credit;
+    admission_generation++;
+    mutex_unlock(admission_lock);
+
+    if (credit > 0 && held_thread_id != -1)
+        gwthread_wakeup(held_thread_id);
+}
+
+
+/*
+ * Account messages passed to bearerbox against the credit, the
+ * reservation of the running request first.
+ */
+static void admission_consume(long msgs)
+{
+    long *reserved, used;
+
+    reserved = pthread_getspecific(admission_key);
+    mutex_lock(admission_lock);
+    if (reserved != NULL) {
+        used = (*reserved < msgs ? *reserved : msgs);
+        *reserved -= used;
+        msgs -= used;
+    }
+    if (bb_credit > 0)
+        bb_credit = (bb_credit > msgs ? bb_credit - msgs : 0);
+    mutex_unlock(admission_lock);
+}
+
+
 /*
  * Read an Msg from the bearerbox and send it to the proper receiver
  * via a List. At the moment all messages are sent to the smsbox_requests
@@ -285,6 +390,10 @@ static void read_messages_from_bearerbox(void)
 	    if (!immediate_sendsms_reply)
 		delayed_http_reply(msg);
 	    msg_destroy(msg);
+	} else if (msg_type(msg) == heartbeat) {
+	    /* bearerbox announces its credit as load value */
+	    admission_credit_update(msg->heartbeat.load);
+	    msg_destroy(msg);
 	} else {
 	    warning(0, "Received other message than sms/admin, ignoring!");
 	    msg_destroy(msg);
@@ -307,12 +416,10 @@ static void read_messages_from_bearerbox(void)
 static Counter *catenated_sms_counter;
  
 /*
- * Send a message to the bearerbox for delivery to a phone. Use
- * configuration from `trans' to format the message before sending.
- * Return >= 0 for success & count of splitted sms messages, 
- * -1 for failure.  Does not destroy the msg.
+ * Split msg and send the parts to bearerbox, or append them to 'batch'
+ * if it isn't NULL, to be written later with write_batch_to_bearerbox().
  */
-static int send_message(URLTranslation *trans, Msg *msg)
+static int send_message_batch(URLTranslation *trans, Msg *msg, List *batch)
 {
     int max_msgs;
     Octstr *header, *footer, *suffix, *split_chars;
@@ -405,19 +512,40 @@ static int send_message(URLTranslation *trans, Msg *msg)
             octstr_append(new_msg->sms.msgdata, part->sms.msgdata);
             msg_destroy(part);
         }
-        write_to_bearerbox(new_msg);
+        if (batch != NULL)
+            gwlist_append(batch, new_msg);
+        else
+            write_to_bearerbox(new_msg);
     } else {
         /* msgs are the independent parts so sent those as is */
-        while ((part = gwlist_extract_first(list)) != NULL)
-            write_to_bearerbox(part);
+        while ((part = gwlist_extract_first(list)) != NULL) {
+            if (batch != NULL)
+                gwlist_append(batch, part);
+            else
+                write_to_bearerbox(part);
+        }
     }
     
     gwlist_destroy(list, NULL);
 
+    admission_consume(msg_count);
+
     return msg_count;
 }
 
 
+/*
+ * Send a message to the bearerbox for delivery to a phone. Use
+ * configuration from `trans' to format the message before sending.
+ * Return >= 0 for success & count of splitted sms messages, 
+ * -1 for failure.  Does not destroy the msg.
+ */
+static int send_message(URLTranslation *trans, Msg *msg)
+{
+    return send_message_batch(trans, msg, NULL);
+}
+
+
 /***********************************************************************
  * Stuff to remember which receiver belongs to which HTTP query.
  * This also includes HTTP request data to queue a failed HTTP request
@@ -1942,7 +2070,7 @@ static Octstr* store_uuid(Msg *msg)
     debug("sms.http", 0, "Stored UUID %s", octstr_get_cstr(stored_uuid));
 
     /* this octstr is then used to store the HTTP client into 
-     * client_dict, if need to, in sendsms_thread */
+     * client_dict, if need to, in the sendsms workers */
 
     return stored_uuid;
 }
@@ -1957,7 +2085,8 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
 				 int validity, int deferred,
 				 int *status, int dlr_mask, Octstr *dlr_url, 
 				 Octstr *account, int pid, int alt_dcs, int rpi,
-				 List *receiver, Octstr *binfo, int priority, Octstr *meta_data)
+				 List *receiver, Octstr *binfo, int priority, Octstr *meta_data,
+				 List *batch)
 {				     
     Msg *msg = NULL;
     Octstr *newfrom = NULL;
@@ -2296,7 +2425,8 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
      */
     failed_id = gwlist_create();
 
-    if (!immediate_sendsms_reply) {
+    /* bulk requests are answered at once, without client */
+    if (!immediate_sendsms_reply && client != NULL) {
         stored_uuid = store_uuid(msg);
         dict_put(client_dict, stored_uuid, client);
     }
@@ -2308,7 +2438,7 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
 
         msg->sms.time = time(NULL);
         /* send the message and return number of splits */
-        ret = send_message(t, msg);
+        ret = send_message_batch(t, msg, batch);
 
         if (ret == -1) {
             /* add the receiver to the failed list */
@@ -2371,7 +2501,7 @@ transmit_error:
     *status = HTTP_INTERNAL_SERVER_ERROR;
     returnerror = octstr_create("Sending failed.");
 
-    if (!immediate_sendsms_reply)
+    if (stored_uuid != NULL)
         dict_remove(client_dict, stored_uuid);
 
     /* 
@@ -2406,10 +2536,7 @@ static URLTranslation *authorise_username(Octstr *username, Octstr *password,
     if (octstr_compare(password, urltrans_password(t))!=0)
 	return NULL;
     else {
-	Octstr *allow_ip = urltrans_allow_ip(t);
-	Octstr *deny_ip = urltrans_deny_ip(t);
-	
-        if (is_allowed_ip(allow_ip, deny_ip, client_ip) == 0) {
+        if (urltrans_is_allowed_ip(t, client_ip) == 0) {
 	    warning(0, "Non-allowed connect tried by <%s> from <%s>, ignored",
 		    octstr_get_cstr(username), octstr_get_cstr(client_ip));
 	    return NULL;
@@ -2459,13 +2586,14 @@ static URLTranslation *authorise_user(List *list, Octstr *client_ip)
 
 
 /*
- * Create and send an SMS message from an HTTP request.
- * Args: args contains the CGI parameters
+ * Create and send an SMS message for an already authorised user.
+ * Args: args contains the CGI parameters, batch is passed on to
+ * smsbox_req_handle()
  */
-static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
-				  HTTPClient *client)
+static Octstr *smsbox_req_sendsms_args(URLTranslation *t, List *args,
+				       Octstr *client_ip, int *status,
+				       HTTPClient *client, List *batch)
 {
-    URLTranslation *t = NULL;
     Octstr *tmp_string;
     Octstr *from, *to, *charset, *text, *udh, *smsc, *dlr_url, *account;
     Octstr *binfo, *meta_data;
@@ -2476,13 +2604,6 @@ static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
     mclass = mwi = coding = compress = validity = deferred = dlr_mask = 
         pid = alt_dcs = rpi = priority = SMS_PARAM_UNDEFINED;
  
-    /* check the username and password */
-    t = authorise_user(args, client_ip);
-    if (t == NULL) {
-	*status = HTTP_FORBIDDEN;
-	return octstr_create("Authorization failed for sendsms");
-    }
-    
     udh = http_cgi_variable(args, "udh");
     text = http_cgi_variable(args, "text");
     charset = http_cgi_variable(args, "charset");
@@ -2566,11 +2687,107 @@ static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
     return smsbox_req_handle(t, client_ip, client, from, to, text, charset, udh,
 			     smsc, mclass, mwi, coding, compress, validity, 
 			     deferred, status, dlr_mask, dlr_url, account,
-			     pid, alt_dcs, rpi, NULL, binfo, priority, meta_data);
+			     pid, alt_dcs, rpi, NULL, binfo, priority, meta_data,
+			     batch);
     
 }
 
 
+/*
+ * Create and send an SMS message from an HTTP request.
+ * Args: args contains the CGI parameters
+ */
+static Octstr *smsbox_req_sendsms(List *args, Octstr *client_ip, int *status,
+				  HTTPClient *client)
+{
+    URLTranslation *t;
+
+    /* check the username and password */
+    t = authorise_user(args, client_ip);
+    if (t == NULL) {
+	*status = HTTP_FORBIDDEN;
+	return octstr_create("Authorization failed for sendsms");
+    }
+
+    return smsbox_req_sendsms_args(t, args, client_ip, status, client, NULL);
+}
+
+
+/*
+ * Send many SMS messages from one HTTP POST request. The user is
+ * authorised once by the CGI parameters of the URL. Each non-empty line
+ * of the body is one entry, formatted like a sendsms query string
+ * ("to=...&text=..."); its variables override the ones of the URL. The
+ * messages are written to bearerbox in batches, and the answer has one
+ * line "<line>: <status> <answer>" for each entry.
+ */
+static Octstr *smsbox_req_sendsms_bulk(List *args, Octstr *body,
+				       Octstr *client_ip, int *status)
+{
+    URLTranslation *t;
+    List *batch, *entry, *vars;
+    Octstr *line, *answer, *result;
+    long pos, end, lineno, entries;
+    int entry_status, i;
+
+    t = authorise_user(args, client_ip);
+    if (t == NULL) {
+	*status = HTTP_FORBIDDEN;
+	return octstr_create("Authorization failed for sendsms");
+    }
+
+    result = octstr_create("");
+    batch = gwlist_create();
+    entries = 0;
+    lineno = 0;
+    for (pos = 0; pos < octstr_len(body); pos = end + 1) {
+        if ((end = octstr_search_char(body, '\n', pos)) == -1)
+            end = octstr_len(body);
+        lineno++;
+        line = octstr_copy(body, pos, end - pos);
+        octstr_strip_crlfs(line);
+        if (octstr_len(line) == 0) {
+            octstr_destroy(line);
+            continue;
+        }
+
+        /* entry variables first, so they override the URL ones */
+        entry = http_cgi_parse(line);
+        vars = gwlist_create();
+        for (i = 0; i < gwlist_len(entry); i++)
+            gwlist_append(vars, gwlist_get(entry, i));
+        for (i = 0; i < gwlist_len(args); i++)
+            gwlist_append(vars, gwlist_get(args, i));
+
+        answer = smsbox_req_sendsms_args(t, vars, client_ip, &entry_status,
+                                         NULL, batch);
+        octstr_format_append(result, "%ld: %d %S\n", lineno, entry_status, answer);
+
+        octstr_destroy(answer);
+        gwlist_destroy(vars, NULL);
+        http_destroy_cgiargs(entry);
+        octstr_destroy(line);
+
+        if (gwlist_len(batch) >= SENDSMS_BULK_BATCH)
+            write_batch_to_bearerbox(batch);
+        entries++;
+    }
+    write_batch_to_bearerbox(batch);
+    gwlist_destroy(batch, NULL);
+
+    if (entries == 0) {
+        octstr_destroy(result);
+        *status = HTTP_BAD_REQUEST;
+        return octstr_create("No entries in bulk request, rejected");
+    }
+
+    info(0, "sendsms bulk request with %ld entries from <%s>", entries,
+         octstr_get_cstr(client_ip));
+    *status = HTTP_ACCEPTED;
+    return result;
+}
+
+
 /*
  * Create and send an SMS message from an HTTP request.
  * Args: args contains the CGI parameters
@@ -2670,7 +2887,7 @@ static Octstr *smsbox_sendsms_post(List *headers, Octstr *body,
 				    udh, smsc, mclass, mwi, coding, compress, 
 				    validity, deferred, status, dlr_mask, 
 				    dlr_url, account, pid, alt_dcs, rpi, tolist,
-				    binfo, priority, meta_data);
+				    binfo, priority, meta_data, NULL);
 
     }
     octstr_destroy(user);
@@ -3150,16 +3367,312 @@ error:
 }
 
 
+/*
+ * Tell the credit and the admission metrics of the sendsms requests.
+ */
+static Octstr *sendsms_admission_status(void)
+{
+    Octstr *ret;
+
+    mutex_lock(admission_lock);
+    if (bb_credit < 0)
+        ret = octstr_create("Credit: none announced\n");
+    else
+        ret = octstr_format("Credit: %ld of %ld\n", bb_credit, bb_announced);
+    octstr_format_append(ret, "Held: %ld\n"
+                         "Admitted: %lu\n"
+                         "Delayed: %lu\n"
+                         "Rejected: %lu\n"
+                         "Expired: %lu\n",
+                         admission_held, admitted_requests, delayed_requests,
+                         rejected_requests, expired_requests);
+    mutex_unlock(admission_lock);
+
+    return ret;
+}
+
+
+/*
+ * Handle a HTTP request to the sendsms port and reply to it, unless
+ * the reply is delayed until bearerbox acknowledges the message.
+ */
+static void sendsms_request(HTTPClient *client, Octstr *ip, Octstr *url,
+                            List *hdrs, Octstr *body, List *args)
+{
+    Octstr *answer;
+    int status = HTTP_OK, immediate;
+
+    immediate = immediate_sendsms_reply;
+
+    /*
+     * determine which kind of HTTP request this is any
+     * call the necessary routine for it
+     */
+
+    /* sendsms */
+    if (octstr_compare(url, sendsms_url) == 0) {
+        /*
+         * decide if this is a GET or POST request and let the
+         * related routine handle the checking
+         */
+        if (body == NULL)
+            answer = smsbox_req_sendsms(args, ip, &status, client);
+        else
+            answer = smsbox_sendsms_post(hdrs, body, ip, &status, client);
+    }
+    /* bulk sendsms */
+    else if (octstr_compare(url, sendsms_bulk_url) == 0) {
+        if (body == NULL) {
+            answer = octstr_create("Incomplete request.");
+            status = HTTP_BAD_REQUEST;
+        } else
+            answer = smsbox_req_sendsms_bulk(args, body, ip, &status);
+        /* there is no single message to wait for */
+        immediate = 1;
+    }
+    /* XML-RPC */
+    else if (octstr_compare(url, xmlrpc_url) == 0) {
+        /*
+         * XML-RPC request needs to have a POST body
+         */
+        if (body == NULL) {
+            answer = octstr_create("Incomplete request.");
+            status = HTTP_BAD_REQUEST;
+        } else
+            answer = smsbox_xmlrpc_post(hdrs, body, ip, &status);
+    }
+    /* sendota */
+    else if (octstr_compare(url, sendota_url) == 0) {
+        if (body == NULL)
+            answer = smsbox_req_sendota(args, ip, &status, client);
+        else
+            answer = smsbox_sendota_post(hdrs, body, ip, &status, client);
+    }
+    /* admission metrics */
+    else if (octstr_compare(url, sendsms_status_url) == 0) {
+        answer = sendsms_admission_status();
+        status = HTTP_OK;
+    }
+    /* add aditional URI compares here */
+    else {
+        answer = octstr_create("Unknown request.");
+        status = HTTP_NOT_FOUND;
+    }
+
+    debug("sms.http", 0, "Status: %d Answer: <%s>", status,
+            octstr_get_cstr(answer));
+
+    octstr_destroy(ip);
+    octstr_destroy(url);
+    http_destroy_headers(hdrs);
+    octstr_destroy(body);
+    http_destroy_cgiargs(args);
+
+    if (immediate || status != HTTP_ACCEPTED)
+        http_send_reply(client, status, sendsms_reply_hdrs, answer);
+    else {
+        debug("sms.http", 0, "Delayed reply - wait for bearerbox");
+    }
+    octstr_destroy(answer);
+}
+
+
+/*
+ * Tell the client to come back later, bearerbox is too busy.
+ */
+static void sendsms_reject(HTTPClient *client, Octstr *ip, Octstr *url,
+                           List *hdrs, Octstr *body, List *args)
+{
+    List *reply_hdrs;
+    Octstr *answer;
+
+    debug("sms.http", 0, "Rejecting request <%s> from <%s>, no credit",
+          octstr_get_cstr(url), octstr_get_cstr(ip));
+
+    reply_hdrs = http_header_duplicate(sendsms_reply_hdrs);
+    http_header_add(reply_hdrs, "Retry-After", SENDSMS_RETRY_AFTER);
+    answer = octstr_create("Temporal failure, try again later.");
+    http_send_reply(client, HTTP_SERVICE_UNAVAILABLE, reply_hdrs, answer);
+
+    octstr_destroy(answer);
+    http_destroy_headers(reply_hdrs);
+    octstr_destroy(ip);
+    octstr_destroy(url);
+    http_destroy_headers(hdrs);
+    octstr_destroy(body);
+    http_destroy_cgiargs(args);
+}
+
+
+/*
+ * Number of messages a request is expected to pass to bearerbox, one
+ * per non-empty line for the bulk requests.
+ */
+static long sendsms_request_msgs(Octstr *url, Octstr *body)
+{
+    long pos, msgs;
+    int c, empty;
+
+    if (octstr_compare(url, sendsms_bulk_url) != 0 || body == NULL)
+        return 1;
+
+    msgs = 0;
+    empty = 1;
+    for (pos = 0; pos < octstr_len(body); pos++) {
+        c = octstr_get_char(body, pos);
+        if (c == '\n') {
+            msgs += !empty;
+            empty = 1;
+        } else if (c != '\r')
+            empty = 0;
+    }
+    msgs += !empty;
+
+    return (msgs > 0 ? msgs : 1);
+}
+
+
+/*
+ * Reserve the credit for the messages of a request. A request larger
+ * than the credit gets what there is once a whole announcement is
+ * left, so it does not wait forever. Return 1 if the request may go
+ * on. The caller holds admission_lock.
+ */
+static int admission_reserve(SendsmsRequest *req)
+{
+    req->reserved = 0;
+    req->generation = admission_generation;
+
+    if (bb_credit < 0)
+        return 1;
+    if (bb_credit == 0 || (bb_credit < req->msgs && bb_credit < bb_announced))
+        return 0;
+
+    req->reserved = (bb_credit < req->msgs ? bb_credit : req->msgs);
+    bb_credit -= req->reserved;
+
+    return 1;
+}
+
+
+/*
+ * Give back the credit a request reserved and did not use.
+ */
+static void admission_release(SendsmsRequest *req)
+{
+    int wakeup = 0;
+
+    mutex_lock(admission_lock);
+    if (req->reserved > 0 && req->generation == admission_generation &&
+            bb_credit >= 0) {
+        bb_credit += req->reserved;
+        wakeup = (admission_held > 0);
+    }
+    req->reserved = 0;
+    mutex_unlock(admission_lock);
+
+    if (wakeup && held_thread_id != -1)
+        gwthread_wakeup(held_thread_id);
+}
+
+
+/*
+ * Decide about a request passing messages to bearerbox. Return 1 if it
+ * is to be handled right away, 0 if it is to be held and -1 if it is
+ * rejected. Held requests keep their order, new ones queue up behind.
+ */
+static int sendsms_admit(SendsmsRequest *req)
+{
+    int ret;
+
+    mutex_lock(admission_lock);
+    if (admission_held == 0 && admission_reserve(req)) {
+        admitted_requests++;
+        ret = 1;
+    } else if (admission_held < admission_queue) {
+        admission_held++;
+        delayed_requests++;
+        ret = 0;
+    } else {
+        rejected_requests++;
+        ret = -1;
+    }
+    mutex_unlock(admission_lock);
+
+    return ret;
+}
+
+
+/*
+ * Handle an admitted request in one of the sendsms workers.
+ */
+static void sendsms_task(void *arg)
+{
+    SendsmsRequest *req = arg;
+
+    pthread_setspecific(admission_key, &req->reserved);
+    sendsms_request(req->client, req->ip, req->url, req->hdrs,
+                    req->body, req->args);
+    pthread_setspecific(admission_key, NULL);
+    admission_release(req);
+    gw_free(req);
+}
+
+
+/*
+ * Pass the held requests in order to the sendsms workers as soon as
+ * bearerbox gives credit again, reject those waiting longer than
+ * sendsms-admission-timeout.
+ */
+static void sendsms_held_thread(void *arg)
+{
+    SendsmsRequest *req;
+    double left;
+    int credit;
+
+    while ((req = gwlist_consume(held_requests)) != NULL) {
+        for (;;) {
+            mutex_lock(admission_lock);
+            credit = admission_reserve(req);
+            mutex_unlock(admission_lock);
+            left = admission_timeout - difftime(time(NULL), req->arrived);
+            if (credit || left <= 0 || program_status == shutting_down)
+                break;
+            gwthread_sleep(left);
+        }
+
+        mutex_lock(admission_lock);
+        admission_held--;
+        if (!credit)
+            expired_requests++;
+        mutex_unlock(admission_lock);
+
+        if (credit)
+            gw_pool_execute(sendsms_pool, sendsms_task, req);
+        else {
+            sendsms_reject(req->client, req->ip, req->url, req->hdrs,
+                           req->body, req->args);
+            gw_free(req);
+        }
+    }
+}
+
+
+/*
+ * Accept loop of the sendsms port. The requests are handled by the
+ * sendsms workers, so a slow request does not hold up the loop.
+ */
 static void sendsms_thread(void *arg)
- {
+{
     HTTPClient *client;
-    Octstr *ip, *url, *body, *answer;
+    Octstr *ip, *url, *body;
     List *hdrs, *args;
-    int status;
-    
+    SendsmsRequest *req;
+    int admit;
+
     for (;;) {
     	/* reset request wars */
-    	ip = url = body = answer = NULL;
+    	ip = url = body = NULL;
     	hdrs = args = NULL;
 
         client = http_accept_request(sendsms_port, &ip, &url, &hdrs, &body, &args);
@@ -3169,61 +3682,40 @@ static void sendsms_thread(void *arg)
         info(0, "smsbox: Got HTTP request <%s> from <%s>",
                 octstr_get_cstr(url), octstr_get_cstr(ip));
 
-        /*
-         * determine which kind of HTTP request this is any
-         * call the necessary routine for it
-         */
+        req = gw_malloc(sizeof(*req));
+        req->client = client;
+        req->ip = ip;
+        req->url = url;
+        req->hdrs = hdrs;
+        req->body = body;
+        req->args = args;
+        req->arrived = time(NULL);
+        req->msgs = sendsms_request_msgs(url, body);
+        req->reserved = 0;
+        req->generation = 0;
+
+        /* only requests passing messages to bearerbox need credit */
+        if (octstr_compare(url, sendsms_url) == 0 ||
+                octstr_compare(url, sendsms_bulk_url) == 0 ||
+                octstr_compare(url, xmlrpc_url) == 0 ||
+                octstr_compare(url, sendota_url) == 0)
+            admit = sendsms_admit(req);
+        else
+            admit = 1;
 
-        /* sendsms */
-        if (octstr_compare(url, sendsms_url) == 0) {
-            /*
-             * decide if this is a GET or POST request and let the
-             * related routine handle the checking
-             */
-            if (body == NULL)
-                answer = smsbox_req_sendsms(args, ip, &status, client);
-            else
-                answer = smsbox_sendsms_post(hdrs, body, ip, &status, client);
-        }
-        /* XML-RPC */
-        else if (octstr_compare(url, xmlrpc_url) == 0) {
-            /*
-             * XML-RPC request needs to have a POST body
-             */
-            if (body == NULL) {
-                answer = octstr_create("Incomplete request.");
-                status = HTTP_BAD_REQUEST;
-            } else
-                answer = smsbox_xmlrpc_post(hdrs, body, ip, &status);
-        }
-        /* sendota */
-        else if (octstr_compare(url, sendota_url) == 0) {
-            if (body == NULL)
-                answer = smsbox_req_sendota(args, ip, &status, client);
-            else
-                answer = smsbox_sendota_post(hdrs, body, ip, &status, client);
-        }
-        /* add aditional URI compares here */
-        else {
-            answer = octstr_create("Unknown request.");
-            status = HTTP_NOT_FOUND;
+        if (admit < 0) {
+            sendsms_reject(client, ip, url, hdrs, body, args);
+            gw_free(req);
+            continue;
         }
 
-        debug("sms.http", 0, "Status: %d Answer: <%s>", status,
-                octstr_get_cstr(answer));
-
-        octstr_destroy(ip);
-        octstr_destroy(url);
-        http_destroy_headers(hdrs);
-        octstr_destroy(body);
-        http_destroy_cgiargs(args);
-
-        if (immediate_sendsms_reply || status != HTTP_ACCEPTED)
-            http_send_reply(client, status, sendsms_reply_hdrs, answer);
+        if (admit == 1)
+            gw_pool_execute(sendsms_pool, sendsms_task, req);
         else {
-            debug("sms.http", 0, "Delayed reply - wait for bearerbox");
+            debug("sms.http", 0, "Holding request <%s> from <%s>, no credit",
+                  octstr_get_cstr(url), octstr_get_cstr(ip));
+            gwlist_produce(held_requests, req);
         }
-        octstr_destroy(answer);
     }
 
 }
@@ -3298,8 +3790,8 @@ static Cfg *init_smsbox(Cfg *cfg)
     Octstr *http_proxy_password = NULL;
     Octstr *http_proxy_exceptions_regex = NULL;
     int ssl = 0;
-    int lf, m;
-    long max_req;
+    int lf, m, ret;
+    long max_req, http_loops, sendsms_threads, i;
 
     bb_port = BB_DEFAULT_SMSBOX_PORT;
     bb_ssl = 0;
@@ -3409,6 +3901,14 @@ static Cfg *init_smsbox(Cfg *cfg)
     }
 
     cfg_get_integer(&sendsms_port, grp, octstr_imm("sendsms-port"));
+
+    /* accept loops for the sendsms port, feeding the sendsms workers */
+    if (cfg_get_integer(&http_loops, grp, octstr_imm("http-server-loops")) == -1 ||
+        http_loops < 1)
+        http_loops = 1;
+    http_set_server_loops(http_loops);
+    if (cfg_get_integer(&sendsms_threads, grp, octstr_imm("sendsms-threads")) == -1)
+        sendsms_threads = 0;
     
     /* check if want to bind to a specific interface */
     sendsms_interface = cfg_get(grp, octstr_imm("sendsms-interface"));    
@@ -3429,6 +3929,23 @@ static Cfg *init_smsbox(Cfg *cfg)
         xmlrpc_url = octstr_imm("/cgi-bin/xmlrpc");
     if ((sendota_url = cfg_get(grp, octstr_imm("sendota-url"))) == NULL)
         sendota_url = octstr_imm("/cgi-bin/sendota");
+    if ((sendsms_bulk_url = cfg_get(grp, octstr_imm("sendsms-bulk-url"))) == NULL)
+        sendsms_bulk_url = octstr_imm("/cgi-bin/sendsms-bulk");
+    if ((sendsms_status_url = cfg_get(grp, octstr_imm("sendsms-status-url"))) == NULL)
+        sendsms_status_url = octstr_imm("/cgi-bin/sendsms-status");
+
+    /* hold or reject sendsms requests while bearerbox gives no credit */
+    if (cfg_get_integer(&admission_queue, grp, octstr_imm("sendsms-admission-queue")) == -1)
+        admission_queue = SENDSMS_ADMISSION_QUEUE;
+    if (cfg_get_integer(&admission_timeout, grp, octstr_imm("sendsms-admission-timeout")) == -1)
+        admission_timeout = SENDSMS_ADMISSION_TIMEOUT;
+    admission_lock = mutex_create();
+    if ((ret = pthread_key_create(&admission_key, NULL)) != 0)
+        panic(ret, "pthread_key_create failed");
+    held_requests = gwlist_create();
+    gwlist_add_producer(held_requests);
+    if (admission_queue > 0)
+        held_thread_id = gwthread_create(sendsms_held_thread, NULL);
 
     global_sender = cfg_get(grp, octstr_imm("global-sender"));
     accepted_chars = cfg_get(grp, octstr_imm("sendsms-chars"));
@@ -3495,8 +4012,11 @@ static Cfg *init_smsbox(Cfg *cfg)
             else
                 panic(0, "Failed to open HTTP socket");
         } else {
-            info(0, "Set up send sms service at port %ld", sendsms_port);
-            gwthread_create(sendsms_thread, NULL);
+            sendsms_pool = gw_pool_create(sendsms_threads);
+            info(0, "Set up send sms service at port %ld with %ld workers",
+                 sendsms_port, gw_pool_threads(sendsms_pool));
+            for (i = 0; i < http_loops; i++)
+                gwthread_create(sendsms_thread, NULL);
         }
     }
 
@@ -3617,6 +4137,13 @@ int main(int argc, char **argv)
     heartbeat_stop(ALL_HEARTBEATS);
     http_close_all_ports();
     gwthread_join_every(sendsms_thread);
+    gwlist_remove_producer(held_requests);
+    if (held_thread_id != -1) {
+        gwthread_wakeup(held_thread_id);
+        gwthread_join(held_thread_id);
+    }
+    /* after the held thread, it passes the held requests to the pool */
+    gw_pool_destroy(sendsms_pool);
     gwlist_remove_producer(smsbox_requests);
     gwlist_remove_producer(smsbox_http_requests);
     gwthread_join_every(obey_request_thread);
@@ -3631,6 +4158,13 @@ int main(int argc, char **argv)
     gw_assert(gwlist_len(smsbox_http_requests) == 0);
     gwlist_destroy(smsbox_requests, NULL);
     gwlist_destroy(smsbox_http_requests, NULL);
+    gwlist_destroy(held_requests, NULL);
+    if (bb_credit >= 0)
+        info(0, "Sendsms admission: admitted %lu, delayed %lu, rejected %lu, "
+             "expired %lu requests.", admitted_requests, delayed_requests,
+             rejected_requests, expired_requests);
+    mutex_destroy(admission_lock);
+    pthread_key_delete(admission_key);
     http_caller_destroy(caller);
     gw_timerset_destroy(timerset);
     counter_destroy(num_outstanding_requests);
@@ -3642,6 +4176,8 @@ int main(int argc, char **argv)
     octstr_destroy(sendsms_url);
     octstr_destroy(sendota_url);
     octstr_destroy(xmlrpc_url);
+    octstr_destroy(sendsms_bulk_url);
+    octstr_destroy(sendsms_status_url);
     octstr_destroy(reply_emptymessage);
     octstr_destroy(reply_requestfailed);
     octstr_destroy(reply_couldnotfetch);
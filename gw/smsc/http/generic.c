@@ -316,11 +316,8 @@ static void generic_receive_sms(SMSCConn *conn, HTTPClient *client,
 
             if (dlrerr != NULL) {
                 /* pass errorcode as is */
-                if (dlrmsg->sms.meta_data == NULL)
-                    dlrmsg->sms.meta_data = octstr_create("");
-
-                meta_data_set_value(dlrmsg->sms.meta_data, METADATA_DLR_GROUP,
-                                    octstr_imm(METADATA_DLR_GROUP_ERRORCODE), dlrerr, 1);
+                meta_data_msg_set_value(dlrmsg, METADATA_DLR_GROUP,
+                                        octstr_imm(METADATA_DLR_GROUP_ERRORCODE), dlrerr, 1);
             }
 
             Msg *resp = msg_duplicate(dlrmsg);
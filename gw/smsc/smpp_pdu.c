@@ -124,7 +124,8 @@ static struct smpp_tlv *smpp_tlv_get_by_tag(Octstr *smsc_id, long tag)
     Dict *tmp_dict;
     Octstr *tmp;
 
-    if (tlvs_by_tag == NULL)
+    /* no smpp-tlv groups configured, nothing to find */
+    if (tlvs_by_tag == NULL || dict_key_count(tlvs_by_tag) == 0)
         return NULL;
 
     tmp = octstr_format("%ld", tag);
@@ -276,15 +277,17 @@ int smpp_pdu_shutdown(void)
 
 static long decode_integer(Octstr *os, long pos, int octets)
 {
+    const unsigned char *data;
     unsigned long u;
     int i;
 
     if (octstr_len(os) < pos + octets) 
         return -1;
 
+    data = (const unsigned char *) octstr_get_cstr(os) + pos;
     u = 0;
     for (i = 0; i < octets; ++i)
-    	u = (u << 8) | octstr_get_char(os, pos + i);
+    	u = (u << 8) | data[i];
 
     return u;
 }
@@ -292,10 +295,26 @@ static long decode_integer(Octstr *os, long pos, int octets)
 
 static void append_encoded_integer(Octstr *os, unsigned long u, long octets)
 {
+    unsigned char buf[8];
     long i;
 
+    gw_assert(octets >= 0 && octets <= (long) sizeof(buf));
+
     for (i = 0; i < octets; ++i)
-    	octstr_append_char(os, (u >> ((octets - i - 1) * 8)) & 0xFF);
+    	buf[i] = (u >> ((octets - i - 1) * 8)) & 0xFF;
+    octstr_append_data(os, (char *) buf, octets);
+}
+
+
+/*
+ * Configured TLVs are only kept in a Dict if there are any, most PDUs
+ * never carry one and don't need to pay for the hash table.
+ */
+static void tlv_dict_put(Dict **dict, Octstr *name, Octstr *value)
+{
+    if (*dict == NULL)
+        *dict = dict_create(16, octstr_destroy_item);
+    dict_put(*dict, name, value);
 }
 
 
@@ -356,7 +375,7 @@ SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no)
     #define TLV_INTEGER(name, octets) p->name = -1;
     #define TLV_NULTERMINATED(name, max_len) p->name = NULL;
     #define TLV_OCTETS(name, min_len, max_len) p->name = NULL;
-    #define OPTIONAL_END p->tlv = dict_create(1024, octstr_destroy_item);
+    #define OPTIONAL_END p->tlv = NULL;
     #define INTEGER(name, octets) p->name = 0;
     #define NULTERMINATED(name, max_octets) p->name = NULL;
     #define OCTETS(name, field_giving_octetst) p->name = NULL;
@@ -402,14 +421,16 @@ void smpp_pdu_destroy(SMPP_PDU *pdu)
 }
 
 
-Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
+int smpp_pdu_pack_append(Octstr *smsc_id, SMPP_PDU *pdu, Octstr *os)
 {
-    Octstr *os;
-    Octstr *temp;
-
-    os = octstr_create("");
+    long start, len;
 
     gw_assert(pdu != NULL);
+    gw_assert(os != NULL);
+
+    /* reserve room for command_length, it's filled in at the end */
+    start = octstr_len(os);
+    octstr_append_data(os, "\0\0\0\0", 4);
 
     /*
      * Fix lengths of octet string fields.
@@ -428,7 +449,9 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
     	case id: { struct name *p = &pdu->u.name; fields } break;
     #include "smpp_pdu.def"
     default:
-    	error(0, "Unknown SMPP_PDU type, internal error while packing.");
+    	error(0, "Unknown SMPP_PDU type 0x%08lx, internal error while packing.", pdu->type);
+        octstr_delete(os, start, octstr_len(os) - start);
+        return -1;
     }
 
     switch (pdu->type) {
@@ -511,15 +534,14 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
         append_encoded_integer(os, p->name, octets);
     #define NULTERMINATED(name, max_octets) \
         if (p->name != NULL) { \
-            if (octstr_len(p->name) >= max_octets) { \
+            len = octstr_len(p->name); \
+            if (len >= max_octets) { \
                 warning(0, "SMPP: PDU element <%s> too long " \
                         "(length is %ld, should be %d)", \
-                        #name, octstr_len(p->name), max_octets-1); \
-                temp = octstr_copy(p->name, 0, max_octets-1); \
-            } else \
-                temp = octstr_duplicate(p->name); \
-            octstr_append(os, temp); \
-            octstr_destroy(temp); \
+                        #name, len, max_octets-1); \
+                len = max_octets - 1; \
+            } \
+            octstr_append_data(os, octstr_get_cstr(p->name), len); \
         } \
         octstr_append_char(os, '\0');
     #define OCTETS(name, field_giving_octets) \
@@ -528,14 +550,28 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
         case id: { struct name *p = &pdu->u.name; fields } break;
     #include "smpp_pdu.def"
     default:
-        error(0, "Unknown SMPP_PDU type 0x%08lx, internal error while packing.", pdu->type);
         break;
     }
 
-    temp = octstr_create("");
-    append_encoded_integer(temp, octstr_len(os) + 4, 4);
-    octstr_insert(os, temp, 0);
-    octstr_destroy(temp);
+    len = octstr_len(os) - start;
+    octstr_set_char(os, start, (len >> 24) & 0xFF);
+    octstr_set_char(os, start + 1, (len >> 16) & 0xFF);
+    octstr_set_char(os, start + 2, (len >> 8) & 0xFF);
+    octstr_set_char(os, start + 3, len & 0xFF);
+
+    return 0;
+}
+
+
+Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
+{
+    Octstr *os;
+
+    os = octstr_create("");
+    if (smpp_pdu_pack_append(smsc_id, pdu, os) == -1) {
+        octstr_destroy(os);
+        return NULL;
+    }
 
     return os;
 }
@@ -573,9 +609,8 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                 struct smpp_tlv *tlv; \
                 unsigned long opt_tag, opt_len; \
                 opt_tag = decode_integer(data_without_len, pos, 2); pos += 2; \
-                debug("sms.smpp", 0, "Optional parameter tag (0x%04lx)", opt_tag);  \
                 opt_len = decode_integer(data_without_len, pos, 2); pos += 2;  \
-                debug("sms.smpp", 0, "Optional parameter length read as %ld", opt_len); \
+                debug("sms.smpp", 0, "Optional parameter tag (0x%04lx) length %ld", opt_tag, opt_len); \
                 /* check configured TLVs */ \
                 tlv = smpp_tlv_get_by_tag(smsc_id, opt_tag); \
                 if (tlv != NULL) debug("sms.smpp", 0, "Found configured optional parameter `%s'", octstr_get_cstr(tlv->name));
@@ -588,7 +623,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                         continue; \
                     } \
                     INTEGER(mname, opt_len); \
-                    if (tlv != NULL) dict_put(p->tlv, tlv->name, octstr_format("%ld", p->mname)); \
+                    if (tlv != NULL) tlv_dict_put(&p->tlv, tlv->name, octstr_format("%ld", p->mname)); \
                 } else
     #define TLV_NULTERMINATED(mname, max_len) \
                 if (SMPP_##mname == opt_tag) { \
@@ -599,7 +634,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                         continue; \
                     } \
                     copy_until_nul(#mname, data_without_len, &pos, opt_len, &p->mname); \
-                    if (tlv != NULL) dict_put(p->tlv, tlv->name, octstr_duplicate(p->mname)); \
+                    if (tlv != NULL) tlv_dict_put(&p->tlv, tlv->name, octstr_duplicate(p->mname)); \
                 } else
     #define TLV_OCTETS(mname, min_len, max_len) \
                 if (SMPP_##mname == opt_tag) { \
@@ -612,7 +647,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                     } \
                     p->mname = octstr_copy(data_without_len, pos, opt_len); \
                     pos += opt_len; \
-                    if (tlv != NULL) dict_put(p->tlv, tlv->name, octstr_duplicate(p->mname)); \
+                    if (tlv != NULL) tlv_dict_put(&p->tlv, tlv->name, octstr_duplicate(p->mname)); \
                 } else
     #define OPTIONAL_END \
                 { \
@@ -632,19 +667,19 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                             if ((val_i = decode_integer(data_without_len, pos, opt_len)) == -1) \
                                 goto err; \
                             val = octstr_format("%ld", val_i); \
-                            dict_put(p->tlv, tlv->name, val); \
+                            tlv_dict_put(&p->tlv, tlv->name, val); \
                             pos += opt_len; \
                             break; \
                         } \
                         case SMPP_TLV_OCTETS: { \
                             val = octstr_copy(data_without_len, pos, opt_len); \
-                            dict_put(p->tlv, tlv->name, val); \
+                            tlv_dict_put(&p->tlv, tlv->name, val); \
                             pos += opt_len; \
                             break; \
                         } \
                         case SMPP_TLV_NULTERMINATED: { \
                             if (copy_until_nul(octstr_get_cstr(tlv->name), data_without_len, &pos, opt_len, &val) == 0) \
-                                dict_put(p->tlv, tlv->name, val); \
+                                tlv_dict_put(&p->tlv, tlv->name, val); \
                             break; \
                         } \
                         default: \
@@ -95,7 +95,7 @@ struct SMPP_PDU {
         #define TLV_INTEGER(name, octets) long name;
         #define TLV_NULTERMINATED(name, max_len) Octstr *name;
         #define TLV_OCTETS(name, min_len, max_len) Octstr *name;
-        #define OPTIONAL_END Dict *tlv;
+        #define OPTIONAL_END Dict *tlv; /* configured TLVs, NULL if none */
         #define INTEGER(name, octets) unsigned long name;
         #define NULTERMINATED(name, max_octets) Octstr *name;
         #define OCTETS(name, field_giving_octets) Octstr *name;
@@ -235,6 +235,12 @@ SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no);
 void smpp_pdu_destroy(SMPP_PDU *pdu);
 int smpp_pdu_is_valid(SMPP_PDU *pdu); /* XXX */
 Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu);
+/*
+ * Encode the PDU, including its command_length, at the end of `os' in
+ * a single pass. Return 0 on success and -1 if the PDU can't be packed,
+ * in which case `os' is left as it was.
+ */
+int smpp_pdu_pack_append(Octstr *smsc_id, SMPP_PDU *pdu, Octstr *os);
 SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len);
 void smpp_pdu_dump(Octstr *smsc_id, SMPP_PDU *pdu);
 void smpp_pdu_dump_line(Octstr *smsc_id, SMPP_PDU *pdu);
@@ -150,6 +150,7 @@ typedef struct conndata {
     Octstr *send_url;
     Octstr *dlr_url;
     Counter *open_sends;
+    Counter *open_replies; /* replies being parsed in the pool */
     Semaphore *max_pending_sends;
     Octstr *username;   /* if needed */
     Octstr *password;   /* as said */
@@ -186,6 +187,7 @@ static void conndata_destroy(ConnData *conndata)
     octstr_destroy(conndata->system_id);
     octstr_destroy(conndata->alt_charset);
     counter_destroy(conndata->open_sends);
+    counter_destroy(conndata->open_replies);
     gwlist_destroy(conndata->msg_to_send, NULL);
     if (conndata->max_pending_sends)
         semaphore_destroy(conndata->max_pending_sends);
@@ -345,6 +347,48 @@ static void httpsmsc_sender(void *arg)
     }
 }
 
+/*
+ * Reply of the SMSC, parsed in the shared pool
+ */
+typedef struct {
+    SMSCConn *conn;
+    Msg *msg;
+    int status;
+    List *headers;
+    Octstr *body;
+} Reply;
+
+
+static void httpsmsc_parse_reply(void *arg)
+{
+    Reply *reply = arg;
+    SMSCConn *conn = reply->conn;
+    ConnData *conndata = conn->data;
+    long send_cb_thread;
+    int log_idx;
+
+    /* Make sure we log into our own log-file if defined */
+    log_idx = log_thread_switch(conn->log_idx);
+
+    conndata->callbacks->parse_reply(conn, reply->msg, reply->status,
+                                     reply->headers, reply->body);
+    http_destroy_headers(reply->headers);
+    octstr_destroy(reply->body);
+    gw_free(reply);
+
+    log_thread_switch(log_idx);
+
+    /* the send is done only now, so slow replies hold back new sends */
+    if (conndata->max_pending_sends)
+        semaphore_up(conndata->max_pending_sends);
+
+    /* conndata may be gone as soon as the counter drops */
+    send_cb_thread = conndata->send_cb_thread;
+    counter_decrease(conndata->open_replies);
+    gwthread_wakeup(send_cb_thread);
+}
+
+
 /*
  * Thread to handle finished sendings
  */
@@ -356,6 +400,7 @@ static void httpsmsc_send_cb(void *arg)
     int status;
     List *headers;
     Octstr *final_url, *body;
+    Reply *reply;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
@@ -369,7 +414,8 @@ static void httpsmsc_send_cb(void *arg)
             break;  /* they told us to die, by unlocking */
 
         counter_decrease(conndata->open_sends);
-        if (conndata->max_pending_sends)
+        /* a failed send is done, a replied one once its reply is parsed */
+        if (status == -1 && conndata->max_pending_sends)
             semaphore_up(conndata->max_pending_sends);
 
         /* Handle various states here. */
@@ -416,7 +462,17 @@ static void httpsmsc_send_cb(void *arg)
                 /* tell bearerbox core that we are connected again */
                 bb_smscconn_connected(conn);
             }
-            conndata->callbacks->parse_reply(conn, msg, status, headers, body);
+            /* parse the reply in the pool, we go on receiving */
+            reply = gw_malloc(sizeof(*reply));
+            reply->conn = conn;
+            reply->msg = msg;
+            reply->status = status;
+            reply->headers = headers;
+            reply->body = body;
+            headers = NULL;
+            body = NULL;
+            counter_increase(conndata->open_replies);
+            gw_pool_execute(bb_smscconn_pool(), httpsmsc_parse_reply, reply);
         }
 
         http_destroy_headers(headers);
@@ -427,6 +483,10 @@ static void httpsmsc_send_cb(void *arg)
           octstr_get_cstr(conn->id));
     conndata->shutdown = 1;
 
+    /* replies still being parsed need conndata */
+    while (counter_value(conndata->open_replies) > 0)
+        gwthread_sleep(1.0);
+
     if (counter_value(conndata->open_sends)) {
         warning(0, "HTTP[%s]: Shutdown while <%ld> requests are pending.",
                 octstr_get_cstr(conn->id), counter_value(conndata->open_sends));
@@ -711,11 +771,8 @@ static void kannel_receive_sms(SMSCConn *conn, HTTPClient *client,
 
             if (dlrerr != NULL) {
                 /* pass errorcode as is */
-            	if (dlrmsg->sms.meta_data == NULL)
-            		dlrmsg->sms.meta_data = octstr_create("");
-
-                meta_data_set_value(dlrmsg->sms.meta_data, METADATA_DLR_GROUP,
-                                    octstr_imm(METADATA_DLR_GROUP_ERRORCODE), dlrerr, 1);
+                meta_data_msg_set_value(dlrmsg, METADATA_DLR_GROUP,
+                                        octstr_imm(METADATA_DLR_GROUP_ERRORCODE), dlrerr, 1);
             }
             
             ret = bb_smscconn_receive(conn, dlrmsg);
@@ -963,6 +1020,7 @@ int smsc_http_create(SMSCConn *conn, CfgGroup *cfg)
     }
 
     conndata->open_sends = counter_create();
+    conndata->open_replies = counter_create();
     conndata->msg_to_send = gwlist_create();
     gwlist_add_producer(conndata->msg_to_send);
     conndata->http_ref = http_caller_create();
@@ -125,6 +125,7 @@ enum smpp_pdu_dump_format {
 #define SMPP_DEFAULT_WAITACK        60
 #define SMPP_DEFAULT_SHUTDOWN_TIMEOUT 30
 #define SMPP_DEFAULT_PORT           2775
+#define SMPP_OUTPUT_BUFFERING       65536
 
 
 /*
@@ -141,10 +142,11 @@ enum smpp_pdu_dump_format {
 
 
 typedef struct {
-    long transmitter;
-    long receiver;
+    struct smpp_session **sessions;
+    long num_sessions;
+    long event_loops;
+    long sessions_running;
     gw_prioqueue_t *msgs_to_send;
-    Dict *sent_msgs;
     List *received_msgs;
     Counter *message_id_counter;
     Octstr *host;
@@ -190,6 +192,11 @@ typedef struct {
 struct smpp_msg {
     time_t sent_time;
     Msg *msg;
+    unsigned long sequence_number;
+    /* chaining within the sequence number bucket */
+    struct smpp_msg *hash_next;
+    /* links within the send time ordered list */
+    struct smpp_msg *prev, *next;
 };
 
 
@@ -203,6 +210,8 @@ static inline struct smpp_msg* smpp_msg_create(Msg *msg)
     gw_assert(result != NULL);
     result->sent_time = time(NULL);
     result->msg = msg;
+    result->sequence_number = 0;
+    result->hash_next = result->prev = result->next = NULL;
 
     return result;
 }
@@ -224,6 +233,311 @@ static inline void smpp_msg_destroy(struct smpp_msg *msg, int destroy_msg)
 }
 
 
+/*
+ * Submits that are waiting for a response from the SMSC. Entries are
+ * indexed by their sequence number and linked in the order they were
+ * sent. Since every entry expires after the same wait-ack period, the
+ * head of the list is always the next one to expire, so the cleanup
+ * only needs to look at entries that have actually expired.
+ * Sequence numbers are assigned from a counter, so masking them gives
+ * a good enough bucket distribution.
+ */
+struct smpp_sent_queue {
+    Mutex *lock;
+    struct smpp_msg **buckets;
+    unsigned long mask;
+    struct smpp_msg *head, *tail;
+    long len;
+};
+
+
+static struct smpp_sent_queue *sent_queue_create(long size_hint)
+{
+    struct smpp_sent_queue *q;
+    unsigned long size = 64;
+
+    while (size < (unsigned long) size_hint * 2)
+        size <<= 1;
+
+    q = gw_malloc(sizeof(*q));
+    q->lock = mutex_create();
+    q->buckets = gw_malloc(size * sizeof(*q->buckets));
+    memset(q->buckets, 0, size * sizeof(*q->buckets));
+    q->mask = size - 1;
+    q->head = q->tail = NULL;
+    q->len = 0;
+
+    return q;
+}
+
+
+static void sent_queue_destroy(struct smpp_sent_queue *q)
+{
+    struct smpp_msg *smpp_msg;
+
+    if (q == NULL)
+        return;
+
+    while ((smpp_msg = q->head) != NULL) {
+        q->head = smpp_msg->next;
+        smpp_msg_destroy(smpp_msg, 1);
+    }
+    mutex_destroy(q->lock);
+    gw_free(q->buckets);
+    gw_free(q);
+}
+
+
+/* Unlink an entry from both the bucket chain and the ordered list. Caller holds the lock. */
+static void sent_queue_unlink(struct smpp_sent_queue *q, struct smpp_msg *smpp_msg)
+{
+    struct smpp_msg **p;
+
+    for (p = &q->buckets[smpp_msg->sequence_number & q->mask]; *p != NULL; p = &(*p)->hash_next) {
+        if (*p == smpp_msg) {
+            *p = smpp_msg->hash_next;
+            break;
+        }
+    }
+
+    if (smpp_msg->prev != NULL)
+        smpp_msg->prev->next = smpp_msg->next;
+    else
+        q->head = smpp_msg->next;
+    if (smpp_msg->next != NULL)
+        smpp_msg->next->prev = smpp_msg->prev;
+    else
+        q->tail = smpp_msg->prev;
+
+    smpp_msg->hash_next = smpp_msg->prev = smpp_msg->next = NULL;
+    q->len--;
+}
+
+
+static void sent_queue_put(struct smpp_sent_queue *q, unsigned long sequence_number,
+                           struct smpp_msg *smpp_msg)
+{
+    struct smpp_msg **bucket;
+
+    smpp_msg->sequence_number = sequence_number;
+
+    mutex_lock(q->lock);
+    bucket = &q->buckets[sequence_number & q->mask];
+    smpp_msg->hash_next = *bucket;
+    *bucket = smpp_msg;
+
+    smpp_msg->next = NULL;
+    smpp_msg->prev = q->tail;
+    if (q->tail != NULL)
+        q->tail->next = smpp_msg;
+    else
+        q->head = smpp_msg;
+    q->tail = smpp_msg;
+    q->len++;
+    mutex_unlock(q->lock);
+}
+
+
+/* Remove and return the entry for sequence number, or NULL if none. */
+static struct smpp_msg *sent_queue_remove(struct smpp_sent_queue *q, unsigned long sequence_number)
+{
+    struct smpp_msg *smpp_msg;
+
+    mutex_lock(q->lock);
+    for (smpp_msg = q->buckets[sequence_number & q->mask]; smpp_msg != NULL; smpp_msg = smpp_msg->hash_next) {
+        if (smpp_msg->sequence_number == sequence_number) {
+            sent_queue_unlink(q, smpp_msg);
+            break;
+        }
+    }
+    mutex_unlock(q->lock);
+
+    return smpp_msg;
+}
+
+
+/*
+ * Return the oldest entry if it was sent more than wait_ack seconds
+ * before now, NULL otherwise. If extract is set the entry is removed.
+ */
+static struct smpp_msg *sent_queue_expired(struct smpp_sent_queue *q, time_t now,
+                                           long wait_ack, int extract)
+{
+    struct smpp_msg *smpp_msg;
+
+    mutex_lock(q->lock);
+    smpp_msg = q->head;
+    if (smpp_msg != NULL && difftime(now, smpp_msg->sent_time) > wait_ack) {
+        if (extract)
+            sent_queue_unlink(q, smpp_msg);
+    } else
+        smpp_msg = NULL;
+    mutex_unlock(q->lock);
+
+    return smpp_msg;
+}
+
+
+/* Remove and return the oldest entry, NULL if queue is empty. */
+static struct smpp_msg *sent_queue_extract_first(struct smpp_sent_queue *q)
+{
+    struct smpp_msg *smpp_msg;
+
+    mutex_lock(q->lock);
+    if ((smpp_msg = q->head) != NULL)
+        sent_queue_unlink(q, smpp_msg);
+    mutex_unlock(q->lock);
+
+    return smpp_msg;
+}
+
+
+/*
+ * One bind to the SMSC. An SMSCConn has one session per configured
+ * port, or bind-sessions of them when running as a bind group. All
+ * transmitting sessions share the msgs_to_send queue, but each one has
+ * its own window of submits waiting for a response.
+ */
+struct smpp_session {
+    SMPP *smpp;
+    long index;
+    int transmitter; /* 0 receiver, 1 transmitter, 2 transceiver */
+    long thread;
+    int status;
+    volatile long pending_submits;
+    struct smpp_sent_queue *sent_msgs;
+    /* state kept between passes when driven by an event loop */
+    struct smpp_loop *loop;
+    Connection *conn;
+    long len;
+    long last_enquire_sent;
+    time_t last_cleanup, last_response, reconnect_time, unbind_time;
+    int requeue;
+};
+
+
+static struct smpp_session *smpp_session_create(SMPP *smpp, long index, int transmitter)
+{
+    struct smpp_session *session;
+
+    session = gw_malloc(sizeof(*session));
+    session->smpp = smpp;
+    session->index = index;
+    session->transmitter = transmitter;
+    session->thread = -1;
+    session->status = SMSCCONN_CONNECTING;
+    session->pending_submits = -1;
+    session->sent_msgs = sent_queue_create(smpp->max_pending_submits);
+    session->loop = NULL;
+    session->conn = NULL;
+    session->len = 0;
+    session->last_enquire_sent = 0;
+    session->last_cleanup = session->last_response = 0;
+    session->reconnect_time = session->unbind_time = 0;
+    session->requeue = 0;
+
+    return session;
+}
+
+
+static void smpp_session_destroy(struct smpp_session *session)
+{
+    if (session == NULL)
+        return;
+
+    sent_queue_destroy(session->sent_msgs);
+    gw_free(session);
+}
+
+
+static void smpp_add_sessions(SMPP *smpp, long count, int transmitter)
+{
+    long i;
+
+    smpp->sessions = gw_realloc(smpp->sessions,
+                                (smpp->num_sessions + count) * sizeof(*smpp->sessions));
+    for (i = 0; i < count; i++, smpp->num_sessions++)
+        smpp->sessions[smpp->num_sessions] = smpp_session_create(smpp, smpp->num_sessions, transmitter);
+}
+
+
+/*
+ * Set the status of one session and derive the SMSCConn status from
+ * all sessions: the connection is active as long as any transmitting
+ * session is bound.
+ */
+static void smpp_session_set_status(struct smpp_session *session, int status)
+{
+    SMPP *smpp = session->smpp;
+    int old_status, new_status;
+    long i;
+
+    mutex_lock(smpp->conn->flow_mutex);
+    session->status = status;
+    old_status = smpp->conn->status;
+    new_status = status;
+    for (i = 0; i < smpp->num_sessions; i++) {
+        if (smpp->sessions[i]->status == SMSCCONN_ACTIVE) {
+            new_status = SMSCCONN_ACTIVE;
+            break;
+        }
+        if (smpp->sessions[i]->status == SMSCCONN_ACTIVE_RECV)
+            new_status = SMSCCONN_ACTIVE_RECV;
+    }
+    smpp->conn->status = new_status;
+    if (status == SMSCCONN_ACTIVE ||
+        (status == SMSCCONN_ACTIVE_RECV && old_status != SMSCCONN_ACTIVE))
+        time(&smpp->conn->connect_time);
+    mutex_unlock(smpp->conn->flow_mutex);
+}
+
+
+/* Number of bound transmitting sessions other than exclude. */
+static long smpp_active_transmitters(SMPP *smpp, struct smpp_session *exclude)
+{
+    long i, active = 0;
+
+    for (i = 0; i < smpp->num_sessions; i++) {
+        if (smpp->sessions[i] != exclude && smpp->sessions[i]->transmitter &&
+            smpp->sessions[i]->status == SMSCCONN_ACTIVE)
+            active++;
+    }
+
+    return active;
+}
+
+
+/*
+ * Wake up the transmitting session with the most room left in its
+ * window. If exclude is set, only wake another session and only if it
+ * can actually take more submits; this lets a session whose window is
+ * full hand the remaining queue over to an idle sibling.
+ */
+static void smpp_wakeup_transmitter(SMPP *smpp, struct smpp_session *exclude)
+{
+    struct smpp_session *best = NULL, *session;
+    long i, room, best_room = 0;
+
+    for (i = 0; i < smpp->num_sessions; i++) {
+        session = smpp->sessions[i];
+        if (!session->transmitter || session == exclude || session->thread == -1)
+            continue;
+        if (best == NULL && exclude == NULL)
+            best = session;
+        if (session->status != SMSCCONN_ACTIVE)
+            continue;
+        room = smpp->max_pending_submits - session->pending_submits;
+        if (room > best_room) {
+            best = session;
+            best_room = room;
+        }
+    }
+
+    if (best != NULL)
+        gwthread_wakeup(best->thread);
+}
+
+
 static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
                          int receive_port, int our_port, int our_receiver_port, Octstr *system_type,
                          Octstr *username, Octstr *password,
@@ -240,10 +554,11 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     SMPP *smpp;
 
     smpp = gw_malloc(sizeof(*smpp));
-    smpp->transmitter = -1;
-    smpp->receiver = -1;
+    smpp->sessions = NULL;
+    smpp->num_sessions = 0;
+    smpp->event_loops = 0;
+    smpp->sessions_running = 0;
     smpp->msgs_to_send = gw_prioqueue_create(sms_priority_compare);
-    smpp->sent_msgs = dict_create(max_pending_submits, NULL);
     gw_prioqueue_add_producer(smpp->msgs_to_send);
     smpp->received_msgs = gwlist_create();
     smpp->message_id_counter = counter_create();
@@ -292,9 +607,13 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
 
 static void smpp_destroy(SMPP *smpp)
 {
+    long i;
+
     if (smpp != NULL) {
         gw_prioqueue_destroy(smpp->msgs_to_send, msg_destroy_item);
-        dict_destroy(smpp->sent_msgs);
+        for (i = 0; i < smpp->num_sessions; i++)
+            smpp_session_destroy(smpp->sessions[i]);
+        gw_free(smpp->sessions);
         gwlist_destroy(smpp->received_msgs, msg_destroy_item);
         counter_destroy(smpp->message_id_counter);
         octstr_destroy(smpp->host);
@@ -705,9 +1024,7 @@ static Msg *pdu_to_msg(SMPP *smpp, SMPP_PDU *pdu, long *reason)
     /* set priority flag */
     msg->sms.priority = pdu->u.deliver_sm.priority_flag;
 
-    if (msg->sms.meta_data == NULL)
-        msg->sms.meta_data = octstr_create("");
-    meta_data_set_values(msg->sms.meta_data, pdu->u.deliver_sm.tlv, "smpp", 1);
+    meta_data_msg_set_values(msg, pdu->u.deliver_sm.tlv, "smpp", 1);
 
     return msg;
 
@@ -833,9 +1150,7 @@ static Msg *data_sm_to_msg(SMPP *smpp, SMPP_PDU *pdu, long *reason)
     /* handle default data coding */
     handle_mo_dcs(msg, smpp->alt_charset, pdu->u.data_sm.data_coding, pdu->u.data_sm.esm_class);
 
-    if (msg->sms.meta_data == NULL)
-        msg->sms.meta_data = octstr_create("");
-    meta_data_set_values(msg->sms.meta_data, pdu->u.data_sm.tlv, "smpp", 1);
+    meta_data_msg_set_values(msg, pdu->u.data_sm.tlv, "smpp", 1);
 
     return msg;
 
@@ -862,17 +1177,28 @@ static long smpp_status_to_smscconn_failure_reason(long status)
 }
 
 
+/* A value of the smpp meta-data of a message, owned by the dictionary. */
+static Octstr *smpp_meta_value(Dict *meta, const char *key)
+{
+    return (meta != NULL ? dict_get(meta, octstr_imm(key)) : NULL);
+}
+
+
 static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
 {
     SMPP_PDU *pdu;
     int validity;
     Octstr *tmp;
+    Dict *meta;
     int ton_npi_forced;
     int data_coding = -1;
 
     pdu = smpp_pdu_create(submit_sm,
                           counter_increase(smpp->message_id_counter));
 
+    /* the smpp meta-data, unpacked once for all the values below */
+    meta = meta_data_msg_get_values(msg, METADATA_SMPP_GROUP);
+
     pdu->u.submit_sm.source_addr = octstr_duplicate(msg->sms.sender);
     pdu->u.submit_sm.destination_addr = octstr_duplicate(msg->sms.receiver);
 
@@ -904,17 +1230,15 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
 
     /* Check for forced source ton and npi values via meta-data */
     ton_npi_forced = 0;
-    tmp = meta_data_get_value(msg->sms.meta_data, METADATA_SMPP_GROUP, octstr_imm("source_addr_ton"));
+    tmp = smpp_meta_value(meta, "source_addr_ton");
     if (tmp != NULL) {
         ton_npi_forced = 1;
         pdu->u.submit_sm.source_addr_ton = atoi(octstr_get_cstr(tmp));
-        octstr_destroy(tmp);
     }
-    tmp = meta_data_get_value(msg->sms.meta_data, METADATA_SMPP_GROUP, octstr_imm("source_addr_npi"));
+    tmp = smpp_meta_value(meta, "source_addr_npi");
     if (tmp != NULL) {
         ton_npi_forced = 1;
         pdu->u.submit_sm.source_addr_npi = atoi(octstr_get_cstr(tmp));
-        octstr_destroy(tmp);
     }
 
     /* don't touch source_addr ton/npi if overwritten in meta_data */
@@ -969,17 +1293,15 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
 
     /* Check for forced destination ton and npi values via meta-data */
     ton_npi_forced = 0;
-    tmp = meta_data_get_value(msg->sms.meta_data, METADATA_SMPP_GROUP, octstr_imm("dest_addr_ton"));
+    tmp = smpp_meta_value(meta, "dest_addr_ton");
     if (tmp != NULL) {
         ton_npi_forced = 1;
         pdu->u.submit_sm.dest_addr_ton = atoi(octstr_get_cstr(tmp));
-        octstr_destroy(tmp);
     }
-    tmp = meta_data_get_value(msg->sms.meta_data, METADATA_SMPP_GROUP, octstr_imm("dest_addr_npi"));
+    tmp = smpp_meta_value(meta, "dest_addr_npi");
     if (tmp != NULL) {
         ton_npi_forced = 1;
         pdu->u.submit_sm.dest_addr_npi = atoi(octstr_get_cstr(tmp));
-        octstr_destroy(tmp);
     }
 
     /* don't touch source_addr ton/npi if overwritten in meta_data */
@@ -997,6 +1319,7 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
     /* check length of src/dst address */
     if (octstr_len(pdu->u.submit_sm.destination_addr) > 20 ||
         octstr_len(pdu->u.submit_sm.source_addr) > 20) {
+        dict_destroy(meta);
         smpp_pdu_destroy(pdu);
         return NULL;
     }
@@ -1040,11 +1363,9 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
     pdu->u.submit_sm.short_message = octstr_duplicate(msg->sms.msgdata);
 
     /* Check for forced data_coding value via meta-data */
-    tmp = meta_data_get_value(msg->sms.meta_data, METADATA_SMPP_GROUP, octstr_imm("data_coding"));
-    if (tmp != NULL) {
+    tmp = smpp_meta_value(meta, "data_coding");
+    if (tmp != NULL)
         data_coding = atoi(octstr_get_cstr(tmp));
-        octstr_destroy(tmp);
-    }
 
     /*
      * only re-encoding if using default smsc charset that is defined via
@@ -1130,16 +1451,44 @@ static SMPP_PDU *msg_to_pdu(SMPP *smpp, Msg *msg)
         pdu->u.submit_sm.more_messages_to_send = 1;
 
     dict_destroy(pdu->u.submit_sm.tlv);
-    pdu->u.submit_sm.tlv = meta_data_get_values(msg->sms.meta_data, "smpp");
+    pdu->u.submit_sm.tlv = meta;
 
 	return pdu;
 }
 
 
+struct pdu_writer {
+    Octstr *smsc_id;
+    SMPP_PDU *pdu;
+};
+
+
+static int pack_pdu(Octstr *outbuf, void *context)
+{
+    struct pdu_writer *writer = context;
+
+    return smpp_pdu_pack_append(writer->smsc_id, writer->pdu, outbuf);
+}
+
+
+/*
+ * Encode the PDU straight into the connection's output buffer.
+ * Returns the conn_write() result.
+ */
+static int write_pdu(Connection *conn, SMPP *smpp, SMPP_PDU *pdu)
+{
+    struct pdu_writer writer;
+
+    writer.smsc_id = smpp->conn->id;
+    writer.pdu = pdu;
+
+    return conn_write_encoded(conn, pack_pdu, &writer);
+}
+
+
 static int send_enquire_link(SMPP *smpp, Connection *conn, long *last_sent)
 {
     SMPP_PDU *pdu;
-    Octstr *os;
     int ret;
 
     if (difftime(date_universal_now(),*last_sent) < smpp->enquire_link_interval)
@@ -1148,12 +1497,7 @@ static int send_enquire_link(SMPP *smpp, Connection *conn, long *last_sent)
 
     pdu = smpp_pdu_create(enquire_link, counter_increase(smpp->message_id_counter));
     dump_pdu("Sending enquire link:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
-    if (os != NULL)
-        ret = conn_write(conn, os); /* Write errors checked by caller. */
-    else
-        ret = -1;
-    octstr_destroy(os);
+    ret = write_pdu(conn, smpp, pdu); /* Write errors checked by caller. */
     smpp_pdu_destroy(pdu);
 
     return ret;
@@ -1162,18 +1506,12 @@ static int send_enquire_link(SMPP *smpp, Connection *conn, long *last_sent)
 static int send_gnack(SMPP *smpp, Connection *conn, long reason, unsigned long seq_num)
 {
     SMPP_PDU *pdu;
-    Octstr *os;
     int ret;
 
     pdu = smpp_pdu_create(generic_nack, seq_num);
     pdu->u.generic_nack.command_status = reason;
     dump_pdu("Sending generic_nack:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
-    if (os != NULL)
-        ret = conn_write(conn, os);
-    else
-        ret = -1;
-    octstr_destroy(os);
+    ret = write_pdu(conn, smpp, pdu);
     smpp_pdu_destroy(pdu);
 
     return ret;
@@ -1182,17 +1520,11 @@ static int send_gnack(SMPP *smpp, Connection *conn, long reason, unsigned long s
 static int send_unbind(SMPP *smpp, Connection *conn)
 {
     SMPP_PDU *pdu;
-    Octstr *os;
     int ret;
 
     pdu = smpp_pdu_create(unbind, counter_increase(smpp->message_id_counter));
     dump_pdu("Sending unbind:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
-    if (os != NULL)
-        ret = conn_write(conn, os);
-    else
-        ret = -1;
-    octstr_destroy(os);
+    ret = write_pdu(conn, smpp, pdu);
     smpp_pdu_destroy(pdu);
 
     return ret;
@@ -1201,33 +1533,29 @@ static int send_unbind(SMPP *smpp, Connection *conn)
 
 static int send_pdu(Connection *conn, SMPP *smpp, SMPP_PDU *pdu)
 {
-    Octstr *os;
     int ret;
 
     dump_pdu("Sending PDU:", smpp->conn->id, pdu, smpp->log_format);
-    os = smpp_pdu_pack(smpp->conn->id, pdu);
-    if (os) {
-        /* Caller checks for write errors later */
-        ret = conn_write(conn, os);
-        /* it's not a error if we still have data buffered */
-        ret = (ret == 1) ? 0 : ret;
-    } else
-        ret = -1;
-    octstr_destroy(os);
-    return ret;
+    /* Caller checks for write errors later */
+    ret = write_pdu(conn, smpp, pdu);
+    /* it's not a error if we still have data buffered */
+    return (ret == 1) ? 0 : ret;
 }
 
 
-static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
+static int send_messages(struct smpp_session *session, Connection *conn)
 {
+    SMPP *smpp = session->smpp;
     Msg *msg;
     SMPP_PDU *pdu;
-    Octstr *os;
 
-    if (*pending_submits == -1)
+    if (session->pending_submits == -1)
         return 0;
 
-    while (*pending_submits < smpp->max_pending_submits) {
+    /* queue the PDUs of this round and write them out together */
+    conn_set_output_buffering(conn, SMPP_OUTPUT_BUFFERING);
+
+    while (session->pending_submits < smpp->max_pending_submits) {
         /* check our throughput */
         if (smpp->conn->throughput > 0 && load_get(smpp->load, 0) >= smpp->conn->throughput) {
             debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit exceeded (%.02f,%.02f)",
@@ -1251,11 +1579,9 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         /* check for write errors */
         if (send_pdu(conn, smpp, pdu) == 0) {
             struct smpp_msg *smpp_msg = smpp_msg_create(msg);
-            os = octstr_format("%ld", pdu->u.submit_sm.sequence_number);
-            dict_put(smpp->sent_msgs, os, smpp_msg);
+            sent_queue_put(session->sent_msgs, pdu->u.submit_sm.sequence_number, smpp_msg);
             smpp_pdu_destroy(pdu);
-            octstr_destroy(os);
-            ++(*pending_submits);
+            ++session->pending_submits;
             load_increase(smpp->load);
         }
         else { /* write error occurs */
@@ -1265,162 +1591,108 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         }
     }
 
+    conn_set_output_buffering(conn, 0);
+
+    /* our window is full, let an idle bind of the group take the rest */
+    if (smpp->num_sessions > 1 && session->pending_submits >= smpp->max_pending_submits &&
+        gw_prioqueue_len(smpp->msgs_to_send) > 0)
+        smpp_wakeup_transmitter(smpp, session);
+
     return 0;
 }
 
 
 /*
- * Open transmission connection to SMS center. Return NULL for error,
- * open Connection for OK. Caller must set smpp->conn->status correctly
- * before calling this.
+ * Open a connection to the SMS center for the given session type. If
+ * nonblocking is set, the connect may still be in progress when this
+ * returns, see conn_is_connected(). Return NULL for error.
  */
-static Connection *open_transmitter(SMPP *smpp)
+static Connection *open_connection(SMPP *smpp, int transmitter, int nonblocking)
 {
-    SMPP_PDU *bind;
     Connection *conn;
+    int port = (transmitter ? smpp->transmit_port : smpp->receive_port);
+    int our_port = (transmitter ? smpp->our_port : smpp->our_receiver_port);
 
 #ifdef HAVE_LIBSSL
-    if (smpp->use_ssl)
-        conn = conn_open_ssl(smpp->host, smpp->transmit_port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
-    else
+    if (smpp->use_ssl) {
+        if (nonblocking)
+            conn = conn_open_ssl_nb(smpp->host, port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
+        else
+            conn = conn_open_ssl(smpp->host, port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
+    } else
 #endif
 
-    if (smpp->our_port > 0)
-        conn = conn_open_tcp_with_port(smpp->host, smpp->transmit_port, smpp->our_port, smpp->conn->our_host );
+    if (nonblocking)
+        conn = conn_open_tcp_nb_with_port(smpp->host, port, our_port, smpp->conn->our_host);
     else
-        conn = conn_open_tcp(smpp->host, smpp->transmit_port, smpp->conn->our_host);
+        conn = conn_open_tcp_with_port(smpp->host, port, our_port, smpp->conn->our_host);
 
-    if (conn == NULL) {
+    if (conn == NULL)
         error(0, "SMPP[%s]: Couldn't connect to server.",
               octstr_get_cstr(smpp->conn->id));
-        return NULL;
-    }
-
-    bind = smpp_pdu_create(bind_transmitter,
-                counter_increase(smpp->message_id_counter));
-    bind->u.bind_transmitter.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_transmitter.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_transmitter.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_transmitter.system_type =
-            octstr_duplicate(smpp->system_type);
-    bind->u.bind_transmitter.interface_version = smpp->version;
-    bind->u.bind_transmitter.address_range =
-        octstr_duplicate(smpp->address_range);
-    bind->u.bind_transmitter.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_transmitter.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_transmitter to server.",
-              octstr_get_cstr(smpp->conn->id));
-        conn_destroy(conn);
-        conn = NULL;
-    }
-    smpp_pdu_destroy(bind);
 
     return conn;
 }
 
 
 /*
- * Open transceiver connection to SMS center. Return NULL for error,
- * open Connection for OK. Caller must set smpp->conn->status correctly
- * before calling this.
+ * Send the bind PDU matching the session type: 0 receiver,
+ * 1 transmitter, 2 transceiver. Return -1 for error.
  */
-static Connection *open_transceiver(SMPP *smpp)
+static int send_bind(SMPP *smpp, Connection *conn, int transmitter)
 {
     SMPP_PDU *bind;
-    Connection *conn;
-
-#ifdef HAVE_LIBSSL
-    if (smpp->use_ssl)
-        conn = conn_open_ssl(smpp->host, smpp->transmit_port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
-    else
-#endif
-
-    if (smpp->our_port > 0)
-       conn = conn_open_tcp_with_port(smpp->host, smpp->transmit_port, smpp->our_port, smpp->conn->our_host );  
-    else
-        conn = conn_open_tcp(smpp->host, smpp->transmit_port, smpp->conn->our_host);
+    int ret;
 
-    if (conn == NULL) {
-       error(0, "SMPP[%s]: Couldn't connect to server.",
-             octstr_get_cstr(smpp->conn->id));
-       return NULL;
+#define BIND_FIELDS(type) \
+    bind->u.type.system_id = octstr_duplicate(smpp->username); \
+    bind->u.type.password = octstr_duplicate(smpp->password); \
+    if (smpp->system_type == NULL) \
+        bind->u.type.system_type = octstr_create("VMA"); \
+    else \
+        bind->u.type.system_type = octstr_duplicate(smpp->system_type); \
+    bind->u.type.interface_version = smpp->version; \
+    bind->u.type.address_range = octstr_duplicate(smpp->address_range); \
+    bind->u.type.addr_ton = smpp->bind_addr_ton; \
+    bind->u.type.addr_npi = smpp->bind_addr_npi;
+
+    if (transmitter == 1) {
+        bind = smpp_pdu_create(bind_transmitter, counter_increase(smpp->message_id_counter));
+        BIND_FIELDS(bind_transmitter)
+    } else if (transmitter == 2) {
+        bind = smpp_pdu_create(bind_transceiver, counter_increase(smpp->message_id_counter));
+        BIND_FIELDS(bind_transceiver)
+    } else {
+        bind = smpp_pdu_create(bind_receiver, counter_increase(smpp->message_id_counter));
+        BIND_FIELDS(bind_receiver)
     }
 
-    bind = smpp_pdu_create(bind_transceiver,
-                           counter_increase(smpp->message_id_counter));
-    bind->u.bind_transceiver.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_transceiver.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_transceiver.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_transceiver.system_type = octstr_duplicate(smpp->system_type);
-    bind->u.bind_transceiver.interface_version = smpp->version;
-    bind->u.bind_transceiver.address_range = octstr_duplicate(smpp->address_range);
-    bind->u.bind_transceiver.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_transceiver.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_transceiver to server.",
-              octstr_get_cstr(smpp->conn->id));
-        conn_destroy(conn);
-        conn = NULL;
-    }
+#undef BIND_FIELDS
+
+    ret = send_pdu(conn, smpp, bind);
+    if (ret == -1)
+        error(0, "SMPP[%s]: Couldn't send %s to server.",
+              octstr_get_cstr(smpp->conn->id), bind->type_name);
     smpp_pdu_destroy(bind);
 
-    return conn;
+    return ret;
 }
 
 
 /*
- * Open reception connection to SMS center. Return NULL for error,
- * open Connection for OK. Caller must set smpp->conn->status correctly
- * before calling this.
+ * Open connection to SMS center and send the bind PDU for the session
+ * type. Return NULL for error, open Connection for OK. Caller must set
+ * the session status correctly before calling this.
  */
-static Connection *open_receiver(SMPP *smpp)
+static Connection *open_session(SMPP *smpp, int transmitter)
 {
-    SMPP_PDU *bind;
     Connection *conn;
 
-#ifdef HAVE_LIBSSL
-    if (smpp->use_ssl)
-        conn = conn_open_ssl(smpp->host, smpp->receive_port, smpp->ssl_client_certkey_file, smpp->conn->our_host);
-    else
-#endif
-
-    if (smpp->our_receiver_port > 0)
-        conn = conn_open_tcp_with_port(smpp->host, smpp->receive_port, smpp->our_receiver_port, smpp->conn->our_host);
-    else
-        conn = conn_open_tcp(smpp->host, smpp->receive_port, smpp->conn->our_host);
-
-    if (conn == NULL) {
-        error(0, "SMPP[%s]: Couldn't connect to server.",
-              octstr_get_cstr(smpp->conn->id));
-        return NULL;
-    }
-
-    bind = smpp_pdu_create(bind_receiver,
-                counter_increase(smpp->message_id_counter));
-    bind->u.bind_receiver.system_id = octstr_duplicate(smpp->username);
-    bind->u.bind_receiver.password = octstr_duplicate(smpp->password);
-    if (smpp->system_type == NULL)
-        bind->u.bind_receiver.system_type = octstr_create("VMA");
-    else
-        bind->u.bind_receiver.system_type =
-            octstr_duplicate(smpp->system_type);
-    bind->u.bind_receiver.interface_version = smpp->version;
-    bind->u.bind_receiver.address_range =
-        octstr_duplicate(smpp->address_range);
-    bind->u.bind_receiver.addr_ton = smpp->bind_addr_ton;
-    bind->u.bind_receiver.addr_npi = smpp->bind_addr_npi;
-    if (send_pdu(conn, smpp, bind) == -1) {
-        error(0, "SMPP[%s]: Couldn't send bind_receiver to server.",
-              octstr_get_cstr(smpp->conn->id));
+    conn = open_connection(smpp, transmitter, 0);
+    if (conn != NULL && send_bind(smpp, conn, transmitter) == -1) {
         conn_destroy(conn);
         conn = NULL;
     }
-    smpp_pdu_destroy(bind);
 
     return conn;
 }
@@ -1652,10 +1924,7 @@ static Msg *handle_dlr(SMPP *smpp, Octstr *destination_addr, Octstr *short_messa
         dlrmsg->sms.sms_type = report_mo;
         dlrmsg->sms.account = octstr_duplicate(smpp->username);
         if (network_err != NULL) {
-            if (dlrmsg->sms.meta_data == NULL) {
-                dlrmsg->sms.meta_data = octstr_create("");
-            }
-            meta_data_set_value(dlrmsg->sms.meta_data, "smpp", octstr_imm("dlr_err"), network_err, 1);
+            meta_data_msg_set_value(dlrmsg, "smpp", octstr_imm("dlr_err"), network_err, 1);
         }
     } else {
         error(0,"SMPP[%s]: got DLR but could not find message or was not interested "
@@ -1686,11 +1955,10 @@ static long smscconn_failure_reason_to_smpp_status(long reason)
 }
 
 
-static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
-                      long *pending_submits)
+static int handle_pdu(struct smpp_session *session, Connection *conn, SMPP_PDU *pdu)
 {
+    SMPP *smpp = session->smpp;
     SMPP_PDU *resp = NULL;
-    Octstr *os;
     Msg *msg = NULL, *dlrmsg=NULL;
     struct smpp_msg *smpp_msg = NULL;
     long reason, cmd_stat;
@@ -1700,7 +1968,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
      * In order to keep the protocol implementation logically clean,
      * we will obey the required SMPP session state while processing
      * the PDUs, see Table 2-1, SMPP v3.4 spec, section 2.3, page 17.
-     * Therefore we will interpret our abstracted smpp->conn->status
+     * Therefore we will interpret our abstracted session->status
      * value as SMPP session state here.
      */
     switch (pdu->type) {
@@ -1708,8 +1976,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1736,9 +2004,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                  dlrmsg = handle_dlr(smpp, pdu->u.data_sm.source_addr, NULL, pdu->u.data_sm.message_payload,
                                      pdu->u.data_sm.receipted_message_id, pdu->u.data_sm.message_state, pdu->u.data_sm.network_error_code);
                  if (dlrmsg != NULL) {
-                     if (dlrmsg->sms.meta_data == NULL)
-                         dlrmsg->sms.meta_data = octstr_create("");
-                     meta_data_set_values(dlrmsg->sms.meta_data, pdu->u.data_sm.tlv, "smpp", 0);
+                     meta_data_msg_set_values(dlrmsg, pdu->u.data_sm.tlv, "smpp", 0);
                      /* passing DLR to upper layer */
                      reason = bb_smscconn_receive(smpp->conn, dlrmsg);
                  } else {
@@ -1775,8 +2041,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1810,9 +2076,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                                     pdu->u.deliver_sm.receipted_message_id, pdu->u.deliver_sm.message_state, pdu->u.deliver_sm.network_error_code);
                 resp = smpp_pdu_create(deliver_sm_resp, pdu->u.deliver_sm.sequence_number);
                 if (dlrmsg != NULL) {
-                    if (dlrmsg->sms.meta_data == NULL)
-                        dlrmsg->sms.meta_data = octstr_create("");
-                    meta_data_set_values(dlrmsg->sms.meta_data, pdu->u.deliver_sm.tlv, "smpp", 0);
+                    meta_data_msg_set_values(dlrmsg, pdu->u.deliver_sm.tlv, "smpp", 0);
                     /* passing DLR to upper layer */
                     reason = bb_smscconn_receive(smpp->conn, dlrmsg);
                 } else {
@@ -1855,8 +2119,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1869,8 +2133,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1887,15 +2151,13 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE)) {
+            if (!(session->status == SMSCCONN_ACTIVE)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
 
-            os = octstr_format("%ld", pdu->u.submit_sm_resp.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = sent_queue_remove(session->sent_msgs, pdu->u.submit_sm_resp.sequence_number);
             if (smpp_msg == NULL) {
                 warning(0, "SMPP[%s]: SMSC sent submit_sm_resp PDU "
                         "with wrong sequence number 0x%08lx",
@@ -1907,9 +2169,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             smpp_msg_destroy(smpp_msg, 0);
 
             /* pack submit_sm_resp TLVs into metadata */
-            if (msg->sms.meta_data == NULL)
-                msg->sms.meta_data = octstr_create("");
-            meta_data_set_values(msg->sms.meta_data, pdu->u.submit_sm_resp.tlv, "smpp_resp", 1);
+            meta_data_msg_set_values(msg, pdu->u.submit_sm_resp.tlv, "smpp_resp", 1);
 
             if (pdu->u.submit_sm_resp.command_status != 0) {
                 error(0, "SMPP[%s]: SMSC returned error code 0x%08lx (%s) "
@@ -1931,7 +2191,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 
                 bb_smscconn_send_failed(smpp->conn, msg, reason, octstr_format("0x%08lx/%s", pdu->u.submit_sm_resp.command_status,
                                         smpp_error_to_string(pdu->u.submit_sm_resp.command_status)));
-                --(*pending_submits);
+                --session->pending_submits;
             }
             else if (pdu->u.submit_sm_resp.message_id != NULL) {
                 Octstr *tmp;
@@ -1967,7 +2227,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                 }
 
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --session->pending_submits;
             } /* end if for SMSC ACK */
             else {
                 error(0, "SMPP[%s]: SMSC returned error code 0x%08lx (%s) "
@@ -1976,7 +2236,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.submit_sm_resp.command_status,
                       smpp_error_to_string(pdu->u.submit_sm_resp.command_status));
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --session->pending_submits;
             }
             break;
 
@@ -1984,8 +2244,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -1996,20 +2256,15 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_transmitter_resp.command_status,
                 smpp_error_to_string(pdu->u.bind_transmitter_resp.command_status));
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_DISCONNECTED;
-                mutex_unlock(smpp->conn->flow_mutex);
+                smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
                 if (pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVSYSID ||
                     pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVPASWD ||
                     pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                     smpp->quitting = 1;
                 }
             } else {
-                *pending_submits = 0;
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
-                mutex_unlock(smpp->conn->flow_mutex);
+                session->pending_submits = 0;
+                smpp_session_set_status(session, SMSCCONN_ACTIVE);
                 bb_smscconn_connected(smpp->conn);
             }
             break;
@@ -2018,8 +2273,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2030,20 +2285,15 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_transceiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_transceiver_resp.command_status));
-                 mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
-                 mutex_unlock(smpp->conn->flow_mutex);
+                 smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
                  if (pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVPASWD ||
                      pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                      smpp->quitting = 1;
                  }
             } else {
-                *pending_submits = 0;
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
-                mutex_unlock(smpp->conn->flow_mutex);
+                session->pending_submits = 0;
+                smpp_session_set_status(session, SMSCCONN_ACTIVE);
                 bb_smscconn_connected(smpp->conn);
             }
             break;
@@ -2052,8 +2302,8 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV) {
+            if (session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2064,22 +2314,14 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_receiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_receiver_resp.command_status));
-                 mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
-                 mutex_unlock(smpp->conn->flow_mutex);
+                 smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
                  if (pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVPASWD ||
                      pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                      smpp->quitting = 1;
                  }
             } else {
-                /* set only receive status if no transmit is bind */
-                mutex_lock(smpp->conn->flow_mutex);
-                if (smpp->conn->status != SMSCCONN_ACTIVE) {
-                    smpp->conn->status = SMSCCONN_ACTIVE_RECV;
-                    time(&smpp->conn->connect_time);
-                }
-                mutex_unlock(smpp->conn->flow_mutex);
+                smpp_session_set_status(session, SMSCCONN_ACTIVE_RECV);
             }
             break;
 
@@ -2087,40 +2329,36 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
             resp = smpp_pdu_create(unbind_resp, pdu->u.unbind.sequence_number);
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
-            mutex_unlock(smpp->conn->flow_mutex);
-            *pending_submits = -1;
+            smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
+            session->pending_submits = -1;
             break;
 
         case unbind_resp:
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
             }
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
-            mutex_unlock(smpp->conn->flow_mutex);
+            smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
             break;
 
         case generic_nack:
             /*
              * Session state check
              */
-            if (!(smpp->conn->status == SMSCCONN_ACTIVE ||
-                    smpp->conn->status == SMSCCONN_ACTIVE_RECV)) {
+            if (!(session->status == SMSCCONN_ACTIVE ||
+                    session->status == SMSCCONN_ACTIVE_RECV)) {
                 warning(0, "SMPP[%s]: SMSC sent %s PDU while session not bound, ignored.",
                         octstr_get_cstr(smpp->conn->id), pdu->type_name);
                 return 0;
@@ -2128,9 +2366,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 
             cmd_stat  = pdu->u.generic_nack.command_status;
 
-            os = octstr_format("%ld", pdu->u.generic_nack.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = sent_queue_remove(session->sent_msgs, pdu->u.generic_nack.sequence_number);
 
             if (smpp_msg == NULL) {
                 error(0, "SMPP[%s]: SMSC rejected last command, code 0x%08lx (%s).",
@@ -2158,7 +2394,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                 reason = smpp_status_to_smscconn_failure_reason(cmd_stat);
                 bb_smscconn_send_failed(smpp->conn, msg, reason,
                                         octstr_format("0x%08lx/%s", cmd_stat, smpp_error_to_string(cmd_stat)));
-                --(*pending_submits);
+                --session->pending_submits;
             }
             break;
         
@@ -2182,86 +2418,117 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 }
 
 
-struct io_arg {
-    SMPP *smpp;
-    int transmitter;
-};
-
-
-static struct io_arg *io_arg_create(SMPP *smpp, int transmitter)
-{
-    struct io_arg *io_arg;
-
-    io_arg = gw_malloc(sizeof(*io_arg));
-    io_arg->smpp = smpp;
-    io_arg->transmitter = transmitter;
-    return io_arg;
-}
-
-
 /*
  * sent queue cleanup.
  * @return 1 if io_thread should reconnect; 0 if not
  */
-static int do_queue_cleanup(SMPP *smpp, long *pending_submits)
+static int do_queue_cleanup(struct smpp_session *session)
 {
-    List *keys;
-    Octstr *key;
+    SMPP *smpp = session->smpp;
     struct smpp_msg *smpp_msg;
     time_t now = time(NULL);
 
-    if (*pending_submits <= 0)
+    if (session->pending_submits <= 0)
         return 0;
 
     /* check if action set to wait ack for ever */
     if (smpp->wait_ack_action == SMPP_WAITACK_NEVER_EXPIRE)
         return 0;
 
-    keys = dict_keys(smpp->sent_msgs);
-    if (keys == NULL)
-        return 0;
-
-    while ((key = gwlist_extract_first(keys)) != NULL) {
-        smpp_msg = dict_get(smpp->sent_msgs, key);
-        if (smpp_msg != NULL && difftime(now, smpp_msg->sent_time) > smpp->wait_ack) {
-            switch(smpp->wait_ack_action) {
-                case SMPP_WAITACK_RECONNECT: /* reconnect */
-                    /* found at least one not acked msg */
-                    warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
-                                   octstr_get_cstr(smpp->conn->id));
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 1; /* io_thread will reconnect */
-                case SMPP_WAITACK_REQUEUE: /* requeue */
-                    smpp_msg = dict_remove(smpp->sent_msgs, key);
-                    if (smpp_msg != NULL) {
-                        warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
-                                   " SENT<%ld>sec. ago, SEQ<%s>, DST<%s>",
-                                   octstr_get_cstr(smpp->conn->id),
-                                   (long)difftime(now, smpp_msg->sent_time) ,
-                                   octstr_get_cstr(key),
-                                   octstr_get_cstr(smpp_msg->msg->sms.receiver));
-                        bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
-                        smpp_msg_destroy(smpp_msg, 0);
-                        (*pending_submits)--;
-                    }
-                    break;
-                default:
-                    error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
-                          octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 0;
+    switch(smpp->wait_ack_action) {
+        case SMPP_WAITACK_RECONNECT: /* reconnect */
+            if (sent_queue_expired(session->sent_msgs, now, smpp->wait_ack, 0) != NULL) {
+                /* found at least one not acked msg */
+                warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
+                               octstr_get_cstr(smpp->conn->id));
+                return 1; /* io_thread will reconnect */
             }
-        }
-        octstr_destroy(key);
+            break;
+        case SMPP_WAITACK_REQUEUE: /* requeue */
+            while ((smpp_msg = sent_queue_expired(session->sent_msgs, now, smpp->wait_ack, 1)) != NULL) {
+                warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
+                           " SENT<%ld>sec. ago, SEQ<%lu>, DST<%s>",
+                           octstr_get_cstr(smpp->conn->id),
+                           (long)difftime(now, smpp_msg->sent_time) ,
+                           smpp_msg->sequence_number,
+                           octstr_get_cstr(smpp_msg->msg->sms.receiver));
+                bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
+                smpp_msg_destroy(smpp_msg, 0);
+                session->pending_submits--;
+            }
+            break;
+        default:
+            error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
+                  octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
+            break;
     }
-    gwlist_destroy(keys, octstr_destroy_item);
 
     return 0;
 }
 
 
+/*
+ * Hand the submits still waiting for a response on a failed bind over
+ * to the other bound sessions of the group via the shared send queue.
+ * Does nothing if no other transmitting session is bound.
+ */
+static void smpp_session_rebalance(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    struct smpp_msg *smpp_msg;
+    long count = 0;
+
+    if (smpp_active_transmitters(smpp, session) == 0)
+        return;
+
+    while ((smpp_msg = sent_queue_extract_first(session->sent_msgs)) != NULL) {
+        gw_prioqueue_produce(smpp->msgs_to_send, smpp_msg->msg);
+        smpp_msg_destroy(smpp_msg, 0);
+        count++;
+    }
+    session->pending_submits = -1;
+
+    if (count > 0) {
+        debug("bb.sms.smpp", 0, "SMPP[%s]: Session %ld moved %ld pending submits to other sessions.",
+              octstr_get_cstr(smpp->conn->id), session->index, count);
+        smpp_wakeup_transmitter(smpp, session);
+    }
+}
+
+
+/*
+ * Called after a session lost its connection. Put all queued messages
+ * back into global queue,so if we have another link running than
+ * messages will be delivered quickly. If another session of our own
+ * group is still bound, it keeps sending from the shared queue instead.
+ */
+static void smpp_session_requeue(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    Msg *msg;
+    struct smpp_msg *smpp_msg;
+    long reason;
+
+    if (!session->transmitter)
+        return;
+
+    if (!smpp->quitting && smpp_active_transmitters(smpp, session) > 0) {
+        smpp_session_rebalance(session);
+        return;
+    }
+
+    reason = (smpp->quitting?SMSCCONN_FAILED_SHUTDOWN:SMSCCONN_FAILED_TEMPORARILY);
+
+    while((msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
+        bb_smscconn_send_failed(smpp->conn, msg, reason, NULL);
+
+    while((smpp_msg = sent_queue_extract_first(session->sent_msgs)) != NULL) {
+        bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
+        smpp_msg_destroy(smpp_msg, 0);
+    }
+}
+
+
 /*
  * This is the main function for the background thread for doing I/O on
  * one SMPP connection (the one for transmitting or receiving messages).
@@ -2271,36 +2538,29 @@ static int do_queue_cleanup(SMPP *smpp, long *pending_submits)
 static void io_thread(void *arg)
 {
     SMPP *smpp;
-    struct io_arg *io_arg;
+    struct smpp_session *session;
     int transmitter;
     Connection *conn;
     int ret;
-    long pending_submits;
     long len;
     SMPP_PDU *pdu;
     double timeout;
     time_t last_cleanup, last_enquire_sent, last_response, now;
 
-    io_arg = arg;
-    smpp = io_arg->smpp;
-    transmitter = io_arg->transmitter;
-    gw_free(io_arg);
+    session = arg;
+    smpp = session->smpp;
+    transmitter = session->transmitter;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(smpp->conn->log_idx);
 
-#define IS_ACTIVE (smpp->conn->status == SMSCCONN_ACTIVE || smpp->conn->status == SMSCCONN_ACTIVE_RECV)
+#define IS_ACTIVE (session->status == SMSCCONN_ACTIVE || session->status == SMSCCONN_ACTIVE_RECV)
 
     conn = NULL;
     while (!smpp->quitting) {
-        if (transmitter == 1)
-            conn = open_transmitter(smpp);
-        else if (transmitter == 2)
-            conn = open_transceiver(smpp);
-        else
-            conn = open_receiver(smpp);
+        conn = open_session(smpp, transmitter);
         
-        pending_submits = -1;
+        session->pending_submits = -1;
         len = 0;
         last_response = last_cleanup = last_enquire_sent = time(NULL);
         while(conn != NULL) {
@@ -2320,7 +2580,7 @@ static void io_thread(void *arg)
             } else if (ret == 1) { /* data available */
                 /* Deal with the PDU we just got */
                 dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
-                ret = handle_pdu(smpp, conn, pdu, &pending_submits);
+                ret = handle_pdu(session, conn, pdu);
                 smpp_pdu_destroy(pdu);
                 if (ret == -1) {
                     error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
@@ -2333,7 +2593,7 @@ static void io_thread(void *arg)
                  * Note: Function handle_pdu will set status to SMSCCONN_DISCONNECTED
                  * when unbind was received.
                  */
-                if (smpp->conn->status == SMSCCONN_DISCONNECTED)
+                if (session->status == SMSCCONN_DISCONNECTED)
                     break;
                 
                 /*
@@ -2367,11 +2627,11 @@ static void io_thread(void *arg)
                 if (!IS_ACTIVE && timeout <= 0)
                     timeout = smpp->enquire_link_interval;
                 if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
-                    smpp->throttling_err_time > 0 && pending_submits < smpp->max_pending_submits) {
+                    smpp->throttling_err_time > 0 && session->pending_submits < smpp->max_pending_submits) {
                     time_t tr_timeout = smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME - now;
                     timeout = timeout > tr_timeout ? tr_timeout : timeout;
                 } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 && smpp->conn->throughput > 0 &&
-                           smpp->max_pending_submits > pending_submits) {
+                           smpp->max_pending_submits > session->pending_submits) {
                     double t = 1.0 / smpp->conn->throughput;
                     timeout = t < timeout ? t : timeout;
                 }
@@ -2386,7 +2646,7 @@ static void io_thread(void *arg)
             
             /* cleanup sent queue */
             if (transmitter && difftime(time(NULL), last_cleanup) > smpp->wait_ack) {
-                if (do_queue_cleanup(smpp, &pending_submits))
+                if (do_queue_cleanup(session))
                     break; /* reconnect */
                 time(&last_cleanup);
             }
@@ -2394,7 +2654,7 @@ static void io_thread(void *arg)
             /* make sure we send */
             if (transmitter && difftime(time(NULL), smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
                 smpp->throttling_err_time = 0;
-                if (send_messages(smpp, conn, &pending_submits) == -1)
+                if (send_messages(session, conn) == -1)
                     break;
             }
             
@@ -2410,7 +2670,7 @@ static void io_thread(void *arg)
                       difftime(time(NULL), last_response) < SMPP_DEFAULT_SHUTDOWN_TIMEOUT) {
                     if (read_pdu(smpp, conn, &len, &pdu) == 1) {
                         dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
-                        handle_pdu(smpp, conn, pdu, &pending_submits);
+                        handle_pdu(session, conn, pdu);
                         smpp_pdu_destroy(pdu);
                     }
                 }
@@ -2429,52 +2689,32 @@ static void io_thread(void *arg)
         if (!smpp->quitting) {
             error(0, "SMPP[%s]: Couldn't connect to SMS center (retrying in %ld seconds).",
                   octstr_get_cstr(smpp->conn->id), smpp->conn->reconnect_delay);
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_RECONNECTING;
-            mutex_unlock(smpp->conn->flow_mutex);
+            smpp_session_set_status(session, SMSCCONN_RECONNECTING);
+            /* let the other binds of the group take over right away */
+            if (transmitter)
+                smpp_session_rebalance(session);
             gwthread_sleep(smpp->conn->reconnect_delay);
         }
-        /*
-         * put all queued messages back into global queue,so if
-         * we have another link running than messages will be delivered
-         * quickly
-         */
-        if (transmitter) {
-            Msg *msg;
-            struct smpp_msg *smpp_msg;
-            List *noresp;
-            Octstr *key;
-
-            long reason = (smpp->quitting?SMSCCONN_FAILED_SHUTDOWN:SMSCCONN_FAILED_TEMPORARILY);
-
-            while((msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
-                bb_smscconn_send_failed(smpp->conn, msg, reason, NULL);
-
-            noresp = dict_keys(smpp->sent_msgs);
-            while((key = gwlist_extract_first(noresp)) != NULL) {
-                smpp_msg = dict_remove(smpp->sent_msgs, key);
-                if (smpp_msg != NULL) {
-                    bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
-                    smpp_msg_destroy(smpp_msg, 0);
-                }
-                octstr_destroy(key);
-            }
-            gwlist_destroy(noresp, NULL);
-        }
+        smpp_session_requeue(session);
     }
     
 #undef IS_ACTIVE
     
     /*
      * Shutdown sequence as follow:
-     *    1) if this is TX session so join receiver and free SMPP
-     *    2) if RX session available but no TX session so nothing to join then free SMPP
+     *    1) the first session joins all other sessions and frees SMPP
+     *    2) all other sessions just exit
      */
-    if (transmitter && smpp->receiver != -1) {
-        gwthread_wakeup(smpp->receiver);
-        gwthread_join(smpp->receiver);
-    }
-    if (transmitter || smpp->transmitter == -1) {
+    if (session == smpp->sessions[0]) {
+        long i;
+
+        for (i = 1; i < smpp->num_sessions; i++) {
+            if (smpp->sessions[i]->thread != -1) {
+                gwthread_wakeup(smpp->sessions[i]->thread);
+                gwthread_join(smpp->sessions[i]->thread);
+            }
+        }
+
         debug("bb.smpp", 0, "SMSCConn %s shut down.",
               octstr_get_cstr(smpp->conn->name));
         
@@ -2489,6 +2729,468 @@ static void io_thread(void *arg)
 }
 
 
+/***********************************************************************
+ * Event loop engine. Instead of one io_thread per session, sessions of
+ * all SMSCConns with event-loops set are spread over a small, shared
+ * pool of loop threads. Each loop thread owns its sessions: it polls
+ * their connections together, decodes every complete PDU that has
+ * arrived and runs the same timers as io_thread, without blocking on
+ * any single session. Other threads only touch sessions through the
+ * shared send queue, the status and gwthread_wakeup() on the loop.
+ */
+
+struct smpp_loop {
+    long thread;
+    List *sessions;
+    struct smpp_engine *engine;
+};
+
+struct smpp_engine {
+    struct smpp_loop **loops;
+    long num_loops;
+    long next_loop;
+    long users;
+    long loops_running;
+    int running;
+};
+
+/* created and cleared under engine_lock; creation of SMSCConns is serialized */
+static struct smpp_engine *engine = NULL;
+static Mutex *engine_lock = NULL;
+
+/* upper bound for the time a loop sleeps, so that timers are checked */
+#define SMPP_LOOP_MAX_WAIT  1.0
+
+
+static void smpp_loop_thread(void *arg);
+
+
+static int engine_add_loop(struct smpp_engine *e)
+{
+    struct smpp_loop *loop;
+
+    loop = gw_malloc(sizeof(*loop));
+    loop->sessions = gwlist_create();
+    loop->engine = e;
+    loop->thread = gwthread_create(smpp_loop_thread, loop);
+    if (loop->thread == -1) {
+        gwlist_destroy(loop->sessions, NULL);
+        gw_free(loop);
+        return -1;
+    }
+    e->loops = gw_realloc(e->loops, (e->num_loops + 1) * sizeof(*e->loops));
+    e->loops[e->num_loops++] = loop;
+    e->loops_running++;
+
+    return 0;
+}
+
+
+/*
+ * Attach all sessions of smpp to the engine, starting it or adding
+ * loops as needed to have at least smpp->event_loops of them.
+ * Return -1 if no loop thread could be started.
+ */
+static int engine_attach(SMPP *smpp)
+{
+    struct smpp_loop *loop;
+    long i;
+    int ret = 0;
+
+    if (engine_lock == NULL)
+        engine_lock = mutex_create();
+
+    mutex_lock(engine_lock);
+    if (engine == NULL) {
+        engine = gw_malloc(sizeof(*engine));
+        engine->loops = NULL;
+        engine->num_loops = engine->next_loop = 0;
+        engine->users = engine->loops_running = 0;
+        engine->running = 1;
+    }
+    while (engine->num_loops < smpp->event_loops) {
+        if (engine_add_loop(engine) == -1)
+            break;
+    }
+    if (engine->num_loops == 0) {
+        gw_free(engine);
+        engine = NULL;
+        ret = -1;
+    } else {
+        engine->users++;
+        smpp->sessions_running = smpp->num_sessions;
+        for (i = 0; i < smpp->num_sessions; i++) {
+            loop = engine->loops[engine->next_loop++ % engine->num_loops];
+            smpp->sessions[i]->loop = loop;
+            smpp->sessions[i]->thread = loop->thread;
+            gwlist_append(loop->sessions, smpp->sessions[i]);
+            gwthread_wakeup(loop->thread);
+        }
+    }
+    mutex_unlock(engine_lock);
+
+    return ret;
+}
+
+
+/* An SMSCConn stopped using the engine. The last one stops the loops. */
+static void engine_release(void)
+{
+    long i;
+
+    mutex_lock(engine_lock);
+    if (--engine->users == 0) {
+        engine->running = 0;
+        for (i = 0; i < engine->num_loops; i++)
+            gwthread_wakeup(engine->loops[i]->thread);
+        /* loops free the engine when they are done, see smpp_loop_thread() */
+        engine = NULL;
+    }
+    mutex_unlock(engine_lock);
+}
+
+
+/*
+ * Called by the loop when a session of a quitting SMSCConn has been
+ * closed. The last session shuts down the SMSCConn, the way the first
+ * io_thread does in the threaded mode.
+ */
+static void engine_session_done(struct smpp_session *session)
+{
+    SMPP *smpp = session->smpp;
+    int last;
+
+    gwlist_delete_equal(session->loop->sessions, session);
+    session->loop = NULL;
+
+    mutex_lock(smpp->conn->flow_mutex);
+    last = (--smpp->sessions_running == 0);
+    mutex_unlock(smpp->conn->flow_mutex);
+
+    if (!last)
+        return;
+
+    debug("bb.smpp", 0, "SMSCConn %s shut down.",
+          octstr_get_cstr(smpp->conn->name));
+
+    mutex_lock(smpp->conn->flow_mutex);
+    smpp->conn->status = SMSCCONN_DEAD;
+    smpp->conn->data = NULL;
+    mutex_unlock(smpp->conn->flow_mutex);
+
+    smpp_destroy(smpp);
+    bb_smscconn_killed();
+    engine_release();
+}
+
+
+/*
+ * Close the connection of a session. Unless we are quitting, try to
+ * reconnect after reconnect-delay seconds.
+ */
+static void engine_session_close(struct smpp_session *session, time_t now)
+{
+    SMPP *smpp = session->smpp;
+
+    if (session->conn != NULL) {
+        conn_destroy(session->conn);
+        session->conn = NULL;
+    }
+    session->unbind_time = 0;
+
+    if (smpp->quitting) {
+        smpp_session_set_status(session, SMSCCONN_DISCONNECTED);
+        smpp_session_requeue(session);
+        return;
+    }
+
+    error(0, "SMPP[%s]: Couldn't connect to SMS center (retrying in %ld seconds).",
+          octstr_get_cstr(smpp->conn->id), smpp->conn->reconnect_delay);
+    smpp_session_set_status(session, SMSCCONN_RECONNECTING);
+    /* let the other binds of the group take over right away */
+    if (session->transmitter)
+        smpp_session_rebalance(session);
+    session->reconnect_time = now + smpp->conn->reconnect_delay;
+    session->requeue = 1;
+}
+
+
+/*
+ * Run the timers of a session, the same way io_thread does between
+ * reads: (re)connect, connection timeout, enquire links, sent queue
+ * cleanup, sending and unbinding when quitting.
+ * Return the seconds until the session wants to run again, or -1
+ * once the session is done.
+ */
+static double engine_session_run(struct smpp_session *session, time_t now)
+{
+    SMPP *smpp = session->smpp;
+    double timeout;
+
+#define IS_ACTIVE (session->status == SMSCCONN_ACTIVE || session->status == SMSCCONN_ACTIVE_RECV)
+
+    if (session->conn == NULL) {
+        if (smpp->quitting) {
+            if (session->requeue)
+                smpp_session_requeue(session);
+            return -1;
+        }
+        if (now < session->reconnect_time)
+            return difftime(session->reconnect_time, now);
+        if (session->requeue) {
+            smpp_session_requeue(session);
+            session->requeue = 0;
+        }
+        session->conn = open_connection(smpp, session->transmitter, 1);
+        if (session->conn == NULL) {
+            engine_session_close(session, now);
+            return difftime(session->reconnect_time, now);
+        }
+        session->pending_submits = -1;
+        session->len = 0;
+        session->last_response = session->last_cleanup = now;
+        session->last_enquire_sent = date_universal_now();
+        if (conn_is_connected(session->conn) == 0 &&
+            send_bind(smpp, session->conn, session->transmitter) == -1)
+            engine_session_close(session, now);
+        return SMPP_LOOP_MAX_WAIT;
+    }
+
+    /* still waiting for the connect to finish */
+    if (conn_is_connected(session->conn) != 0) {
+        if (smpp->quitting || (smpp->connection_timeout > 0 &&
+            difftime(now, session->last_response) > smpp->connection_timeout))
+            engine_session_close(session, now);
+        return SMPP_LOOP_MAX_WAIT;
+    }
+
+    if (smpp->connection_timeout > 0 &&
+        difftime(now, session->last_response) > smpp->connection_timeout) {
+        /* connection seems to be broken */
+        warning(0, "Got no responses within %ld sec., reconnecting...",
+                (long) difftime(now, session->last_response));
+        engine_session_close(session, now);
+        return 0;
+    }
+
+    /* send enquire link, only if connection is active */
+    if (IS_ACTIVE && send_enquire_link(smpp, session->conn, &session->last_enquire_sent) == -1) {
+        engine_session_close(session, now);
+        return 0;
+    }
+
+    /* cleanup sent queue */
+    if (session->transmitter && difftime(now, session->last_cleanup) > smpp->wait_ack) {
+        if (do_queue_cleanup(session)) {
+            engine_session_close(session, now);
+            return 0;
+        }
+        session->last_cleanup = now;
+    }
+
+    /* make sure we send */
+    if (session->transmitter && difftime(now, smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
+        smpp->throttling_err_time = 0;
+        if (send_messages(session, session->conn) == -1) {
+            engine_session_close(session, now);
+            return 0;
+        }
+    }
+
+    /*
+     * unbind
+     * Keep reading so long as unbind_resp received or timeout passed.
+     * Otherwise we have double delivered messages.
+     */
+    if (smpp->quitting) {
+        if (session->unbind_time == 0) {
+            if (!IS_ACTIVE || send_unbind(smpp, session->conn) == -1) {
+                engine_session_close(session, now);
+                return 0;
+            }
+            session->unbind_time = now;
+        } else if (!IS_ACTIVE ||
+                   difftime(now, session->unbind_time) >= SMPP_DEFAULT_SHUTDOWN_TIMEOUT) {
+            engine_session_close(session, now);
+            return 0;
+        }
+        return SMPP_LOOP_MAX_WAIT;
+    }
+
+    timeout = session->last_enquire_sent + smpp->enquire_link_interval - date_universal_now();
+    if (timeout <= 0 || !IS_ACTIVE)
+        timeout = SMPP_LOOP_MAX_WAIT;
+    if (session->transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
+        smpp->max_pending_submits > session->pending_submits) {
+        if (smpp->throttling_err_time > 0)
+            timeout = SMPP_THROTTLING_SLEEP_TIME;
+        else if (smpp->conn->throughput > 0 && 1.0 / smpp->conn->throughput < timeout)
+            timeout = 1.0 / smpp->conn->throughput;
+    }
+
+#undef IS_ACTIVE
+
+    return timeout;
+}
+
+
+/*
+ * Handle poll events of a session: finish a pending connect, or decode
+ * and handle every complete PDU that has arrived and push out queued
+ * output.
+ */
+static void engine_session_io(struct smpp_session *session, int revents, time_t now)
+{
+    SMPP *smpp = session->smpp;
+    SMPP_PDU *pdu;
+    int ret;
+
+    if (conn_is_connected(session->conn) != 0) {
+        if (conn_get_connect_result(session->conn) == -1) {
+            error(0, "SMPP[%s]: Couldn't connect to server.",
+                  octstr_get_cstr(smpp->conn->id));
+            engine_session_close(session, now);
+        } else if (send_bind(smpp, session->conn, session->transmitter) == -1)
+            engine_session_close(session, now);
+        return;
+    }
+
+    /* write out whatever is left in the output buffer */
+    if ((revents & POLLOUT) && conn_wait(session->conn, 0) == -1) {
+        error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+              octstr_get_cstr(smpp->conn->id));
+        engine_session_close(session, now);
+        return;
+    }
+
+    if (!(revents & (POLLIN | POLLERR | POLLHUP)))
+        return;
+
+    while ((ret = read_pdu(smpp, session->conn, &session->len, &pdu)) != 0) {
+        if (ret == -1) { /* connection broken */
+            error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                  octstr_get_cstr(smpp->conn->id));
+            engine_session_close(session, now);
+            return;
+        } else if (ret == -2) {
+            /* wrong pdu length , send gnack */
+            session->len = 0;
+            if (send_gnack(smpp, session->conn, SMPP_ESME_RINVCMDLEN, 0) == -1) {
+                error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                      octstr_get_cstr(smpp->conn->id));
+                engine_session_close(session, now);
+                return;
+            }
+            continue;
+        }
+
+        dump_pdu("Got PDU:", smpp->conn->id, pdu, smpp->log_format);
+        ret = handle_pdu(session, session->conn, pdu);
+        smpp_pdu_destroy(pdu);
+        if (ret == -1) {
+            error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
+                  octstr_get_cstr(smpp->conn->id));
+            engine_session_close(session, now);
+            return;
+        }
+        /* unbind received or bind rejected */
+        if (session->status == SMSCCONN_DISCONNECTED) {
+            engine_session_close(session, now);
+            return;
+        }
+        if (session->status == SMSCCONN_ACTIVE || session->status == SMSCCONN_ACTIVE_RECV)
+            session->last_response = now;
+    }
+}
+
+
+static void smpp_loop_thread(void *arg)
+{
+    struct smpp_loop *loop = arg;
+    struct smpp_engine *e = loop->engine;
+    struct smpp_session **sessions = NULL, **polled = NULL;
+    struct pollfd *fds = NULL;
+    long i, num, nfds, size = 0;
+    double timeout, t;
+    time_t now;
+    int last;
+
+    while (1) {
+        /* sessions are only added by engine_attach and removed by us */
+        gwlist_lock(loop->sessions);
+        num = gwlist_len(loop->sessions);
+        if (num > size) {
+            size = num;
+            sessions = gw_realloc(sessions, size * sizeof(*sessions));
+            polled = gw_realloc(polled, size * sizeof(*polled));
+            fds = gw_realloc(fds, size * sizeof(*fds));
+        }
+        for (i = 0; i < num; i++)
+            sessions[i] = gwlist_get(loop->sessions, i);
+        gwlist_unlock(loop->sessions);
+
+        if (num == 0) {
+            mutex_lock(engine_lock);
+            if (!e->running && gwlist_len(loop->sessions) == 0) {
+                mutex_unlock(engine_lock);
+                break;
+            }
+            mutex_unlock(engine_lock);
+        }
+
+        time(&now);
+        timeout = (num == 0 ? -1 : SMPP_LOOP_MAX_WAIT);
+        nfds = 0;
+        for (i = 0; i < num; i++) {
+            log_thread_to(sessions[i]->smpp->conn->log_idx);
+            t = engine_session_run(sessions[i], now);
+            if (t < 0) {
+                engine_session_done(sessions[i]);
+                continue;
+            }
+            if (t < timeout)
+                timeout = t;
+            if (sessions[i]->conn == NULL)
+                continue;
+            fds[nfds].fd = conn_get_id(sessions[i]->conn);
+            fds[nfds].events = POLLIN;
+            if (conn_is_connected(sessions[i]->conn) != 0 || conn_outbuf_len(sessions[i]->conn) > 0)
+                fds[nfds].events |= POLLOUT;
+            fds[nfds].revents = 0;
+            polled[nfds++] = sessions[i];
+        }
+        log_thread_to(0);
+
+        if (gwthread_poll(fds, nfds, timeout) == -1)
+            continue;
+
+        time(&now);
+        for (i = 0; i < nfds; i++) {
+            if (fds[i].revents == 0)
+                continue;
+            log_thread_to(polled[i]->smpp->conn->log_idx);
+            engine_session_io(polled[i], fds[i].revents, now);
+        }
+        log_thread_to(0);
+    }
+
+    gw_free(sessions);
+    gw_free(polled);
+    gw_free(fds);
+    gwlist_destroy(loop->sessions, NULL);
+    gw_free(loop);
+
+    /* the last loop to go frees the engine */
+    mutex_lock(engine_lock);
+    last = (--e->loops_running == 0);
+    mutex_unlock(engine_lock);
+    if (last) {
+        gw_free(e->loops);
+        gw_free(e);
+    }
+}
+
+
 /***********************************************************************
  * Functions called by smscconn.c via the SMSCConn function pointers.
  */
@@ -2511,7 +3213,7 @@ static int send_msg_cb(SMSCConn *conn, Msg *msg)
 
     smpp = conn->data;
     gw_prioqueue_produce(smpp->msgs_to_send, msg_duplicate(msg));
-    gwthread_wakeup(smpp->transmitter);
+    smpp_wakeup_transmitter(smpp, NULL);
     return 0;
 }
 
@@ -2519,6 +3221,7 @@ static int send_msg_cb(SMSCConn *conn, Msg *msg)
 static int shutdown_cb(SMSCConn *conn, int finish_sending)
 {
     SMPP *smpp;
+    long i;
 
     if (conn == NULL)
         return -1;
@@ -2538,11 +3241,10 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
     }
 
     smpp->quitting = 1;
-    if  (smpp->transmitter != -1)
-        gwthread_wakeup(smpp->transmitter);
-
-    if (smpp->receiver != -1)
-        gwthread_wakeup(smpp->receiver);
+    for (i = 0; i < smpp->num_sessions; i++) {
+        if (smpp->sessions[i]->thread != -1)
+            gwthread_wakeup(smpp->sessions[i]->thread);
+    }
 
     mutex_unlock(conn->flow_mutex);
 
@@ -2589,6 +3291,7 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     Octstr *alt_addr_charset;
     long connection_timeout, wait_ack, wait_ack_action;
     long esm_class;
+    long sessions, event_loops, i;
 
     my_number = alt_addr_charset = alt_charset = NULL;
     transceiver_mode = 0;
@@ -2634,6 +3337,10 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     if (cfg_get_integer(&max_pending_submits, grp,
                         octstr_imm("max-pending-submits")) == -1)
         max_pending_submits = SMPP_MAX_PENDING_SUBMITS;
+    if (cfg_get_integer(&sessions, grp, octstr_imm("bind-sessions")) == -1)
+        sessions = 1;
+    if (cfg_get_integer(&event_loops, grp, octstr_imm("event-loops")) == -1)
+        event_loops = 0;
 
     /* Check that config is OK */
     ok = 1;
@@ -2671,6 +3378,18 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
         warning(0, "SMPP: receive-port for transceiver mode defined, ignoring.");
         receive_port = 0;
     } 
+    if (event_loops < 0) {
+        error(0, "SMPP: event-loops can not be negative.");
+        ok = 0;
+    }
+    if (sessions < 1) {
+        error(0, "SMPP: bind-sessions must be at least 1.");
+        ok = 0;
+    }
+    if (sessions > 1 && (our_port != 0 || our_receiver_port != 0)) {
+        error(0, "SMPP: Can not use our-port or our-receiver-port with more than one bind-sessions.");
+        ok = 0;
+    }
 
     if (!ok)
         return -1;
@@ -2799,25 +3518,45 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
      * I/O threads are only started if the corresponding ports
      * have been configured with positive numbers. Use 0 to
      * disable the creation of the corresponding thread.
+     * Each port gets bind-sessions sessions, transmitters first,
+     * and each session runs in its own thread.
      */
     if (port != 0)
-        smpp->transmitter = gwthread_create(io_thread, io_arg_create(smpp,
-                                           (transceiver_mode ? 2 : 1)));
+        smpp_add_sessions(smpp, sessions, (transceiver_mode ? 2 : 1));
     if (receive_port != 0)
-        smpp->receiver = gwthread_create(io_thread, io_arg_create(smpp, 0));
+        smpp_add_sessions(smpp, sessions, 0);
+
+    /*
+     * With event-loops set, the sessions are run by the shared pool of
+     * loop threads instead of one io_thread each.
+     */
+    smpp->event_loops = event_loops;
+    if (event_loops > 0) {
+        if (engine_attach(smpp) == -1) {
+            error(0, "SMPP[%s]: Couldn't start event loop threads.",
+                  octstr_get_cstr(smpp->conn->id));
+            smpp_destroy(conn->data);
+            conn->data = NULL;
+            return -1;
+        }
+        i = smpp->num_sessions;
+    } else {
+        for (i = 0; i < smpp->num_sessions; i++) {
+            smpp->sessions[i]->thread = gwthread_create(io_thread, smpp->sessions[i]);
+            if (smpp->sessions[i]->thread == -1)
+                break;
+        }
+    }
 
-    if ((port != 0 && smpp->transmitter == -1) ||
-        (receive_port != 0 && smpp->receiver == -1)) {
+    if (i < smpp->num_sessions) {
         error(0, "SMPP[%s]: Couldn't start I/O threads.",
               octstr_get_cstr(smpp->conn->id));
         smpp->quitting = 1;
-        if (smpp->transmitter != -1) {
-            gwthread_wakeup(smpp->transmitter);
-            gwthread_join(smpp->transmitter);
-        }
-        if (smpp->receiver != -1) {
-            gwthread_wakeup(smpp->receiver);
-            gwthread_join(smpp->receiver);
+        for (i = 0; i < smpp->num_sessions; i++) {
+            if (smpp->sessions[i]->thread != -1) {
+                gwthread_wakeup(smpp->sessions[i]->thread);
+                gwthread_join(smpp->sessions[i]->thread);
+            }
         }
         smpp_destroy(conn->data);
         conn->data = NULL;
@@ -243,6 +243,10 @@ SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
     load_add_interval(conn->outgoing_dlr_load, 300);
     load_add_interval(conn->outgoing_dlr_load, -1);
 
+    conn->queue_latency = histogram_create();
+    conn->submit_latency = histogram_create();
+    conn->dlr_latency = histogram_create();
+
 
 #define GET_OPTIONAL_VAL(x, n) x = cfg_get(grp, octstr_imm(n))
 #define SPLIT_OPTIONAL_VAL(x, n) \
@@ -422,6 +426,10 @@ int smscconn_destroy(SMSCConn *conn)
     load_destroy(conn->outgoing_sms_load);
     load_destroy(conn->outgoing_dlr_load);
 
+    histogram_destroy(conn->queue_latency);
+    histogram_destroy(conn->submit_latency);
+    histogram_destroy(conn->dlr_latency);
+
     octstr_destroy(conn->name);
     octstr_destroy(conn->id);
     octstr_destroy(conn->admin_id);
@@ -597,6 +605,7 @@ int smscconn_send(SMSCConn *conn, Msg *msg)
 {
     int ret = -1;
     List *parts = NULL;
+    long long now, queued;
     
     gw_assert(conn != NULL);
     mutex_lock(conn->flow_mutex);
@@ -605,6 +614,11 @@ int smscconn_send(SMSCConn *conn, Msg *msg)
         return -1;
     }
 
+    /* the parts and the driver's copies inherit the submit time */
+    now = histogram_now();
+    queued = msg->queued_usec;
+    msg->submitted_usec = now;
+
     /* if this a retry of splitted message, don't unify prefix and don't try to split */
     if (msg->sms.split_parts == NULL) {    
         /* normalize the destination number for this smsc */
@@ -657,6 +671,8 @@ int smscconn_send(SMSCConn *conn, Msg *msg)
         }
         gwlist_destroy(parts, msg_destroy_item);
     }
+    if (ret >= 0 && queued > 0)
+        histogram_record(conn->queue_latency, now - queued);
     mutex_unlock(conn->flow_mutex);
     return ret;
 }
@@ -216,6 +216,10 @@ struct smscconn {
     Load *incoming_dlr_load;
     Load *outgoing_dlr_load;
 
+    Histogram *queue_latency;   /* queued in bearerbox until smscconn_send() */
+    Histogram *submit_latency;  /* smscconn_send() until the SMSC answered */
+    Histogram *dlr_latency;     /* smscconn_send() until the final DLR */
+
     /* XXX: move rest global data from Smsc here
      */
 
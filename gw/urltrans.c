@@ -113,6 +113,8 @@ struct URLTranslation {
     Octstr *allow_ip;	/* allowed IPs to request send-sms with this 
     	    	    	   account */
     Octstr *deny_ip;	/* denied IPs to request send-sms with this account */
+    IPPatternList *allow_ip_patterns; /* allow_ip and deny_ip, compiled */
+    IPPatternList *deny_ip_patterns;
     Octstr *allowed_prefix;	/* Prefixes (of sender) allowed in this translation, or... */
     Octstr *denied_prefix;	/* ...denied prefixes */
     Octstr *allowed_recv_prefix; /* Prefixes (of receiver) allowed in this translation, or... */
@@ -150,6 +152,7 @@ struct URLTranslationList {
     List *list;
     List *defaults; /* List of default sms-services */
     Dict *names;	/* Dict of lowercase Octstr names */
+    Dict *users;	/* Dict of send-sms usernames, first one wins */
 };
 
 
@@ -187,6 +190,7 @@ URLTranslationList *urltrans_create(void)
     trans->list = gwlist_create();
     trans->defaults = gwlist_create();
     trans->names = dict_create(1024, destroy_keyword_list);
+    trans->users = dict_create(1024, NULL);
     return trans;
 }
 
@@ -196,6 +200,7 @@ void urltrans_destroy(URLTranslationList *trans)
     gwlist_destroy(trans->list, destroy_onetrans);
     gwlist_destroy(trans->defaults, destroy_onetrans);
     dict_destroy(trans->names);
+    dict_destroy(trans->users);
     gw_free(trans);
 }
 
@@ -221,6 +226,9 @@ int urltrans_add_one(URLTranslationList *trans, CfgGroup *grp)
     }
     gwlist_append(list2, ot);
 
+    if (ot->type == TRANSTYPE_SENDSMS)
+        dict_put_once(trans->users, ot->username, ot);
+
     return 0;
 }
 
@@ -283,18 +291,8 @@ URLTranslation *urltrans_find_service(URLTranslationList *trans, Msg *msg)
 
 URLTranslation *urltrans_find_username(URLTranslationList *trans, Octstr *name)
 {
-    URLTranslation *t;
-    int i;
-
     gw_assert(name != NULL);
-    for (i = 0; i < gwlist_len(trans->list); ++i) {
-	t = gwlist_get(trans->list, i);
-	if (t->type == TRANSTYPE_SENDSMS) {
-	    if (octstr_compare(name, t->username) == 0)
-		return t;
-	}
-    }
-    return NULL;
+    return dict_get(trans->users, name);
 }
 
 /*
@@ -679,7 +677,7 @@ Octstr *urltrans_fill_escape_codes(Octstr *pattern, Msg *request)
                 meta_param = octstr_copy(pattern, pos, (k-pos));
                 pos = k - 1;
                 if (request->sms.meta_data != NULL) {
-                    enc = meta_data_get_value(request->sms.meta_data,
+                    enc = meta_data_msg_get_value(request,
                             octstr_get_cstr(meta_group), meta_param);
                     octstr_url_encode(enc);
                     octstr_append(result, enc);
@@ -864,6 +862,11 @@ Octstr *urltrans_deny_ip(URLTranslation *t)
     return t->deny_ip;
 }
 
+int urltrans_is_allowed_ip(URLTranslation *t, Octstr *ip)
+{
+    return is_allowed_ip_patterns(t->allow_ip_patterns, t->deny_ip_patterns, ip);
+}
+
 Octstr *urltrans_allowed_prefix(URLTranslation *t) 
 {
     return t->allowed_prefix;
@@ -1174,6 +1177,8 @@ static URLTranslation *create_onetrans(CfgGroup *grp)
 
 	ot->deny_ip = cfg_get(grp, octstr_imm("user-deny-ip"));
 	ot->allow_ip = cfg_get(grp, octstr_imm("user-allow-ip"));
+	ot->deny_ip_patterns = ip_pattern_list_create(ot->deny_ip);
+	ot->allow_ip_patterns = ip_pattern_list_create(ot->allow_ip);
 	ot->default_sender = cfg_get(grp, octstr_imm("default-sender"));
     }
     
@@ -1276,6 +1281,8 @@ static void destroy_onetrans(void *p)
 	octstr_destroy(ot->default_smsc);
 	octstr_destroy(ot->allow_ip);
 	octstr_destroy(ot->deny_ip);
+	ip_pattern_list_destroy(ot->allow_ip_patterns);
+	ip_pattern_list_destroy(ot->deny_ip_patterns);
 	octstr_destroy(ot->allowed_prefix);
 	octstr_destroy(ot->denied_prefix);
 	octstr_destroy(ot->allowed_recv_prefix);
@@ -313,6 +313,13 @@ Octstr *urltrans_default_smsc(URLTranslation *t);
 Octstr *urltrans_allow_ip(URLTranslation *t);
 Octstr *urltrans_deny_ip(URLTranslation *t);
 
+/*
+ * Return 1 if send-sms requests from 'ip' are allowed by the allow and
+ * deny IPs, as is_allowed_ip() does, but using the lists compiled when
+ * the configuration was read.
+ */
+int urltrans_is_allowed_ip(URLTranslation *t, Octstr *ip);
+
 /* Return allowed and denied prefixes */
 Octstr *urltrans_allowed_prefix(URLTranslation *t);
 Octstr *urltrans_denied_prefix(URLTranslation *t);
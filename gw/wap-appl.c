@@ -83,6 +83,7 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 
 #include "gwlib/gwlib.h"
 #include "wmlscript/ws.h"
@@ -146,9 +147,37 @@ struct content {
     Octstr *charset;
     Octstr *url;
     Octstr *version;
+    List *headers;      /* HTTP response headers, not owned */
 };
 
 
+/*
+ * Cache of compiled content, shared by all threads. Entries are keyed by
+ * the converter, the MD5 of the source, the URL, charset, WBXML version
+ * and the ETag and Last-Modified validators of the response, so a hit
+ * means the very same source is compiled the very same way. They are kept
+ * in a list from the most to the least recently used one, the least
+ * recently used one goes when the cache is full.
+ */
+struct cache_entry {
+    Octstr *key;
+    Octstr *result;
+    time_t expires;
+    struct cache_entry *prev;
+    struct cache_entry *next;
+};
+
+static Dict *cache = NULL;
+static Mutex *cache_lock = NULL;
+static struct cache_entry *cache_first = NULL;
+static struct cache_entry *cache_last = NULL;
+static long cache_entries = 0;
+static long cache_size = 0;
+static long cache_lifetime = 0;
+static Counter *cache_hits = NULL;
+static Counter *cache_misses = NULL;
+
+
 /*
  * A mapping from HTTP request identifiers to information about the request.
  */
@@ -187,6 +216,7 @@ static void dev_null(const char *data, size_t len, void *context);
 
 static Octstr *convert_wml_to_wmlc(struct content *content);
 static Octstr *convert_wmlscript_to_wmlscriptc(struct content *content);
+static void cache_remove(struct cache_entry *e);
 /* DAVI: To-Do static Octstr *convert_multipart_mixed(struct content *content); */
 static Octstr *deconvert_multipart_formdata(struct content *content);
 /* DAVI: To-Do static Octstr *deconvert_mms_message(struct content *content); */
@@ -246,11 +276,22 @@ static void response_push_connection(WAPEvent *e);
  * The public interface to the application layer.
  */
 
-void wap_appl_init(Cfg *cfg) 
+void wap_appl_init(Cfg *cfg, long compile_cache_size, 
+                   long compile_cache_lifetime) 
 {
     gw_assert(run_status == limbo);
     queue = gwlist_create();
     fetches = counter_create();
+    cache_size = compile_cache_size;
+    cache_lifetime = compile_cache_lifetime;
+    if (cache_size > 0 && cache_lifetime > 0) {
+        cache = dict_create(cache_size, NULL);
+        cache_lock = mutex_create();
+        info(0, "Caching up to %ld compiled documents for %ld seconds.",
+             cache_size, cache_lifetime);
+    }
+    cache_hits = counter_create();
+    cache_misses = counter_create();
     gwlist_add_producer(queue);
     run_status = running;
     charsets = wml_charsets();
@@ -282,6 +323,20 @@ void wap_appl_shutdown(void)
     gwlist_destroy(queue, wap_event_destroy_item);
     gwlist_destroy(charsets, octstr_destroy_item);
     counter_destroy(fetches);
+
+    if (cache != NULL) {
+        debug("wap.convert", 0, "WSP: Compiled content cache had %lu hits "
+              "and %lu misses.", counter_value(cache_hits),
+              counter_value(cache_misses));
+        while (cache_first != NULL)
+            cache_remove(cache_first);
+        dict_destroy(cache);
+        mutex_destroy(cache_lock);
+        cache = NULL;
+        cache_lock = NULL;
+    }
+    counter_destroy(cache_hits);
+    counter_destroy(cache_misses);
 }
 
 
@@ -299,6 +354,21 @@ long wap_appl_get_load(void)
 }
 
 
+void wap_appl_get_cache_stats(long *entries, long *hits, long *misses)
+{
+    gw_assert(run_status == running);
+
+    *entries = 0;
+    if (cache != NULL) {
+        mutex_lock(cache_lock);
+        *entries = cache_entries;
+        mutex_unlock(cache_lock);
+    }
+    *hits = counter_value(cache_hits);
+    *misses = counter_value(cache_misses);
+}
+
+
 /***********************************************************************
  * Private functions.
  */
@@ -410,6 +480,183 @@ static void main_thread(void *arg)
 }
 
 
+/*
+ * Unlink an entry of the compiled content cache and destroy it. The caller
+ * must hold cache_lock, unless at shutdown.
+ */
+static void cache_remove(struct cache_entry *e)
+{
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        cache_first = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        cache_last = e->prev;
+    dict_remove(cache, e->key);
+    cache_entries--;
+
+    octstr_destroy(e->key);
+    octstr_destroy(e->result);
+    gw_free(e);
+}
+
+
+/*
+ * Return for how many seconds the compiled form of a response may be
+ * reused, or 0 if not at all. Responses not to be stored by shared caches
+ * are not cached, max-age and Expires shorten the lifetime.
+ */
+static long cache_lifetime_of(List *headers)
+{
+    Octstr *value, *item;
+    List *items;
+    long lifetime, max_age, expires;
+
+    if (headers == NULL)
+        return 0;
+
+    lifetime = cache_lifetime;
+    max_age = -1;
+
+    if ((value = http_header_value(headers, octstr_imm("Pragma"))) != NULL) {
+        if (octstr_case_search(value, octstr_imm("no-cache"), 0) >= 0)
+            lifetime = 0;
+        octstr_destroy(value);
+    }
+
+    if ((value = http_header_value(headers, octstr_imm("Cache-Control"))) != NULL) {
+        items = http_header_split_value(value);
+        while ((item = gwlist_extract_first(items)) != NULL) {
+            octstr_strip_blanks(item);
+            if (octstr_str_case_compare(item, "no-store") == 0 ||
+                octstr_str_case_compare(item, "no-cache") == 0 ||
+                octstr_str_case_compare(item, "private") == 0)
+                lifetime = 0;
+            else if (octstr_case_search(item, octstr_imm("max-age="), 0) == 0 &&
+                     octstr_parse_long(&max_age, item, 8, 10) == -1)
+                max_age = 0;
+            octstr_destroy(item);
+        }
+        gwlist_destroy(items, NULL);
+        octstr_destroy(value);
+    }
+
+    if (max_age < 0 &&
+        (value = http_header_value(headers, octstr_imm("Expires"))) != NULL) {
+        expires = date_parse_http(value);
+        max_age = (expires == -1) ? 0 : expires - time(NULL);
+        octstr_destroy(value);
+    }
+
+    if (max_age >= 0 && max_age < lifetime)
+        lifetime = max_age;
+
+    return lifetime > 0 ? lifetime : 0;
+}
+
+
+static Octstr *cache_key(int converter, struct content *content)
+{
+    Octstr *digest, *etag, *modified, *key;
+
+    digest = md5digest(content->body);
+    etag = http_header_value(content->headers, octstr_imm("ETag"));
+    modified = http_header_value(content->headers, octstr_imm("Last-Modified"));
+
+    key = octstr_format("%d\n%S\n%S\n%S\n%S\n%S\n%S", converter, digest,
+                        content->url,
+                        content->charset ? content->charset : octstr_imm(""),
+                        content->version ? content->version : octstr_imm(""),
+                        etag ? etag : octstr_imm(""),
+                        modified ? modified : octstr_imm(""));
+
+    octstr_destroy(digest);
+    octstr_destroy(etag);
+    octstr_destroy(modified);
+
+    return key;
+}
+
+
+/*
+ * Convert the content with the given converter, reusing the result of an
+ * earlier conversion of the same source when it is cached.
+ */
+static Octstr *cached_convert(int converter, struct content *content)
+{
+    struct cache_entry *e;
+    Octstr *key, *result;
+    long lifetime;
+
+    if (cache == NULL ||
+        (lifetime = cache_lifetime_of(content->headers)) == 0)
+        return converters[converter].convert(content);
+
+    key = cache_key(converter, content);
+
+    mutex_lock(cache_lock);
+    e = dict_get(cache, key);
+    if (e != NULL && e->expires <= time(NULL)) {
+        cache_remove(e);
+        e = NULL;
+    }
+    if (e != NULL) {
+        /* move to the front, it is the most recently used one now */
+        if (e != cache_first) {
+            e->prev->next = e->next;
+            if (e->next != NULL)
+                e->next->prev = e->prev;
+            else
+                cache_last = e->prev;
+            e->prev = NULL;
+            e->next = cache_first;
+            cache_first->prev = e;
+            cache_first = e;
+        }
+        result = octstr_duplicate(e->result);
+        mutex_unlock(cache_lock);
+        counter_increase(cache_hits);
+        debug("wap.convert", 0, "WSP: Compiled content of <%s> found in cache",
+              octstr_get_cstr(content->url));
+        octstr_destroy(key);
+        return result;
+    }
+    mutex_unlock(cache_lock);
+    counter_increase(cache_misses);
+
+    result = converters[converter].convert(content);
+    if (result == NULL) {
+        octstr_destroy(key);
+        return NULL;
+    }
+
+    mutex_lock(cache_lock);
+    if (dict_get(cache, key) == NULL) {
+        e = gw_malloc(sizeof(*e));
+        e->key = key;
+        e->result = octstr_duplicate(result);
+        e->expires = time(NULL) + lifetime;
+        e->prev = NULL;
+        e->next = cache_first;
+        if (cache_first != NULL)
+            cache_first->prev = e;
+        else
+            cache_last = e;
+        cache_first = e;
+        dict_put(cache, key, e);
+        cache_entries++;
+        while (cache_entries > cache_size)
+            cache_remove(cache_last);
+    } else
+        octstr_destroy(key);
+    mutex_unlock(cache_lock);
+
+    return result;
+}
+
+
 /*
  * Tries to convert or compile a specific content-type to
  * it's complementing one. It does not convert if the client has explicitely
@@ -437,7 +684,7 @@ static int convert_content(struct content *content, List *request_headers,
             if (allow_empty && octstr_len(content->body) == 0) 
                 return 1;
 
-            new_body = converters[i].convert(content);
+            new_body = cached_convert(i, content);
             if (new_body != NULL) {
                 long s = octstr_len(content->body);
                 octstr_destroy(content->body);
@@ -776,6 +1023,7 @@ static void return_reply(int status, Octstr *content_body, List *headers,
     content.url = url;
     content.body = content_body;
     content.version = content.type = content.charset = NULL;
+    content.headers = headers;
     server = ua = NULL;
 
     /* Get session machine for this session. If this was a connection-less
@@ -1332,15 +1580,38 @@ static Octstr *convert_wml_to_wmlc(struct content *content)
 }
 
 
-static Octstr *convert_wmlscript_to_wmlscriptc(struct content *content) 
+/*
+ * Each thread converting WMLScript keeps a compiler of its own and reuses
+ * it for all its compilations, it is destroyed when the thread exits.
+ */
+static pthread_key_t ws_compiler_key;
+static pthread_once_t ws_compiler_key_once = PTHREAD_ONCE_INIT;
+
+
+static void ws_compiler_destroy(void *compiler)
+{
+    ws_destroy(compiler);
+}
+
+
+static void ws_compiler_key_create(void)
+{
+    int ret;
+
+    if ((ret = pthread_key_create(&ws_compiler_key, ws_compiler_destroy)) != 0)
+        panic(ret, "WSP: pthread_key_create failed");
+}
+
+
+static WsCompilerPtr thread_ws_compiler(void)
 {
     WsCompilerParams params;
     WsCompilerPtr compiler;
-    WsResult result;
-    unsigned char *result_data;
-    size_t result_size;
-    Octstr *wmlscriptc;
-    
+
+    pthread_once(&ws_compiler_key_once, ws_compiler_key_create);
+    if ((compiler = pthread_getspecific(ws_compiler_key)) != NULL)
+        return compiler;
+
     memset(&params, 0, sizeof(params));
     params.use_latin1_strings = 0;
     params.print_symbolic_assembler = 0;
@@ -1356,7 +1627,21 @@ static Octstr *convert_wmlscript_to_wmlscriptc(struct content *content)
     if (compiler == NULL) {
         panic(0, "WSP: could not create WMLScript compiler");
     }
+    pthread_setspecific(ws_compiler_key, compiler);
+
+    return compiler;
+}
+
+
+static Octstr *convert_wmlscript_to_wmlscriptc(struct content *content) 
+{
+    WsCompilerPtr compiler;
+    WsResult result;
+    unsigned char *result_data;
+    size_t result_size;
+    Octstr *wmlscriptc;
     
+    compiler = thread_ws_compiler();
     result = ws_compile_data(compiler, octstr_get_cstr(content->url),
                              (unsigned char *)octstr_get_cstr(content->body),
                              octstr_len(content->body),
@@ -1367,6 +1652,7 @@ static Octstr *convert_wmlscript_to_wmlscriptc(struct content *content)
         wmlscriptc = NULL;
     } else {
         wmlscriptc = octstr_create_from_data((char *)result_data, result_size);
+        ws_free_byte_code(result_data);
     }
     
     return wmlscriptc;
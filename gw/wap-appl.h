@@ -63,11 +63,21 @@
 
 #include "wap/wap.h"
 
-void wap_appl_init(Cfg *cfg);
+/*
+ * Start the application layer. Up to compile_cache_size compiled WML and
+ * WMLScript documents are kept for at most compile_cache_lifetime seconds
+ * and reused when the same source is fetched again, a size of 0 turns the
+ * cache off.
+ */
+void wap_appl_init(Cfg *cfg, long compile_cache_size,
+                   long compile_cache_lifetime);
 void wap_appl_dispatch(WAPEvent *event);
 void wap_appl_shutdown(void);
 long wap_appl_get_load(void);
 
+/* number of cached compiled documents, cache hits and misses so far */
+void wap_appl_get_cache_stats(long *entries, long *hits, long *misses);
+
 /* configure an URL mapping (new version) */
 void wsp_http_url_map(Octstr *name, Octstr *url, Octstr *map_url, 
                       Octstr *send_msisdn_query, 
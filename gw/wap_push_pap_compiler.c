@@ -258,6 +258,8 @@ static int parse_push_message_value(Octstr *attr_name, Octstr *attr_value,
                                      WAPEvent **e);
 static int parse_address_value(Octstr *attr_name, Octstr *attr_value, 
                                WAPEvent **e, long *type_of_address);
+static int parse_multicast_address(Octstr *attr_value, WAPEvent **e,
+                                   long *type_of_address);
 static int parse_quality_of_service_value(Octstr *attr_name, 
                                           Octstr *attr_value, WAPEvent **e,
                                           int *is_any);
@@ -1013,6 +1015,11 @@ static int parse_push_message_value(Octstr *attr_name, Octstr *attr_value,
  * initiator) we use value "erroneous". This is necessary, because this a 
  * mandatory field.
  *
+ * A push message may have several address elements (a multicast push). The
+ * first address is stored in the address value field, all accepted ones in
+ * the addresses list. All addresses must be of same type, and an address 
+ * given twice is used only once.
+ *
  * Output a) a newly created wap event
  *        b) the type of the client address
  */
@@ -1023,10 +1030,17 @@ static int parse_address_value(Octstr *attr_name, Octstr *attr_value,
 
     ret = -2;
     if (octstr_compare(attr_name, octstr_imm("address-value")) == 0) {
+        if ((**e).u.Push_Message.addresses != NULL)
+            return parse_multicast_address(attr_value, e, type_of_address);
         octstr_destroy((**e).u.Push_Message.address_value);
 	(**e).u.Push_Message.address_value = 
              (ret = parse_address(&attr_value, type_of_address)) > -1 ? 
              octstr_duplicate(attr_value) : octstr_imm("erroneous");
+        if (ret > -1) {
+            (**e).u.Push_Message.addresses = gwlist_create();
+            gwlist_append((**e).u.Push_Message.addresses, 
+                          octstr_duplicate(attr_value));
+        }
         return ret;
     } 
 
@@ -1035,6 +1049,43 @@ static int parse_address_value(Octstr *attr_name, Octstr *attr_value,
     return -2;
 }
 
+static int parse_multicast_address(Octstr *attr_value, WAPEvent **e,
+                                   long *type_of_address)
+{
+    List *addresses;
+    Octstr *address;
+    long first_type;
+    long i;
+    int ret;
+
+    first_type = *type_of_address;
+    address = octstr_duplicate(attr_value);
+    if ((ret = parse_address(&address, type_of_address)) < 0) {
+        octstr_destroy(address);
+        return ret;
+    }
+
+    if (*type_of_address != first_type) {
+        debug("wap.push.pap.compiler", 0, "PAP COMPILER: addresses of a"
+              " multicast push must be of same type");
+        octstr_destroy(address);
+        return -2;
+    }
+
+    addresses = (**e).u.Push_Message.addresses;
+    for (i = 0; i < gwlist_len(addresses); i++) {
+        if (octstr_compare(gwlist_get(addresses, i), address) == 0) {
+            warning(0, "PAP COMPILER: address %s given twice, using it once",
+                    octstr_get_cstr(address));
+            octstr_destroy(address);
+            return ret;
+        }
+    }
+
+    gwlist_append(addresses, address);
+    return ret;
+}
+
 static int parse_quality_of_service_value(Octstr *attr_name, 
                                           Octstr *attr_value, WAPEvent **e,
                                           int *is_any)
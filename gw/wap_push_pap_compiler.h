@@ -93,6 +93,10 @@ enum {
  *        -2, when error
  * In addition, returns a newly created wap event corresponding the pap 
  * control message, if success, wap event NULL otherwise.
+ *
+ * A push message may have several addresses (a multicast push). The first
+ * one is the address value of the event, and all of them are listed in the
+ * addresses field.
  */
 int pap_compile(Octstr *pap_content, WAPEvent **e);
 
@@ -138,9 +138,17 @@ static List *ppg_queue = NULL;
 static List *pap_queue = NULL;
 
 /*
- * List of ppg session machines (it is, of currently active sessions)
+ * Ppg session machines (it is, currently active sessions), indexed by the
+ * PI client address, by the client ip address and by the session id. Each
+ * index maps a key to a List of machines, in order of last update, so that
+ * the first one is the one the old linear search would have found. The
+ * lock keeps the indexes consistent with each other.
  */
-static List *ppg_machines = NULL;
+static Dict *ppg_machines_by_client = NULL;
+static Dict *ppg_machines_by_addr = NULL;
+static Dict *ppg_machines_by_sid = NULL;
+static Mutex *ppg_machines_lock = NULL;
+static long ppg_machines_count = 0;
 
 /*
  * List of currently active unit pushes (we need a threadsafe storage for them,
@@ -231,7 +239,11 @@ static void https_read_thread(void *arg);
 
 static void handle_internal_event(WAPEvent *e);
 static void pap_request_thread(void *arg);
-static int handle_push_message(HTTPClient **c, WAPEvent *ppg_event, int status);
+static int handle_push_message(HTTPClient **c, WAPEvent *ppg_event, int status,
+                               int transformed, Octstr *transformed_type);
+static int handle_multicast_push(HTTPClient **c, WAPEvent *ppg_event, 
+                                 int status);
+static int phone_numbers_acceptable(Octstr *username, WAPEvent *e);
 static PAPEvent *pap_event_create(Octstr *ip, Octstr *url, List *push_headers, 
                                   Octstr *mime_content, List *cgivars,
                                   HTTPClient *client);
@@ -274,19 +286,22 @@ static PPGPushMachine *find_ppg_push_machine_using_pid(PPGSessionMachine *sm,
 static PPGPushMachine *find_ppg_push_machine_using_pi_push_id(
     PPGSessionMachine *sm, Octstr *pi_push_id);
 static PPGPushMachine *find_unit_ppg_push_machine_using_pi_push_id(
-    Octstr *pi_push_id);
+    Octstr *pi_push_id, WAPAddrTuple *tuple);
 static int push_has_pi_push_id(void *a, void *b);
 static int push_has_pid(void *a, void *b);
-static int session_has_pi_client_address(void *a, void *b);
-static int session_has_addr(void *a, void *b);
-static int session_has_sid(void *a, void *b);
+static void session_index_add(PPGSessionMachine *m);
+static void session_index_remove(PPGSessionMachine *m);
+static PPGSessionMachine *session_index_find(Dict *index, Octstr *key);
+static Octstr *session_sid_key(long sid);
 
 /*
  * Main logic of PPG.
  */
 static int check_capabilities(List *requested, List *assumed);
 static int transform_message(WAPEvent **e, WAPAddrTuple **tuple, 
-                             List *push_headers, int connected, Octstr **type);
+                             List *push_headers, int connected, Octstr **type,
+                             int transformed, Octstr *transformed_type);
+static int transform_content(WAPEvent *e, Octstr **type);
 static long check_x_wap_application_id_header(List **push_headers);
 static int pap_convert_content(struct content *content);
 static int pap_get_content(struct content *content);
@@ -404,7 +419,10 @@ void wap_push_ppg_init(wap_dispatch_func_t *ota_dispatch,
         pap_queue = gwlist_create();
         gwlist_add_producer(pap_queue);
         push_id_counter = counter_create();
-        ppg_machines = gwlist_create();
+        ppg_machines_by_client = dict_create(number_of_pushes, NULL);
+        ppg_machines_by_addr = dict_create(number_of_pushes, NULL);
+        ppg_machines_by_sid = dict_create(number_of_pushes, NULL);
+        ppg_machines_lock = mutex_create();
         ppg_unit_pushes = gwlist_create();
 
         dispatch_to_ota = ota_dispatch;
@@ -432,6 +450,10 @@ void wap_push_ppg_init(wap_dispatch_func_t *ota_dispatch,
 
 void wap_push_ppg_shutdown(void)
 {
+     PPGSessionMachine *sm;
+     List *keys, *machines;
+     Octstr *key;
+
      if (user_configuration != USER_CONFIGURATION_NOT_ADDED) {
          gw_assert(run_status == running);
          run_status = terminating;
@@ -464,8 +486,24 @@ void wap_push_ppg_shutdown(void)
          counter_destroy(push_id_counter);
      
          debug("wap.push.ppg", 0, "PPG: %ld push session machines left.",
-               gwlist_len(ppg_machines));
-         gwlist_destroy(ppg_machines, session_machine_destroy);
+               ppg_machines_count);
+         keys = dict_keys(ppg_machines_by_client);
+         while ((key = gwlist_extract_first(keys)) != NULL) {
+             while ((machines = dict_get(ppg_machines_by_client, key)) != NULL) {
+                 sm = gwlist_get(machines, 0);
+                 session_index_remove(sm);
+                 session_machine_destroy(sm);
+             }
+             octstr_destroy(key);
+         }
+         gwlist_destroy(keys, NULL);
+         dict_destroy(ppg_machines_by_client);
+         dict_destroy(ppg_machines_by_addr);
+         dict_destroy(ppg_machines_by_sid);
+         mutex_destroy(ppg_machines_lock);
+         ppg_machines_by_client = ppg_machines_by_addr = NULL;
+         ppg_machines_by_sid = NULL;
+         ppg_machines_lock = NULL;
 
          debug("wap_push_ppg", 0, "PPG: %ld unit pushes left", 
                gwlist_len(ppg_unit_pushes));
@@ -490,7 +528,7 @@ PPGSessionMachine *wap_push_ppg_have_push_session_for(WAPAddrTuple *tuple)
     PPGSessionMachine *sm;
 
     gw_assert(tuple);
-    sm = gwlist_search(ppg_machines, tuple->remote->address, session_has_addr);
+    sm = session_index_find(ppg_machines_by_addr, tuple->remote->address);
 
     return sm;
 }
@@ -503,13 +541,47 @@ PPGSessionMachine *wap_push_ppg_have_push_session_for(WAPAddrTuple *tuple)
 PPGSessionMachine *wap_push_ppg_have_push_session_for_sid(long sid)
 {
     PPGSessionMachine *sm;
+    Octstr *key;
 
     gw_assert(sid >= 0);
-    sm = gwlist_search(ppg_machines, &sid, session_has_sid);
+    key = session_sid_key(sid);
+    sm = session_index_find(ppg_machines_by_sid, key);
+    octstr_destroy(key);
 
     return sm;
 }
 
+long wap_push_ppg_session_count(void)
+{
+    long count;
+
+    if (ppg_machines_lock == NULL)
+        return 0;
+
+    mutex_lock(ppg_machines_lock);
+    count = ppg_machines_count;
+    mutex_unlock(ppg_machines_lock);
+
+    return count;
+}
+
+int wap_push_ppg_reload_users(Cfg *cfg)
+{
+    List *list;
+
+    if (run_status != running || trusted_pi) {
+        warning(0, "PPG: no push users to reload");
+        return -1;
+    }
+
+    if ((list = cfg_get_multi_group(cfg, octstr_imm("wap-push-user"))) == NULL) {
+        error(0, "PPG: no user group in the configuration, keeping old users");
+        return 0;
+    }
+
+    return wap_push_ppg_pushuser_list_reload(list, number_of_users);
+}
+
 /*****************************************************************************
  *
  * INTERNAL FUNCTIONS
@@ -760,7 +832,8 @@ static void pap_request_thread(void *arg)
     Octstr *not_found = NULL;
     Octstr *username = NULL;
     int compiler_status,
-        http_status;
+        http_status,
+        handled;
     List *push_headers,                /* MIME headers themselves */
          *content_headers,             /* Headers from the content entity, see
                                           pap chapters 8.2, 13.1. Rfc 2045 
@@ -911,16 +984,14 @@ static void pap_request_thread(void *arg)
 
             dict_put(urls, ppg_event->u.Push_Message.pi_push_id, url); 
  
-            if (is_phone_number(ppg_event->u.Push_Message.address_type)) {
-                if (!trusted_pi && user_configuration && 
-                        !wap_push_ppg_pushuser_client_phone_number_acceptable(
-                        username, ppg_event->u.Push_Message.address_value)) {
-                    tell_fatal_error(&client, ppg_event, url, http_status, 
-                                    PAP_FORBIDDEN);
-                    if (client == NULL)
-	                break;
-	                goto not_acceptable;
-	            }   
+            if (is_phone_number(ppg_event->u.Push_Message.address_type) &&
+                    !trusted_pi && user_configuration &&
+                    !phone_numbers_acceptable(username, ppg_event)) {
+                tell_fatal_error(&client, ppg_event, url, http_status, 
+                                 PAP_FORBIDDEN);
+                if (client == NULL)
+	            break;
+	        goto not_acceptable;
             }        
             
             debug("wap.push.ppg", 0, "PPG: http_read_thread: pap control"
@@ -937,7 +1008,13 @@ static void pap_request_thread(void *arg)
             remove_x_kannel_headers(&push_headers);
             ppg_event->u.Push_Message.push_headers = http_header_duplicate(push_headers);
             
-            if (!handle_push_message(&client, ppg_event, http_status)) {
+            if (gwlist_len(ppg_event->u.Push_Message.addresses) > 1)
+                handled = handle_multicast_push(&client, ppg_event, 
+                                                http_status);
+            else
+                handled = handle_push_message(&client, ppg_event, 
+                                              http_status, -1, NULL);
+            if (!handled) {
 	        if (client == NULL)
 		    break;
                 goto no_transform;
@@ -1043,15 +1120,40 @@ berror:
     }
 }
 
+/*
+ * Check that the user may push to all phone numbers of a push message.
+ */
+static int phone_numbers_acceptable(Octstr *username, WAPEvent *e)
+{
+    List *addresses;
+    long i;
+
+    addresses = e->u.Push_Message.addresses;
+    if (addresses == NULL)
+        return wap_push_ppg_pushuser_client_phone_number_acceptable(
+                   username, e->u.Push_Message.address_value);
+
+    for (i = 0; i < gwlist_len(addresses); i++)
+        if (!wap_push_ppg_pushuser_client_phone_number_acceptable(
+                username, gwlist_get(addresses, i)))
+            return 0;
+
+    return 1;
+}
+
 /*
  * Operations needed when push proxy gateway receives a new push message are 
  * defined in ppg Chapter 6. We create machines when error, too, because we 
  * must then have a reportable message error state.
+ * If transformed is -1, the push content is transformed here. Otherwise it 
+ * was already transformed by handle_multicast_push, transformed is the result
+ * and transformed_type the new content type.
  * Output: current HTTP Client state.
  * Return 1 if the push content was OK, 0 if it was not transformable.
  */
 
-static int handle_push_message(HTTPClient **c, WAPEvent *e, int status)
+static int handle_push_message(HTTPClient **c, WAPEvent *e, int status,
+                               int transformed, Octstr *transformed_type)
 {
     int cless,
         session_exists,
@@ -1079,7 +1181,8 @@ static int handle_push_message(HTTPClient **c, WAPEvent *e, int status)
     coded_appid_value = check_x_wap_application_id_header(&push_headers);
     cless = cless_accepted(e, sm);
     message_transformable = transform_message(&e, &tuple, push_headers, cless, 
-                                              &type);
+                                              &type, transformed, 
+                                              transformed_type);
 
     if (!sm && !cless) {
         sm = store_session_data(sm, e, tuple, &session_exists); 
@@ -1193,6 +1296,55 @@ no_start:
     return 1;
 }
 
+/*
+ * A multicast push (a push message having several addresses) is handled as 
+ * a push message per address. All of them have the same content, so it is 
+ * transformed only once. The addresses share the quality of service, too, so
+ * the response to the first push is the response to the whole request; the
+ * responses to the others find no waiting client and are dropped.
+ * Output: current HTTP Client state.
+ * Return 1 if the push content was OK, 0 if it was not transformable.
+ */
+static int handle_multicast_push(HTTPClient **c, WAPEvent *e, int status)
+{
+    WAPEvent *pe;
+    HTTPClient *answered;
+    List *addresses;
+    Octstr *type;
+    int transformed;
+    long i;
+
+    addresses = e->u.Push_Message.addresses;
+    e->u.Push_Message.addresses = NULL;
+    type = NULL;
+    transformed = 0;
+    if (e->u.Push_Message.push_headers != NULL)
+        transformed = transform_content(e, &type);
+
+    info(0, "PPG: handle_multicast_push: push %s to %ld addresses",
+         octstr_get_cstr(e->u.Push_Message.pi_push_id), gwlist_len(addresses));
+
+    for (i = 0; i < gwlist_len(addresses); i++) {
+        pe = wap_event_duplicate(e);
+        octstr_destroy(pe->u.Push_Message.address_value);
+        pe->u.Push_Message.address_value = 
+            octstr_duplicate(gwlist_get(addresses, i));
+        if (i == 0) {
+            handle_push_message(c, pe, status, transformed, type);
+        } else {
+            answered = NULL;
+            handle_push_message(&answered, pe, status, transformed, type);
+        }
+        if (!transformed)
+            break;
+    }
+
+    gwlist_destroy(addresses, octstr_destroy_item);
+    octstr_destroy(type);
+    wap_event_destroy(e);
+    return transformed;
+}
+
 /*
  * These events come from OTA layer
  */
@@ -1327,7 +1479,7 @@ static PPGSessionMachine *session_machine_create(WAPAddrTuple *tuple,
         wsp_cap_duplicate_list(e->u.Push_Message.pi_capabilities);
     m->preferconfirmed_value = PAP_CONFIRMED;    
 
-    gwlist_append(ppg_machines, m);
+    session_index_add(m);
     debug("wap.push.ppg", 0, "PPG: Created PPGSessionMachine %ld",
           m->session_id);
 
@@ -1445,26 +1597,82 @@ static void push_machines_list_destroy(List *machines)
     gwlist_destroy(machines, push_machine_destroy);
 }
 
-static int session_has_addr(void *a, void *b)
+static Octstr *session_sid_key(long sid)
 {
-    Octstr *cliaddr;
-    PPGSessionMachine *sm;
+    return octstr_create_from_data((char *) &sid, sizeof(sid));
+}
 
-    cliaddr = b;
-    sm = a;
-    
-    return octstr_compare(sm->addr_tuple->remote->address, cliaddr) == 0;
+/*
+ * Append a session machine to the List under key in the index.
+ */
+static void index_append(Dict *index, Octstr *key, PPGSessionMachine *m)
+{
+    List *machines;
+
+    if ((machines = dict_get(index, key)) == NULL) {
+        machines = gwlist_create();
+        dict_put(index, key, machines);
+    }
+    gwlist_append(machines, m);
 }
 
-static int session_has_sid(void *a, void *b)
+static void index_delete(Dict *index, Octstr *key, PPGSessionMachine *m)
 {
-     PPGSessionMachine *sm;
-     long *sid;
+    List *machines;
 
-     sid = b;
-     sm = a;
+    if ((machines = dict_get(index, key)) == NULL)
+        return;
 
-     return *sid == sm->session_id;
+    gwlist_delete_equal(machines, m);
+    if (gwlist_len(machines) == 0) {
+        dict_remove(index, key);
+        gwlist_destroy(machines, NULL);
+    }
+}
+
+/*
+ * Enter a session machine into all indexes, as the most recently updated
+ * one.
+ */
+static void session_index_add(PPGSessionMachine *m)
+{
+    Octstr *key;
+
+    key = session_sid_key(m->session_id);
+    mutex_lock(ppg_machines_lock);
+    index_append(ppg_machines_by_client, m->pi_client_address, m);
+    index_append(ppg_machines_by_addr, m->addr_tuple->remote->address, m);
+    index_append(ppg_machines_by_sid, key, m);
+    ppg_machines_count++;
+    mutex_unlock(ppg_machines_lock);
+    octstr_destroy(key);
+}
+
+static void session_index_remove(PPGSessionMachine *m)
+{
+    Octstr *key;
+
+    key = session_sid_key(m->session_id);
+    mutex_lock(ppg_machines_lock);
+    index_delete(ppg_machines_by_client, m->pi_client_address, m);
+    index_delete(ppg_machines_by_addr, m->addr_tuple->remote->address, m);
+    index_delete(ppg_machines_by_sid, key, m);
+    ppg_machines_count--;
+    mutex_unlock(ppg_machines_lock);
+    octstr_destroy(key);
+}
+
+static PPGSessionMachine *session_index_find(Dict *index, Octstr *key)
+{
+    PPGSessionMachine *sm;
+    List *machines;
+
+    mutex_lock(ppg_machines_lock);
+    machines = dict_get(index, key);
+    sm = machines != NULL ? gwlist_get(machines, 0) : NULL;
+    mutex_unlock(ppg_machines_lock);
+
+    return sm;
 }
 
 /*
@@ -1759,18 +1967,19 @@ static void push_machine_assert(PPGPushMachine *pm)
  * headers earlier, but let us be careful.
  */
 static int transform_message(WAPEvent **e, WAPAddrTuple **tuple, 
-                             List *push_headers, int cless_accepted, Octstr **type)
+                             List *push_headers, int cless_accepted, Octstr **type,
+                             int transformed, Octstr *transformed_type)
 {
-    int message_deliverable;
-    struct content content;
     Octstr *cliaddr;
     long cliport,
          servport,
          address_type;
 
     gw_assert((**e).type == Push_Message);
-    if ((**e).u.Push_Message.push_headers == NULL)
-        goto herror;
+    if ((**e).u.Push_Message.push_headers == NULL) {
+        warning(0, "PPG: transform_message: no push headers, cannot accept");
+        return 0;
+    }
 
     cliaddr = (**e).u.Push_Message.address_value;
     push_headers = (**e).u.Push_Message.push_headers;
@@ -1786,13 +1995,34 @@ static int transform_message(WAPEvent **e, WAPAddrTuple **tuple,
     address_type = (**e).u.Push_Message.address_type;
     *tuple = set_addr_tuple(cliaddr, cliport, servport, address_type, push_headers);
 
+    if (transformed < 0)
+        return transform_content(*e, type);
+
+    *type = octstr_duplicate(transformed_type);
+    return transformed;
+}
+
+/*
+ * Transform the content of a push message, see transform_message. The push
+ * headers of the message must be present.
+ */
+static int transform_content(WAPEvent *e, Octstr **type)
+{
+    int message_deliverable;
+    struct content content;
+    List *push_headers;
+
+    gw_assert(e->type == Push_Message);
+    push_headers = e->u.Push_Message.push_headers;
+    gw_assert(push_headers != NULL);
+
     if (!content_transformable(push_headers)) 
         goto no_transform;
 
     content.charset = NULL;
     content.type = NULL;
 
-    content.body = (**e).u.Push_Message.push_data; 
+    content.body = e->u.Push_Message.push_data; 
     if (content.body == NULL)
         goto no_transform;
 
@@ -1824,18 +2054,13 @@ static int transform_message(WAPEvent **e, WAPAddrTuple **tuple,
         goto error;
     }
 
-    (**e).u.Push_Message.push_data = content.body;
+    e->u.Push_Message.push_data = content.body;
     octstr_destroy(content.charset);
 
     debug("wap.push.ppg", 0, "PPG: transform_message: push message content"
           " and headers valid");
     return 1;
 
-herror:
-    warning(0, "PPG: transform_message: no push headers, cannot accept");
-    octstr_destroy(content.type);
-    return 0;
-
 error:
     warning(0, "PPG: transform_message: push content erroneous, cannot"
             " accept");
@@ -2127,17 +2352,6 @@ int select_bearer_network(WAPEvent **e)
     return 1;
 }
 
-static int session_has_pi_client_address(void *a, void *b)
-{
-    Octstr *caddr;
-    PPGSessionMachine *sm;
-
-    caddr = b;
-    sm = a;
-
-    return octstr_compare(caddr, sm->pi_client_address) == 0;
-}
-
 /*
  * PI client address is composed of a client specifier and a PPG specifier (see
  * ppg, chapter 7). So it is equivalent with gw address quadruplet.
@@ -2146,7 +2360,7 @@ PPGSessionMachine *session_find_using_pi_client_address(Octstr *caddr)
 {
     PPGSessionMachine *sm;
     
-    sm = gwlist_search(ppg_machines, caddr, session_has_pi_client_address);
+    sm = session_index_find(ppg_machines_by_client, caddr);
 
     return sm;
 }
@@ -2293,7 +2507,8 @@ static int store_push_data(PPGPushMachine **pm, PPGSessionMachine *sm,
     if (((!cless) && 
        (find_ppg_push_machine_using_pi_push_id(sm, pi_push_id) != NULL)) ||
        ((cless) && 
-       (find_unit_ppg_push_machine_using_pi_push_id(pi_push_id) != NULL)))
+       (find_unit_ppg_push_machine_using_pi_push_id(pi_push_id, tuple) 
+        != NULL)))
        duplicate_push_id = 1;
 
     *pm = push_machine_create(e, tuple);
@@ -2427,7 +2642,7 @@ static void remove_session_data(PPGSessionMachine *sm, int status)
         remove_push_data(sm, pm, sm == NULL);
     }
 
-    gwlist_delete_equal(ppg_machines, sm);
+    session_index_remove(sm);
     session_machine_destroy(sm);
 }
 
@@ -2439,7 +2654,7 @@ static void remove_pushless_session(PPGSessionMachine *sm)
     session_machine_assert(sm);
 
     if (gwlist_len(sm->push_machines) == 0) {
-        gwlist_delete_equal(ppg_machines, sm);
+        session_index_remove(sm);
         session_machine_destroy(sm);
     }
 }
@@ -2536,15 +2751,30 @@ static PPGPushMachine *find_ppg_push_machine_using_pi_push_id(
     return pm;
 }
 
+/*
+ * Unit pushes of a multicast push share the push id, so they are told apart
+ * by the client address.
+ */
 static PPGPushMachine *find_unit_ppg_push_machine_using_pi_push_id(
-    Octstr *pi_push_id)
+    Octstr *pi_push_id, WAPAddrTuple *tuple)
 {
     PPGPushMachine *pm;
+    long i;
 
     gw_assert(pi_push_id);
-    pm = gwlist_search(ppg_unit_pushes, pi_push_id, push_has_pi_push_id);
+    gwlist_lock(ppg_unit_pushes);
+    for (i = 0; i < gwlist_len(ppg_unit_pushes); i++) {
+        pm = gwlist_get(ppg_unit_pushes, i);
+        if (push_has_pi_push_id(pm, pi_push_id) && 
+                (tuple == NULL || pm->addr_tuple == NULL ||
+                 wap_addr_tuple_same(pm->addr_tuple, tuple))) {
+            gwlist_unlock(ppg_unit_pushes);
+            return pm;
+        }
+    }
+    gwlist_unlock(ppg_unit_pushes);
 
-    return pm;
+    return NULL;
 }
 
 /*
@@ -2609,8 +2839,8 @@ static PPGPushMachine *update_push_data_with_attribute(PPGSessionMachine **sm,
     if (*sm != NULL){
         gwlist_delete_matching((**sm).push_machines, &qm->push_id, push_has_pid);
         gwlist_append((**sm).push_machines, qm);
-        gwlist_delete_equal(ppg_machines, *sm);
-        gwlist_append(ppg_machines, *sm);
+        session_index_remove(*sm);
+        session_index_add(*sm);
     } else {
         gwlist_delete_matching(ppg_unit_pushes, &qm->push_id, push_has_pid);
         gwlist_append(ppg_unit_pushes, qm);
@@ -2628,12 +2858,11 @@ static PPGSessionMachine *update_session_data(PPGSessionMachine *m,
     session_machine_assert(m);
     gw_assert(sid >= 0);
 
+    session_index_remove(m);
     m->session_id = sid;
     m->addr_tuple->remote->port = port;
     m->client_capabilities = wsp_cap_duplicate_list(caps);
-
-    gwlist_delete_equal(ppg_machines, m);
-    gwlist_append(ppg_machines, m);
+    session_index_add(m);
 
     return m;
 }
@@ -3077,6 +3306,16 @@ static HTTPClient *send_push_response(WAPEvent *e, int status)
     url = dict_get(urls, e->u.Push_Response.pi_push_id);
     dict_remove(urls, e->u.Push_Response.pi_push_id);
 
+    c = dict_get(http_clients, e->u.Push_Response.pi_push_id);
+    dict_remove(http_clients, e->u.Push_Response.pi_push_id);
+
+    /* PI was already answered, by the first push of a multicast push say */
+    if (c == NULL) {
+        octstr_destroy(url);
+        wap_event_destroy(e);
+        return NULL;
+    }
+
     reply_body = octstr_format("%s", 
         "<?xml version=\"1.0\"?>"
         "<!DOCTYPE pap PUBLIC \"-//WAPFORUM//DTD PAP 1.0//EN\""
@@ -3127,9 +3366,6 @@ static HTTPClient *send_push_response(WAPEvent *e, int status)
 
     octstr_destroy(url);
 
-    c = dict_get(http_clients, e->u.Push_Response.pi_push_id);
-    dict_remove(http_clients, e->u.Push_Response.pi_push_id);
-
     debug("wap.push.ppg", 0, "PPG: send_push_response: telling pi");
     send_to_pi(&c, reply_body, status);
 
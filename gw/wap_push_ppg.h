@@ -211,4 +211,17 @@ PPGSessionMachine *wap_push_ppg_have_push_session_for(WAPAddrTuple *tuple);
  */
 PPGSessionMachine *wap_push_ppg_have_push_session_for_sid(long sid);
 
+/*
+ * Return the number of push sessions the PPG knows of.
+ */
+long wap_push_ppg_session_count(void);
+
+/*
+ * Read the push users (wap-push-user groups) again from cfg and take them in
+ * use. Return 1 when the users were replaced, 0 when the new configuration
+ * was not accepted and -1 when the PPG is not running or does not use push
+ * users.
+ */
+int wap_push_ppg_reload_users(Cfg *cfg);
+
 #endif
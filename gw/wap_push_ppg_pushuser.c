@@ -68,6 +68,21 @@
  *
  * Global data structures
  *
+ * An ip list of an user, as configured by deny-ip or allow-ip. The list is
+ * split when the configuration is read, so that an ip needs only be looked
+ * up when a push request arrives.
+ */
+
+struct IPList {
+    int all;                           /* the list is '*.*.*.*' */
+    Dict *exact;                       /* ips without wildcards */
+    List *wildcarded;                  /* ips with wildcards, each one split
+                                          into a list of fragments */
+};
+
+typedef struct IPList IPList;
+
+/*
  * Hold user specific  data for one ppg user
  */
 
@@ -78,9 +93,12 @@ struct WAPPushUser {
     Octstr *country_prefix;
     Octstr *allowed_prefix;            /* phone number prefixes allowed by 
                                           this user when pushing*/
+    List *allowed_prefixes;            /* the same split, country prefix
+                                          included */
     regex_t *allowed_prefix_regex;
     
     Octstr *denied_prefix;             /* and denied ones */
+    List *denied_prefixes;
     regex_t *denied_prefix_regex;
 
     Numhash *white_list;               /* phone numbers of this user, used for 
@@ -89,9 +107,11 @@ struct WAPPushUser {
     Numhash *black_list;               /* numbers should not be used for push*/
     regex_t *black_list_regex;
 
-    Octstr *user_deny_ip;              /* this user allows pushes from these 
+    Octstr *user_deny_ip;              /* this user denies pushes from these
                                           IPs*/
-    Octstr *user_allow_ip;             /* and denies them from these*/
+    IPList *deny_ips;
+    Octstr *user_allow_ip;             /* and allows them from these*/
+    IPList *allow_ips;
     Octstr *smsc_id;                   /* force push SMs to this smsc */
     Octstr *default_smsc_id;           /* use this smsc as a default for push SMs */
     Octstr *dlr_url;                   /* default dlr url from this user */
@@ -101,7 +121,8 @@ struct WAPPushUser {
 typedef struct WAPPushUser WAPPushUser;
 
 /*
- * Hold user specific  data of all ppg users
+ * Hold user specific  data of all ppg users. Users are owned by the list,
+ * names maps an username to the first user configured with it.
  */
 
 struct WAPPushUserList {
@@ -113,6 +134,12 @@ typedef struct WAPPushUserList WAPPushUserList;
 
 static WAPPushUserList *users = NULL;
 
+/*
+ * Users list may be replaced by a reload while pushes are authenticated.
+ * Readers keep a read lock as long as they use an user.
+ */
+static RWLock *users_lock = NULL;
+
 /*
  * This hash table stores time when a specific ip is allowed to try next time.
  */
@@ -123,11 +150,11 @@ static Dict *next_try = NULL;
  * Prototypes of internal functions
  */
 
-static void destroy_users_list(void *l);
-static WAPPushUserList *pushusers_create(long number_of_users);
+static WAPPushUserList *pushusers_create(List *list, long number_of_users);
+static void pushusers_destroy(WAPPushUserList *pusers);
 static WAPPushUser *create_oneuser(CfgGroup *grp);
 static void destroy_oneuser(void *p);
-static int oneuser_add(CfgGroup *cfg);
+static int oneuser_add(WAPPushUserList *pusers, CfgGroup *cfg);
 static void oneuser_dump(WAPPushUser *u);
 static WAPPushUser *user_find_by_username(Octstr *username);
 static int password_matches(WAPPushUser *u, Octstr *password);
@@ -136,12 +163,16 @@ static int prefix_allowed(WAPPushUser *u, Octstr *number);
 static int whitelisted(WAPPushUser *u, Octstr *number);
 static int blacklisted(WAPPushUser *u, Octstr *number);
 static int wildcarded_ip_found(Octstr *ip, Octstr *needle, Octstr *ip_sep);
+static IPList *ip_list_create(Octstr *ips);
+static void ip_list_destroy(IPList *ipl);
+static int ip_list_contains(IPList *ipl, Octstr *ip);
+static List *prefix_list_create(Octstr *prefixes, Octstr *country_prefix);
+static int prefix_listed(List *prefixes, Octstr *number);
 static int response(List *push_headers, Octstr **username, Octstr **password);
 static void challenge(HTTPClient *c, List *push_headers);
 static void reply(HTTPClient *c, List *push_headers);
 static int parse_cgivars_for_username(List *cgivars, Octstr **username);
 static int parse_cgivars_for_password(List *cgivars, Octstr **password);
-static int compare_octstr_sequence(Octstr *os1, Octstr *os2, long start);
 static Octstr *forced_smsc(WAPPushUser *u);
 static Octstr *default_smsc(WAPPushUser *u);
 
@@ -156,18 +187,35 @@ static Octstr *default_smsc(WAPPushUser *u);
 int wap_push_ppg_pushuser_list_add(List *list, long number_of_pushes, 
                                    long number_of_users)
 {
-    CfgGroup *grp;
-
     next_try = dict_create(number_of_pushes, octstr_destroy_item);
-    users = pushusers_create(number_of_users);
+    users_lock = gw_rwlock_create();
     gw_assert(list);
-    while (list && (grp = gwlist_extract_first(list))) {
-        if (oneuser_add(grp) == -1) {
-	        gwlist_destroy(list, NULL);
-            return 0;
-        }
+    users = pushusers_create(list, number_of_users);
+
+    return users != NULL;
+}
+
+/*
+ * Replace the push users list with a new one. The old list stays in use if
+ * the new one cannot be created.
+ */
+int wap_push_ppg_pushuser_list_reload(List *list, long number_of_users)
+{
+    WAPPushUserList *new_users, *old_users;
+
+    gw_assert(list);
+    if ((new_users = pushusers_create(list, number_of_users)) == NULL) {
+        error(0, "unable to reload push users list, keeping the old one");
+        return 0;
     }
-    gwlist_destroy(list, NULL);
+
+    gw_rwlock_wrlock(users_lock);
+    old_users = users;
+    users = new_users;
+    gw_rwlock_unlock(users_lock);
+
+    pushusers_destroy(old_users);
+    info(0, "push users list reloaded, %ld users", gwlist_len(users->list));
 
     return 1;
 }
@@ -175,12 +223,12 @@ int wap_push_ppg_pushuser_list_add(List *list, long number_of_pushes,
 void wap_push_ppg_pushuser_list_destroy(void)
 {
     dict_destroy(next_try);
-    if (users == NULL)
-        return;
-
-    gwlist_destroy(users->list, destroy_oneuser);
-    dict_destroy(users->names);
-    gw_free(users);
+    next_try = NULL;
+    pushusers_destroy(users);
+    users = NULL;
+    if (users_lock != NULL)
+        gw_rwlock_destroy(users_lock);
+    users_lock = NULL;
 }
 
 enum {
@@ -231,7 +279,9 @@ int wap_push_ppg_pushuser_authenticate(HTTPClient *c, List *cgivars, Octstr *ip,
         WAPPushUser *u;
         Octstr *copy,
                *password;
-        int ret;
+        int ret,
+            ip_allowed,
+            password_ok;
         
         copy = octstr_duplicate(ip);
         time(&now);
@@ -247,8 +297,13 @@ int wap_push_ppg_pushuser_authenticate(HTTPClient *c, List *cgivars, Octstr *ip,
         if (password == NULL)
             parse_cgivars_for_password(cgivars, &password);
 
+        gw_rwlock_rdlock(users_lock);
         u = user_find_by_username(*username);
-        if (!ip_allowed_by_user(u, ip)) {
+        ip_allowed = ip_allowed_by_user(u, ip);
+        password_ok = u != NULL && password_matches(u, password);
+        gw_rwlock_unlock(users_lock);
+
+        if (!ip_allowed) {
 	        goto not_listed;
         }
 
@@ -269,7 +324,7 @@ int wap_push_ppg_pushuser_authenticate(HTTPClient *c, List *cgivars, Octstr *ip,
 	        goto listed;
         }
 
-        if (!password_matches(u, password)) {
+        if (!password_ok) {
 	        error(0, "wrong or missing password in request from %s, challenging" , 
                   octstr_get_cstr(copy));
             goto listed;
@@ -313,27 +368,25 @@ int wap_push_ppg_pushuser_client_phone_number_acceptable(Octstr *username,
         Octstr *number)
 {
     WAPPushUser *u;
+    int ret;
 
+    ret = 0;
+    gw_rwlock_rdlock(users_lock);
     u = user_find_by_username(username);
     if (!prefix_allowed(u, number)) {
         error(0, "Number %s not allowed by user %s (wrong prefix)", 
               octstr_get_cstr(number), octstr_get_cstr(username));
-        return 0;
-    }
-
-    if (blacklisted(u, number)) {
+    } else if (blacklisted(u, number)) {
         error(0, "Number %s not allowed by user %s (blacklisted)", 
               octstr_get_cstr(number), octstr_get_cstr(username) );
-        return 0;
-    }
-
-    if (!whitelisted(u, number)) {
+    } else if (!whitelisted(u, number)) {
         error(0, "Number %s not allowed by user %s (not whitelisted)", 
               octstr_get_cstr(number), octstr_get_cstr(username) );
-        return 0;
-    }
+    } else
+        ret = 1;
+    gw_rwlock_unlock(users_lock);
 
-    return 1;
+    return ret;
 }
 
 int wap_push_ppg_pushuser_search_ip_from_wildcarded_list(Octstr *haystack, 
@@ -382,16 +435,19 @@ Octstr *wap_push_ppg_pushuser_smsc_id_get(Octstr *username)
     WAPPushUser *u;
     Octstr *smsc_id;
 
+    gw_rwlock_rdlock(users_lock);
     if ((u = user_find_by_username(username)) == NULL) {
         /* no user found with this username */
+        gw_rwlock_unlock(users_lock);
         return NULL;
     }
 
-    if ((smsc_id = forced_smsc(u)) != NULL)
-        return octstr_duplicate(smsc_id);
+    if ((smsc_id = forced_smsc(u)) == NULL)
+        smsc_id = default_smsc(u);
+    smsc_id = octstr_duplicate(smsc_id);
+    gw_rwlock_unlock(users_lock);
 
-    smsc_id = default_smsc(u);
-    return octstr_duplicate(smsc_id);
+    return smsc_id;
 }
 
 /*
@@ -402,10 +458,12 @@ Octstr *wap_push_ppg_pushuser_dlr_url_get(Octstr *username)
     WAPPushUser *u;
     Octstr *dlr_url;
 
+    gw_rwlock_rdlock(users_lock);
     u = user_find_by_username(username);
-    dlr_url = u->dlr_url;     
+    dlr_url = u ? octstr_duplicate(u->dlr_url) : NULL;
+    gw_rwlock_unlock(users_lock);
 
-    return octstr_duplicate(dlr_url);
+    return dlr_url;
 }
 
 /*
@@ -416,10 +474,12 @@ Octstr *wap_push_ppg_pushuser_smsbox_id_get(Octstr *username)
     WAPPushUser *u;
     Octstr *smsbox_id;
 
+    gw_rwlock_rdlock(users_lock);
     u = user_find_by_username(username);
-    smsbox_id = u->smsbox_id;
+    smsbox_id = u ? octstr_duplicate(u->smsbox_id) : NULL;
+    gw_rwlock_unlock(users_lock);
 
-    return octstr_duplicate(smsbox_id);
+    return smsbox_id;
 }
 
 
@@ -428,18 +488,39 @@ Octstr *wap_push_ppg_pushuser_smsbox_id_get(Octstr *username)
  * Implementation of internal functions
  */
 
-static void destroy_users_list(void *l)
+/*
+ * Create an users list from wap-push-user groups. Destroys the list of groups.
+ * Return NULL if any of the users could not be created.
+ */
+static WAPPushUserList *pushusers_create(List *list, long number_of_users)
 {
-    gwlist_destroy(l, NULL);
+    WAPPushUserList *pusers;
+    CfgGroup *grp;
+
+    pusers = gw_malloc(sizeof(WAPPushUserList));
+    pusers->list = gwlist_create();
+    pusers->names = dict_create(number_of_users, NULL);
+
+    while ((grp = gwlist_extract_first(list)) != NULL) {
+        if (oneuser_add(pusers, grp) == -1) {
+            gwlist_destroy(list, NULL);
+            pushusers_destroy(pusers);
+            return NULL;
+        }
+    }
+    gwlist_destroy(list, NULL);
+
+    return pusers;
 }
 
-static WAPPushUserList *pushusers_create(long number_of_users) 
+static void pushusers_destroy(WAPPushUserList *pusers)
 {
-    users = gw_malloc(sizeof(WAPPushUserList));
-    users->list = gwlist_create();
-    users->names = dict_create(number_of_users, destroy_users_list);
+    if (pusers == NULL)
+        return;
 
-    return users;
+    dict_destroy(pusers->names);
+    gwlist_destroy(pusers->list, destroy_oneuser);
+    gw_free(pusers);
 }
 
 /*
@@ -463,18 +544,26 @@ static WAPPushUser *create_oneuser(CfgGroup *grp)
     u = gw_malloc(sizeof(WAPPushUser));
     u->name = NULL;
     u->username = NULL;                  
+    u->password = NULL;
+    u->country_prefix = NULL;
     u->allowed_prefix = NULL;           
+    u->allowed_prefixes = NULL;
     u->allowed_prefix_regex = NULL;           
     u->denied_prefix = NULL;             
+    u->denied_prefixes = NULL;
     u->denied_prefix_regex = NULL;             
     u->white_list = NULL;               
     u->white_list_regex = NULL;               
     u->black_list = NULL;              
     u->black_list_regex = NULL;              
     u->user_deny_ip = NULL;              
+    u->deny_ips = NULL;
     u->user_allow_ip = NULL;
+    u->allow_ips = NULL;
     u->smsc_id = NULL;
     u->default_smsc_id = NULL;
+    u->dlr_url = NULL;
+    u->smsbox_id = NULL;
 
     u->name = cfg_get(grp, octstr_imm("wap-push-user"));
 
@@ -511,6 +600,17 @@ static WAPPushUser *create_oneuser(CfgGroup *grp)
     u->dlr_url = cfg_get(grp, octstr_imm("dlr-url"));
     u->smsbox_id = cfg_get(grp, octstr_imm("smsbox-id"));
 
+    if (u->user_deny_ip != NULL)
+        u->deny_ips = ip_list_create(u->user_deny_ip);
+    if (u->user_allow_ip != NULL)
+        u->allow_ips = ip_list_create(u->user_allow_ip);
+    if (u->denied_prefix != NULL)
+        u->denied_prefixes = prefix_list_create(u->denied_prefix,
+                                                u->country_prefix);
+    if (u->allowed_prefix != NULL)
+        u->allowed_prefixes = prefix_list_create(u->allowed_prefix,
+                                                 u->country_prefix);
+
     os = cfg_get(grp, octstr_imm("white-list"));
     if (os != NULL) {
 	    u->white_list = numhash_create(octstr_get_cstr(os));
@@ -523,23 +623,35 @@ static WAPPushUser *create_oneuser(CfgGroup *grp)
     }
 
     if ((os = cfg_get(grp, octstr_imm("allowed-prefix-regex"))) != NULL) {
-        if ((u->allowed_prefix_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+        if ((u->allowed_prefix_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL) {
+            error(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+            octstr_destroy(os);
+            goto error;
+        }
         octstr_destroy(os);
     };
     if ((os = cfg_get(grp, octstr_imm("denied-prefix-regex"))) != NULL) {
-        if ((u->denied_prefix_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+        if ((u->denied_prefix_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL) {
+            error(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+            octstr_destroy(os);
+            goto error;
+        }
         octstr_destroy(os);
     };
     if ((os = cfg_get(grp, octstr_imm("white-list-regex"))) != NULL) {
-        if ((u->white_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+        if ((u->white_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL) {
+            error(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+            octstr_destroy(os);
+            goto error;
+        }
         octstr_destroy(os);
     };
     if ((os = cfg_get(grp, octstr_imm("black-list-regex"))) != NULL) {
-        if ((u->black_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL)
-            panic(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+        if ((u->black_list_regex = gw_regex_comp(os, REG_EXTENDED)) == NULL) {
+            error(0, "Could not compile pattern '%s'", octstr_get_cstr(os));
+            octstr_destroy(os);
+            goto error;
+        }
         octstr_destroy(os);
     };
 
@@ -569,13 +681,19 @@ static void destroy_oneuser(void *p)
      octstr_destroy(u->password);  
      octstr_destroy(u->country_prefix);              
      octstr_destroy(u->allowed_prefix);           
+     gwlist_destroy(u->allowed_prefixes, octstr_destroy_item);
      octstr_destroy(u->denied_prefix);             
+     gwlist_destroy(u->denied_prefixes, octstr_destroy_item);
      numhash_destroy(u->white_list);               
      numhash_destroy(u->black_list);              
      octstr_destroy(u->user_deny_ip);              
+     ip_list_destroy(u->deny_ips);
      octstr_destroy(u->user_allow_ip);
+     ip_list_destroy(u->allow_ips);
      octstr_destroy(u->smsc_id);
      octstr_destroy(u->default_smsc_id);
+     octstr_destroy(u->dlr_url);
+     octstr_destroy(u->smsbox_id);
 
      if (u->black_list_regex != NULL) gw_regex_destroy(u->black_list_regex);
      if (u->white_list_regex != NULL) gw_regex_destroy(u->white_list_regex);
@@ -616,45 +734,35 @@ static void oneuser_dump(WAPPushUser *u)
 /*
  * Add an user to the push users list
  */
-static int oneuser_add(CfgGroup *grp)
+static int oneuser_add(WAPPushUserList *pusers, CfgGroup *grp)
 {
     WAPPushUser *u;
-    List *list;
 
     u = create_oneuser(grp);
     if (u == NULL)
         return -1;
 
-    gwlist_append(users->list, u);
+    gwlist_append(pusers->list, u);
 
-    list = dict_get(users->names, u->username);
-    if (list == NULL) {
-        list = gwlist_create();
-        dict_put(users->names, u->username, list);
-    }
+    /* the first user configured with an username is the one used */
+    if (dict_get(pusers->names, u->username) == NULL)
+        dict_put(pusers->names, u->username, u);
+    else
+        warning(0, "username %s configured more than once, using the first",
+                octstr_get_cstr(u->username));
 
     return 0;
 }
 
+/*
+ * The caller must hold users_lock.
+ */
 static WAPPushUser *user_find_by_username(Octstr *username)
 {
-    WAPPushUser *u;
-    long i;
-    List *list;
-
-    if (username == NULL)
+    if (username == NULL || users == NULL)
         return NULL;
 
-    if ((list = dict_get(users->names, username)) == NULL)
-         return NULL;
-
-    for (i = 0; i < gwlist_len(users->list); ++i) {
-         u = gwlist_get(users->list, i);
-         if (octstr_compare(u->username, username) == 0)
-	         return u;
-    }
-
-    return NULL;
+    return dict_get(users->names, username);
 }
 
 static int password_matches(WAPPushUser *u, Octstr *password)
@@ -711,33 +819,22 @@ static int ip_allowed_by_user(WAPPushUser *u, Octstr *ip)
 
     copy = octstr_duplicate(u->username);
 
-    if (u->user_deny_ip == NULL && u->user_allow_ip == NULL)
+    if (u->deny_ips == NULL && u->allow_ips == NULL)
         goto allowed;
 
-    if (u->user_deny_ip) {
-        if (octstr_compare(u->user_deny_ip, octstr_imm("*.*.*.*")) == 0) {
-            warning(0, "no ips allowed for %s", octstr_get_cstr(copy));
-            goto denied;
-        }
+    if (u->deny_ips && u->deny_ips->all) {
+        warning(0, "no ips allowed for %s", octstr_get_cstr(copy));
+        goto denied;
     }
 
-    if (u->user_allow_ip)
-        if (octstr_compare(u->user_allow_ip, octstr_imm("*.*.*.*")) == 0)
-            goto allowed;
+    if (u->allow_ips && u->allow_ips->all)
+        goto allowed;
 
-    if (u->user_deny_ip) {
-        if (wap_push_ppg_pushuser_search_ip_from_wildcarded_list(u->user_deny_ip, 
-	            ip, octstr_imm(";"), octstr_imm("."))) {
-            goto denied;
-        }
-    }
+    if (u->deny_ips && ip_list_contains(u->deny_ips, ip))
+        goto denied;
 
-    if (u->user_allow_ip) {
-        if (wap_push_ppg_pushuser_search_ip_from_wildcarded_list(u->user_allow_ip, 
-	            ip, octstr_imm(";"), octstr_imm("."))) {
-            goto allowed;
-        }
-    }
+    if (u->allow_ips && ip_list_contains(u->allow_ips, ip))
+        goto allowed;
 
     octstr_destroy(copy);
     warning(0, "ip not found from either ip list, deny it");
@@ -876,89 +973,167 @@ static void reply(HTTPClient *c, List *push_headers)
 }
 
 /*
- * Note that the phone number necessarily follows the international format (a requi-
- * rement by our pap compiler). So we add country prefix to listed prefixes, if one
- * is configured.
+ * Denied prefixes are checked first, then allowed ones. Prefix lists include the
+ * country prefix already (see prefix_list_create).
  */
 static int prefix_allowed(WAPPushUser *u, Octstr *number)
 {
-    List *allowed,
-         *denied;
-    long i;
-    Octstr *listed_prefix;
-
-    allowed = NULL;
-    denied = NULL;
-
     if (u == NULL)
-        goto no_user;
+        return 0;
 
-    if (        u->allowed_prefix == NULL && u->denied_prefix == NULL 
+    if (        u->allowed_prefixes == NULL && u->denied_prefixes == NULL
         && u->allowed_prefix_regex == NULL && u->denied_prefix_regex == NULL)
-        goto no_configuration;
-
-    if (u->denied_prefix != NULL) {
-        denied = octstr_split(u->denied_prefix, octstr_imm(";"));
-        for (i = 0; i < gwlist_len(denied); ++i) {
-             listed_prefix = gwlist_get(denied, i);
-             if (u->country_prefix != NULL)
-                 octstr_insert(listed_prefix, u->country_prefix, 0);
-             if (compare_octstr_sequence(number, listed_prefix, 
-                     0) == 0) {
-      	         goto denied;
-             }
-        }
-    }
+        return 1;
+
+    if (u->denied_prefixes != NULL && prefix_listed(u->denied_prefixes, number))
+        return 0;
 
     /* note: country-prefix _must_be included in the pattern */
     if (u->denied_prefix_regex != NULL) 
         if (gw_regex_match_pre(u->denied_prefix_regex, number) == 1)
-            goto denied;
-
-    if (u->allowed_prefix_regex == NULL && u->allowed_prefix == NULL) 
-        goto no_allowed_config;
-
-    if (u->allowed_prefix != NULL) {
-    allowed = octstr_split(u->allowed_prefix, octstr_imm(";"));
-    for (i = 0; i < gwlist_len(allowed); ++i) {
-         listed_prefix = gwlist_get(allowed, i);
-         if (u->country_prefix != NULL)
-             octstr_insert(listed_prefix, u->country_prefix, 0);
-         if (compare_octstr_sequence(number, listed_prefix, 
-                 0) == 0) {
-	         goto allowed;
-         }
-    }
-    }
+            return 0;
+
+    if (u->allowed_prefix_regex == NULL && u->allowed_prefixes == NULL)
+        return 1;
+
+    if (u->allowed_prefixes != NULL &&
+            prefix_listed(u->allowed_prefixes, number))
+        return 1;
 
     /* note: country-prefix _must_ be included in the pattern */
     if (u->allowed_prefix_regex != NULL) 
         if (gw_regex_match_pre(u->allowed_prefix_regex, number) == 1)
-            goto allowed;
+            return 1;
+
+    return 0;
+}
 
 /*
- * Here we have an intentional fall-through. It will removed when memory cleaning
- * functions are implemented.
+ * Split a prefix list from the configuration. Note that the phone number
+ * necessarily follows the international format (a requirement by our pap
+ * compiler). So we add country prefix to listed prefixes, if one is config-
+ * ured.
  */
-denied:         
-    gwlist_destroy(allowed, octstr_destroy_item);
-    gwlist_destroy(denied, octstr_destroy_item);
-    return 0;
+static List *prefix_list_create(Octstr *prefixes, Octstr *country_prefix)
+{
+    List *list;
+    Octstr *listed_prefix;
+    long i;
 
-allowed:      
-    gwlist_destroy(allowed, octstr_destroy_item);
-    gwlist_destroy(denied, octstr_destroy_item);
-    return 1;
+    list = octstr_split(prefixes, octstr_imm(";"));
+    for (i = 0; i < gwlist_len(list); ++i) {
+        listed_prefix = gwlist_get(list, i);
+        if (country_prefix != NULL)
+            octstr_insert(listed_prefix, country_prefix, 0);
+    }
 
-no_configuration:
-    return 1;
+    return list;
+}
+
+/*
+ * Return 1 when the number starts with one of the prefixes, 0 otherwise.
+ * An empty prefix matches nothing.
+ */
+static int prefix_listed(List *prefixes, Octstr *number)
+{
+    Octstr *listed_prefix;
+    long i, len;
+
+    for (i = 0; i < gwlist_len(prefixes); ++i) {
+        listed_prefix = gwlist_get(prefixes, i);
+        if ((len = octstr_len(listed_prefix)) > 0 &&
+                octstr_ncompare(number, listed_prefix, len) == 0)
+            return 1;
+    }
 
-no_user:
     return 0;
+}
 
-no_allowed_config:
-    gwlist_destroy(denied, octstr_destroy_item);
-    return 1;
+/*
+ * Split an ip list from the configuration. Ips without wildcards go to a hash
+ * table, the wildcarded ones are split into fragments.
+ */
+static IPList *ip_list_create(Octstr *ips)
+{
+    IPList *ipl;
+    List *list;
+    Octstr *configured_ip;
+
+    ipl = gw_malloc(sizeof(IPList));
+    ipl->all = octstr_compare(ips, octstr_imm("*.*.*.*")) == 0;
+    list = octstr_split(ips, octstr_imm(";"));
+    ipl->exact = dict_create(gwlist_len(list) + 1, octstr_destroy_item);
+    ipl->wildcarded = gwlist_create();
+
+    while ((configured_ip = gwlist_extract_first(list)) != NULL) {
+        octstr_strip_blanks(configured_ip);
+        if (octstr_len(configured_ip) == 0)
+            octstr_destroy(configured_ip);
+        else if (octstr_search_char(configured_ip, '*', 0) < 0)
+            dict_put(ipl->exact, configured_ip, configured_ip);
+        else {
+            gwlist_append(ipl->wildcarded,
+                          octstr_split(configured_ip, octstr_imm(".")));
+            octstr_destroy(configured_ip);
+        }
+    }
+    gwlist_destroy(list, NULL);
+
+    return ipl;
+}
+
+static void ip_list_destroy(IPList *ipl)
+{
+    List *fragments;
+
+    if (ipl == NULL)
+        return;
+
+    dict_destroy(ipl->exact);
+    while ((fragments = gwlist_extract_first(ipl->wildcarded)) != NULL)
+        gwlist_destroy(fragments, octstr_destroy_item);
+    gwlist_destroy(ipl->wildcarded, NULL);
+    gw_free(ipl);
+}
+
+/*
+ * Return 1 when the ip is in the list, 0 otherwise. A wildcarded ip must have
+ * as many fragments as the one we are looking for.
+ */
+static int ip_list_contains(IPList *ipl, Octstr *ip)
+{
+    List *ip_fragments,
+         *fragments;
+    Octstr *fragment;
+    long i, j;
+    int found;
+
+    if (ipl->all)
+        return 1;
+
+    if (dict_get(ipl->exact, ip) != NULL)
+        return 1;
+
+    if (gwlist_len(ipl->wildcarded) == 0)
+        return 0;
+
+    found = 0;
+    ip_fragments = octstr_split(ip, octstr_imm("."));
+    for (i = 0; !found && i < gwlist_len(ipl->wildcarded); ++i) {
+        fragments = gwlist_get(ipl->wildcarded, i);
+        if (gwlist_len(fragments) != gwlist_len(ip_fragments))
+            continue;
+        found = 1;
+        for (j = 0; found && j < gwlist_len(fragments); ++j) {
+            fragment = gwlist_get(fragments, j);
+            if (octstr_compare(fragment, gwlist_get(ip_fragments, j)) != 0 &&
+                    octstr_compare(fragment, octstr_imm("*")) != 0)
+                found = 0;
+        }
+    }
+    gwlist_destroy(ip_fragments, octstr_destroy_item);
+
+    return found;
 }
 
 static int whitelisted(WAPPushUser *u, Octstr *number)
@@ -1015,40 +1190,6 @@ static int parse_cgivars_for_password(List *cgivars, Octstr **password)
     return 1;
 }
 
-/*
- * Compare an octet string os2 with a sequence of an octet string os1. The sequence
- * starts with a position start. 
- */
-static int compare_octstr_sequence(Octstr *os1, Octstr *os2, long start)
-{
-    int ret;
-    unsigned char *prefix;
-    long end;
-
-    if (octstr_len(os2) == 0)
-        return 1;
-
-    if (octstr_len(os1) == 0)
-        return -1;
-
-    prefix = NULL;
-    if (start != 0) {
-        prefix = gw_malloc(start);
-        octstr_get_many_chars((char *)prefix, os1, 0, start);
-        octstr_delete(os1, 0, start);
-    }
-    
-    end = start + octstr_len(os2);
-    ret = octstr_ncompare(os1, os2, end - start);
-    
-    if (start != 0) {
-        octstr_insert_data(os1, 0, (char *)prefix, start);
-        gw_free(prefix);
-    }
-
-    return ret;
-}
-
 static Octstr *forced_smsc(WAPPushUser *u)
 {
     return u->smsc_id;
@@ -80,6 +80,14 @@
 int wap_push_ppg_pushuser_list_add(List *l, long number_of_pushes, 
                                    long number_of_users);
 
+/*
+ * Replace the push users data structure with one created from the user
+ * groups in list, while pushes are being authenticated. If any of the users
+ * cannot be created, the old users are kept. Return 1 when the users were
+ * replaced, 0 otherwise.
+ */
+int wap_push_ppg_pushuser_list_reload(List *l, long number_of_users);
+
 /*
  * This function does clean up for module shutdown. This module MUST be called
  * when the caller of this module is shut down.
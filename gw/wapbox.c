@@ -96,14 +96,28 @@ enum {
 };
 
 enum { DEFAULT_TIMER_FREQ = 1};
+enum { DEFAULT_SHARDS = 1 };
+enum { DEFAULT_COMPILE_CACHE_LIFETIME = 300 };
 
 static Octstr *bearerbox_host;
 static long bearerbox_port = BB_DEFAULT_WAPBOX_PORT;
 static int bearerbox_ssl = 0;
 static Counter *sequence_counter = NULL;
 static long timer_freq = DEFAULT_TIMER_FREQ;
+static long shards = DEFAULT_SHARDS;
+static long compile_cache_size = 0;
+static long compile_cache_lifetime = DEFAULT_COMPILE_CACHE_LIFETIME;
 static Octstr *config_filename;
 
+/* optional HTTP port telling the state of the box */
+static long status_port = -1;
+static Octstr *status_interface = NULL;
+static Octstr *status_allow_ip = NULL;
+static Octstr *status_deny_ip = NULL;
+static time_t start_time;
+/* password of the commands accepted by the status port */
+static Octstr *admin_password = NULL;
+
 /* use strict XML parsing or relaxed */
 static int wml_xml_strict = 1;
 
@@ -161,6 +175,28 @@ static Cfg *init_wapbox(Cfg *cfg)
     bearerbox_host = cfg_get(grp, octstr_imm("bearerbox-host"));
     if (cfg_get_integer(&timer_freq, grp, octstr_imm("timer-freq")) == -1)
         timer_freq = DEFAULT_TIMER_FREQ;
+    if (cfg_get_integer(&shards, grp, octstr_imm("shards")) == -1 ||
+            shards < 1)
+        shards = DEFAULT_SHARDS;
+    if (cfg_get_integer(&status_port, grp, octstr_imm("status-port")) == -1)
+        status_port = -1;
+    status_interface = cfg_get(grp, octstr_imm("status-interface"));
+    status_allow_ip = cfg_get(grp, octstr_imm("status-allow-ip"));
+    status_deny_ip = cfg_get(grp, octstr_imm("status-deny-ip"));
+    /* only local clients unless told otherwise */
+    if (status_allow_ip == NULL && status_deny_ip == NULL) {
+        status_allow_ip = octstr_create("127.0.0.1");
+        status_deny_ip = octstr_create("*.*.*.*");
+    }
+    admin_password = cfg_get(grp, octstr_imm("admin-password"));
+    if (cfg_get_integer(&compile_cache_size, grp,
+                        octstr_imm("compile-cache-size")) == -1 ||
+            compile_cache_size < 0)
+        compile_cache_size = 0;
+    if (cfg_get_integer(&compile_cache_lifetime, grp,
+                        octstr_imm("compile-cache-lifetime")) == -1 ||
+            compile_cache_lifetime < 1)
+        compile_cache_lifetime = DEFAULT_COMPILE_CACHE_LIFETIME;
 
     logfile = cfg_get(grp, octstr_imm("log-file"));
     if (logfile != NULL) {
@@ -695,6 +731,109 @@ static void config_reload(int reload) {
     /* XXX TO-DO: if(reload) implement wapbox.resume/mutex.unlock */
 }
 
+/*
+ * Read the push users from the configuration file again. Requires the
+ * admin-password of the wapbox group.
+ */
+static Octstr *reload_push_users(List *args, int *status)
+{
+    Octstr *password;
+    Cfg *cfg;
+    int ret;
+
+    password = http_cgi_variable(args, "password");
+    if (admin_password == NULL || password == NULL ||
+            octstr_compare(password, admin_password) != 0) {
+        *status = HTTP_FORBIDDEN;
+        return octstr_create("Denied.\n");
+    }
+
+    cfg = cfg_create(config_filename);
+    if (cfg_read(cfg) == -1) {
+        cfg_destroy(cfg);
+        *status = HTTP_INTERNAL_SERVER_ERROR;
+        return octstr_format("Couldn't reload configuration from `%s'.\n",
+                             octstr_get_cstr(config_filename));
+    }
+    ret = wap_push_ppg_reload_users(cfg);
+    cfg_destroy(cfg);
+
+    if (ret == 1) {
+        *status = HTTP_OK;
+        return octstr_create("Push users reloaded.\n");
+    }
+    *status = ret == 0 ? HTTP_INTERNAL_SERVER_ERROR : HTTP_NOT_FOUND;
+    return octstr_create(ret == 0 ? "Push users not reloaded, see the log.\n" :
+                         "There are no push users.\n");
+}
+
+/*
+ * Answer requests to the status port with the live session counts.
+ */
+static void status_thread(void *arg)
+{
+    HTTPClient *client;
+    Octstr *ip, *url, *body, *answer;
+    List *hdrs, *args, *reply_hdrs;
+    long t, entries, hits, misses;
+    int status;
+
+    reply_hdrs = http_create_empty_headers();
+    http_header_add(reply_hdrs, "Content-Type", "text/plain");
+
+    for (;;) {
+        client = http_accept_request(status_port, &ip, &url, &hdrs, &body,
+                                     &args);
+        if (client == NULL)
+            break;
+
+        if (is_allowed_ip(status_allow_ip, status_deny_ip, ip) == 0) {
+            info(0, "Status port tried from denied host <%s>, disconnected",
+                 octstr_get_cstr(ip));
+            http_close_client(client);
+            answer = NULL;
+            goto done;
+        }
+
+        if (octstr_str_compare(url, "/reload-push-users") == 0) {
+            answer = reload_push_users(args, &status);
+            http_send_reply(client, status, reply_hdrs, answer);
+            goto done;
+        }
+
+        t = difftime(time(NULL), start_time);
+        wap_appl_get_cache_stats(&entries, &hits, &misses);
+        answer = octstr_format(GW_NAME " wapbox version `%s'.\n"
+                               "Status: %s, uptime %ldd %ldh %ldm %lds\n\n"
+                               "WSP sessions: %ld\n"
+                               "PPG push sessions: %ld\n"
+                               "Load: %ld\n"
+                               "Compile cache: %ld entries, %ld hits, "
+                               "%ld misses, hit rate %.1f%%\n",
+                               GW_VERSION,
+                               program_status == running ? "running" :
+                               "shutting down",
+                               t / 3600 / 24, t / 3600 % 24, t / 60 % 60,
+                               t % 60, wsp_session_count(),
+                               wap_push_ppg_session_count(),
+                               wap_appl_get_load(), entries, hits, misses,
+                               hits + misses > 0 ?
+                               100.0 * hits / (hits + misses) : 0.0);
+        http_send_reply(client, HTTP_OK, reply_hdrs, answer);
+
+done:
+        octstr_destroy(answer);
+        octstr_destroy(ip);
+        octstr_destroy(url);
+        http_destroy_headers(hdrs);
+        octstr_destroy(body);
+        http_destroy_cgiargs(args);
+    }
+
+    http_destroy_headers(reply_hdrs);
+}
+
+
 int main(int argc, char **argv) 
 {
     int cf_index;
@@ -728,7 +867,7 @@ int main(int argc, char **argv)
     wsp_session_init(&wtp_resp_dispatch_event,
                      &wtp_initiator_dispatch_event,
                      &wap_appl_dispatch,
-                     &wap_push_ppg_dispatch_event);
+                     &wap_push_ppg_dispatch_event, shards);
     wsp_unit_init(&dispatch_datagram, &wap_appl_dispatch);
     wsp_push_client_init(&wsp_push_client_dispatch_event, 
                          &wtp_resp_dispatch_event);
@@ -738,8 +877,8 @@ int main(int argc, char **argv)
                            timer_freq);
 
     wtp_resp_init(&dispatch_datagram, &wsp_session_dispatch_event,
-                  &wsp_push_client_dispatch_event, timer_freq);
-    wap_appl_init(cfg);
+                  &wsp_push_client_dispatch_event, timer_freq, shards);
+    wap_appl_init(cfg, compile_cache_size, compile_cache_lifetime);
 
 #if (HAVE_WTLS_OPENSSL)
     wtls_secmgr_init();
@@ -764,6 +903,12 @@ int main(int argc, char **argv)
         wap_push_ota_bb_address_set(bearerbox_host);
 	    
     program_status = running;
+    start_time = time(NULL);
+    if (status_port > 0) {
+        if (http_open_port_if(status_port, 0, status_interface) == -1)
+            panic(0, "Cannot open status port %ld", status_port);
+        gwthread_create(status_thread, NULL);
+    }
     if (0 > heartbeat_start(write_to_bearerbox, heartbeat_freq, 
     	    	    	    	       wap_appl_get_load)) {
         info(0, GW_NAME "Could not start heartbeat.");
@@ -833,6 +978,10 @@ int main(int argc, char **argv)
     
     program_status = shutting_down;
     heartbeat_stop(ALL_HEARTBEATS);
+    if (status_port > 0) {
+        http_close_port(status_port);
+        gwthread_join_every(status_thread);
+    }
     counter_destroy(sequence_counter);
 
     if (cfg)
@@ -858,6 +1007,10 @@ int main(int argc, char **argv)
     octstr_destroy(device_home);
     octstr_destroy(bearerbox_host);
     octstr_destroy(config_filename);
+    octstr_destroy(admin_password);
+    octstr_destroy(status_interface);
+    octstr_destroy(status_allow_ip);
+    octstr_destroy(status_deny_ip);
 
     /*
      * Just sleep for a while to get bearerbox chance to restart.
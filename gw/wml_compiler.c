@@ -124,6 +124,12 @@ static wbxml_version_t wbxml_version[] = {
 
 #define NUMBER_OF_WBXML_VERSION sizeof(wbxml_version)/sizeof(wbxml_version[0])
 
+/*
+ * Initial size of the string table indexes, the prefix index is kept a 
+ * power of two.
+ */
+#define STRING_TABLE_HINT 64
+
 
 typedef enum { NOESC, ESC, UNESC, FAILED } var_esc_t;
 
@@ -149,12 +155,29 @@ typedef struct {
 } wml_table3_t;
 
 
+/*
+ * The string table list node. Strings longer than WBXML_STRING_TABLE_MIN
+ * are also chained into a hash index by their first octets, index is the
+ * position in the string table and mark is used by string_table_find.
+ */
+
+typedef struct string_table_s {
+    unsigned long offset;
+    Octstr *string;
+    long index;
+    long mark;
+    struct string_table_s *next;
+} string_table_t;
+
+
 /*
  * The binary WML structure, that has been passed around between the 
  * internal functions. It contains the header fields for wbxml version, 
  * the WML public ID and the character set, the length of the string table, 
  * the list structure implementing the string table and the octet string 
- * containing the encoded WML binary.
+ * containing the encoded WML binary. The string table is indexed by the
+ * whole strings for string_table_add and by their prefixes for 
+ * string_table_apply.
  */
 
 typedef struct {
@@ -163,20 +186,16 @@ typedef struct {
     unsigned long character_set;
     unsigned long string_table_length;
     List *string_table;
+    Dict *string_index;
+    string_table_t **prefix_index;
+    long prefix_size;
+    long prefix_count;
+    List *prefix_specials;
+    long apply_round;
     Octstr *wbxml_string;
 } wml_binary_t;
 
 
-/*
- * The string table list node.
- */
-
-typedef struct {
-    unsigned long offset;
-    Octstr *string;
-} string_table_t;
-
-
 /*
  * The string table proposal list node.
  */
@@ -207,6 +226,26 @@ typedef struct {
     List *value_list;
 } wml_attribute_t;
 
+
+/*
+ * The token lookup table for elements and attributes. The names of the
+ * code page are placed into a power of two sized table with a seed chosen
+ * at initialization so that no two of them share a slot, hence a lookup
+ * is one hash and one string compare.
+ */
+
+typedef struct {
+    char *name;
+    void *value;
+} wml_token_slot_t;
+
+typedef struct {
+    unsigned long seed;
+    unsigned long mask;
+    wml_token_slot_t *slots;
+    void (*destroy)(void *);
+} wml_token_table_t;
+
 #include "xml_shared.h"
 #include "wml_definitions.h"
 
@@ -215,9 +254,9 @@ typedef struct {
  * Declarations of global variables. 
  */
 
-Dict *wml_elements_dict;
+static wml_token_table_t *wml_elements_table;
 
-Dict *wml_attributes_dict;
+static wml_token_table_t *wml_attributes_table;
 
 List *wml_attr_values_list;
 
@@ -284,11 +323,24 @@ static void output_variable(Octstr *variable, Octstr **output,
 
 static wml_hash_t *hash_create(char *text, unsigned char token);
 static wml_attribute_t *attribute_create(void);
-static void attr_dict_construct(wml_table3_t *attributes, Dict *attr_dict);
+static void attr_list_construct(wml_table3_t *attributes, List *attr_list);
 
 static void hash_destroy(void *p);
 static void attribute_destroy(void *p);
 
+/*
+ * Token lookup tables for elements and attributes.
+ */
+
+static wml_token_table_t *token_table_create(List *values, 
+                                             char *(*name_of)(void *),
+                                             void (*destroy)(void *));
+static unsigned long token_hash(unsigned long seed, const char *name);
+static void token_table_destroy(wml_token_table_t *table);
+static void *token_table_get(wml_token_table_t *table, const char *name);
+static char *hash_name(void *p);
+static char *attribute_name(void *p);
+
 /*
  * Comparison functions for the hash tables.
  */
@@ -306,7 +358,6 @@ static int check_if_url(int hex);
 static int check_if_emphasis(xmlNodePtr node);
 
 static int wml_table_len(wml_table_t *table);
-static int wml_table3_len(wml_table3_t *table);
 
 /* 
  * String table functions, used to add and remove strings into and from the
@@ -318,11 +369,17 @@ static void string_table_destroy(string_table_t *node);
 static string_table_proposal_t *string_table_proposal_create(Octstr *ostr);
 static void string_table_proposal_destroy(string_table_proposal_t *node);
 static void string_table_build(xmlNodePtr node, wml_binary_t **wbxml);
-static void string_table_collect_strings(xmlNodePtr node, List *strings);
+static void string_table_collect_strings(xmlNodePtr node, List *strings,
+                                         Dict *index);
 static List *string_table_collect_words(List *strings);
-static List *string_table_sort_list(List *start);
+static void string_table_propose(Octstr *string, List *proposals, 
+                                 Dict *index);
 static List *string_table_add_many(List *sorted, wml_binary_t **wbxml);
 static unsigned long string_table_add(Octstr *ostr, wml_binary_t **wbxml);
+static unsigned long string_table_prefix_hash(const unsigned char *data);
+static void string_table_index(string_table_t *item, wml_binary_t *wbxml);
+static int string_table_index_cmp(const void *a, const void *b);
+static List *string_table_find(Octstr *ostr, wml_binary_t *wbxml);
 static void string_table_apply(Octstr *ostr, wml_binary_t **wbxml);
 static void string_table_output(Octstr *ostr, wml_binary_t **wbxml);
 
@@ -430,20 +487,25 @@ void wml_init(int wml_xml_strict)
 {
     int i = 0, len = 0;
     wml_hash_t *temp = NULL;
+    List *values;
     
-    /* The wml elements into a hash table. */
+    /* The wml elements into a token table. */
     len = wml_table_len(wml_elements);
-    wml_elements_dict = dict_create(len, hash_destroy);
+    values = gwlist_create();
 
     for (i = 0; i < len; i++) {
 	temp = hash_create(wml_elements[i].text, wml_elements[i].token);
-	dict_put(wml_elements_dict, temp->item, temp);
+	gwlist_append(values, temp);
     }
+    wml_elements_table = token_table_create(values, hash_name, hash_destroy);
+    gwlist_destroy(values, NULL);
 
     /* Attributes. */
-    len = wml_table3_len(wml_attributes);
-    wml_attributes_dict = dict_create(len, attribute_destroy);
-    attr_dict_construct(wml_attributes, wml_attributes_dict);
+    values = gwlist_create();
+    attr_list_construct(wml_attributes, values);
+    wml_attributes_table = token_table_create(values, attribute_name, 
+                                              attribute_destroy);
+    gwlist_destroy(values, NULL);
 
     /* Attribute values. */
     len = wml_table_len(wml_attribute_values);
@@ -478,8 +540,8 @@ void wml_init(int wml_xml_strict)
 
 void wml_shutdown()
 {
-    dict_destroy(wml_elements_dict);
-    dict_destroy(wml_attributes_dict);
+    token_table_destroy(wml_elements_table);
+    token_table_destroy(wml_attributes_table);
     gwlist_destroy(wml_attr_values_list, hash_destroy);
     gwlist_destroy(wml_URL_values_list, hash_destroy);
 }
@@ -665,10 +727,9 @@ static int parse_element(xmlNodePtr node, wml_binary_t **wbxml)
     Octstr *name;
     wml_hash_t *element;
 
-    name = octstr_create((char *)node->name);
-
     /* Check, if the tag can be found from the code page. */
-    if ((element = dict_get(wml_elements_dict, name)) != NULL) {
+    if ((element = token_table_get(wml_elements_table, 
+                                   (char *)node->name)) != NULL) {
 	wbxml_hex = element->binary;
 	/* A conformance patch: no do-elements of same name in a card or
 	   template. An extremely ugly patch. --tuo */
@@ -682,10 +743,8 @@ static int parse_element(xmlNodePtr node, wml_binary_t **wbxml)
 	/* A conformance patch: if variable in setvar has a bad name, it's
 	   ignored. */
 	if (wbxml_hex == 0x3E) /* Setvar */
-	    if (check_variable_name(node) == FAILED) {
-		octstr_destroy(name);
+	    if (check_variable_name(node) == FAILED)
 		return add_end_tag;
-	    }
 	if ((status_bits = element_check_content(node)) > 0) {
 	    wbxml_hex = wbxml_hex | status_bits;
 	    /* If this node has children, the end tag must be added after 
@@ -707,9 +766,10 @@ static int parse_element(xmlNodePtr node, wml_binary_t **wbxml)
 		add_end_tag = 1;
 	}
 	output_st_char(wbxml_hex, wbxml);
-	octstr_append_uintvar((*wbxml)->wbxml_string,string_table_add(octstr_duplicate(name), wbxml));
+	name = octstr_create((char *)node->name);
 	warning(0, "WML compiler: Unknown tag in WML source: <%s>", 
 		octstr_get_cstr(name));
+	octstr_append_uintvar((*wbxml)->wbxml_string,string_table_add(name, wbxml));
     }
 
     /* Encode the attribute list for this node and add end tag after the 
@@ -724,7 +784,6 @@ static int parse_element(xmlNodePtr node, wml_binary_t **wbxml)
 	parse_st_end(wbxml);
     }
 
-    octstr_destroy(name);
     return add_end_tag;
 }
 
@@ -746,8 +805,6 @@ static int parse_attribute(xmlAttrPtr attr, wml_binary_t **wbxml)
     wml_attribute_t *attribute = NULL;
     Octstr *name = NULL, *pattern = NULL, *p = NULL;
 
-    name = octstr_create((char *)attr->name);
-
     if (attr->children != NULL)
 	pattern = create_octstr_from_node((char *)attr->children);
     else 
@@ -755,7 +812,8 @@ static int parse_attribute(xmlAttrPtr attr, wml_binary_t **wbxml)
 
     /* Check if the attribute is found on the code page. */
 
-    if ((attribute = dict_get(wml_attributes_dict, name)) != NULL) {
+    if ((attribute = token_table_get(wml_attributes_table, 
+                                     (char *)attr->name)) != NULL) {
 	if (attr->children == NULL || 
 	    (hit = gwlist_search(attribute->value_list, (void *)pattern, 
 			       hash_cmp)) == NULL) {
@@ -767,7 +825,7 @@ static int parse_attribute(xmlAttrPtr attr, wml_binary_t **wbxml)
 			       (attr->children != NULL ? "\"": ""));
 	            wbxml_hex = WBXML_LITERAL;
 	            output_st_char(wbxml_hex, wbxml);
-	            output_st_char(string_table_add(octstr_duplicate(name), wbxml), wbxml);
+	            output_st_char(string_table_add(octstr_duplicate(attribute->attribute), wbxml), wbxml);
 		} else {
 		    wbxml_hex = attribute->binary;
 		    output_st_char(wbxml_hex, wbxml);
@@ -783,15 +841,16 @@ static int parse_attribute(xmlAttrPtr attr, wml_binary_t **wbxml)
 	   string. */
 	wbxml_hex = WBXML_LITERAL;
 	output_st_char(wbxml_hex, wbxml);
-	octstr_append_uintvar((*wbxml)->wbxml_string,string_table_add(octstr_duplicate(name), wbxml));
+	name = octstr_create((char *)attr->name);
 	warning(0, "WML compiler: Unknown attribute in WML source: <%s>", 
 		octstr_get_cstr(name));
+	octstr_append_uintvar((*wbxml)->wbxml_string,string_table_add(name, wbxml));
     }
 
     if (status >= 0) {
 	var_esc_t default_esc;
 
-	default_esc = (octstr_str_compare (name, "href") == 0) ? ESC : NOESC;
+	default_esc = (strcmp((char *)attr->name, "href") == 0) ? ESC : NOESC;
 
 	/* The rest of the attribute is coded as a inline string. */
 	if (pattern != NULL && 
@@ -817,8 +876,6 @@ static int parse_attribute(xmlAttrPtr attr, wml_binary_t **wbxml)
     }
 
     /* Memory cleanup. */
-    octstr_destroy(name);
-
     if (pattern != NULL)
 	octstr_destroy(pattern);
 
@@ -1286,6 +1343,15 @@ static wml_binary_t *wml_binary_create(void)
     wbxml->character_set = 0x00;
     wbxml->string_table_length = 0x00;
     wbxml->string_table = gwlist_create();
+    wbxml->string_index = dict_create(STRING_TABLE_HINT, NULL);
+    wbxml->prefix_size = STRING_TABLE_HINT;
+    wbxml->prefix_index = gw_malloc(wbxml->prefix_size * 
+                                    sizeof(string_table_t *));
+    memset(wbxml->prefix_index, 0, wbxml->prefix_size * 
+           sizeof(string_table_t *));
+    wbxml->prefix_count = 0;
+    wbxml->prefix_specials = gwlist_create();
+    wbxml->apply_round = 0;
     wbxml->wbxml_string = octstr_create("");
 
     return wbxml;
@@ -1301,6 +1367,9 @@ static void wml_binary_destroy(wml_binary_t *wbxml)
 {
     if (wbxml != NULL) {
 	gwlist_destroy(wbxml->string_table, NULL);
+	dict_destroy(wbxml->string_index);
+	gw_free(wbxml->prefix_index);
+	gwlist_destroy(wbxml->prefix_specials, NULL);
 	octstr_destroy(wbxml->wbxml_string);
 	gw_free(wbxml);
     }
@@ -1415,11 +1484,11 @@ static wml_attribute_t *attribute_create(void)
 
 
 /*
- * attr_dict_construct - takes a table of attributes and their values and 
- * inputs these into a dictionary. 
+ * attr_list_construct - takes a table of attributes and their values and 
+ * inputs these into a list, one node for each attribute. 
  */
 
-static void attr_dict_construct(wml_table3_t *attributes, Dict *attr_dict)
+static void attr_list_construct(wml_table3_t *attributes, List *attr_list)
 {
     int i = 0;
     wml_attribute_t *node = NULL;
@@ -1431,7 +1500,7 @@ static void attr_dict_construct(wml_table3_t *attributes, Dict *attr_dict)
 	if (node->attribute == NULL)
 	    node->attribute = octstr_create(attributes[i].text1);
 	else if (strcmp(attributes[i].text1, attributes[i-1].text1) != 0) {
-	    dict_put(attr_dict, node->attribute, node);
+	    gwlist_append(attr_list, node);
 	    node = attribute_create();
 	    node->attribute = octstr_create(attributes[i].text1);
 	}
@@ -1445,7 +1514,7 @@ static void attr_dict_construct(wml_table3_t *attributes, Dict *attr_dict)
 	i++;
     } while (attributes[i].text1 != NULL);
 
-    dict_put(attr_dict, node->attribute, node);
+    gwlist_append(attr_list, node);
 }
 
 
@@ -1489,6 +1558,130 @@ static void attribute_destroy(void *p)
 
 
 
+/*
+ * hash_name, attribute_name - return the name of a token table value.
+ */
+
+static char *hash_name(void *p)
+{
+    return octstr_get_cstr(((wml_hash_t *)p)->item);
+}
+
+
+static char *attribute_name(void *p)
+{
+    return octstr_get_cstr(((wml_attribute_t *)p)->attribute);
+}
+
+
+
+/*
+ * token_hash - the seeded hash function of the token tables.
+ */
+
+static unsigned long token_hash(unsigned long seed, const char *name)
+{
+    unsigned long h = 2166136261UL ^ seed;
+
+    while (*name != '\0') {
+	h ^= (unsigned char) *name++;
+	h = (h * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return h ^ (h >> 15);
+}
+
+
+
+/*
+ * token_table_create - builds a token table of the values, naming them 
+ * with name_of. Seeds are tried until one places every name into a slot 
+ * of its own, if none of TOKEN_TABLE_SEEDS does the table is doubled.
+ */
+
+#define TOKEN_TABLE_SEEDS 1000
+
+static wml_token_table_t *token_table_create(List *values, 
+                                             char *(*name_of)(void *),
+                                             void (*destroy)(void *))
+{
+    wml_token_table_t *table;
+    unsigned long size, slot;
+    long i, len;
+    char *name;
+    void *value;
+
+    table = gw_malloc(sizeof(wml_token_table_t));
+    table->destroy = destroy;
+    len = gwlist_len(values);
+
+    for (size = 4; size < 4 * (unsigned long) len; size <<= 1)
+	;
+    table->slots = NULL;
+
+    for (;;) {
+	table->mask = size - 1;
+	table->slots = gw_realloc(table->slots, 
+	                          size * sizeof(wml_token_slot_t));
+	for (table->seed = 0; table->seed < TOKEN_TABLE_SEEDS; table->seed++) {
+	    memset(table->slots, 0, size * sizeof(wml_token_slot_t));
+	    for (i = 0; i < len; i++) {
+		value = gwlist_get(values, i);
+		name = name_of(value);
+		slot = token_hash(table->seed, name) & table->mask;
+		if (table->slots[slot].name != NULL)
+		    break;
+		table->slots[slot].name = name;
+		table->slots[slot].value = value;
+	    }
+	    if (i == len)
+		return table;
+	}
+	size <<= 1;
+    }
+}
+
+
+
+/*
+ * token_table_destroy - frees the token table and its values.
+ */
+
+static void token_table_destroy(wml_token_table_t *table)
+{
+    unsigned long i;
+
+    if (table == NULL)
+	return;
+
+    for (i = 0; i <= table->mask; i++)
+	if (table->slots[i].name != NULL && table->destroy != NULL)
+	    table->destroy(table->slots[i].value);
+
+    gw_free(table->slots);
+    gw_free(table);
+}
+
+
+
+/*
+ * token_table_get - returns the value for name or NULL if name is not in 
+ * the table.
+ */
+
+static void *token_table_get(wml_token_table_t *table, const char *name)
+{
+    wml_token_slot_t *slot;
+
+    slot = &table->slots[token_hash(table->seed, name) & table->mask];
+    if (slot->name == NULL || strcmp(slot->name, name) != 0)
+	return NULL;
+
+    return slot->value;
+}
+
+
+
 /*
  * hash_cmp - compares pattern against item and if the pattern matches the 
  * item returns 1, else 0.
@@ -1689,22 +1882,6 @@ static int wml_table_len(wml_table_t *table)
 
 
 
-/*
- * wml_table3_len - returns the length of a wml_table3_t array.
- */
-
-static int wml_table3_len(wml_table3_t *table)
-{
-    int i = 0;
-
-    while (table[i].text1 != NULL)
-	i++;
-
-    return i;
-}
-
-
-
 /*
  * string_table_create - reserves memory for the string_table_t and sets the 
  * fields.
@@ -1717,6 +1894,9 @@ static string_table_t *string_table_create(int offset, Octstr *ostr)
     node = gw_malloc(sizeof(string_table_t));
     node->offset = offset;
     node->string = ostr;
+    node->index = 0;
+    node->mark = 0;
+    node->next = NULL;
 
     return node;
 }
@@ -1774,26 +1954,27 @@ static void string_table_proposal_destroy(string_table_proposal_t *node)
  * string_table_build - collects the strings from the WML source into a list, 
  * adds those strings that appear more than once into string table. The rest 
  * of the strings are sliced into words and the same procedure is executed to 
- * the list of these words.
+ * the list of these words. The tree is walked once, the strings are counted 
+ * as they are collected.
  */
 
 static void string_table_build(xmlNodePtr node, wml_binary_t **wbxml)
 {
     string_table_proposal_t *item = NULL;
     List *list = NULL;
+    Dict *index = NULL;
 
     list = gwlist_create();
+    index = dict_create(STRING_TABLE_HINT, NULL);
 
-    string_table_collect_strings(node, list);
+    string_table_collect_strings(node, list, index);
+    dict_destroy(index);
 
-    list = string_table_add_many(string_table_sort_list(list), wbxml);
+    list = string_table_add_many(list, wbxml);
 
-    list =  string_table_collect_words(list);
+    list = string_table_collect_words(list);
 
-    /* Don't add strings if there aren't any. (no NULLs please) */
-    if (list) {
-	list = string_table_add_many(string_table_sort_list(list), wbxml);
-    }
+    list = string_table_add_many(list, wbxml);
 
     /* Memory cleanup. */
     while (gwlist_len(list)) {
@@ -1808,11 +1989,12 @@ static void string_table_build(xmlNodePtr node, wml_binary_t **wbxml)
 
 /*
  * string_table_collect_strings - collects the strings from the WML 
- * ocument into a list that is then further processed to build the 
- * string table for the document.
+ * ocument into a list of proposals that is then further processed to build 
+ * the string table for the document.
  */
 
-static void string_table_collect_strings(xmlNodePtr node, List *strings)
+static void string_table_collect_strings(xmlNodePtr node, List *strings,
+                                         Dict *index)
 {
     Octstr *string;
     xmlAttrPtr attribute;
@@ -1827,7 +2009,7 @@ static void string_table_collect_strings(xmlNodePtr node, List *strings)
 	    octstr_strip_nonalphanums(string);
 
 	if (octstr_len(string) > WBXML_STRING_TABLE_MIN)
-	    gwlist_append(strings, string);
+	    string_table_propose(string, strings, index);
 	else 
 	    octstr_destroy(string);
 	break;
@@ -1836,7 +2018,8 @@ static void string_table_collect_strings(xmlNodePtr node, List *strings)
 	    attribute = node->properties;
 	    while (attribute != NULL) {
 		if (attribute->children != NULL)
-		    string_table_collect_strings(attribute->children, strings);
+		    string_table_collect_strings(attribute->children, strings,
+		                                 index);
 		attribute = attribute->next;
 	    }
 	}
@@ -1846,52 +2029,33 @@ static void string_table_collect_strings(xmlNodePtr node, List *strings)
     }
 
     if (node->children != NULL)
-	string_table_collect_strings(node->children, strings);
+	string_table_collect_strings(node->children, strings, index);
 
     if (node->next != NULL)
-	string_table_collect_strings(node->next, strings);
+	string_table_collect_strings(node->next, strings, index);
 }
 
 
 
 /*
- * string_table_sort_list - takes a list of octet strings and returns a list
- * of string_table_proposal_t:s that contains the same strings with number of 
- * instants of every string in the input list.
+ * string_table_propose - counts an instance of string into the list of 
+ * string_table_proposal_t:s. The proposals are kept in the order of first 
+ * appearance, index maps the strings to them.
  */
 
-static List *string_table_sort_list(List *start)
+static void string_table_propose(Octstr *string, List *proposals, 
+                                 Dict *index)
 {
-    int i;
-    Octstr *string = NULL;
     string_table_proposal_t *item = NULL;
-    List *sorted = NULL;
-
-    sorted = gwlist_create();
-
-    while (gwlist_len(start)) {
-	string = gwlist_extract_first(start);
-      
-	/* Check whether the string is unique. */
-	for (i = 0; i < gwlist_len(sorted); i++) {
-	    item = gwlist_get(sorted, i);
-	    if (octstr_compare(item->string, string) == 0) {
-		octstr_destroy(string);
-		string = NULL;
-		item->count ++;
-		break;
-	    }
-	}
-	
-	if (string != NULL) {
-	    item = string_table_proposal_create(string);
-	    gwlist_append(sorted, item);
-	}
-    }
-
-    gwlist_destroy(start, NULL);
 
-    return sorted;
+    if ((item = dict_get(index, string)) != NULL) {
+	octstr_destroy(string);
+	item->count ++;
+    } else {
+	item = string_table_proposal_create(string);
+	dict_put(index, string, item);
+	gwlist_append(proposals, item);
+    }
 }
 
 
@@ -1928,8 +2092,8 @@ static List *string_table_add_many(List *sorted, wml_binary_t **wbxml)
 
 
 /*
- * string_table_collect_words - takes a list of strings and returns a list 
- * of words contained by those strings.
+ * string_table_collect_words - takes a list of string proposals and returns 
+ * a list of proposals for words contained by those strings.
  */
 
 static List *string_table_collect_words(List *strings)
@@ -1937,25 +2101,25 @@ static List *string_table_collect_words(List *strings)
     Octstr *word = NULL;
     string_table_proposal_t *item = NULL;
     List *list = NULL, *temp_list = NULL;
+    Dict *index = NULL;
+
+    list = gwlist_create();
+    index = dict_create(STRING_TABLE_HINT, NULL);
 
     while (gwlist_len(strings)) {
 	item = gwlist_extract_first(strings);
 
-	if (list == NULL) {
-	    list = octstr_split_words(item->string);
-	    string_table_proposal_destroy(item);
-	} else {
-	    temp_list = octstr_split_words(item->string);
+	temp_list = octstr_split_words(item->string);
 
-	    while ((word = gwlist_extract_first(temp_list)) != NULL)
-		gwlist_append(list, word);
+	while ((word = gwlist_extract_first(temp_list)) != NULL)
+	    string_table_propose(word, list, index);
 
-	    gwlist_destroy(temp_list, NULL);
-	    string_table_proposal_destroy(item);
-	}
+	gwlist_destroy(temp_list, NULL);
+	string_table_proposal_destroy(item);
     }
 
     gwlist_destroy(strings, NULL);
+    dict_destroy(index);
 
     return list;
 }
@@ -1972,47 +2136,187 @@ static List *string_table_collect_words(List *strings)
 static unsigned long string_table_add(Octstr *ostr, wml_binary_t **wbxml)
 {
     string_table_t *item = NULL;
-    unsigned long i, offset = 0;
+    unsigned long offset = 0;
 
     /* Check whether the string is unique. */
-    for (i = 0; i < (unsigned long)gwlist_len((*wbxml)->string_table); i++) {
-	item = gwlist_get((*wbxml)->string_table, i);
-	if (octstr_compare(item->string, ostr) == 0) {
-	    octstr_destroy(ostr);
-	    return item->offset;
-	}
+    if ((item = dict_get((*wbxml)->string_index, ostr)) != NULL) {
+	octstr_destroy(ostr);
+	return item->offset;
     }
 
     /* Create a new list item for the string table. */
     offset = (*wbxml)->string_table_length;
 
     item = string_table_create(offset, ostr);
+    item->index = gwlist_len((*wbxml)->string_table);
 
     (*wbxml)->string_table_length = 
 	(*wbxml)->string_table_length + octstr_len(ostr) + 1;
     gwlist_append((*wbxml)->string_table, item);
+    dict_put((*wbxml)->string_index, ostr, item);
+    string_table_index(item, *wbxml);
 
     return offset;
 }
 
 
 
+/*
+ * string_table_prefix_hash - hashes the first WBXML_STRING_TABLE_MIN 
+ * octets of data.
+ */
+
+static unsigned long string_table_prefix_hash(const unsigned char *data)
+{
+    unsigned long h = 0;
+    int i;
+
+    for (i = 0; i < WBXML_STRING_TABLE_MIN; i++)
+	h = (h * 33) ^ data[i];
+
+    return h ^ (h >> 7);
+}
+
+
+
+/*
+ * string_table_index - adds a string table entry into the prefix index 
+ * used by string_table_find. Only strings longer than WBXML_STRING_TABLE_MIN 
+ * are ever referenced from inline strings. Entries containing octets that 
+ * string_table_apply inserts are remembered separately, they may match 
+ * across an earlier reference.
+ */
+
+static void string_table_index(string_table_t *item, wml_binary_t *wbxml)
+{
+    string_table_t **old, *p, *next;
+    unsigned long slot;
+    long i, old_size;
+
+    if (octstr_len(item->string) <= WBXML_STRING_TABLE_MIN)
+	return;
+
+    if (octstr_search_char(item->string, WBXML_STR_END, 0) >= 0 ||
+	octstr_search_char(item->string, WBXML_STR_I, 0) >= 0 ||
+	octstr_search_char(item->string, WBXML_STR_T, 0) >= 0)
+	gwlist_append(wbxml->prefix_specials, item);
+
+    /* Keep the chains short. */
+    if (wbxml->prefix_count >= wbxml->prefix_size) {
+	old = wbxml->prefix_index;
+	old_size = wbxml->prefix_size;
+	wbxml->prefix_size *= 2;
+	wbxml->prefix_index = gw_malloc(wbxml->prefix_size * 
+	                                sizeof(string_table_t *));
+	memset(wbxml->prefix_index, 0, wbxml->prefix_size * 
+	       sizeof(string_table_t *));
+	for (i = 0; i < old_size; i++)
+	    for (p = old[i]; p != NULL; p = next) {
+		next = p->next;
+		slot = string_table_prefix_hash((unsigned char *) 
+		    octstr_get_cstr(p->string)) & (wbxml->prefix_size - 1);
+		p->next = wbxml->prefix_index[slot];
+		wbxml->prefix_index[slot] = p;
+	    }
+	gw_free(old);
+    }
+
+    slot = string_table_prefix_hash((unsigned char *) 
+        octstr_get_cstr(item->string)) & (wbxml->prefix_size - 1);
+    item->next = wbxml->prefix_index[slot];
+    wbxml->prefix_index[slot] = item;
+    wbxml->prefix_count++;
+}
+
+
+
+/*
+ * string_table_index_cmp - orders string table entries by their position 
+ * in the table.
+ */
+
+static int string_table_index_cmp(const void *a, const void *b)
+{
+    const string_table_t *item_a = a;
+    const string_table_t *item_b = b;
+
+    return (item_a->index > item_b->index) - (item_a->index < item_b->index);
+}
+
+
+
+/*
+ * string_table_find - returns the string table entries string_table_apply 
+ * may replace in ostr, in string table order. These are the ones found in 
+ * ostr through the prefix index and the ones that may match across an 
+ * inserted reference. (An entry could also match inside the offset octets 
+ * of a reference alone, but that takes a string table over 2^28 octets.)
+ */
+
+static List *string_table_find(Octstr *ostr, wml_binary_t *wbxml)
+{
+    List *hits;
+    string_table_t *item;
+    const unsigned char *data;
+    unsigned long slot;
+    long pos, len, i;
+
+    hits = gwlist_create();
+    if (wbxml->prefix_count == 0)
+	return hits;
+
+    wbxml->apply_round++;
+    data = (unsigned char *) octstr_get_cstr(ostr);
+    len = octstr_len(ostr);
+
+    for (pos = 0; pos + WBXML_STRING_TABLE_MIN < len; pos++) {
+	slot = string_table_prefix_hash(data + pos) & (wbxml->prefix_size - 1);
+	for (item = wbxml->prefix_index[slot]; item != NULL; item = item->next) {
+	    if (item->mark != wbxml->apply_round && 
+		octstr_len(item->string) <= len - pos &&
+		memcmp(octstr_get_cstr(item->string), data + pos, 
+		       octstr_len(item->string)) == 0) {
+		item->mark = wbxml->apply_round;
+		gwlist_append(hits, item);
+	    }
+	}
+    }
+
+    for (i = 0; i < gwlist_len(wbxml->prefix_specials); i++) {
+	item = gwlist_get(wbxml->prefix_specials, i);
+	if (item->mark != wbxml->apply_round) {
+	    item->mark = wbxml->apply_round;
+	    gwlist_append(hits, item);
+	}
+    }
+
+    if (gwlist_len(hits) > 1)
+	gwlist_sort(hits, string_table_index_cmp);
+
+    return hits;
+}
+
+
+
 /*
  * string_table_apply - takes a octet string of WML bnary and goes it 
  * through searching for substrings that are in the string table and 
- * replaces them with string table references.
+ * replaces them with string table references. Only the entries that 
+ * string_table_find returns are searched for.
  */
 
 static void string_table_apply(Octstr *ostr, wml_binary_t **wbxml)
 {
     Octstr *input = NULL;
     string_table_t *item = NULL;
+    List *hits = NULL;
     long i = 0, word_s = 0, str_e = 0;
 
     input = octstr_create("");
+    hits = string_table_find(ostr, *wbxml);
 
-    for (i = 0; i < gwlist_len((*wbxml)->string_table); i++) {
-	item = gwlist_get((*wbxml)->string_table, i);
+    for (i = 0; i < gwlist_len(hits); i++) {
+	item = gwlist_get(hits, i);
 
 	if (octstr_len(item->string) > WBXML_STRING_TABLE_MIN)
 	    /* No use to replace 1 to 3 character substring, the reference 
@@ -2058,6 +2362,7 @@ static void string_table_apply(Octstr *ostr, wml_binary_t **wbxml)
     }
 
     octstr_destroy(input);
+    gwlist_destroy(hits, NULL);
 
     if (octstr_get_char(ostr, 0) != WBXML_STR_T)
 	output_st_char(WBXML_STR_I, wbxml);
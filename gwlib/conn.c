@@ -1064,6 +1064,22 @@ int conn_write_data(Connection *conn, unsigned char *data, long length)
     return ret;
 }
 
+int conn_write_encoded(Connection *conn,
+                       int (*encode)(Octstr *outbuf, void *context),
+                       void *context)
+{
+    int ret;
+
+    lock_out(conn);
+    if (encode(conn->outbuf, context) == -1)
+        ret = -1;
+    else
+        ret = unlocked_try_write(conn);
+    unlock_out(conn);
+
+    return ret;
+}
+
 int conn_write_withlen(Connection *conn, Octstr *data)
 {
     int ret;
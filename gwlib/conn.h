@@ -249,6 +249,14 @@ int conn_flush(Connection *conn);
  */
 int conn_write(Connection *conn, Octstr *data);
 int conn_write_data(Connection *conn, unsigned char *data, long length);
+/* Let `encode' append its output directly to the connection's output
+ * buffer, without an intermediate Octstr, and queue it as conn_write
+ * does. `encode' is called with the output lock held and must only
+ * append to `outbuf'; if it returns -1, -1 is returned and nothing
+ * must have been appended. */
+int conn_write_encoded(Connection *conn,
+                       int (*encode)(Octstr *outbuf, void *context),
+                       void *context);
 /* Write the length of the octstr as a standard network long, then
  * write the octstr itself. */
 int conn_write_withlen(Connection *conn, Octstr *data);
@@ -139,6 +139,41 @@ static long key_to_index(Dict *dict, Octstr *key)
     return octstr_hash_key(key) % dict->size;
 }
 
+/*
+ * Double the size of the table once it holds more keys than it has
+ * slots, so that the chains stay short however far the size hint was
+ * off. Must be called with the dict locked.
+ */
+static void grow(Dict *dict)
+{
+    List **old_tab, *list;
+    Item *p;
+    long i, old_size;
+
+    if (dict->key_count <= dict->size)
+        return;
+
+    old_tab = dict->tab;
+    old_size = dict->size;
+    dict->size = old_size * 2;
+    dict->tab = gw_malloc(sizeof(dict->tab[0]) * dict->size);
+    for (i = 0; i < dict->size; ++i)
+        dict->tab[i] = NULL;
+
+    for (i = 0; i < old_size; ++i) {
+        if (old_tab[i] == NULL)
+            continue;
+        while ((p = gwlist_extract_first(old_tab[i])) != NULL) {
+            list = dict->tab[key_to_index(dict, p->key)];
+            if (list == NULL)
+                list = dict->tab[key_to_index(dict, p->key)] = gwlist_create();
+            gwlist_append(list, p);
+        }
+        gwlist_destroy(old_tab[i], NULL);
+    }
+    gw_free(old_tab);
+}
+
 static int handle_null_value(Dict *dict, Octstr *key, void *value)
 {
     if (value == NULL) {
@@ -173,6 +208,7 @@ static int dict_put_true(Dict *dict, Octstr *key, void *value)
 	gwlist_append(dict->tab[i], p);
         dict->key_count++;
         item_unique = 1;
+        grow(dict);
     } else {
     	if (dict->destroy_value != NULL)
     	    dict->destroy_value(value);
@@ -260,6 +296,7 @@ void dict_put(Dict *dict, Octstr *key, void *value)
     	p = item_create(key, value);
 	gwlist_append(dict->tab[i], p);
         dict->key_count++;
+        grow(dict);
     } else {
 	if (dict->destroy_value != NULL)
 	    dict->destroy_value(p->value);
@@ -73,8 +73,8 @@ typedef struct Dict Dict;
 /*
  * Create a Dict. `size_hint' gives an indication of how many different
  * keys will be in the Dict at the same time, at most. This is used for
- * performance optimization; things will work fine, though somewhat
- * slower, even if it the number is exceeded. `destroy_value' is a pointer
+ * performance optimization; the table grows once the number is
+ * exceeded, so things will work fine, though somewhat slower. `destroy_value' is a pointer
  * to a function that is called whenever a value stored in the Dict needs
  * to be destroyed. If `destroy_value' is NULL, then values are not
  * destroyed by the Dict, they are just discarded.
@@ -0,0 +1,452 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * gw-pool.c - pool of worker threads running short tasks
+ *
+ * Every worker owns a list of tasks. The owner takes tasks from the
+ * head of its list, other workers steal from the tail when their own
+ * list is empty. All operations on a list are done holding the list's
+ * permanent lock, so that stealing (peek at the tail, then delete it)
+ * is atomic towards the owner and the producers.
+ *
+ * The pool lock protects the idle flags. A worker out of tasks marks
+ * itself idle under the pool lock, looks at the lists once more and
+ * only then sleeps. Producers queue new tasks under the pool lock and
+ * wake an idle worker, if any. As the wakeup of a gwthread is kept
+ * until its next sleep, no wakeup gets lost in between.
+ */
+
+#include "gw-config.h"
+#include <unistd.h>
+#include <pthread.h>
+#include "gwlib.h"
+#include "gw-pool.h"
+
+
+struct task {
+    gwthread_func_t *execute;
+    gw_pool_func_t *submit;
+    void *arg;
+    gw_future_t *future;
+};
+
+struct worker {
+    gw_pool_t *pool;
+    long index;
+    long thread;
+    List *tasks;
+    int idle;
+};
+
+struct gw_pool {
+    Mutex *lock;
+    struct worker *workers;
+    long count;
+    long next;
+    long idle;
+    int closing;
+    Counter *queued;
+};
+
+struct gw_future {
+    Mutex *lock;
+    int done;
+    void *result;
+    long waiter;
+};
+
+
+/* The worker the calling thread is, if any. */
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+
+static void worker_key_create(void)
+{
+    int ret;
+
+    if ((ret = pthread_key_create(&worker_key, NULL)) != 0)
+        panic(ret, "gw-pool: pthread_key_create failed");
+}
+
+
+static struct worker *current_worker(void)
+{
+    pthread_once(&worker_key_once, worker_key_create);
+    return pthread_getspecific(worker_key);
+}
+
+
+static struct task *take_own(struct worker *w)
+{
+    struct task *task;
+
+    gwlist_lock(w->tasks);
+    task = gwlist_extract_first(w->tasks);
+    gwlist_unlock(w->tasks);
+
+    return task;
+}
+
+
+static struct task *steal(struct worker *victim)
+{
+    struct task *task = NULL;
+    long len;
+
+    gwlist_lock(victim->tasks);
+    len = gwlist_len(victim->tasks);
+    if (len > 0) {
+        task = gwlist_get(victim->tasks, len - 1);
+        gwlist_delete(victim->tasks, len - 1, 1);
+    }
+    gwlist_unlock(victim->tasks);
+
+    return task;
+}
+
+
+/*
+ * Take the next task for the worker, from its own list first, then
+ * from the others, starting with its neighbour.
+ */
+static struct task *take_task(struct worker *w)
+{
+    gw_pool_t *pool = w->pool;
+    struct task *task;
+    long i;
+
+    task = take_own(w);
+    for (i = 1; task == NULL && i < pool->count; i++)
+        task = steal(&pool->workers[(w->index + i) % pool->count]);
+
+    if (task != NULL)
+        counter_decrease(pool->queued);
+
+    return task;
+}
+
+
+static void future_complete(gw_future_t *future, void *result)
+{
+    long waiter;
+
+    mutex_lock(future->lock);
+    future->result = result;
+    future->done = 1;
+    waiter = future->waiter;
+    mutex_unlock(future->lock);
+
+    if (waiter >= 0)
+        gwthread_wakeup(waiter);
+}
+
+
+static void run_task(struct task *task)
+{
+    if (task->execute != NULL)
+        task->execute(task->arg);
+    else
+        future_complete(task->future, task->submit(task->arg));
+    gw_free(task);
+}
+
+
+static void worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    gw_pool_t *pool = w->pool;
+    struct task *task;
+
+    pthread_once(&worker_key_once, worker_key_create);
+    pthread_setspecific(worker_key, w);
+
+    for (;;) {
+        if ((task = take_task(w)) != NULL) {
+            run_task(task);
+            continue;
+        }
+
+        mutex_lock(pool->lock);
+        if (pool->closing && counter_value(pool->queued) == 0) {
+            mutex_unlock(pool->lock);
+            break;
+        }
+        w->idle = 1;
+        pool->idle++;
+        mutex_unlock(pool->lock);
+
+        /* a task may have come in before we were marked idle */
+        if ((task = take_task(w)) == NULL && !pool->closing)
+            gwthread_sleep(-1);
+
+        mutex_lock(pool->lock);
+        if (w->idle) {
+            w->idle = 0;
+            pool->idle--;
+        }
+        mutex_unlock(pool->lock);
+
+        if (task != NULL)
+            run_task(task);
+    }
+
+    pthread_setspecific(worker_key, NULL);
+}
+
+
+/*
+ * Queue a task and wake up a worker to run it, if needed.
+ */
+static void queue_task(gw_pool_t *pool, struct task *task)
+{
+    struct worker *self, *target, *wake = NULL;
+    long i;
+
+    self = current_worker();
+
+    mutex_lock(pool->lock);
+    gw_assert(!pool->closing || (self != NULL && self->pool == pool));
+
+    if (self != NULL && self->pool == pool)
+        target = self;
+    else {
+        target = &pool->workers[pool->next];
+        pool->next = (pool->next + 1) % pool->count;
+    }
+
+    counter_increase(pool->queued);
+    gwlist_lock(target->tasks);
+    gwlist_append(target->tasks, task);
+    gwlist_unlock(target->tasks);
+
+    if (pool->idle > 0) {
+        if (target->idle)
+            wake = target;
+        for (i = 0; wake == NULL && i < pool->count; i++) {
+            if (pool->workers[i].idle)
+                wake = &pool->workers[i];
+        }
+        wake->idle = 0;
+        pool->idle--;
+    }
+    mutex_unlock(pool->lock);
+
+    if (wake != NULL)
+        gwthread_wakeup(wake->thread);
+}
+
+
+gw_pool_t *gw_pool_create(long threads)
+{
+    gw_pool_t *pool;
+    long i;
+
+    if (threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (threads <= 0)
+            threads = 1;
+    }
+
+    pool = gw_malloc(sizeof(*pool));
+    pool->lock = mutex_create();
+    pool->count = threads;
+    pool->next = 0;
+    pool->idle = 0;
+    pool->closing = 0;
+    pool->queued = counter_create();
+    pool->workers = gw_malloc(threads * sizeof(*pool->workers));
+
+    for (i = 0; i < threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].tasks = gwlist_create();
+        pool->workers[i].idle = 0;
+    }
+    /* start the workers only when all lists exist, they steal at once */
+    for (i = 0; i < threads; i++) {
+        pool->workers[i].thread = gwthread_create(worker_thread, &pool->workers[i]);
+        if (pool->workers[i].thread == -1)
+            panic(0, "gw-pool: Could not start worker thread.");
+    }
+
+    return pool;
+}
+
+
+void gw_pool_destroy(gw_pool_t *pool)
+{
+    long i;
+
+    if (pool == NULL)
+        return;
+
+    gw_assert(current_worker() == NULL || current_worker()->pool != pool);
+
+    mutex_lock(pool->lock);
+    pool->closing = 1;
+    mutex_unlock(pool->lock);
+
+    for (i = 0; i < pool->count; i++)
+        gwthread_wakeup(pool->workers[i].thread);
+    for (i = 0; i < pool->count; i++)
+        gwthread_join(pool->workers[i].thread);
+
+    for (i = 0; i < pool->count; i++) {
+        gw_assert(gwlist_len(pool->workers[i].tasks) == 0);
+        gwlist_destroy(pool->workers[i].tasks, NULL);
+    }
+    gw_free(pool->workers);
+    counter_destroy(pool->queued);
+    mutex_destroy(pool->lock);
+    gw_free(pool);
+}
+
+
+void gw_pool_execute(gw_pool_t *pool, gwthread_func_t *func, void *arg)
+{
+    struct task *task;
+
+    gw_assert(pool != NULL);
+    gw_assert(func != NULL);
+
+    task = gw_malloc(sizeof(*task));
+    task->execute = func;
+    task->submit = NULL;
+    task->arg = arg;
+    task->future = NULL;
+
+    queue_task(pool, task);
+}
+
+
+gw_future_t *gw_pool_submit(gw_pool_t *pool, gw_pool_func_t *func, void *arg)
+{
+    struct task *task;
+    gw_future_t *future;
+
+    gw_assert(pool != NULL);
+    gw_assert(func != NULL);
+
+    future = gw_malloc(sizeof(*future));
+    future->lock = mutex_create();
+    future->done = 0;
+    future->result = NULL;
+    future->waiter = -1;
+
+    task = gw_malloc(sizeof(*task));
+    task->execute = NULL;
+    task->submit = func;
+    task->arg = arg;
+    task->future = future;
+
+    queue_task(pool, task);
+
+    return future;
+}
+
+
+void *gw_future_wait(gw_future_t *future)
+{
+    struct worker *self;
+    struct task *task;
+    void *result;
+
+    gw_assert(future != NULL);
+    gw_assert(gwthread_self() >= 0);
+
+    self = current_worker();
+
+    for (;;) {
+        mutex_lock(future->lock);
+        if (future->done) {
+            mutex_unlock(future->lock);
+            break;
+        }
+        future->waiter = gwthread_self();
+        mutex_unlock(future->lock);
+
+        /* a worker keeps its pool going instead of just sleeping */
+        if (self != NULL && (task = take_task(self)) != NULL)
+            run_task(task);
+        else
+            gwthread_sleep(-1);
+    }
+
+    result = future->result;
+    mutex_destroy(future->lock);
+    gw_free(future);
+
+    return result;
+}
+
+
+long gw_pool_threads(gw_pool_t *pool)
+{
+    gw_assert(pool != NULL);
+    return pool->count;
+}
+
+
+long gw_pool_queued(gw_pool_t *pool)
+{
+    gw_assert(pool != NULL);
+    return counter_value(pool->queued);
+}
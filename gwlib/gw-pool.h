@@ -0,0 +1,134 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * gw-pool.h - pool of worker threads running short tasks
+ *
+ * A fixed set of worker threads runs tasks handed in by any thread.
+ * Each worker has its own queue; a worker running out of tasks takes
+ * tasks from the queues of the others (work stealing). Idle workers
+ * sleep in gwthread_sleep() and are woken with gwthread_wakeup(), so
+ * the usual gwthread machinery works for them as for any other thread.
+ *
+ * Tasks must not block for long, or they delay all tasks queued behind
+ * them on the same worker until someone steals them.
+ */
+
+#ifndef GW_POOL_H
+#define GW_POOL_H 1
+
+#include "gwthread.h"
+
+typedef struct gw_pool gw_pool_t;
+typedef struct gw_future gw_future_t;
+
+/*
+ * Task returning a result, see gw_pool_submit().
+ */
+typedef void *gw_pool_func_t(void *arg);
+
+/**
+ * Create a pool and start its workers.
+ * @threads - number of workers, zero or less for one per online CPU
+ * @return newly created pool
+ */
+gw_pool_t *gw_pool_create(long threads);
+
+/**
+ * Run all the queued tasks, stop the workers and destroy the pool.
+ * Must not be called from one of the workers of the pool.
+ * @pool - pool to destroy
+ */
+void gw_pool_destroy(gw_pool_t *pool);
+
+/**
+ * Queue a task without result. Tasks queued by a worker of the pool
+ * go to its own queue, other ones are spread over the workers.
+ * @pool - pool to run the task in
+ * @func - task function
+ * @arg - argument passed to the task function
+ */
+void gw_pool_execute(gw_pool_t *pool, gwthread_func_t *func, void *arg);
+
+/**
+ * Queue a task whose result is needed later on.
+ * @pool - pool to run the task in
+ * @func - task function
+ * @arg - argument passed to the task function
+ * @return future to pass to gw_future_wait()
+ */
+gw_future_t *gw_pool_submit(gw_pool_t *pool, gw_pool_func_t *func, void *arg);
+
+/**
+ * Wait for the task of a future to finish and destroy the future.
+ * A worker of a pool waiting for a future runs other tasks meanwhile.
+ * @future - future returned by gw_pool_submit()
+ * @return the value returned by the task function
+ */
+void *gw_future_wait(gw_future_t *future);
+
+/**
+ * Return the number of workers of the pool.
+ */
+long gw_pool_threads(gw_pool_t *pool);
+
+/**
+ * Return the number of tasks queued but not yet started.
+ */
+long gw_pool_queued(gw_pool_t *pool);
+
+#endif
@@ -61,30 +61,48 @@
  */
 
 #include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include "gwlib/gwlib.h"
 #include "gw-timer.h"
 
 /*
- * Active timers are stored in a TimerHeap.  It is a partially ordered
- * array.  Each element i is the child of element i/2 (rounded down),
- * and a child never elapses before its parent.  The result is that
- * element 0, the top of the heap, is always the first timer to
- * elapse.  The heap is kept in this partial order by all operations on
- * it.  Maintaining a partial order is much cheaper than maintaining
- * a sorted list.
- * The array will be resized as needed.  The size field is the number
- * of elements for which space is reserved, and the len field is the
- * number of elements actually used.  The elements used will always be
- * at tab[0] through tab[len-1].
+ * Active timers are stored in a hierarchical timing wheel, ticking
+ * once per millisecond.  The root wheel has a slot for each of the
+ * next 256 ticks.  Each of the four outer wheels has 64 slots, each
+ * slot covering 64 times the span of a slot of the wheel inside it.
+ * A timer goes to the innermost wheel whose span reaches its elapse
+ * time.  Whenever the root wheel has gone round, the next slot of the
+ * first outer wheel is emptied into it (and so on outwards, if that
+ * wheel has gone round too), so that timers move inwards as their
+ * time comes near.  Timers further away than the outermost wheel
+ * reaches, about 49 days, are parked in its last slot and placed again
+ * when that slot is emptied.
+ * Each slot is a doubly linked list, which makes starting and
+ * stopping a timer O(1) no matter how many timers are active.
  */
-struct TimerHeap
+#define ROOT_BITS 8
+#define ROOT_SIZE (1 << ROOT_BITS)
+#define ROOT_MASK (ROOT_SIZE - 1)
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEELS 4
+
+/* Number of low bits of a tick below the slot index of outer wheel n. */
+#define WHEEL_SHIFT(n) (ROOT_BITS + (n) * WHEEL_BITS)
+
+/* Furthest ahead the outermost wheel reaches. */
+#define MAX_SPAN ((1LL << WHEEL_SHIFT(WHEELS)) - 1)
+
+typedef struct TimerLink TimerLink;
+struct TimerLink
 {
-    Timer **tab;
-    long len;
-    long size;
+    TimerLink *next;
+    TimerLink *prev;
 };
-typedef struct TimerHeap TimerHeap;
 
 struct Timerset
 {
@@ -100,19 +118,43 @@ struct Timerset
      */
     Mutex *mutex;
     /*
-     * Active timers are stored here in a partially ordered structure.
-     * See the definition of TimerHeap, above, for an explanation.
+     * Active timers are stored here, see the explanation of the
+     * timing wheel above.  The count fields hold the number of timers
+     * in each wheel, index 0 being the root wheel.
      */
-    TimerHeap *heap;
+    TimerLink root[ROOT_SIZE];
+    TimerLink wheels[WHEELS][WHEEL_SIZE];
+    long count[WHEELS + 1];
+    long active;
     /*
-     * The thread that watches the top of the heap, and processes
-     * timers that have elapsed.
+     * The next tick (in milliseconds of the set's clock) the timer
+     * thread will process.  Timers elapsing before it sit in the
+     * root slot of this tick.
+     */
+    long long tick;
+    /*
+     * The tick at which the timer thread will wake up next.  Starting
+     * a timer elapsing earlier wakes it up.
+     */
+    long long next_wakeup;
+    /*
+     * The thread that watches the wheels, and processes timers that
+     * have elapsed.
      */
     long thread;
 };
 
 struct Timer
 {
+    /*
+     * Links to the other timers of the same wheel slot.  Must be
+     * the first field, the wheel slots only know about links.
+     */
+    TimerLink link;
+    /*
+     * The wheel the timer is in, 0 being the root wheel.
+     */
+    int wheel;
 	/*
 	 * The timer set this timer belongs to.
 	 */
@@ -132,10 +174,10 @@ struct Timer
     void (*callback) (void* data);
     /*
      * The timer is set to elapse at this time, expressed in
-     * Unix time format.  This field is set to -1 if the timer
-     * is not active (i.e. in the timer set's heap).
+     * milliseconds of the set's clock.  This field is set to -1
+     * if the timer is not active (i.e. in the timer set's wheels).
      */
-    long elapses;
+    long long elapses;
     /*
      * A duplicate of this event will be put on the output list
      * when the timer elapses.  It can be NULL if the timer has
@@ -149,12 +191,6 @@ struct Timer
      * the list, or if it's confirmed that the event was consumed.
      */
     void *elapsed_data;
-    /*
-     * The index in the timer set's heap.  This field is managed by
-     * the heap operations, and is used to make them faster.
-     * If this timer is not in the heap, this field is -1.
-     */
-    long index;
 };
 
 
@@ -162,12 +198,14 @@ struct Timer
  * Internal functions
  */
 static void abort_elapsed(Timer *timer);
-static TimerHeap *heap_create(void);
-static void heap_destroy(TimerHeap *heap);
-static void heap_delete(TimerHeap *heap, long index);
-static int heap_adjust(TimerHeap *heap, long index);
-static void heap_insert(TimerHeap *heap, Timer *timer);
-static void heap_swap(TimerHeap *heap, long index1, long index2);
+static long long clock_now(void);
+static void wheel_insert(Timerset *set, Timer *timer);
+static void wheel_delete(Timerset *set, Timer *timer);
+static void wheel_cascade(Timerset *set, int wheel, long index);
+static void wheel_run(Timerset *set, long long now);
+static long long wheel_next(Timerset *set);
+static void start_timer(Timer *timer, long msec, void *data, int elapsed);
+static void stop_timer(Timer *timer, int elapsed);
 static void lock(Timerset *set);
 static void unlock(Timerset *set);
 static void watch_timers(void *arg);   /* The timer thread */
@@ -177,10 +215,21 @@ static void elapse_timer(Timer *timer);
 Timerset *gw_timerset_create(void)
 {
 	Timerset *set;
+	long i, j;
 
 	set = gw_malloc(sizeof(Timerset));
     set->mutex = mutex_create();
-    set->heap = heap_create();
+    for (i = 0; i < ROOT_SIZE; i++)
+        set->root[i].next = set->root[i].prev = &set->root[i];
+    for (i = 0; i < WHEELS; i++) {
+        for (j = 0; j < WHEEL_SIZE; j++)
+            set->wheels[i][j].next = set->wheels[i][j].prev = &set->wheels[i][j];
+    }
+    for (i = 0; i <= WHEELS; i++)
+        set->count[i] = 0;
+    set->active = 0;
+    set->tick = clock_now();
+    set->next_wakeup = LLONG_MAX;
     set->stopping = 0;
     set->thread = gwthread_create(watch_timers, set);
 
@@ -189,12 +238,14 @@ Timerset *gw_timerset_create(void)
 
 void gw_timerset_destroy(Timerset *set)
 {
+    List *timers;
+
 	if (set == NULL)
 		return;
        
     /* Stop all timers. */
-    while (set->heap->len > 0)
-        gw_timer_stop(set->heap->tab[0]);
+    if ((timers = gw_timer_break(set)) != NULL)
+        gwlist_destroy(timers, NULL);
 
     /* Kill timer thread */
     set->stopping = 1;
@@ -202,22 +253,33 @@ void gw_timerset_destroy(Timerset *set)
     gwthread_join(set->thread);
 
     /* Free resources */
-    heap_destroy(set->heap);
     mutex_destroy(set->mutex);
     gw_free(set);
 }
 
+long gw_timerset_count(Timerset *set)
+{
+    long count;
+
+    lock(set);
+    count = set->active;
+    unlock(set);
+
+    return count;
+}
+
 
 Timer *gw_timer_create(Timerset *set, List *outputlist, void (*callback) (void*))
 {
     Timer *t;
 
     t = gw_malloc(sizeof(*t));
+    t->link.next = t->link.prev = NULL;
+    t->wheel = -1;
     t->timerset = set;
     t->elapses = -1;
     t->data = NULL;
     t->elapsed_data = NULL;
-    t->index = -1;
     t->output = outputlist;
     if (t->output != NULL)
         gwlist_add_producer(outputlist);
@@ -250,169 +312,65 @@ void gw_timer_elapsed_destroy(Timer *timer)
 
 void gw_timer_start(Timer *timer, int interval, void *data)
 {
-    int wakeup = 0;
-
-    gw_assert(timer != NULL);
-
-    if (timer == NULL)
-        return;
-        
-    lock(timer->timerset);
-
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
-    } else {
-        /* Setting a new timer, or resetting an elapsed one.
-         * First deal with a possible elapse event that may
-         * still be on the output list. */
-        abort_elapsed(timer);
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
-    }
-
-    if (data != NULL) {
-        timer->data = data;
-    }
-
-    unlock(timer->timerset);
+    start_timer(timer, interval * 1000L, data, 0);
+}
 
-    if (wakeup)
-        gwthread_wakeup(timer->timerset->thread);
+void gw_timer_start_ms(Timer *timer, long msec, void *data)
+{
+    start_timer(timer, msec, data, 0);
 }
 
 void gw_timer_elapsed_start(Timer *timer, int interval, void *data)
 {
-    int wakeup = 0;
-
-    gw_assert(timer != NULL);
-
-    if (timer == NULL)
-        return;
-
-    lock(timer->timerset);
-
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
-    } else {
-        /* Setting a new timer, or resetting an elapsed one.
-         * There should be no further elapse event on the
-         * output list here. */
-        /* abort_elapsed(timer); */
-    	timer->elapsed_data = NULL;
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
-    }
-
-    if (data != NULL) {
-        timer->data = data;
-    }
-
-    unlock(timer->timerset);
+    start_timer(timer, interval * 1000L, data, 1);
+}
 
-    if (wakeup)
-        gwthread_wakeup(timer->timerset->thread);
+void gw_timer_elapsed_start_ms(Timer *timer, long msec, void *data)
+{
+    start_timer(timer, msec, data, 1);
 }
 
 void gw_timer_stop(Timer *timer)
 {
-    gw_assert(timer != NULL);
-    lock(timer->timerset);
-
-    /*
-     * If the timer is active, make it inactive and remove it from
-     * the heap.
-     */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
-
-    abort_elapsed(timer);
-
-    unlock(timer->timerset);
+    stop_timer(timer, 0);
 }
 
 void gw_timer_elapsed_stop(Timer *timer)
 {
-    gw_assert(timer != NULL);
-    lock(timer->timerset);
-
-    /*
-     * If the timer is active, make it inactive and remove it from
-     * the heap.
-     */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
-
-    /* abort_elapsed(timer); */
-	timer->elapsed_data = NULL;
-
-    unlock(timer->timerset);
+    stop_timer(timer, 1);
 }
 
 List *gw_timer_break(Timerset *set)
 {
 	List *ret = NULL;
+	TimerLink *slot;
+	Timer *timer;
+	long i;
 
     lock(set);
 
-    if (set->heap->len == 0) {
+    if (set->active == 0) {
         unlock(set);
     	return NULL;
     }
 
     ret = gwlist_create();
 
-    /* Stop all timers. */
-    while (set->heap->len > 0) {
-    	Timer *timer = set->heap->tab[0];
-
-    	gwlist_append(ret, timer);
-
-        /*
-         * If the timer is active, make it inactive and remove it from
-         * the heap.
-         */
-        if (timer->elapses > 0) {
+    /* Stop all timers, slot by slot. */
+    for (i = 0; i < ROOT_SIZE + WHEELS * WHEEL_SIZE; i++) {
+        if (i < ROOT_SIZE)
+            slot = &set->root[i];
+        else
+            slot = &set->wheels[(i - ROOT_SIZE) / WHEEL_SIZE][(i - ROOT_SIZE) % WHEEL_SIZE];
+        while (slot->next != slot) {
+            timer = (Timer *) slot->next;
+            gwlist_append(ret, timer);
             timer->elapses = -1;
-            gw_assert(set->heap->tab[timer->index] == timer);
-            heap_delete(set->heap, timer->index);
+            wheel_delete(set, timer);
+            abort_elapsed(timer);
         }
-
-        abort_elapsed(timer);
     }
+    gw_assert(set->active == 0);
 
     unlock(set);
 
@@ -438,6 +396,101 @@ static void unlock(Timerset *set)
     mutex_unlock(set->mutex);
 }
 
+/*
+ * Milliseconds of a monotonic clock, so that changes of the system
+ * time do not make timers elapse early or late.
+ */
+static long long clock_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+}
+
+/*
+ * Common part of the gw_timer_start variants.  For the _elapsed_
+ * variants there is no need to look for an elapse event on the output
+ * list.
+ */
+static void start_timer(Timer *timer, long msec, void *data, int elapsed)
+{
+    Timerset *set;
+    int wakeup = 0;
+
+    gw_assert(timer != NULL);
+
+    if (timer == NULL)
+        return;
+
+    set = timer->timerset;
+    lock(set);
+
+    if (timer->elapses >= 0) {
+        /* Resetting an existing timer.  Move it to its new slot. */
+        wheel_delete(set, timer);
+    } else if (elapsed) {
+        /* Setting a new timer, or resetting an elapsed one.
+         * There should be no further elapse event on the
+         * output list here. */
+    	timer->elapsed_data = NULL;
+    } else {
+        /* Setting a new timer, or resetting an elapsed one.
+         * First deal with a possible elapse event that may
+         * still be on the output list. */
+        abort_elapsed(timer);
+    }
+
+    /* Convert to absolute time and activate the timer. */
+    timer->elapses = clock_now() + (msec > 0 ? msec : 0);
+    wheel_insert(set, timer);
+
+    /* Will the timer thread wake up in time? */
+    if (timer->elapses < set->next_wakeup) {
+        set->next_wakeup = timer->elapses;
+        wakeup = 1;
+    }
+
+    if (data != NULL) {
+        timer->data = data;
+    }
+
+    unlock(set);
+
+    if (wakeup)
+        gwthread_wakeup(set->thread);
+}
+
+static void stop_timer(Timer *timer, int elapsed)
+{
+    gw_assert(timer != NULL);
+    lock(timer->timerset);
+
+    /*
+     * If the timer is active, make it inactive and remove it from
+     * the wheels.
+     */
+    if (timer->elapses >= 0) {
+        timer->elapses = -1;
+        wheel_delete(timer->timerset, timer);
+    }
+
+    if (elapsed)
+        timer->elapsed_data = NULL;
+    else
+        abort_elapsed(timer);
+
+    unlock(timer->timerset);
+}
+
 /*
  * Go back and remove this timer's elapse event from the output list,
  * to pretend that it didn't elapse after all.  This is necessary
@@ -455,160 +508,157 @@ static void abort_elapsed(Timer *timer)
 }
 
 /*
- * Create a new timer heap.
+ * Put an active timer into the slot for its elapse time.  Timers that
+ * are already due go to the slot of the tick processed next.
  */
-static TimerHeap *heap_create(void)
+static void wheel_insert(Timerset *set, Timer *timer)
 {
-    TimerHeap *heap;
-
-    heap = gw_malloc(sizeof(*heap));
-    heap->tab = gw_malloc(sizeof(heap->tab[0]));
-    heap->size = 1;
-    heap->len = 0;
-
-    return heap;
-}
-
-static void heap_destroy(TimerHeap *heap)
-{
-    if (heap == NULL)
-        return;
+    TimerLink *slot;
+    long long elapses, ahead;
+    int n;
+
+    elapses = timer->elapses;
+    ahead = elapses - set->tick;
+
+    if (ahead < ROOT_SIZE) {
+        if (ahead < 0)
+            elapses = set->tick;
+        slot = &set->root[elapses & ROOT_MASK];
+        timer->wheel = 0;
+    } else {
+        if (ahead > MAX_SPAN)
+            elapses = set->tick + MAX_SPAN;
+        for (n = 0; n < WHEELS - 1; n++) {
+            if (ahead < (1LL << WHEEL_SHIFT(n + 1)))
+                break;
+        }
+        slot = &set->wheels[n][(elapses >> WHEEL_SHIFT(n)) & WHEEL_MASK];
+        timer->wheel = n + 1;
+    }
 
-    gw_free(heap->tab);
-    gw_free(heap);
+    timer->link.next = slot;
+    timer->link.prev = slot->prev;
+    slot->prev->next = &timer->link;
+    slot->prev = &timer->link;
+    set->count[timer->wheel]++;
+    set->active++;
 }
 
-/*
- * Remove a timer from the heap.  Do this by swapping it with the element
- * in the last position, then shortening the heap, then moving the
- * swapped element up or down to maintain the partial ordering.
- */
-static void heap_delete(TimerHeap *heap, long index)
+static void wheel_delete(Timerset *set, Timer *timer)
 {
-    long last;
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-    gw_assert(heap->tab[index]->index == index);
-
-    last = heap->len - 1;
-    heap_swap(heap, index, last);
-    heap->tab[last]->index = -1;
-    heap->len--;
-    if (index != last)
-        heap_adjust(heap, index);
+    gw_assert(timer->wheel >= 0);
+
+    timer->link.prev->next = timer->link.next;
+    timer->link.next->prev = timer->link.prev;
+    timer->link.next = timer->link.prev = NULL;
+    set->count[timer->wheel]--;
+    set->active--;
+    timer->wheel = -1;
 }
 
 /*
- * Add a timer to the heap.  Do this by adding it at the end, then
- * moving it up or down as necessary to achieve partial ordering.
+ * Empty a slot of an outer wheel, placing its timers again.  They will
+ * go to inner wheels, being closer to their elapse time by now.
  */
-static void heap_insert(TimerHeap *heap, Timer *timer)
+static void wheel_cascade(Timerset *set, int wheel, long index)
 {
-    heap->len++;
-    if (heap->len > heap->size) {
-        heap->tab = gw_realloc(heap->tab,
-                                heap->len * sizeof(heap->tab[0]));
-        heap->size = heap->len;
+    TimerLink *slot;
+    Timer *timer;
+
+    slot = &set->wheels[wheel][index];
+    while (slot->next != slot) {
+        timer = (Timer *) slot->next;
+        wheel_delete(set, timer);
+        wheel_insert(set, timer);
     }
-    heap->tab[heap->len - 1] = timer;
-    timer->index = heap->len - 1;
-    heap_adjust(heap, timer->index);
 }
 
 /*
- * Swap two elements of the heap, and update their index fields.
- * This is the basic heap operation.
+ * Process all ticks up to and including now, elapsing the timers in
+ * their root slots.  Ticks are skipped a root wheel revolution at a
+ * time while the root wheel is empty.  We have the set locked.
  */
-static void heap_swap(TimerHeap *heap, long index1, long index2)
+static void wheel_run(Timerset *set, long long now)
 {
-    Timer *t;
-
-    gw_assert(index1 >= 0);
-    gw_assert(index1 < heap->len);
-    gw_assert(index2 >= 0);
-    gw_assert(index2 < heap->len);
+    TimerLink *slot;
+    Timer *timer;
+    long index;
+    int n;
+
+    while (set->tick <= now) {
+        if (set->count[0] == 0) {
+            /* nothing to elapse before the root wheel goes round */
+            if (((set->tick + ROOT_MASK) & ~(long long) ROOT_MASK) > now) {
+                set->tick = now + 1;
+                break;
+            }
+            set->tick = (set->tick + ROOT_MASK) & ~(long long) ROOT_MASK;
+        }
 
-    if (index1 == index2)
-        return;
+        if ((set->tick & ROOT_MASK) == 0) {
+            /* the root wheel has gone round, refill it */
+            for (n = 0; n < WHEELS; n++) {
+                index = (set->tick >> WHEEL_SHIFT(n)) & WHEEL_MASK;
+                wheel_cascade(set, n, index);
+                if (index != 0)
+                    break;
+            }
+        }
 
-    t = heap->tab[index1];
-    heap->tab[index1] = heap->tab[index2];
-    heap->tab[index2] = t;
-    heap->tab[index1]->index = index1;
-    heap->tab[index2]->index = index2;
+        slot = &set->root[set->tick & ROOT_MASK];
+        while (slot->next != slot) {
+            timer = (Timer *) slot->next;
+            wheel_delete(set, timer);
+            elapse_timer(timer);
+        }
+        set->tick++;
+    }
 }
 
 /*
- * The current element has broken the partial ordering of the
- * heap (see explanation in the definition of Timerset), and
- * it has to be moved up or down until the ordering is restored.
- * Return 1 if the timer at the heap's top is now earlier than
- * before this operation, otherwise 0.
+ * Return the tick at which the timer thread has to look at the wheels
+ * again, either to elapse timers or to move them inwards, or -1 if no
+ * timers are active.  We have the set locked.
  */
-static int heap_adjust(TimerHeap *heap, long index)
+static long long wheel_next(Timerset *set)
 {
-    Timer *t;
-    Timer *parent;
-    long child_index;
-
-    /*
-     * We can assume that the heap was fine before this element's
-     * elapse time was changed.  There are three cases to deal
-     * with:
-     *  - Element's new elapse time is too small; it should be
-     *    moved toward the top.
-     *  - Element's new elapse time is too large; it should be
-     *    moved toward the bottom.
-     *  - Element's new elapse time still fits here, we don't
-     *    have to do anything.
-     */
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-
-    /* Move to top? */
-    t = heap->tab[index];
-    parent = heap->tab[index / 2];
-    if (t->elapses < parent->elapses) {
-        /* This will automatically terminate when it reaches
-         * the top, because in that t == parent. */
-        do {
-            heap_swap(heap, index, index / 2);
-            index = index / 2;
-            parent = heap->tab[index / 2];
-        } while (t->elapses < parent->elapses);
-        /* We're done.  Return 1 if we changed the top. */
-        return index == 0;
-    }
-
-    /* Move to bottom? */
-    for (; ; ) {
-        child_index = index * 2;
-        if (child_index >= heap->len)
-            return 0;   /* Already at bottom */
-        if (child_index == heap->len - 1) {
-            /* Only one child */
-            if (heap->tab[child_index]->elapses < t->elapses)
-                heap_swap(heap, index, child_index);
-            break;
-        }
-
-        /* Find out which child elapses first */
-        if (heap->tab[child_index + 1]->elapses <
-            heap->tab[child_index]->elapses) {
-            child_index++;
+    long long next, base;
+    long i, index;
+    int n;
+
+    if (set->active == 0)
+        return -1;
+
+    next = LLONG_MAX;
+
+    if (set->count[0] > 0) {
+        for (i = 0; i < ROOT_SIZE; i++) {
+            if (set->root[(set->tick + i) & ROOT_MASK].next !=
+                &set->root[(set->tick + i) & ROOT_MASK]) {
+                next = set->tick + i;
+                break;
+            }
         }
+    }
 
-        if (heap->tab[child_index]->elapses < t->elapses) {
-            heap_swap(heap, index, child_index);
-            index = child_index;
-        } else {
-            break;
+    for (n = 0; n < WHEELS; n++) {
+        if (set->count[n + 1] == 0)
+            continue;
+        /* slots of wheel n are emptied when the ticks below are zero */
+        base = (set->tick + (1LL << WHEEL_SHIFT(n)) - 1) &
+               ~((1LL << WHEEL_SHIFT(n)) - 1);
+        index = (base >> WHEEL_SHIFT(n)) & WHEEL_MASK;
+        for (i = 0; i < WHEEL_SIZE; i++) {
+            if (set->wheels[n][(index + i) & WHEEL_MASK].next !=
+                &set->wheels[n][(index + i) & WHEEL_MASK]) {
+                if (base + (i << WHEEL_SHIFT(n)) < next)
+                    next = base + (i << WHEEL_SHIFT(n));
+                break;
+            }
         }
     }
 
-    return 0;
+    return next;
 }
 
 /*
@@ -636,35 +686,29 @@ static void elapse_timer(Timer *timer)
 static void watch_timers(void *arg)
 {
     Timerset *set;
-    long top_time;
-    long now;
+    long long next;
+    long long now;
 
     set = arg;
 
     while (!set->stopping) {
         lock(set);
 
-        now = time(NULL);
-
-        while (set->heap->len > 0 && set->heap->tab[0]->elapses <= now) {
-        	Timer *timer = set->heap->tab[0];
-        	heap_delete(set->heap, 0);
-        	elapse_timer(timer);
-        }
+        now = clock_now();
+        wheel_run(set, now);
 
     	/*
-    	 * Now sleep until the next timer elapses.  If there isn't one,
-    	 * then just sleep very long.  We will get woken up if the
-    	 * top of the heap changes before we wake.
+    	 * Now sleep until the next timer elapses or has to be moved
+    	 * inwards.  If there isn't one, then just sleep very long.  We
+    	 * will get woken up if a timer elapsing earlier is started.
     	 */
+        next = wheel_next(set);
+        set->next_wakeup = (next < 0 ? LLONG_MAX : next);
+        unlock(set);
 
-    	if (set->heap->len == 0) {
-    		unlock(set);
+    	if (next < 0)
     		gwthread_sleep(1000000.0);
-    	} else {
-    		top_time = set->heap->tab[0]->elapses;
-    		unlock(set);
-    		gwthread_sleep(top_time - now);
-    	}
+    	else
+    		gwthread_sleep((next - now) / 1000.0);
     }
 }
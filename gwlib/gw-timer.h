@@ -58,8 +58,9 @@
  * gw-timer.h - interface to timers and timer sets.
  *
  * Timers can be set to elapse after a specified number of seconds
- * (the "interval").  They can be stopped before elapsing, and the
- * interval can be changed.
+ * or milliseconds (the "interval").  They can be stopped before
+ * elapsing, and the interval can be changed.  Starting and stopping
+ * a timer takes constant time, however many timers are active.
  *
  * An "output list" is defined for each timer.  When it elapses, an
  * event is generated on this list.  The event may be removed from
@@ -93,9 +94,19 @@ typedef struct Timer Timer;
 typedef struct Timerset Timerset;
 
 
+/*
+ * Create a timer set, with its own thread elapsing its timers.  Code
+ * using lots of timers from several threads may use a set per thread
+ * to keep them from contending for the set's lock.
+ */
 Timerset *gw_timerset_create(void);
 void gw_timerset_destroy(Timerset *set);
 
+/*
+ * Return the number of active timers of the set.
+ */
+long gw_timerset_count(Timerset *set);
+
 
 /*
  * Create a timer and tell it to use the specified output list or
@@ -135,6 +146,12 @@ void gw_timer_elapsed_destroy(Timer *timer);
 void gw_timer_start(Timer *timer, int interval, void *data);
 void gw_timer_elapsed_start(Timer *timer, int interval, void *data);
 
+/*
+ * Same as above, with the interval given in milliseconds.
+ */
+void gw_timer_start_ms(Timer *timer, long msec, void *data);
+void gw_timer_elapsed_start_ms(Timer *timer, long msec, void *data);
+
 /*
  * Stop this timer.  If it has already elapsed, try to remove its
  * event from the output list.
@@ -90,6 +90,7 @@
 #include "fdset.h"
 #include "gwassert.h"
 #include "counter.h"
+#include "histogram.h"
 #include "charset.h"
 #include "conn.h"
 #include "ssl.h"
@@ -103,6 +104,7 @@
 #include "gw_uuid.h"
 #include "gw-rwlock.h"
 #include "gw-prioqueue.h"
+#include "gw-pool.h"
 
 void gwlib_assert_init(void);
 void gwlib_init(void);
@@ -676,6 +676,17 @@ void *gw_check_claim_area(void *p, const char *filename, long lineno,
     return p;
 }
 
+void gw_check_stats(long *areas, long *bytes, long *highest_bytes)
+{
+    gw_assert(initialized);
+
+    lock();
+    *areas = num_allocations;
+    *bytes = total_size;
+    *highest_bytes = highest_total_size;
+    unlock();
+}
+
 void gw_check_check_leaks(void)
 {
     long calculated_size;
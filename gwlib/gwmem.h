@@ -100,6 +100,7 @@ long gw_check_area_size(void *p);
 void *gw_check_claim_area(void *p,
 	const char *filename, long line, const char *function);
 void gw_check_shutdown(void);
+void gw_check_stats(long *areas, long *bytes, long *highest_bytes);
 
 
 
@@ -130,6 +131,8 @@ void gw_check_shutdown(void);
 #define gw_claim_area_for(ptr, file, line, func) (gw_native_noop(ptr))
 #define gwmem_shutdown()
 #define gwmem_type() (octstr_imm("native"))
+/* allocations are only counted by the checking wrapper */
+#define gwmem_stats(areas, bytes, highest_bytes) (-1)
 
 #elif USE_GWMEM_CHECK
 
@@ -165,6 +168,8 @@ void gw_check_shutdown(void);
 #define gw_claim_area_for(ptr, file, line, func) \
 	(gw_check_claim_area(ptr, file, line, func))
 #define gwmem_shutdown() (gw_check_shutdown())
+#define gwmem_stats(areas, bytes, highest_bytes) \
+	(gw_check_stats(areas, bytes, highest_bytes), 0)
 
 #else
 
@@ -72,10 +72,10 @@
 #include <openssl/err.h>
 #endif /* HAVE_LIBSSL */
 
-/* Maximum number of live threads we can support at once.  Increasing
- * this will increase the size of the threadtable.  Use powers of two
- * for efficiency. */
-#define THREADTABLE_SIZE 1024
+/* Size of the threadtable at start-up.  The table doubles whenever it
+ * fills up, so the number of live threads is only limited by memory and
+ * the operating system.  Must be a power of two. */
+#define THREADTABLE_INITIAL_SIZE 1024
 
 struct threadinfo
 {
@@ -102,16 +102,19 @@ struct new_thread_args
 };
 
 /* The index is the external thread number modulo the table size; the
- * thread number allocation code makes sure that there are no collisions. */
-static struct threadinfo *threadtable[THREADTABLE_SIZE];
-#define THREAD(t) (threadtable[(t) % THREADTABLE_SIZE])
+ * thread number allocation code makes sure that there are no collisions.
+ * Numbers unique modulo the size are unique modulo twice the size as
+ * well, so growing the table keeps them apart. */
+static struct threadinfo **threadtable = NULL;
+static long threadtable_size = 0;
+#define THREAD(t) (threadtable[(t) & (threadtable_size - 1)])
 
 /* Number of threads currently in the thread table. */
 static long active_threads = 0;
 
 /* Number to use for the next thread created.  The actual number used
  * may be higher than this, in order to avoid collisions in the threadtable.
- * Specifically, (threadnumber % THREADTABLE_SIZE) must be unique for all
+ * Specifically, (threadnumber % threadtable_size) must be unique for all
  * live threads. */
 static long next_threadnumber;
 
@@ -160,18 +163,40 @@ static void flushpipe(int fd)
     } while (bytes > 0);
 }
 
+/* Double the size of the thread table.  The thread table must already
+ * be locked by the caller. */
+static void grow_threadtable(void)
+{
+    struct threadinfo **old;
+    long old_size, i;
+
+    old = threadtable;
+    old_size = threadtable_size;
+
+    threadtable_size = (old_size > 0 ? old_size * 2 : THREADTABLE_INITIAL_SIZE);
+    threadtable = gw_malloc(threadtable_size * sizeof(*threadtable));
+    for (i = 0; i < threadtable_size; i++)
+        threadtable[i] = NULL;
+    for (i = 0; i < old_size; i++) {
+        if (old[i] != NULL)
+            THREAD(old[i]->number) = old[i];
+    }
+    gw_free(old);
+
+    if (old_size > 0)
+        debug("gwlib.gwthread", 0, "Thread table grown to %ld entries for "
+              "%ld active threads.", threadtable_size, active_threads);
+}
+
 /* Allocate and fill a threadinfo structure for a new thread, and store
  * it in a free slot in the thread table.  The thread table must already
  * be locked by the caller.  Return the thread number chosen for this
- * thread.  The caller must make sure that there is room in the table. */
+ * thread.  The table is grown if there is no room left. */
 static long fill_threadinfo(pthread_t id, const char *name,
                             gwthread_func_t *func,
                             struct threadinfo *ti)
 {
     int pipefds[2];
-    long first_try;
-
-    gw_assert(active_threads < THREADTABLE_SIZE);
 
     /* initialize to default values */
     ti->self = id;
@@ -192,16 +217,12 @@ static long fill_threadinfo(pthread_t id, const char *name,
     socket_set_blocking(ti->wakefd_recv, 0);
     socket_set_blocking(ti->wakefd_send, 0);
 
-    /* Find a free table entry and claim it. */
-    first_try = next_threadnumber;
+    /* Find a free table entry and claim it.  With at least one entry
+     * free, this takes less than one round over the table. */
+    if (active_threads >= threadtable_size)
+        grow_threadtable();
     do {
         ti->number = next_threadnumber++;
-        /* Check if we looped all the way around the thread table. */
-        if (ti->number == first_try + THREADTABLE_SIZE) {
-            error(0, "Cannot have more than %d active threads", THREADTABLE_SIZE);
-            ti->number = -1;
-            return -1;
-        }
     } while (THREAD(ti->number) != NULL);
     THREAD(ti->number) = ti;
 
@@ -263,7 +284,6 @@ static void delete_threadinfo(void)
 void gwthread_init(void)
 {
     int ret;
-    int i;
 
     pthread_mutex_init(&threadtable_lock, NULL);
 
@@ -272,10 +292,10 @@ void gwthread_init(void)
         panic(ret, "gwthread-pthread: pthread_key_create failed");
     }
 
-    for (i = 0; i < THREADTABLE_SIZE; i++) {
-        threadtable[i] = NULL;
-    }
+    threadtable = NULL;
+    threadtable_size = 0;
     active_threads = 0;
+    grow_threadtable();
 
     /* create main thread info */
     if (fill_threadinfo(pthread_self(), "main", NULL, &mainthread) == -1)
@@ -293,16 +313,16 @@ void gwthread_shutdown(void)
 {
     int ret;
     int running;
-    int i;
+    long i;
 
     /* Main thread must not have disappeared */
-    gw_assert(threadtable[0] != NULL);
+    gw_assert(THREAD(MAIN_THREAD_ID) != NULL);
     lock();
 
     running = 0;
     /* Start i at 1 to skip the main thread, which is supposed to be
      * still running. */
-    for (i = 1; i < THREADTABLE_SIZE; i++) {
+    for (i = 1; i < threadtable_size; i++) {
         if (threadtable[i] != NULL) {
             debug("gwlib", 0, "Thread %ld (%s) still running",
                   threadtable[i]->number,
@@ -321,6 +341,11 @@ void gwthread_shutdown(void)
         warning(ret, "cannot destroy threadtable lock");
     }
 
+    /* Only the main thread is left, and its info is kept statically. */
+    gw_free(threadtable);
+    threadtable = NULL;
+    threadtable_size = 0;
+
     /* We can't delete the tsd_key here, because gwthread_self()
      * still needs it to access the main thread's info. */
 }
@@ -465,13 +490,6 @@ static long spawn_thread(gwthread_func_t *func, const char *name, void *arg)
      * we have entered it in the thread table. */
     lock();
 
-    if (active_threads >= THREADTABLE_SIZE) {
-        unlock();
-        warning(0, "Too many threads, could not create new thread.");
-        gw_free(p);
-        return -1;
-    }
-
     ret = pthread_create(&id, NULL, &new_thread, p);
     if (ret != 0) {
         unlock();
@@ -574,26 +592,50 @@ void gwthread_join(long thread)
     pthread_cond_destroy(&exit_cond);
 }
 
-void gwthread_join_all(void)
+/*
+ * Return the numbers of all live threads but the calling one, and their
+ * count in *count. The caller must free the array. Thread 0 is a valid
+ * number, so the numbers are not kept in a List.
+ */
+static long *other_threads(long *count)
 {
-    long i;
-    long our_thread = gwthread_self();
+    long *numbers;
+    long i, our_thread;
+
+    our_thread = gwthread_self();
 
-    for (i = 0; i < THREADTABLE_SIZE; ++i) {
-        if (THREAD(our_thread) != THREAD(i))
-            gwthread_join(i);
+    lock();
+    numbers = gw_malloc((threadtable_size + 1) * sizeof(*numbers));
+    *count = 0;
+    for (i = 0; i < threadtable_size; ++i) {
+        if (threadtable[i] != NULL && threadtable[i]->number != our_thread)
+            numbers[(*count)++] = threadtable[i]->number;
     }
+    unlock();
+
+    return numbers;
+}
+
+void gwthread_join_all(void)
+{
+    long *numbers;
+    long i, count;
+
+    numbers = other_threads(&count);
+    for (i = 0; i < count; ++i)
+        gwthread_join(numbers[i]);
+    gw_free(numbers);
 }
 
 void gwthread_wakeup_all(void)
 {
-    long i;
-    long our_thread = gwthread_self();
+    long *numbers;
+    long i, count;
 
-    for (i = 0; i < THREADTABLE_SIZE; ++i) {
-        if (THREAD(our_thread) != THREAD(i))
-            gwthread_wakeup(i);
-    }
+    numbers = other_threads(&count);
+    for (i = 0; i < count; ++i)
+        gwthread_wakeup(numbers[i]);
+    gw_free(numbers);
 }
 
 void gwthread_join_every(gwthread_func_t *func)
@@ -617,8 +659,8 @@ void gwthread_join_every(gwthread_func_t *func)
      * start while we wait, and we'll miss them.
      */
     lock();
-    for (i = 0; i < THREADTABLE_SIZE; ++i) {
-        ti = THREAD(i);
+    for (i = 0; i < threadtable_size; ++i) {
+        ti = threadtable[i];
         if (ti == NULL || ti->func != func)
             continue;
         debug("gwlib.gwthread", 0,
@@ -0,0 +1,293 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gwlib/histogram.c - latency histograms
+ *
+ * This file implements the Histogram objects declared in histogram.h.
+ *
+ * Bucket layout: values 0..63 have a bucket each. Above that, a value
+ * with its highest bit at position m (m >= 6) is shifted right by
+ * m - 5, which leaves 32..63, and the 32 possible results are the
+ * buckets of that power of two. 30 powers of two follow the exact
+ * range, for 1024 buckets in all.
+ */
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "gwlib.h"
+
+#define SUB_BITS        5
+#define SUB_COUNT       (1 << SUB_BITS)
+#define EXACT_COUNT     (2 * SUB_COUNT)
+#define MAX_SHIFT       30
+#define BUCKETS         (EXACT_COUNT + MAX_SHIFT * SUB_COUNT)
+#define MAX_VALUE       ((1LL << (MAX_SHIFT + SUB_BITS + 1)) - 1)
+
+struct Histogram
+{
+#ifndef __GNUC__
+    Mutex *lock;
+#endif
+    unsigned long count;
+    long long sum;
+    long long max;
+    unsigned long buckets[BUCKETS];
+};
+
+
+/*
+ * GCC (and clang) give us atomic builtins, everybody else pays for a
+ * mutex on each record.
+ */
+#ifdef __GNUC__
+#define lock(h)
+#define unlock(h)
+#define atomic_add(p, v) __sync_fetch_and_add((p), (v))
+#else
+#define lock(h) mutex_lock(h->lock)
+#define unlock(h) mutex_unlock(h->lock)
+#define atomic_add(p, v) (*(p) += (v))
+#endif
+
+
+static int highest_bit(unsigned long long value)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+
+    while (value >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+
+static long bucket_index(long long value)
+{
+    int shift;
+
+    if (value < EXACT_COUNT)
+        return value;
+    shift = highest_bit(value) - SUB_BITS;
+    return EXACT_COUNT + (shift - 1) * SUB_COUNT +
+           ((value >> shift) - SUB_COUNT);
+}
+
+
+/* the middle of the range of values counted in a bucket */
+static long long bucket_value(long index)
+{
+    int shift;
+
+    if (index < EXACT_COUNT)
+        return index;
+    index -= EXACT_COUNT;
+    shift = index / SUB_COUNT + 1;
+    return ((long long) (index % SUB_COUNT + SUB_COUNT) << shift) +
+           (1LL << (shift - 1));
+}
+
+
+Histogram *histogram_create(void)
+{
+    Histogram *hist;
+
+    hist = gw_malloc(sizeof(Histogram));
+    memset(hist, 0, sizeof(Histogram));
+#ifndef __GNUC__
+    hist->lock = mutex_create();
+#endif
+    return hist;
+}
+
+
+void histogram_destroy(Histogram *hist)
+{
+    if (hist == NULL)
+        return;
+
+#ifndef __GNUC__
+    mutex_destroy(hist->lock);
+#endif
+    gw_free(hist);
+}
+
+
+void histogram_record(Histogram *hist, long long usec)
+{
+    long long max;
+
+    if (usec < 0)
+        usec = 0;
+    else if (usec > MAX_VALUE)
+        usec = MAX_VALUE;
+
+    lock(hist);
+    atomic_add(&hist->buckets[bucket_index(usec)], 1);
+    atomic_add(&hist->sum, usec);
+    atomic_add(&hist->count, 1);
+#ifdef __GNUC__
+    while ((max = hist->max) < usec &&
+           !__sync_bool_compare_and_swap(&hist->max, max, usec))
+        ;
+#else
+    if (hist->max < usec)
+        hist->max = usec;
+#endif
+    unlock(hist);
+}
+
+
+unsigned long histogram_count(Histogram *hist)
+{
+    return hist->count;
+}
+
+
+long long histogram_sum(Histogram *hist)
+{
+    return hist->sum;
+}
+
+
+long long histogram_max(Histogram *hist)
+{
+    return hist->max;
+}
+
+
+long long histogram_percentile(Histogram *hist, double percentile)
+{
+    unsigned long snapshot[BUCKETS];
+    unsigned long total, wanted, seen;
+    long long value;
+    long i;
+
+    total = 0;
+    for (i = 0; i < BUCKETS; i++)
+        total += (snapshot[i] = hist->buckets[i]);
+    if (total == 0)
+        return 0;
+
+    if (percentile >= 100)
+        return hist->max;
+    if (percentile < 0)
+        percentile = 0;
+    wanted = (unsigned long) (percentile / 100 * total + 0.5);
+    if (wanted == 0)
+        wanted = 1;
+
+    seen = 0;
+    for (i = 0; i < BUCKETS - 1; i++) {
+        seen += snapshot[i];
+        if (seen >= wanted)
+            break;
+    }
+
+    value = bucket_value(i);
+    return (value > hist->max ? hist->max : value);
+}
+
+
+void histogram_append_summary(Octstr *os, const char *name,
+                              Octstr *labels, Histogram *hist)
+{
+    static const char *quantiles[] = { "0.5", "0.9", "0.99", "0.999" };
+    static const double percentiles[] = { 50, 90, 99, 99.9 };
+    const char *sep;
+    int i;
+
+    if (labels == NULL)
+        labels = octstr_imm("");
+    sep = (octstr_len(labels) > 0 ? "," : "");
+    for (i = 0; i < 4; i++)
+        octstr_format_append(os, "%s{%S%squantile=\"%s\"} %.6f\n",
+                             name, labels, sep, quantiles[i],
+                             histogram_percentile(hist, percentiles[i]) / 1e6);
+
+    if (octstr_len(labels) > 0) {
+        octstr_format_append(os, "%s_sum{%S} %.6f\n", name, labels,
+                             histogram_sum(hist) / 1e6);
+        octstr_format_append(os, "%s_count{%S} %lu\n", name, labels,
+                             histogram_count(hist));
+    } else {
+        octstr_format_append(os, "%s_sum %.6f\n", name,
+                             histogram_sum(hist) / 1e6);
+        octstr_format_append(os, "%s_count %lu\n", name,
+                             histogram_count(hist));
+    }
+}
+
+
+long long histogram_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+}
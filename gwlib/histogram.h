@@ -0,0 +1,117 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * gwlib/histogram.h - latency histograms
+ *
+ * A Histogram counts microsecond values into log-linear buckets, in the
+ * way HdrHistogram does: values below 64 are counted exactly, larger
+ * ones land in one of 32 buckets per power of two, which keeps the
+ * error of any reported percentile below 3%. Recording a value is a
+ * couple of atomic additions and takes no lock, so it may be called on
+ * the message path from any number of threads. Readers walk the buckets
+ * without stopping the writers, they may see a value counted in the
+ * bucket but not yet in the total, which is fine for monitoring.
+ *
+ * Values above about 19 hours are counted in the last bucket.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+typedef struct Histogram Histogram;
+
+/* create a new, empty histogram. PANIC if fails */
+Histogram *histogram_create(void);
+
+/* destroy it */
+void histogram_destroy(Histogram *hist);
+
+/* count one value, in microseconds. Negative values are counted as 0 */
+void histogram_record(Histogram *hist, long long usec);
+
+/* return the number of values counted so far */
+unsigned long histogram_count(Histogram *hist);
+
+/* return the sum of the values counted so far, in microseconds */
+long long histogram_sum(Histogram *hist);
+
+/* return the largest value counted so far */
+long long histogram_max(Histogram *hist);
+
+/*
+ * Return the value below which the given percentage (0..100) of the
+ * counted values fall, or 0 if nothing was counted yet.
+ */
+long long histogram_percentile(Histogram *hist, double percentile);
+
+/*
+ * Append the histogram as Prometheus summary `name' to `os': the 50th,
+ * 90th, 99th and 99.9th percentile, the sum and the count, in seconds.
+ * `labels' is added to every line, it is either NULL or of the form
+ * `smsc="foo"'. The caller prints the HELP and TYPE lines.
+ */
+void histogram_append_summary(Octstr *os, const char *name,
+                              Octstr *labels, Histogram *hist);
+
+/*
+ * Return the current time of a monotonic clock in microseconds, for
+ * taking the values recorded. Only differences between two calls are
+ * meaningful.
+ */
+long long histogram_now(void);
+
+#endif
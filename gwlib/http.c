@@ -95,6 +95,9 @@ static int http_client_timeout = 240;
 /* max accepted clients */
 #define HTTP_SERVER_MAX_ACTIVE_CONNECTIONS 500
 
+/* accept loops for each server port opened, see http_set_server_loops() */
+static long http_server_loops = 1;
+
 /***********************************************************************
  * Stuff used in several sub-modules.
  */
@@ -123,12 +126,49 @@ static enum {
 static Octstr *http_interface = NULL;
 
 
+/*
+ * Headers we look up ourselves while reading an entity. Their position
+ * in the header list is noted while the headers are read, so they need
+ * no search afterwards.
+ */
+enum known_header {
+    known_transfer_encoding,
+    known_content_length,
+    known_connection,
+    known_headers_count
+};
+
+static const char *known_header_names[known_headers_count] = {
+    "Transfer-Encoding",
+    "Content-Length",
+    "Connection"
+};
+
+
+static void known_header_note(long *known, List *headers, Octstr *line)
+{
+    long colon, i;
+
+    colon = octstr_search_char(line, ':', 0);
+    if (colon <= 0)
+        return;
+    for (i = 0; i < known_headers_count; i++) {
+        if (known[i] == -1 && (long) strlen(known_header_names[i]) == colon &&
+            strncasecmp(octstr_get_cstr(line), known_header_names[i], colon) == 0) {
+            known[i] = gwlist_len(headers) - 1;
+            return;
+        }
+    }
+}
+
+
 /*
  * Read some headers, i.e., until the first empty line (read and discard
  * the empty line as well). Return -1 for error, 0 for all headers read,
- * 1 for more headers to follow.
+ * 1 for more headers to follow. If known is not NULL, note the position
+ * of the first header of each known_header name in it.
  */
-static int read_some_headers(Connection *conn, List *headers)
+static int read_some_headers(Connection *conn, List *headers, long *known)
 {
     Octstr *line, *prev;
 
@@ -154,6 +194,8 @@ static int read_some_headers(Connection *conn, List *headers)
         } else {
             gwlist_append(headers, line);
             prev = line;
+            if (known != NULL)
+                known_header_note(known, headers, line);
         }
     }
 
@@ -165,20 +207,15 @@ static int read_some_headers(Connection *conn, List *headers)
  * Check that the HTTP version string is valid. Return -1 for invalid,
  * 0 for version 1.0, 1 for 1.x.
  */
-static int parse_http_version(Octstr *version)
+static int parse_http_version_data(const char *version, long len)
 {
-    Octstr *prefix;
-    long prefix_len;
+    static const char prefix[] = "HTTP/1.";
+    long prefix_len = sizeof(prefix) - 1;
     int digit;
-    
-    prefix = octstr_imm("HTTP/1.");
-    prefix_len = octstr_len(prefix);
 
-    if (octstr_ncompare(version, prefix, prefix_len) != 0)
+    if (len != prefix_len + 1 || memcmp(version, prefix, prefix_len) != 0)
     	return -1;
-    if (octstr_len(version) != prefix_len + 1)
-    	return -1;
-    digit = octstr_get_char(version, prefix_len);
+    digit = (unsigned char) version[prefix_len];
     if (!isdigit(digit))
     	return -1;
     if (digit == '0')
@@ -187,6 +224,12 @@ static int parse_http_version(Octstr *version)
 }
 
 
+static int parse_http_version(Octstr *version)
+{
+    return parse_http_version_data(octstr_get_cstr(version), octstr_len(version));
+}
+
+
 /***********************************************************************
  * Proxy support.
  */
@@ -365,9 +408,35 @@ typedef struct {
     enum entity_state state;
     long chunked_body_chunk_len;
     long expected_body_len;
+    long known[known_headers_count];   /* see read_some_headers() */
 } HTTPEntity;
 
 
+/*
+ * Return the value of a known header of the entity, or NULL if there is
+ * none. As http_header_find_first(), but without searching the headers.
+ */
+static Octstr *entity_header(HTTPEntity *ent, enum known_header which)
+{
+    Octstr *h, *value;
+    long start, len;
+
+    if (ent->known[which] == -1 || ent->known[which] >= gwlist_len(ent->headers))
+        return NULL;
+
+    h = gwlist_get(ent->headers, ent->known[which]);
+    start = strlen(known_header_names[which]) + 1;
+    len = octstr_len(h);
+    while (start < len && isspace(octstr_get_char(h, start)))
+        start++;
+    while (len > start && isspace(octstr_get_char(h, len - 1)))
+        len--;
+    value = octstr_copy(h, start, len - start);
+
+    return value;
+}
+
+
 /*
  * The rules for message bodies (length and presence) are defined
  * in RFC2616 paragraph 4.3 and 4.4.
@@ -383,9 +452,8 @@ static void deduce_body_state(HTTPEntity *ent)
 
     ent->state = body_error;  /* safety net */
 
-    h = http_header_find_first(ent->headers, "Transfer-Encoding");
+    h = entity_header(ent, known_transfer_encoding);
     if (h != NULL) {
-        octstr_strip_blanks(h);
         if (octstr_str_compare(h, "chunked") != 0) {
             error(0, "HTTP: Unknown Transfer-Encoding <%s>",
                   octstr_get_cstr(h));
@@ -397,7 +465,7 @@ static void deduce_body_state(HTTPEntity *ent)
         return;
     }
 
-    h = http_header_find_first(ent->headers, "Content-Length");
+    h = entity_header(ent, known_content_length);
     if (h != NULL) {
         if (octstr_parse_long(&ent->expected_body_len, h, 0, 10) == -1 ||
             ent->expected_body_len < 0) {
@@ -429,6 +497,7 @@ static void deduce_body_state(HTTPEntity *ent)
 static HTTPEntity *entity_create(enum body_expectation exp)
 {
     HTTPEntity *ent;
+    long i;
 
     ent = gw_malloc(sizeof(*ent));
     ent->headers = http_create_empty_headers();
@@ -437,6 +506,8 @@ static HTTPEntity *entity_create(enum body_expectation exp)
     ent->expected_body_len = -1;
     ent->state = reading_headers;
     ent->expect_state = exp;
+    for (i = 0; i < known_headers_count; i++)
+        ent->known[i] = -1;
 
     return ent;
 }
@@ -514,7 +585,7 @@ static void read_chunked_body_trailer(HTTPEntity *ent, Connection *conn)
 {
     int ret;
 
-    ret = read_some_headers(conn, ent->headers);
+    ret = read_some_headers(conn, ent->headers, ent->known);
     if (ret == -1)
 	ent->state = body_error;
     if (ret == 0)
@@ -572,7 +643,7 @@ static int entity_read(HTTPEntity *ent, Connection *conn)
         old_state = ent->state;
         switch (ent->state) {
         case reading_headers:
-            ret = read_some_headers(conn, ent->headers);
+            ret = read_some_headers(conn, ent->headers, ent->known);
                 if (ret == 0)
                 deduce_body_state(ent);
             if (ret < 0)
@@ -1854,6 +1925,7 @@ static void client_shutdown(void)
  */
 struct HTTPClient {
     int port;
+    int loop;   /* accept loop of the port that accepted the client */
     Connection *conn;
     Octstr *ip;
     enum {
@@ -1884,7 +1956,7 @@ static int keep_servers_open = 0;
 static List *active_connections;
 
 
-static HTTPClient *client_create(int port, Connection *conn, Octstr *ip)
+static HTTPClient *client_create(int port, int loop, Connection *conn, Octstr *ip)
 {
     HTTPClient *p;
     
@@ -1897,6 +1969,7 @@ static HTTPClient *client_create(int port, Connection *conn, Octstr *ip)
         debug("gwlib.http", 0, "HTTP: Creating HTTPClient for `%s'.", octstr_get_cstr(ip));
     p = gw_malloc(sizeof(*p));
     p->port = port;
+    p->loop = loop;
     p->conn = conn;
     p->ip = ip;
     p->state = reading_request_line;
@@ -1964,9 +2037,9 @@ static void client_reset(HTTPClient *p)
  * Returns 1 for true, 0 for false.
  */
 
-static int client_is_persistent(List *headers, int use_version_1_0)
+static int client_is_persistent(HTTPEntity *request, int use_version_1_0)
 {
-    Octstr *h = http_header_find_first(headers, "Connection");
+    Octstr *h = entity_header(request, known_connection);
 
     if (h == NULL) {
         return !use_version_1_0;
@@ -1994,7 +2067,24 @@ static int client_is_persistent(List *headers, int use_version_1_0)
 
 /*
  * Port specific lists of clients with requests.
+ *
+ * A port opened with more than one accept loop has a SO_REUSEPORT socket,
+ * an FDSet and a request queue for each loop. The first loop uses fd and
+ * server_fdset and is served by server_thread, the others have their own
+ * server_loop_thread. Consumers take requests from the queue of their
+ * own loop first and from the others if it is empty; the semaphore
+ * counts the requests queued over all loops.
  */
+struct port_loop {
+    struct port *port;
+    int index;
+    int fd;
+    FDSet *server_fdset;
+    List *clients_with_requests;
+    long thread;
+    volatile sig_atomic_t running;
+};
+
 struct port {
     int fd;
     int port;
@@ -2002,6 +2092,9 @@ struct port {
     List *clients_with_requests;
     Counter *active_consumers;
     FDSet *server_fdset;
+    int loops;
+    struct port_loop *loop;     /* NULL for a single accept loop */
+    Semaphore *queued_requests;
 };
 
 
@@ -2042,15 +2135,34 @@ static struct port *port_add(int port)
 {
     Octstr *key;
     struct port *p;
+    long i;
 
     key = port_key(port);
     mutex_lock(port_mutex);
     if ((p = dict_get(port_collection, key)) == NULL) {
         p = gw_malloc(sizeof(*p));
+        p->fd = -1;
         p->clients_with_requests = gwlist_create();
         gwlist_add_producer(p->clients_with_requests);
         p->active_consumers = counter_create();
         p->server_fdset = fdset_create_real(HTTP_SERVER_TIMEOUT);
+        p->loops = http_server_loops;
+        p->loop = NULL;
+        p->queued_requests = NULL;
+        if (p->loops > 1) {
+            p->loop = gw_malloc(p->loops * sizeof(*p->loop));
+            for (i = 0; i < p->loops; i++) {
+                p->loop[i].port = p;
+                p->loop[i].index = i;
+                p->loop[i].fd = -1;
+                p->loop[i].server_fdset = (i == 0 ? p->server_fdset :
+                                           fdset_create_real(HTTP_SERVER_TIMEOUT));
+                p->loop[i].clients_with_requests = gwlist_create();
+                p->loop[i].thread = -1;
+                p->loop[i].running = 0;
+            }
+            p->queued_requests = semaphore_create(0);
+        }
         dict_put(port_collection, key, p);
     } else {
         warning(0, "HTTP: port_add called for existing port (%d)", port);
@@ -2068,6 +2180,7 @@ static void port_remove(int port)
     struct port *p;
     List *l;
     HTTPClient *client;
+    long i;
 
     key = port_key(port);
     mutex_lock(port_mutex);
@@ -2080,11 +2193,27 @@ static void port_remove(int port)
         return;
     }
 
+    /* stop the additional accept loops */
+    for (i = 1; p->loop != NULL && i < p->loops; i++) {
+        if (p->loop[i].thread != -1) {
+            p->loop[i].running = 0;
+            gwthread_wakeup(p->loop[i].thread);
+            gwthread_join(p->loop[i].thread);
+        }
+        if (p->loop[i].fd != -1)
+            (void) close(p->loop[i].fd);
+    }
+
     gwlist_remove_producer(p->clients_with_requests);
-    while (counter_value(p->active_consumers) > 0)
+    while (counter_value(p->active_consumers) > 0) {
+       if (p->queued_requests != NULL)
+           semaphore_up(p->queued_requests);
        gwthread_sleep(0.1);    /* Reasonable use of busy waiting. */
+    }
 
     gwlist_destroy(p->clients_with_requests, client_destroy);
+    for (i = 0; p->loop != NULL && i < p->loops; i++)
+        gwlist_destroy(p->loop[i].clients_with_requests, client_destroy);
     counter_destroy(p->active_consumers);
 
     /*
@@ -2106,6 +2235,12 @@ static void port_remove(int port)
 
     /* now destroy fdset */
     fdset_destroy(p->server_fdset);
+    if (p->loop != NULL) {
+        for (i = 1; i < p->loops; i++)
+            fdset_destroy(p->loop[i].server_fdset);
+        gw_free(p->loop);
+        semaphore_destroy(p->queued_requests);
+    }
     gw_free(p);
 }
 
@@ -2125,7 +2260,12 @@ static void port_put_request(HTTPClient *client)
         client_destroy(client);
         return;
     }
-    gwlist_produce(p->clients_with_requests, client);
+    if (p->loop == NULL)
+        gwlist_produce(p->clients_with_requests, client);
+    else {
+        gwlist_produce(p->loop[client->loop].clients_with_requests, client);
+        semaphore_up(p->queued_requests);
+    }
     mutex_unlock(port_mutex);
 }
 
@@ -2135,6 +2275,7 @@ static HTTPClient *port_get_request(int port)
     Octstr *key;
     struct port *p;
     HTTPClient *client;
+    long i, home;
     
     mutex_lock(port_mutex);
     key = port_key(port);
@@ -2144,11 +2285,26 @@ static HTTPClient *port_get_request(int port)
     if (p == NULL) {
        client = NULL;
        mutex_unlock(port_mutex);
-    } else {
+    } else if (p->loop == NULL) {
        counter_increase(p->active_consumers);
        mutex_unlock(port_mutex);   /* Placement of this unlock is tricky. */
        client = gwlist_consume(p->clients_with_requests);
        counter_decrease(p->active_consumers);
+    } else {
+       counter_increase(p->active_consumers);
+       mutex_unlock(port_mutex);
+       /*
+        * Each consumer thread prefers the queue of one loop, so requests
+        * of a connection tend to stay with the same thread.
+        */
+       semaphore_down(p->queued_requests);
+       home = gwthread_self();
+       if (home < 0)
+           home = 0;
+       client = NULL;
+       for (i = 0; client == NULL && i < p->loops; i++)
+           client = gwlist_extract_first(p->loop[(home + i) % p->loops].clients_with_requests);
+       counter_decrease(p->active_consumers);
     }
     return client;
 }
@@ -2158,20 +2314,24 @@ static void port_set_timeout(int port, long timeout)
 {
     Octstr *key;
     struct port *p;
+    long i;
 
     mutex_lock(port_mutex);
     key = port_key(port);
     p = dict_get(port_collection, key);
     octstr_destroy(key);
 
-    if (p != NULL)
+    if (p != NULL) {
         fdset_set_timeout(p->server_fdset, timeout);
+        for (i = 1; p->loop != NULL && i < p->loops; i++)
+            fdset_set_timeout(p->loop[i].server_fdset, timeout);
+    }
 
     mutex_unlock(port_mutex);
 }
 
 
-static FDSet *port_get_fdset(int port)
+static FDSet *port_get_fdset(int port, int loop)
 {
     Octstr *key;
     struct port *p;
@@ -2183,7 +2343,7 @@ static FDSet *port_get_fdset(int port)
     octstr_destroy(key);
 
     if (p != NULL)
-        ret = p->server_fdset;
+        ret = (p->loop == NULL ? p->server_fdset : p->loop[loop].server_fdset);
 
     mutex_unlock(port_mutex);
 
@@ -2191,49 +2351,57 @@ static FDSet *port_get_fdset(int port)
 }
 
 
+/*
+ * Split the request line into method, URL and version in place, without
+ * copying anything but the URL.
+ */
 static int parse_request_line(int *method, Octstr **url,
                               int *use_version_1_0, Octstr *line)
 {
-    List *words;
-    Octstr *version;
-    Octstr *method_str;
+    const char *data;
+    long len, pos, n, start[3], end[3];
     int ret;
 
-    words = octstr_split_words(line);
-    if (gwlist_len(words) != 3) {
-        gwlist_destroy(words, octstr_destroy_item);
-        return -1;
+    data = octstr_get_cstr(line);
+    len = octstr_len(line);
+
+    for (n = 0, pos = 0; ; n++) {
+        while (pos < len && isspace((unsigned char) data[pos]))
+            pos++;
+        if (pos == len)
+            break;
+        if (n == 3)
+            return -1;
+        start[n] = pos;
+        while (pos < len && !isspace((unsigned char) data[pos]))
+            pos++;
+        end[n] = pos;
     }
+    if (n != 3)
+        return -1;
 
-    method_str = gwlist_get(words, 0);
-    *url = gwlist_get(words, 1);
-    version = gwlist_get(words, 2);
-    gwlist_destroy(words, NULL);
+#define WORD_IS(i, str) \
+    (end[i] - start[i] == sizeof(str) - 1 && \
+     memcmp(data + start[i], str, sizeof(str) - 1) == 0)
 
-    if (octstr_compare(method_str, octstr_imm("GET")) == 0)
+    if (WORD_IS(0, "GET"))
         *method = HTTP_METHOD_GET;
-    else if (octstr_compare(method_str, octstr_imm("POST")) == 0)
+    else if (WORD_IS(0, "POST"))
         *method = HTTP_METHOD_POST;
-    else if (octstr_compare(method_str, octstr_imm("HEAD")) == 0)
+    else if (WORD_IS(0, "HEAD"))
         *method = HTTP_METHOD_HEAD;
     else
-        goto error;
+        return -1;
 
-    ret = parse_http_version(version);
+#undef WORD_IS
+
+    ret = parse_http_version_data(data + start[2], end[2] - start[2]);
     if (ret < 0)
-        goto error;
+        return -1;
     *use_version_1_0 = !ret;
 
-    octstr_destroy(method_str);
-    octstr_destroy(version);
+    *url = octstr_copy(line, start[1], end[1] - start[1]);
     return 0;
-
-error:
-    octstr_destroy(method_str);
-    octstr_destroy(*url);
-    octstr_destroy(version);
-    *url = NULL;
-    return -1;
 }
 
 
@@ -2330,15 +2498,79 @@ error:
 }
 
 
-static void server_thread(void *dummy)
+/*
+ * Accept a client on the listening socket fd of accept loop 'loop' of
+ * the port and register it with the FDSet of that loop.
+ */
+static void server_accept(struct port *p, int loop, int listen_fd)
 {
-    struct pollfd *tab = NULL;
-    struct port **ports = NULL;
-    int tab_size = 0, n, i, fd, ret, max_clients_reached;
     struct sockaddr_in addr;
     socklen_t addrlen;
     HTTPClient *client;
     Connection *conn;
+    FDSet *fdset;
+    int fd;
+
+    addrlen = sizeof(addr);
+    fd = accept(listen_fd, (struct sockaddr *) &addr, &addrlen);
+    if (fd == -1) {
+        error(errno, "HTTP: Error accepting a client.");
+    } else {
+        Octstr *client_ip = host_ip(addr);
+        /*
+         * Be aware that conn_wrap_fd() will return NULL if SSL 
+         * handshake has failed, so we only client_create() if
+         * there is an conn.
+         */             
+        if ((conn = conn_wrap_fd(fd, p->ssl))) {
+            fdset = (p->loop == NULL ? p->server_fdset : p->loop[loop].server_fdset);
+            client = client_create(p->port, loop, conn, client_ip);
+            conn_register(conn, fdset, receive_request, client);
+        } else {
+            error(0, "HTTP: unsuccessful SSL handshake for client `%s'",
+            octstr_get_cstr(client_ip));
+            octstr_destroy(client_ip);
+        }
+    }
+}
+
+
+/*
+ * Accept loop of a port with more than one accept loop, for all loops
+ * but the first one, which is polled by server_thread.
+ */
+static void server_loop_thread(void *arg)
+{
+    struct port_loop *loop = arg;
+    struct pollfd tab;
+
+    while (run_status == running && loop->running) {
+        if (gwlist_len(active_connections) >= HTTP_SERVER_MAX_ACTIVE_CONNECTIONS) {
+            /* wait for slots to become free */
+            gwthread_sleep(1.0);
+            continue;
+        }
+
+        tab.fd = loop->fd;
+        tab.events = POLLIN;
+        tab.revents = 0;
+        if (gwthread_poll(&tab, 1, -1.0) == -1) {
+            if (errno != EINTR)
+                warning(errno, "HTTP: gwthread_poll failed.");
+            continue;
+        }
+
+        if (loop->running && (tab.revents & POLLIN))
+            server_accept(loop->port, loop->index, loop->fd);
+    }
+}
+
+
+static void server_thread(void *dummy)
+{
+    struct pollfd *tab = NULL;
+    struct port **ports = NULL;
+    int tab_size = 0, n, i, ret, max_clients_reached;
     int *portno;
 
     n = max_clients_reached = 0;
@@ -2387,26 +2619,7 @@ static void server_thread(void *dummy)
                     max_clients_reached = 0;
                 }
 
-                addrlen = sizeof(addr);
-                fd = accept(tab[i].fd, (struct sockaddr *) &addr, &addrlen);
-                if (fd == -1) {
-                    error(errno, "HTTP: Error accepting a client.");
-                } else {
-                    Octstr *client_ip = host_ip(addr);
-                    /*
-                     * Be aware that conn_wrap_fd() will return NULL if SSL 
-                     * handshake has failed, so we only client_create() if
-                     * there is an conn.
-                     */             
-                    if ((conn = conn_wrap_fd(fd, ports[i]->ssl))) {
-                        client = client_create(ports[i]->port, conn, client_ip);
-                        conn_register(conn, ports[i]->server_fdset, receive_request, client);
-                    } else {
-                        error(0, "HTTP: unsuccessful SSL handshake for client `%s'",
-                        octstr_get_cstr(client_ip));
-                        octstr_destroy(client_ip);
-                    }
-                }
+                server_accept(ports[i], 0, tab[i].fd);
             }
         }
 
@@ -2469,9 +2682,17 @@ void http_set_server_timeout(int port, long timeout)
 }
 
 
+void http_set_server_loops(long loops)
+{
+    http_server_loops = (loops > 1 ? loops : 1);
+}
+
+
 int http_open_port_if(int port, int ssl, Octstr *interface)
 {
     struct port *p;
+    const char *iface;
+    long i;
 
     if (ssl) 
         info(0, "HTTP: Opening SSL server at port %d.", port);
@@ -2480,11 +2701,30 @@ int http_open_port_if(int port, int ssl, Octstr *interface)
     p = port_add(port);
     p->port = port;
     p->ssl = ssl;
-    p->fd = make_server_socket(port, (interface ? octstr_get_cstr(interface) : NULL));
+    iface = (interface ? octstr_get_cstr(interface) : NULL);
+    if (p->loop == NULL)
+        p->fd = make_server_socket(port, iface);
+    else
+        p->fd = make_server_socket_reuseport(port, iface);
     if (p->fd == -1) {
         port_remove(port);
     	return -1;
     }
+
+    if (p->loop != NULL) {
+        info(0, "HTTP: Using %d accept loops for port %d.", p->loops, port);
+        p->loop[0].fd = p->fd;
+        for (i = 1; i < p->loops; i++) {
+            p->loop[i].fd = make_server_socket_reuseport(port, iface);
+            if (p->loop[i].fd == -1) {
+                (void) close(p->fd);
+                port_remove(port);
+                return -1;
+            }
+            p->loop[i].running = 1;
+            p->loop[i].thread = gwthread_create(server_loop_thread, &p->loop[i]);
+        }
+    }
     
     gwlist_produce(new_server_sockets, p);
     keep_servers_open = 1;
@@ -2523,6 +2763,47 @@ void http_close_all_ports(void)
 }
 
 
+/*
+ * Parse the CGI variables of a query string in os, starting at offset
+ * start, in one pass. Arguments are separated by '&', name and value by
+ * the first '=' of an argument.
+ */
+static List *parse_cgivars_at(Octstr *os, long start)
+{
+    HTTPCGIVar *v;
+    List *list;
+    const char *data, *et, *equals;
+    long len;
+
+    list = gwlist_create();
+    data = octstr_get_cstr(os);
+    len = octstr_len(os);
+
+    while (start < len) {
+        et = memchr(data + start, '&', len - start);
+        if (et == NULL)
+            et = data + len;
+        equals = memchr(data + start, '=', et - (data + start));
+
+        v = gw_malloc(sizeof(HTTPCGIVar));
+        if (equals == NULL) {
+            v->name = octstr_create_from_data(data + start, et - (data + start));
+            v->value = octstr_create("");
+        } else {
+            v->name = octstr_create_from_data(data + start, equals - (data + start));
+            v->value = octstr_create_from_data(equals + 1, et - (equals + 1));
+        }
+        octstr_url_decode(v->name);
+        octstr_url_decode(v->value);
+        gwlist_append(list, v);
+
+        start = et - data + 1;
+    }
+
+    return list;
+}
+
+
 /*
  * Parse CGI variables from the path given in a GET. Return a list
  * of HTTPCGIvar pointers. Modify the url so that the variables are
@@ -2530,44 +2811,23 @@ void http_close_all_ports(void)
  */
 static List *parse_cgivars(Octstr *url)
 {
-    HTTPCGIVar *v;
     List *list;
-    int query, et, equals;
-    Octstr *arg, *args;
+    long query;
 
     query = octstr_search_char(url, '?', 0);
     if (query == -1)
         return gwlist_create();
 
-    args = octstr_copy(url, query + 1, octstr_len(url));
+    list = parse_cgivars_at(url, query + 1);
     octstr_truncate(url, query);
 
-    list = gwlist_create();
-
-    while (octstr_len(args) > 0) {
-        et = octstr_search_char(args, '&', 0);
-        if (et == -1)
-            et = octstr_len(args);
-        arg = octstr_copy(args, 0, et);
-        octstr_delete(args, 0, et + 1);
-
-        equals = octstr_search_char(arg, '=', 0);
-        if (equals == -1)
-            equals = octstr_len(arg);
-
-        v = gw_malloc(sizeof(HTTPCGIVar));
-        v->name = octstr_copy(arg, 0, equals);
-        v->value = octstr_copy(arg, equals + 1, octstr_len(arg));
-        octstr_url_decode(v->name);
-        octstr_url_decode(v->value);
-
-        octstr_destroy(arg);
+    return list;
+}
 
-        gwlist_append(list, v);
-    }
-    octstr_destroy(args);
 
-    return list;
+List *http_cgi_parse(Octstr *query)
+{
+    return parse_cgivars_at(query, 0);
 }
 
 
@@ -2602,7 +2862,7 @@ HTTPClient *http_accept_request(int port, Octstr **client_ip, Octstr **url,
         *body = NULL;
     }
     
-    client->persistent_conn = client_is_persistent(client->request->headers,
+    client->persistent_conn = client_is_persistent(client->request,
                                                    client->use_version_1_0);
     
     client->url = NULL;
@@ -2717,13 +2977,13 @@ void http_send_reply(HTTPClient *client, int status, List *headers,
         } else {
             /* XXX mark this HTTPClient in the keep-alive cleaner thread */
             client_reset(client);
-            conn_register(client->conn, port_get_fdset(client->port), receive_request, client);
+            conn_register(client->conn, port_get_fdset(client->port, client->loop), receive_request, client);
         }
     }
     /* queued for sending, we don't want to block */
     else if (ret == 1) {    
         client->state = sending_reply;
-        conn_register(client->conn, port_get_fdset(client->port), receive_request, client);
+        conn_register(client->conn, port_get_fdset(client->port, client->loop), receive_request, client);
     }
     /* error while sending response */
     else {     
@@ -401,6 +401,15 @@ typedef struct HTTPClient HTTPClient;
  */
 void http_set_server_timeout(int port, long timeout);
 
+/*
+ * Set the number of accept loops for server ports opened afterwards.
+ * With more than one, each loop has its own SO_REUSEPORT socket, FDSet
+ * and request queue, and the kernel spreads the connections among the
+ * loops. http_accept_request() takes requests from all loops, preferring
+ * one loop per calling thread. The default is one loop.
+ */
+void http_set_server_loops(long loops);
+
 /*
  * Open an HTTP server at a given port. Return -1 for errors (invalid
  * port number, etc), 0 for OK. This will also start a background thread
@@ -475,6 +484,14 @@ void http_destroy_cgiargs(List *args);
  */
 Octstr *http_cgi_variable(List *list, char *name);
 
+
+/*
+ * Parse a query string "name=value&..." without the leading '?' into a
+ * list of HTTPCGIVar objects, as http_accept_request() does for the
+ * request URL. Destroy the result with http_destroy_cgiargs().
+ */
+List *http_cgi_parse(Octstr *query);
+
 /*
  * Return METHOD used by client
  */
@@ -67,6 +67,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #ifdef HAVE_EXECINFO_H
 #include <execinfo.h>
@@ -139,19 +140,26 @@ static int num_logfiles = 0;
 
 
 /*
- * Mapping array between thread id and logfiles[] index.
+ * Mapping between thread and logfiles[] index, kept as thread specific
+ * data, so there is no limit on the number of threads. A thread that
+ * never registered logs to index 0.
  * This is used for smsc specific logging.
  */
-#define THREADTABLE_SIZE 1024
-static unsigned int thread_to[(long)THREADTABLE_SIZE];
+static pthread_key_t thread_to_key;
+static int thread_to_initialized = 0;
 
+static int thread_to_get(void)
+{
+    if (!thread_to_initialized)
+        return 0;
+    return (int) (long) pthread_getspecific(thread_to_key);
+}
 
-/*
- * Ensure we use the real threadtable slot number to map the thread id
- * instead of the thread id reported by gwthread_self()
- */
-#define thread_slot() \
-    (gwthread_self() % THREADTABLE_SIZE)
+static void thread_to_set(int idx)
+{
+    if (thread_to_initialized)
+        pthread_setspecific(thread_to_key, (void *) (long) idx);
+}
 
 
 /*
@@ -193,14 +201,16 @@ static void add_stderr(void)
 
 void log_init(void)
 {
-    unsigned long i;
+    int ret;
 
     /* Initialize rwlock */
     gw_rwlock_init_static(&rwlock);
 
-    /* default all possible thread to logging index 0, stderr */
-    for (i = 0; i < THREADTABLE_SIZE; i++) {
-        thread_to[i] = 0;
+    /* all threads log to index 0, stderr, until told otherwise */
+    if (!thread_to_initialized) {
+        if ((ret = pthread_key_create(&thread_to_key, NULL)) != 0)
+            panic(ret, "log: pthread_key_create failed");
+        thread_to_initialized = 1;
     }
 
     add_stderr();
@@ -613,7 +623,7 @@ void error(int err, const char *fmt, ...)
 {
     int e;
     
-    if ((e = thread_to[thread_slot()])) {
+    if ((e = thread_to_get())) {
         FUNCTION_GUTS_EXCL(GW_ERROR, "");
     } else {
         FUNCTION_GUTS(GW_ERROR, "");
@@ -625,7 +635,7 @@ void warning(int err, const char *fmt, ...)
 {
     int e;
     
-    if ((e = thread_to[thread_slot()])) {
+    if ((e = thread_to_get())) {
         FUNCTION_GUTS_EXCL(GW_WARNING, "");
     } else {
         FUNCTION_GUTS(GW_WARNING, "");
@@ -637,7 +647,7 @@ void info(int err, const char *fmt, ...)
 {
     int e;
     
-    if ((e = thread_to[thread_slot()])) {
+    if ((e = thread_to_get())) {
         FUNCTION_GUTS_EXCL(GW_INFO, "");
     } else {
         FUNCTION_GUTS(GW_INFO, "");
@@ -698,7 +708,7 @@ void debug(const char *place, int err, const char *fmt, ...)
     	 * list of what places are used instead of reading them
     	 * from the log file.
 	 */
-        if ((e = thread_to[thread_slot()])) {
+        if ((e = thread_to_get())) {
             FUNCTION_GUTS_EXCL(GW_DEBUG, "");
         } else {
             FUNCTION_GUTS(GW_DEBUG, "");
@@ -722,14 +732,28 @@ void log_set_debug_places(const char *places)
 
 void log_thread_to(int idx)
 {
-    long thread_id = thread_slot();
+    long thread_id = gwthread_self();
 
     if (idx > 0) {
-        info(0, "Logging thread `%ld' to logfile `%s' with level `%d'.", 
-             thread_id, logfiles[idx].filename, logfiles[idx].minimum_output_level);
-        thread_to[thread_id] = idx;
-    } else if (idx != 0 && num_logfiles > 0) {
+        if (thread_to_get() != idx)
+            info(0, "Logging thread `%ld' to logfile `%s' with level `%d'.", 
+                 thread_id, logfiles[idx].filename, logfiles[idx].minimum_output_level);
+        thread_to_set(idx);
+    } else if (idx == 0) {
+        /* back to the main log file */
+        thread_to_set(0);
+    } else if (num_logfiles > 0) {
         warning(0, "Logging thread `%ld' to logfile `%s' with level `%d'.",
                 thread_id, logfiles[0].filename, logfiles[0].minimum_output_level);
     }
 }
+
+
+int log_thread_switch(int idx)
+{
+    int old;
+
+    old = thread_to_get();
+    thread_to_set(idx > 0 ? idx : 0);
+    return old;
+}
@@ -172,8 +172,16 @@ void log_close_all(void);
 
 /* 
  * Register a thread to a specific logfiles[] index and hence 
- * to a specific exclusive log file.
+ * to a specific exclusive log file. Index 0 registers the thread
+ * back to the main log file.
  */
 void log_thread_to(int idx);
 
+/*
+ * Like log_thread_to(), but silently, and return the index the thread
+ * was logging to before. Meant for pool tasks working on behalf of
+ * a connection for a short while.
+ */
+int log_thread_switch(int idx);
+
 #endif
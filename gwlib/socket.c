@@ -90,7 +90,7 @@ static const struct sockaddr_in empty_sockaddr_in;
 #endif
 
 
-int make_server_socket(int port, const char *interface_name)
+static int server_socket(int port, const char *interface_name, int reuseport)
 {
     struct sockaddr_in addr;
     int s;
@@ -124,6 +124,19 @@ int make_server_socket(int port, const char *interface_name)
         goto error;
     }
 
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (char *) &reuse,
+                       sizeof(reuse)) == -1) {
+            error(errno, "setsockopt SO_REUSEPORT failed for server address");
+            goto error;
+        }
+#else
+        error(0, "SO_REUSEPORT is not supported on this platform");
+        goto error;
+#endif
+    }
+
     if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
         error(errno, "bind failed");
         goto error;
@@ -146,6 +159,18 @@ error:
 }
 
 
+int make_server_socket(int port, const char *interface_name)
+{
+    return server_socket(port, interface_name, 0);
+}
+
+
+int make_server_socket_reuseport(int port, const char *interface_name)
+{
+    return server_socket(port, interface_name, 1);
+}
+
+
 int tcpip_connect_to_server(char *hostname, int port, const char *source_addr)
 {
 
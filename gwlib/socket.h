@@ -88,6 +88,11 @@ Octstr *get_official_ip(void);
 /* Open a server socket. Return -1 for error, >= 0 socket number for OK.*/
 int make_server_socket(int port, const char *source_addr);
 
+/* As make_server_socket(), but with SO_REUSEPORT set, so that several
+   sockets may listen on the same port and share its connections. Fails
+   where SO_REUSEPORT is not supported. */
+int make_server_socket_reuseport(int port, const char *source_addr);
+
 /* Open a client socket. */
 int tcpip_connect_to_server(char *hostname, int port, const char *source_addr);
 
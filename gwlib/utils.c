@@ -847,6 +847,236 @@ int connect_denied(Octstr *allow_ip, Octstr *ip)
 }
 
 
+/*
+ * Compiled IP pattern lists. Every pattern is split at dots into
+ * segments, which are stored in a tree shared by all patterns of the
+ * list. A segment is either a literal or a literal prefix followed by
+ * '*', which pattern_matches_ip() lets match the rest of the address
+ * segment. Matching walks the tree one address segment at a time, so
+ * the cost depends on the address, not on the number of patterns.
+ */
+typedef struct IPPatternNode IPPatternNode;
+
+struct IPPatternNode {
+    Dict *literals;     /* Octstr segment -> IPPatternNode, NULL if none */
+    List *wildcards;    /* of IPPatternWildcard, NULL if none */
+    int final;          /* a pattern ends here */
+};
+
+typedef struct {
+    Octstr *prefix;     /* part of the segment before the '*' */
+    int stars;          /* '*' characters at the end of the segment */
+    IPPatternNode *next;
+} IPPatternWildcard;
+
+struct IPPatternList {
+    IPPatternNode *root;
+};
+
+
+static IPPatternNode *ip_pattern_node_create(void)
+{
+    IPPatternNode *node;
+
+    node = gw_malloc(sizeof(*node));
+    node->literals = NULL;
+    node->wildcards = NULL;
+    node->final = 0;
+
+    return node;
+}
+
+
+static void ip_pattern_node_destroy(void *p)
+{
+    IPPatternNode *node = p;
+    IPPatternWildcard *w;
+
+    if (node == NULL)
+        return;
+
+    dict_destroy(node->literals);
+    while (node->wildcards != NULL &&
+           (w = gwlist_extract_first(node->wildcards)) != NULL) {
+        octstr_destroy(w->prefix);
+        ip_pattern_node_destroy(w->next);
+        gw_free(w);
+    }
+    gwlist_destroy(node->wildcards, NULL);
+    gw_free(node);
+}
+
+
+static IPPatternNode *ip_pattern_node_child(IPPatternNode *node, Octstr *seg)
+{
+    IPPatternNode *child;
+    IPPatternWildcard *w;
+    long star, stars, i;
+
+    star = octstr_search_char(seg, '*', 0);
+    if (star == -1) {
+        if (node->literals == NULL)
+            node->literals = dict_create(16, ip_pattern_node_destroy);
+        if ((child = dict_get(node->literals, seg)) == NULL) {
+            child = ip_pattern_node_create();
+            dict_put(node->literals, seg, child);
+        }
+        return child;
+    }
+
+    /* after a '*' only more of them can match, see pattern_matches_ip() */
+    for (i = star; i < octstr_len(seg); i++)
+        if (octstr_get_char(seg, i) != '*')
+            return NULL;
+    stars = octstr_len(seg) - star;
+
+    for (i = 0; node->wildcards != NULL && i < gwlist_len(node->wildcards); i++) {
+        w = gwlist_get(node->wildcards, i);
+        if (w->stars == stars && octstr_ncompare(w->prefix, seg, star) == 0 &&
+            octstr_len(w->prefix) == star)
+            return w->next;
+    }
+    if (node->wildcards == NULL)
+        node->wildcards = gwlist_create();
+    w = gw_malloc(sizeof(*w));
+    w->prefix = octstr_copy(seg, 0, star);
+    w->stars = stars;
+    w->next = ip_pattern_node_create();
+    gwlist_append(node->wildcards, w);
+
+    return w->next;
+}
+
+
+static void ip_pattern_list_add(IPPatternList *list, Octstr *pattern)
+{
+    IPPatternNode *node;
+    Octstr *seg;
+    long pos, end;
+
+    node = list->root;
+    pos = 0;
+    do {
+        if ((end = octstr_search_char(pattern, '.', pos)) == -1)
+            end = octstr_len(pattern);
+        seg = octstr_copy(pattern, pos, end - pos);
+        node = ip_pattern_node_child(node, seg);
+        octstr_destroy(seg);
+        if (node == NULL) {
+            /* could never match, but the nodes created so far are harmless */
+            return;
+        }
+        pos = end + 1;
+    } while (end < octstr_len(pattern));
+
+    node->final = 1;
+}
+
+
+static int ip_pattern_node_matches(IPPatternNode *node, Octstr *ip, long pos)
+{
+    IPPatternNode *next;
+    IPPatternWildcard *w;
+    Octstr *seg;
+    long end, len, i;
+    int last, matches;
+
+    if ((end = octstr_search_char(ip, '.', pos)) == -1)
+        end = octstr_len(ip);
+    last = (end == octstr_len(ip));
+    len = end - pos;
+
+    if (node->literals != NULL) {
+        seg = octstr_copy(ip, pos, len);
+        next = dict_get(node->literals, seg);
+        octstr_destroy(seg);
+        if (next != NULL) {
+            matches = last ? next->final : ip_pattern_node_matches(next, ip, end + 1);
+            if (matches)
+                return 1;
+        }
+    }
+
+    for (i = 0; node->wildcards != NULL && i < gwlist_len(node->wildcards); i++) {
+        w = gwlist_get(node->wildcards, i);
+        /*
+         * A wildcard matches an empty rest of the segment only if another
+         * segment follows, and a repeated one never matches at the end.
+         */
+        if (last && (w->stars > 1 || len <= octstr_len(w->prefix)))
+            continue;
+        if (len < octstr_len(w->prefix) ||
+            memcmp(octstr_get_cstr(ip) + pos, octstr_get_cstr(w->prefix),
+                   octstr_len(w->prefix)) != 0)
+            continue;
+        if (last ? w->next->final : ip_pattern_node_matches(w->next, ip, end + 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+IPPatternList *ip_pattern_list_create(Octstr *pattern_list)
+{
+    IPPatternList *list;
+    List *patterns;
+    Octstr *pattern;
+
+    if (octstr_len(pattern_list) == 0)
+        return NULL;
+
+    list = gw_malloc(sizeof(*list));
+    list->root = ip_pattern_node_create();
+
+    patterns = octstr_split(pattern_list, octstr_imm(";"));
+    while ((pattern = gwlist_extract_first(patterns)) != NULL) {
+        ip_pattern_list_add(list, pattern);
+        octstr_destroy(pattern);
+    }
+    gwlist_destroy(patterns, NULL);
+
+    return list;
+}
+
+
+void ip_pattern_list_destroy(IPPatternList *list)
+{
+    if (list == NULL)
+        return;
+
+    ip_pattern_node_destroy(list->root);
+    gw_free(list);
+}
+
+
+int ip_pattern_list_matches(IPPatternList *list, Octstr *ip)
+{
+    if (list == NULL || ip == NULL)
+        return 0;
+
+    return ip_pattern_node_matches(list->root, ip, 0);
+}
+
+
+int is_allowed_ip_patterns(IPPatternList *allow_ip, IPPatternList *deny_ip, Octstr *ip)
+{
+    if (ip == NULL)
+        return 0;
+
+    if (deny_ip == NULL)
+        return 1;
+
+    if (ip_pattern_list_matches(allow_ip, ip))
+        return 1;
+
+    if (ip_pattern_list_matches(deny_ip, ip))
+        return 0;
+
+    return 1;
+}
+
+
 int does_prefix_match(Octstr *prefix, Octstr *number)
 {
     /* XXX modify to use just octstr operations
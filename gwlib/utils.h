@@ -133,6 +133,25 @@ int get_and_set_debugs(int argc, char **argv,
  */
 int is_allowed_ip(Octstr *allow_ip, Octstr *deny_ip, Octstr *ip);
 
+/*
+ * A semicolon separated list of IP patterns as taken by is_allowed_ip(),
+ * compiled once so that matching doesn't parse the list again.
+ */
+typedef struct IPPatternList IPPatternList;
+
+/*
+ * Compile a pattern list. Returns NULL for a NULL or empty list, which
+ * the functions below treat as a list matching nothing.
+ */
+IPPatternList *ip_pattern_list_create(Octstr *pattern_list);
+void ip_pattern_list_destroy(IPPatternList *list);
+
+/* Return 1 if 'ip' matches any pattern of 'list', 0 otherwise. */
+int ip_pattern_list_matches(IPPatternList *list, Octstr *ip);
+
+/* Same as is_allowed_ip(), but with compiled pattern lists. */
+int is_allowed_ip_patterns(IPPatternList *allow_ip, IPPatternList *deny_ip, Octstr *ip);
+
 /*
  * Return 1 if 'ip' is not allowed to connect, when 'allow_ip' defines
  * allowed hosts, and 0 if connect ok. If 'allow_ip' is NULL, check against
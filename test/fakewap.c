@@ -139,9 +139,10 @@
  * v1.4 - parse WSP message and save only the received payload to the output file
  * v1.5 - support for connectionless get/post
  * v1.6 - robustness fixes for Post (resend group segments if no ack), packet loss simulation
+ * v1.7 - load test with lots of concurrent clients (-L)
  */
 static char usage[] = "\
-fakewap version 1.6\n\
+fakewap version 1.7\n\
 Usage: fakewap [options] url ...\n\
 \n\
 where options are:\n\
@@ -169,6 +170,8 @@ where options are:\n\
 -P in-file	Post data from file\n\
 -w out-file	Write received data to file\n\
 -l loss-precent Simulate packet loss\n\
+-L clients      Load test: connect this many clients from local addresses\n\
+                127.1.0.0 upwards and keep them connected (no urls needed)\n\
 \n\
 The urls are fetched in random order.\n\
 ";
@@ -250,6 +253,7 @@ const char* content_type;
 struct sockaddr_in src_addr;
 int transaction_mode;
 int packet_loss; /* packet loss rate 0-99 */
+long load_clients; /* number of clients in load test */
 Octstr *useragent;
 
 /*
@@ -1186,6 +1190,208 @@ static void client_session( void * arg)
 }
 
 
+#ifdef IP_PKTINFO
+/*
+**  Load test: a lot of clients are simulated from one socket, each of them
+**  sending from its own address in 127.1.0.0 upwards (on Linux any address
+**  of 127.0.0.0/8 is local). Every client connects and stays connected
+**  until all have connected, then all disconnect. The gateway must be on
+**  this host. The time taken by each batch of connects is reported, so
+**  any growth of the per-datagram cost with the number of live clients
+**  shows up directly.
+*/
+#define LOAD_FIRST_ADDR  0x7f010000
+#define LOAD_WINDOW      64
+#define LOAD_BATCH       10000
+
+typedef struct {
+    double         sent;    /* when the connect was sent, 0 if answered */
+    unsigned char  sid[8];
+    int            sid_len;
+} LoadClient;
+
+static double load_now(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (double) now.tv_sec + now.tv_usec / 1e6;
+}
+
+static void load_send(int fd, long client, unsigned char *data, int len)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct in_pktinfo *pktinfo;
+    struct sockaddr_in to;
+    char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+
+    memcpy(&to, octstr_get_cstr(gateway_addr), sizeof(to));
+    iov.iov_base = data;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_name = &to;
+    msg.msg_namelen = sizeof(to);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+    pktinfo = (struct in_pktinfo *) CMSG_DATA(cmsg);
+    pktinfo->ipi_spec_dst.s_addr = htonl(LOAD_FIRST_ADDR + client);
+
+    while (sendmsg(fd, &msg, 0) == -1) {
+        if (errno != ENOBUFS && errno != EAGAIN)
+            panic(errno, "fakewap: sendmsg failed");
+        usleep(1000);
+    }
+    print_msg("Sent packet", data, len);
+}
+
+/* Return the client the datagram was sent to, or -1 */
+static long load_recv(int fd, unsigned char *data, int size, int *len)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct sockaddr_in from;
+    char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    int ret;
+
+    iov.iov_base = data;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if ((ret = recvmsg(fd, &msg, 0)) == -1)
+        panic(errno, "fakewap: recvmsg failed");
+    *len = ret;
+    print_msg("Received packet", data, ret);
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+            return (long) ntohl(((struct in_pktinfo *) CMSG_DATA(cmsg))->ipi_addr.s_addr)
+                   - LOAD_FIRST_ADDR;
+    }
+    return -1;
+}
+
+static void load_test(long clients)
+{
+    LoadClient *client;
+    unsigned char buf[64*1024], pdu[1024], reply[16];
+    long c, next, waiting, done, batch_done;
+    double start, batch_start, now, rtt;
+    int fd, len, on = 1;
+    unsigned short tid = 1;
+
+    fd = udp_client_socket();
+    if (fd == -1)
+        panic(0, "fakewap: Couldn't create socket.");
+    if (setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) == -1)
+        panic(errno, "fakewap: Couldn't set IP_PKTINFO");
+
+    client = gw_malloc(clients * sizeof(*client));
+    memset(client, 0, clients * sizeof(*client));
+
+    /* every client uses the same tid, having its own address */
+    memcpy(pdu, WTP_Invoke_Cl2, sizeof(WTP_Invoke_Cl2));
+    SET_TID(pdu, tid);
+    WSP_Connect[3] = 2 + octstr_len(useragent); /* set header length */
+    memcpy(pdu + sizeof(WTP_Invoke_Cl2), WSP_Connect, sizeof(WSP_Connect));
+    memcpy(pdu + sizeof(WTP_Invoke_Cl2) + sizeof(WSP_Connect),
+           octstr_get_cstr(useragent), octstr_len(useragent));
+    len = sizeof(WTP_Invoke_Cl2) + sizeof(WSP_Connect) + octstr_len(useragent);
+
+    start = batch_start = load_now();
+    next = waiting = done = batch_done = 0;
+    rtt = 0;
+    while (done < clients) {
+        /* keep a window of connects outstanding */
+        while (waiting < LOAD_WINDOW && next < clients) {
+            client[next].sent = load_now();
+            load_send(fd, next, pdu, len);
+            next++;
+            waiting++;
+        }
+
+        if (read_available(fd, WAP_MSG_RECEIVE_TIMEOUT * 1000 * 1000) <= 0)
+            panic(0, "fakewap: Timeout, %ld of %ld clients connected", done, clients);
+        c = load_recv(fd, buf, sizeof(buf), &len);
+        if (c < 0 || c >= next || len < 3 || GET_TID(buf) != tid)
+            continue;
+
+        switch (GET_WTP_PDU_TYPE(buf)) {
+        case WTP_PDU_RESULT:
+            memcpy(reply, WTP_Ack, sizeof(WTP_Ack));
+            SET_TID(reply, tid);
+            load_send(fd, c, reply, sizeof(WTP_Ack));
+            if (client[c].sent == 0) /* a resent result */
+                break;
+            if (len > 4 && buf[3] == 0x02) { /* ConnectReply */
+                client[c].sid_len = min(ReadVarIntLen(&buf[4]), (int) sizeof(client[c].sid));
+                memcpy(client[c].sid, &buf[4], client[c].sid_len);
+            } else
+                warning(0, "fakewap: Client %ld got no ConnectReply", c);
+            now = load_now();
+            rtt += now - client[c].sent;
+            client[c].sent = 0;
+            waiting--;
+            done++;
+            if (++batch_done == LOAD_BATCH || done == clients) {
+                info(0, "fakewap: %ld clients connected, last %ld took %.3f ms "
+                     "per connect, %.3f ms round-trip", done, batch_done,
+                     (now - batch_start) * 1000 / batch_done,
+                     rtt * 1000 / batch_done);
+                batch_start = now;
+                batch_done = 0;
+                rtt = 0;
+            }
+            break;
+
+        case WTP_PDU_ACK: /* tid verification */
+            memcpy(reply, WTP_TidVe, sizeof(WTP_TidVe));
+            SET_TID(reply, tid);
+            load_send(fd, c, reply, sizeof(WTP_TidVe));
+            break;
+
+        case WTP_PDU_ABORT:
+            panic(0, "fakewap: Client %ld got an abort", c);
+            break;
+        }
+    }
+    info(0, "fakewap: %ld clients connected in %.1f seconds",
+         clients, load_now() - start);
+
+    /* and say goodbye */
+    tid++;
+    for (c = 0; c < clients; c++) {
+        memcpy(pdu, WTP_Invoke_Cl0, sizeof(WTP_Invoke_Cl0));
+        SET_TID(pdu, tid);
+        pdu[sizeof(WTP_Invoke_Cl0)] = WSP_Disconnect[0];
+        memcpy(pdu + sizeof(WTP_Invoke_Cl0) + 1, client[c].sid, client[c].sid_len);
+        load_send(fd, c, pdu, sizeof(WTP_Invoke_Cl0) + 1 + client[c].sid_len);
+        if (c % LOAD_WINDOW == 0)
+            usleep(1000);
+    }
+    info(0, "fakewap: %ld clients disconnected", clients);
+
+    gw_free(client);
+    close(fd);
+}
+#endif
+
+
 static void help(void) {
     info(0, "\n%s", usage);
 }
@@ -1238,6 +1444,7 @@ int main(int argc, char **argv)
     src_addr.sin_port = 0;
     transaction_mode = TXN_MODE_CONNECTION_ORIENTED;
     packet_loss = 0;
+    load_clients = 0;
 
     /* create default user agent header prepend with a9, and end with 0 */
     const char firstchar[] = {0xa9, 0}; /* code value for user agent header */
@@ -1246,7 +1453,7 @@ int main(int argc, char **argv)
     octstr_append_data(useragent, octstr_get_cstr(temp), octstr_len(temp) );
     octstr_append_data(useragent, "\0", 1 );
 
-    while ((opt = getopt(argc, argv, "Fhc:g:p:m:i:t:V:t:nsd:A:C:D:I:M:P:w:l:")) != EOF)
+    while ((opt = getopt(argc, argv, "Fhc:g:p:m:i:t:V:t:nsd:A:C:D:I:M:P:w:l:L:")) != EOF)
     {
 	switch (opt) {
 	case 'g':
@@ -1357,6 +1564,10 @@ int main(int argc, char **argv)
             }
 	    break;
 
+	case 'L':
+	    load_clients = atol(optarg);
+	    break;
+
 	case '?':
 	default:
 	    error(0, "fakewap: Unknown option %c", opt);
@@ -1367,7 +1578,7 @@ int main(int argc, char **argv)
 
     time(&start_time);
 
-    if (optind >= argc)
+    if (optind >= argc && load_clients <= 0)
         panic(0, "%s", usage);
 
     if ((!brief) && (!verbose))
@@ -1398,6 +1609,19 @@ int main(int argc, char **argv)
 
     info(0, "fakewap: starting");
 
+    if (load_clients > 0) {
+#ifdef IP_PKTINFO
+        load_test(load_clients);
+#else
+        panic(0, "fakewap: Load test is not supported on this platform.");
+#endif
+        octstr_destroy(hostname);
+        octstr_destroy(gateway_addr);
+        mutex_destroy(mutex);
+        gwlib_shutdown();
+        return 0;
+    }
+
     if (threads < 1) threads = 1;
 
     /*
@@ -63,6 +63,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/time.h>
 
 #include "gwlib/gwlib.h"
 #include "wap/wsp_headers.h"
@@ -115,6 +116,83 @@ static void test_header_combine(void)
 }
  
 
+static long bench_count = 0;
+
+static int check_args(int i, int argc, char **argv)
+{
+    if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+        bench_count = atol(argv[i + 1]);
+        return 1;
+    }
+    return -1;
+}
+
+
+static double elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_usec - start->tv_usec);
+}
+
+
+/* Pack and unpack the headers count times and report the time taken
+ * per round by each direction, both into a header list and as text. */
+static void benchmark(List *headers, long count)
+{
+    struct timeval start;
+    double pack_time, unpack_time, text_time;
+    Octstr *packed, *text, *joined;
+    List *unpacked;
+    long i;
+
+    packed = wsp_headers_pack(headers, 0, WSP_1_2);
+    octstr_destroy(packed);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        packed = wsp_headers_pack(headers, 0, WSP_1_2);
+        octstr_destroy(packed);
+    }
+    pack_time = elapsed(&start);
+
+    packed = wsp_headers_pack(headers, 0, WSP_1_2);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        unpacked = wsp_headers_unpack(packed, 0);
+        http_destroy_headers(unpacked);
+    }
+    unpack_time = elapsed(&start);
+
+    text = octstr_create("");
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        octstr_truncate(text, 0);
+        wsp_headers_unpack_text(text, packed, 0, "\r\n");
+    }
+    text_time = elapsed(&start);
+
+    unpacked = wsp_headers_unpack(packed, 0);
+    joined = octstr_create("");
+    for (i = 0; i < gwlist_len(unpacked); i++) {
+        octstr_append(joined, gwlist_get(unpacked, i));
+        octstr_append_cstr(joined, "\r\n");
+    }
+    if (octstr_compare(joined, text) != 0)
+        error(0, "Text decoding differs from decoded header list.");
+    http_destroy_headers(unpacked);
+    octstr_destroy(joined);
+    octstr_destroy(text);
+
+    info(0, "%ld rounds of %ld headers (%ld octets packed): "
+         "pack %.2f us, unpack %.2f us, unpack to text %.2f us per round",
+         count, gwlist_len(headers), octstr_len(packed),
+         pack_time / count, unpack_time / count, text_time / count);
+    octstr_destroy(packed);
+}
+
+
 static void split_headers(Octstr *headers, List **split, List **expected)
 {
     long start;
@@ -171,9 +249,9 @@ int main(int argc, char **argv)
     gwlib_init();
     wsp_strings_init();
 
-    mptr = get_and_set_debugs(argc, argv, NULL);
+    mptr = get_and_set_debugs(argc, argv, check_args);
     if (argc - mptr <= 0)
-        panic(0, "Usage: test_headers [options] header-file");
+        panic(0, "Usage: test_headers [options] [-b count] header-file");
 
     filename = octstr_create(argv[mptr]);
     headers = octstr_read_file(octstr_get_cstr(filename));
@@ -198,6 +276,9 @@ int main(int argc, char **argv)
 
     test_header_combine();
 
+    if (bench_count > 0)
+        benchmark(split, bench_count);
+
     octstr_destroy(headers);
     octstr_destroy(filename);
     gwlist_destroy(split, octstr_destroy_item);
@@ -73,6 +73,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "gwlib/gwlib.h"
 #include "gw/wap_push_pap_compiler.h"
@@ -90,7 +91,9 @@ static int verbose = 1,
            add_epilogue = 0,
            add_preamble = 0,
            use_dlr_mask = 0,
-           use_dlr_url = 0;
+           use_dlr_url = 0,
+           unique_push_ids = 0;
+static long addresses_per_push = 1;
 static double wait_seconds = 0.0;
 static Counter *counter = NULL;
 static char **push_data = NULL;
@@ -344,7 +347,34 @@ static List *push_headers_create(size_t content_len)
     return push_headers;
 }
 
-static Octstr *push_content_create(void)
+/*
+ * Make push id of the control document unique by prefixing it with the 
+ * number of the request. Count addresses, too, a control document having
+ * several of them is a multicast push.
+ */
+static void prepare_control_document(Octstr *pap_doc, long i)
+{
+    Octstr *prefix;
+    long pos, count;
+
+    if (unique_push_ids && 
+            (pos = octstr_search(pap_doc, octstr_imm("push-id=\""), 0)) >= 0) {
+        octstr_insert(pap_doc, prefix = octstr_format("%ld.", i), pos + 9);
+        octstr_destroy(prefix);
+    }
+
+    count = 0;
+    pos = 0;
+    while ((pos = octstr_search(pap_doc, octstr_imm("address-value"), 
+                                pos)) >= 0) {
+        ++count;
+        ++pos;
+    }
+    if (count > 0)
+        addresses_per_push = count;
+}
+
+static Octstr *push_content_create(long i)
 {
     Octstr *push_content, 
            *wap_content;
@@ -429,6 +459,7 @@ static Octstr *push_content_create(void)
                 octstr_read_file(octstr_get_cstr(pap_file))) ==  NULL)
 	        panic(0, "Stopping");
         
+        prepare_control_document(pap_file_content, i);
         octstr_append(pap_content, pap_file_content);
         octstr_destroy(pap_file_content);
 
@@ -476,7 +507,7 @@ static void start_push(HTTPCaller *caller, long i)
     Octstr *push_content;
     long *id;
     
-    push_content = push_content_create();
+    push_content = push_content_create(i);
     push_headers = push_headers_create(octstr_len(push_content));
     if (verbose) {
        debug("test.ppg", 0, "we have push content");
@@ -531,7 +562,7 @@ static int receive_push_reply(HTTPCaller *caller)
         debug("test.ppg", 0, "try number %d", tries);
         debug("test.ppg", 0, "authentication failure, get a challenge");
         http_destroy_headers(reply_headers);
-        push_content = push_content_create();
+        push_content = push_content_create(*(long *) id);
         retry_headers = push_headers_create(octstr_len(push_content));
         http_add_basic_auth(retry_headers, username, password);
         trid = gw_malloc(sizeof(long));
@@ -760,6 +791,10 @@ static void help(void)
     info(0, "Default off.");
     info(0, "-p");
     info(0, "If set, add hardcoded preamble. Default is off.");
+    info(0, "-U");
+    info(0, "If set, prefix the push id of the control document with the");
+    info(0, "number of the request, so that requests can be in flight at the");
+    info(0, "same time. Default is off.");
     info(0, "-m value");
     info(0, "If set, add push header X-Kannel-DLR-Mask: value");
     info(0, "Default off.");
@@ -772,7 +807,7 @@ int main(int argc, char **argv)
 {
     int opt,
         num_threads;
-    time_t start,
+    struct timeval start,
            end;
     double run_time;
     long threads[MAX_THREADS];
@@ -782,7 +817,7 @@ int main(int argc, char **argv)
     gwlib_init();
     num_threads = 1;
 
-    while ((opt = getopt(argc, argv, "HhBbnEpv:qr:t:c:a:i:e:k:d:s:S:I:m:u:")) != EOF) {
+    while ((opt = getopt(argc, argv, "HhBbnEpUv:qr:t:c:a:i:e:k:d:s:S:I:m:u:")) != EOF) {
         switch(opt) {
 	    case 'v':
 	        log_set_output_level(atoi(optarg));
@@ -907,6 +942,10 @@ int main(int argc, char **argv)
                 add_preamble = 1;
             break;
 
+            case 'U':
+                unique_push_ids = 1;
+            break;
+
             case 'I':
                 initiator_uri = octstr_create(optarg);
 		break;
@@ -998,7 +1037,7 @@ int main(int argc, char **argv)
     boundary = "asdlfkjiurwghasf";
     counter = counter_create();
 
-    time(&start);
+    gettimeofday(&start, NULL);
     if (num_threads == 0)
         push_thread(http_caller_create());
     else {
@@ -1007,10 +1046,14 @@ int main(int argc, char **argv)
 	    for (i = 0; i < num_threads; ++i)
 	        gwthread_join(threads[i]);
     }
-    time(&end);
-    run_time = difftime(end, start);
+    gettimeofday(&end, NULL);
+    run_time = (end.tv_sec - start.tv_sec) + 
+               (end.tv_usec - start.tv_usec) / 1e6;
     info(0, "TEST_PPG: %ld requests in %f seconds, %f requests per second",
          max_pushes, run_time, max_pushes / run_time);
+    if (addresses_per_push > 1)
+        info(0, "TEST_PPG: %ld addresses per request, %f pushes per second",
+             addresses_per_push, max_pushes * addresses_per_push / run_time);
 
     octstr_destroy(content_flag);
     octstr_destroy(appid_flag);
@@ -0,0 +1,250 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_smpp_pdu.c - check and benchmark SMPP PDU packing and unpacking
+ *
+ * Builds a typical submit_sm and deliver_sm (receipt), checks that each
+ * survives a pack/unpack/pack round trip unchanged, and then times N
+ * encode and N decode runs of each.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/smsc/smpp_pdu.h"
+
+static long iterations = 100000;
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static SMPP_PDU *make_submit_sm(void)
+{
+    SMPP_PDU *pdu;
+
+    pdu = smpp_pdu_create(submit_sm, 4711);
+    pdu->u.submit_sm.service_type = octstr_create("CMT");
+    pdu->u.submit_sm.source_addr_ton = GSM_ADDR_TON_ALPHANUMERIC;
+    pdu->u.submit_sm.source_addr = octstr_create("Kannel");
+    pdu->u.submit_sm.dest_addr_ton = GSM_ADDR_TON_INTERNATIONAL;
+    pdu->u.submit_sm.dest_addr_npi = GSM_ADDR_NPI_E164;
+    pdu->u.submit_sm.destination_addr = octstr_create("491701234567");
+    pdu->u.submit_sm.esm_class = ESM_CLASS_SUBMIT_STORE_AND_FORWARD_MODE;
+    pdu->u.submit_sm.validity_period = octstr_create("000001000000000R");
+    pdu->u.submit_sm.registered_delivery = 1;
+    pdu->u.submit_sm.short_message =
+        octstr_create("The quick brown fox jumps over the lazy dog. "
+                      "The quick brown fox jumps over the lazy dog. "
+                      "The quick brown fox jumps over the lazy dog.");
+    pdu->u.submit_sm.user_message_reference = 42;
+    pdu->u.submit_sm.more_messages_to_send = 1;
+
+    return pdu;
+}
+
+
+static SMPP_PDU *make_deliver_sm(void)
+{
+    SMPP_PDU *pdu;
+
+    pdu = smpp_pdu_create(deliver_sm, 815);
+    pdu->u.deliver_sm.source_addr_ton = GSM_ADDR_TON_INTERNATIONAL;
+    pdu->u.deliver_sm.source_addr_npi = GSM_ADDR_NPI_E164;
+    pdu->u.deliver_sm.source_addr = octstr_create("491701234567");
+    pdu->u.deliver_sm.destination_addr = octstr_create("Kannel");
+    pdu->u.deliver_sm.esm_class = ESM_CLASS_DELIVER_SMSC_DELIVER_ACK;
+    pdu->u.deliver_sm.short_message =
+        octstr_create("id:0123456789 sub:001 dlvrd:001 "
+                      "submit date:1810181200 done date:1810181201 "
+                      "stat:DELIVRD err:000 text:The quick brown");
+    pdu->u.deliver_sm.receipted_message_id = octstr_create("0123456789");
+    pdu->u.deliver_sm.message_state = 2;
+
+    return pdu;
+}
+
+
+static int check_roundtrip(const char *name, SMPP_PDU *pdu)
+{
+    Octstr *os, *data, *again;
+    SMPP_PDU *copy;
+    int ret = 0;
+
+    os = smpp_pdu_pack(NULL, pdu);
+    data = octstr_copy(os, 4, octstr_len(os) - 4);
+    copy = smpp_pdu_unpack(NULL, data);
+    if (copy == NULL) {
+        error(0, "%s: unpacking failed.", name);
+        ret = -1;
+    } else {
+        again = smpp_pdu_pack(NULL, copy);
+        if (octstr_compare(os, again) != 0) {
+            error(0, "%s: repacking changed the PDU.", name);
+            octstr_dump(os, 0);
+            octstr_dump(again, 0);
+            ret = -1;
+        } else
+            info(0, "%s: round trip ok (%ld octets).", name, octstr_len(os));
+        octstr_destroy(again);
+    }
+    smpp_pdu_destroy(copy);
+    octstr_destroy(data);
+    octstr_destroy(os);
+
+    return ret;
+}
+
+
+static void report(const char *name, const char *what, double start)
+{
+    double secs = now() - start;
+
+    info(0, "%s %s: %ld PDUs in %.3f s, %.0f PDUs/s, %.0f ns/PDU.",
+         name, what, iterations, secs, iterations / secs,
+         secs * 1e9 / iterations);
+}
+
+
+static void bench(const char *name, SMPP_PDU *pdu)
+{
+    Octstr *os, *data;
+    SMPP_PDU *copy;
+    double start;
+    long i;
+
+    /* encode into a reused buffer, as done into a connection's outbuf */
+    os = octstr_create("");
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        octstr_truncate(os, 0);
+        smpp_pdu_pack_append(NULL, pdu, os);
+    }
+    report(name, "encode", start);
+    octstr_destroy(os);
+
+    os = smpp_pdu_pack(NULL, pdu);
+    data = octstr_copy(os, 4, octstr_len(os) - 4);
+    start = now();
+    for (i = 0; i < iterations; ++i) {
+        copy = smpp_pdu_unpack(NULL, data);
+        smpp_pdu_destroy(copy);
+    }
+    report(name, "decode", start);
+    octstr_destroy(data);
+    octstr_destroy(os);
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_smpp_pdu [-v level] [-n iterations]");
+}
+
+
+int main(int argc, char **argv)
+{
+    SMPP_PDU *submit, *deliver;
+    int opt, ret = 0;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "hv:n:")) != EOF) {
+        switch (opt) {
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'h':
+            help();
+            exit(0);
+        default:
+            error(0, "Invalid option %c", opt);
+            help();
+            panic(0, "Stopping.");
+        }
+    }
+    if (iterations <= 0)
+        panic(0, "Number of iterations must be positive.");
+
+    submit = make_submit_sm();
+    deliver = make_deliver_sm();
+
+    if (check_roundtrip("submit_sm", submit) == -1 ||
+        check_roundtrip("deliver_sm", deliver) == -1)
+        ret = 1;
+    else {
+        bench("submit_sm", submit);
+        bench("deliver_sm", deliver);
+    }
+
+    smpp_pdu_destroy(submit);
+    smpp_pdu_destroy(deliver);
+
+    gwlib_shutdown();
+    return ret;
+}
@@ -67,10 +67,12 @@
 
 static int counter = 0;
 
-static void print_msg(Msg *msg)
+static int print_msg(Msg *msg)
 {   
     counter++;
     msg_dump(msg, 0);
+    msg_destroy(msg);
+    return 0;
 }
 
 /* void function to make gwlib happy */
@@ -0,0 +1,196 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2014 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_timers.c - benchmark Timerset with lots of concurrent timers
+ *
+ * Starts a number of timers (a million by default) with random
+ * intervals, starts all of them again with new intervals, stops half
+ * of them and waits for the rest to elapse. Prints the time taken per
+ * operation and how late the timers elapsed.
+ */
+
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-timer.h"
+
+struct item {
+    Timer *timer;
+    long long due;
+};
+
+static Histogram *lateness;
+
+
+static long long now_usec(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+static void elapse(void *data)
+{
+    struct item *item = data;
+    long long late;
+
+    late = now_usec() - item->due;
+    histogram_record(lateness, late > 0 ? late : 0);
+}
+
+
+static void report(const char *what, long count, long long start)
+{
+    long long usec = now_usec() - start;
+
+    info(0, "%s %ld timers: %.3f s, %.0f ns per timer", what, count,
+         usec / 1e6, usec * 1000.0 / count);
+}
+
+
+static void help(void)
+{
+    info(0, "Usage: test_timers [-n timers] [-m max-msec] [-v loglevel]");
+}
+
+
+int main(int argc, char **argv)
+{
+    Timerset *set;
+    struct item *items;
+    long timers = 1000000, max_msec = 5000, msec, i;
+    long long start;
+    int opt;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "hn:m:v:")) != EOF) {
+        switch (opt) {
+        case 'n':
+            timers = atol(optarg);
+            break;
+        case 'm':
+            max_msec = atol(optarg);
+            break;
+        case 'v':
+            log_set_output_level(atoi(optarg));
+            break;
+        case 'h':
+            help();
+            exit(0);
+        default:
+            help();
+            panic(0, "Invalid option.");
+        }
+    }
+    if (timers < 2 || max_msec < 1)
+        panic(0, "Need at least 2 timers and 1 ms.");
+
+    lateness = histogram_create();
+    set = gw_timerset_create();
+    items = gw_malloc(timers * sizeof(*items));
+
+    start = now_usec();
+    for (i = 0; i < timers; i++)
+        items[i].timer = gw_timer_create(set, NULL, elapse);
+    report("Created", timers, start);
+
+    /* start with the maximum interval, so that none elapses meanwhile */
+    start = now_usec();
+    for (i = 0; i < timers; i++) {
+        items[i].due = now_usec() + max_msec * 1000LL;
+        gw_timer_start_ms(items[i].timer, max_msec, &items[i]);
+    }
+    report("Started", timers, start);
+
+    start = now_usec();
+    for (i = 0; i < timers; i++) {
+        msec = 1 + gw_rand() % max_msec;
+        items[i].due = now_usec() + msec * 1000LL;
+        gw_timer_start_ms(items[i].timer, msec, &items[i]);
+    }
+    report("Restarted", timers, start);
+
+    start = now_usec();
+    for (i = 0; i < timers; i += 2)
+        gw_timer_stop(items[i].timer);
+    report("Stopped", timers / 2, start);
+
+    while (gw_timerset_count(set) > 0)
+        gwthread_sleep(0.1);
+
+    info(0, "Elapsed %lu timers, late by 50%% %.3f ms, 99%% %.3f ms, "
+         "99.9%% %.3f ms, max %.3f ms", histogram_count(lateness),
+         histogram_percentile(lateness, 50) / 1e3,
+         histogram_percentile(lateness, 99) / 1e3,
+         histogram_percentile(lateness, 99.9) / 1e3,
+         histogram_max(lateness) / 1e3);
+
+    start = now_usec();
+    for (i = 0; i < timers; i++)
+        gw_timer_destroy(items[i].timer);
+    report("Destroyed", timers, start);
+
+    gw_free(items);
+    gw_timerset_destroy(set);
+    histogram_destroy(lateness);
+    gwlib_shutdown();
+    return 0;
+}
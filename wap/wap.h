@@ -139,11 +139,14 @@ void wap_shutdown(void);
  *
  * Timer_freq is the timer 'tick' used. All wtp responder timers are 
  * multiplies of this value.
+ *
+ * Shards is the number of threads running responder machines. Events of
+ * one address tuple are always handled by the same thread, in order.
  */
 void wtp_resp_init(wap_dispatch_func_t *datagram_dispatch,
                    wap_dispatch_func_t *session_dispatch,
                    wap_dispatch_func_t *push_dispatch, 
-                   long timer_freq);
+                   long timer_freq, long shards);
 void wtp_resp_dispatch_event(WAPEvent *event);
 void wtp_resp_shutdown(void);
 
@@ -219,14 +222,23 @@ void wsp_unit_shutdown(void);
  * and events of these types to the WTP Initiator layer:
  *
  *   (none yet)
+ *
+ * Shards is the number of threads running session machines. Events of
+ * one address tuple or session are always handled by the same thread,
+ * in order.
  */
 void wsp_session_init(wap_dispatch_func_t *responder_dispatch,
 		      wap_dispatch_func_t *initiator_dispatch,
                       wap_dispatch_func_t *application_dispatch,
-                      wap_dispatch_func_t *ota_dispatch);
+                      wap_dispatch_func_t *ota_dispatch, long shards);
 void wsp_session_dispatch_event(WAPEvent *event);
 void wsp_session_shutdown(void);
 
+/*
+ * Return the number of WSP sessions alive.
+ */
+long wsp_session_count(void);
+
 
 /*
  * Session layer, connection-oriented mode, client side
@@ -122,6 +122,38 @@ int wap_addr_tuple_same(WAPAddrTuple *a, WAPAddrTuple *b)
 }
 
 
+/*
+ * The key holds exactly what wap_addr_tuple_same compares, so tuples
+ * have equal keys if and only if they are the same.
+ */
+Octstr *wap_addr_tuple_key(WAPAddrTuple *tuple)
+{
+    Octstr *key;
+
+    key = octstr_create_from_data((char *) &tuple->remote->iaddr,
+                                  sizeof(tuple->remote->iaddr));
+    octstr_append_data(key, (char *) &tuple->remote->port,
+                       sizeof(tuple->remote->port));
+    octstr_append_data(key, (char *) &tuple->local->iaddr,
+                       sizeof(tuple->local->iaddr));
+    octstr_append_data(key, (char *) &tuple->local->port,
+                       sizeof(tuple->local->port));
+    return key;
+}
+
+
+unsigned long wap_addr_tuple_hash(WAPAddrTuple *tuple)
+{
+    unsigned long h;
+
+    h = (unsigned long) tuple->remote->iaddr * 2654435761UL;
+    h ^= (unsigned long) tuple->remote->port * 40503UL;
+    h ^= (unsigned long) tuple->local->iaddr * 2246822519UL;
+    h ^= (unsigned long) tuple->local->port;
+    return h ^ (h >> 16);
+}
+
+
 WAPAddrTuple *wap_addr_tuple_duplicate(WAPAddrTuple *tuple) 
 {
     if (tuple == NULL)
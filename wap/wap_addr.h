@@ -84,6 +84,19 @@ WAPAddrTuple *wap_addr_tuple_create(Octstr *rmt_addr, long rmt_port,
 void wap_addr_tuple_destroy(WAPAddrTuple *tuple);
 int wap_addr_tuple_same(WAPAddrTuple *a, WAPAddrTuple *b);
 WAPAddrTuple *wap_addr_tuple_duplicate(WAPAddrTuple *tuple);
+
+/*
+ * Return a binary key for hashing the tuple, equal for tuples which
+ * wap_addr_tuple_same considers the same. The caller destroys it.
+ */
+Octstr *wap_addr_tuple_key(WAPAddrTuple *tuple);
+
+/*
+ * Return a hash value of the tuple, equal for tuples which
+ * wap_addr_tuple_same considers the same.
+ */
+unsigned long wap_addr_tuple_hash(WAPAddrTuple *tuple);
+
 void wap_addr_tuple_dump(WAPAddrTuple *tuple);
 
 #endif
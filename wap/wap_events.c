@@ -68,6 +68,31 @@
 #include "wap_events.h"
 #include "wtls_pdu.h"
 
+static List *octstr_list_duplicate(List *list)
+{
+	List *new;
+	long i;
+
+	if (list == NULL)
+		return NULL;
+
+	new = gwlist_create();
+	for (i = 0; i < gwlist_len(list); i++)
+		gwlist_append(new, octstr_duplicate(gwlist_get(list, i)));
+	return new;
+}
+
+
+static void octstr_list_dump(const char *name, List *list)
+{
+	long i;
+
+	debug("wap.event", 0, "%s =", name);
+	for (i = 0; i < gwlist_len(list); i++)
+		octstr_dump(gwlist_get(list, i), 1);
+}
+
+
 WAPEvent *wap_event_create_real(WAPEventName type, const char *file, long line,
                                 const char *func) {
 	WAPEvent *event;
@@ -90,6 +115,7 @@ WAPEvent *wap_event_create_real(WAPEventName type, const char *file, long line,
 	#define HTTPHEADER(name) p->name = NULL;
 	#define ADDRTUPLE(name) p->name = NULL;
 	#define CAPABILITIES(name) p->name = NULL;
+	#define OCTSTRLIST(name) p->name = NULL;
 	#include "wap_events.def"
 	default:
 		panic(0, "Unknown WAP event type %d", event->type);
@@ -119,6 +145,7 @@ void wap_event_destroy(WAPEvent *event) {
 	#define HTTPHEADER(name) http_destroy_headers(p->name);
 	#define ADDRTUPLE(name) wap_addr_tuple_destroy(p->name);
 	#define CAPABILITIES(name) wsp_cap_destroy_list(p->name);
+	#define OCTSTRLIST(name) gwlist_destroy(p->name, octstr_destroy_item);
 	#include "wap_events.def"
 	default:
 		panic(0, "Unknown WAPEvent type %d", (int) event->type);
@@ -157,6 +184,7 @@ WAPEvent *wap_event_duplicate(WAPEvent *event) {
 	#define HTTPHEADER(name) p->name = http_header_duplicate(q->name);
 	#define ADDRTUPLE(name) p->name = wap_addr_tuple_duplicate(q->name);
 	#define CAPABILITIES(name) p->name = wsp_cap_duplicate_list(q->name);
+	#define OCTSTRLIST(name) p->name = octstr_list_duplicate(q->name);
 	#include "wap_events.def"
 	default:
 		panic(0, "Unknown WAP event type %d", event->type);
@@ -208,6 +236,11 @@ void wap_event_dump(WAPEvent *event) {
 			    http_header_dump(p->name);
 		#define ADDRTUPLE(name)     wap_addr_tuple_dump(p->name);
 		#define CAPABILITIES(name)  wsp_cap_dump_list(p->name);
+		#define OCTSTRLIST(name) \
+			if (p->name == NULL) \
+				debug("wap.event", 0, "%s = NULL", #name); \
+			else \
+				octstr_list_dump(#name, p->name);
 		#include "wap_events.def"
 		default:
 			debug("wap.event", 0, "Unknown type");
@@ -238,6 +271,7 @@ void wap_event_assert(WAPEvent *event) {
 #define ADDRTUPLE(name) \
 	gw_assert(p->name != NULL);
 #define CAPABILITIES(name)
+#define OCTSTRLIST(name)
 #include "wap_events.def"
 	default:
 		debug("wap.event", 0, "Unknown type");
@@ -96,6 +96,7 @@ struct WAPEvent {
 	#define WTLSPDUS(name) List *name;
 	#define ADDRTUPLE(name) WAPAddrTuple *name;
 	#define CAPABILITIES(name) List *name;
+	#define OCTSTRLIST(name) List *name; /* May be NULL */
 	#include "wap_events.def"
 	} u;
 };
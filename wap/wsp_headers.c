@@ -1027,8 +1027,33 @@ error:
     return NULL;
 }
 
-void wsp_unpack_well_known_field(List *unpacked, int field_type,
-                                 ParseContext *context)
+/*
+ * Emit one decoded header.  Decoded headers go either into a header list,
+ * as single "Name: value" lines built without a format pass, or as
+ * lines terminated by `eol' straight into a text buffer.
+ */
+static void unpack_header(List *unpacked, Octstr *text, const char *eol,
+                          const char *name, const char *value)
+{
+    Octstr *line;
+
+    if (text != NULL) {
+        octstr_append_cstr(text, name);
+        octstr_append_data(text, ": ", 2);
+        octstr_append_cstr(text, value);
+        octstr_append_cstr(text, eol);
+        return;
+    }
+
+    line = octstr_create(name);
+    octstr_append_data(line, ": ", 2);
+    octstr_append_cstr(line, value);
+    gwlist_append(unpacked, line);
+}
+
+static void unpack_well_known_field(List *unpacked, Octstr *text,
+                                    const char *eol, int field_type,
+                                    ParseContext *context)
 {
     int val, ret;
     unsigned char *headername = NULL;
@@ -1299,7 +1324,7 @@ void wsp_unpack_well_known_field(List *unpacked, int field_type,
         goto value_error;
     }
 
-    http_header_add(unpacked, (char *)headername,(char *) ch);
+    unpack_header(unpacked, text, eol, (char *)headername, (char *)ch);
     octstr_destroy(decoded);
     return;
 
@@ -1308,7 +1333,14 @@ value_error:
     octstr_destroy(decoded);
 }
 
-void wsp_unpack_app_header(List *unpacked, ParseContext *context)
+void wsp_unpack_well_known_field(List *unpacked, int field_type,
+                                 ParseContext *context)
+{
+    unpack_well_known_field(unpacked, NULL, NULL, field_type, context);
+}
+
+static void unpack_app_header(List *unpacked, Octstr *text,
+                              const char *eol, ParseContext *context)
 {
     Octstr *header = NULL;
     Octstr *value = NULL;
@@ -1317,8 +1349,8 @@ void wsp_unpack_app_header(List *unpacked, ParseContext *context)
     value = parse_get_nul_string(context);
 
     if (header && value) {
-        http_header_add(unpacked, octstr_get_cstr(header),
-                        octstr_get_cstr(value));
+        unpack_header(unpacked, text, eol, octstr_get_cstr(header),
+                      octstr_get_cstr(value));
     }
 
     if (parse_error(context))
@@ -1328,14 +1360,18 @@ void wsp_unpack_app_header(List *unpacked, ParseContext *context)
     octstr_destroy(value);
 }
 
-List *wsp_headers_unpack(Octstr *headers, int content_type_present)
+void wsp_unpack_app_header(List *unpacked, ParseContext *context)
+{
+    unpack_app_header(unpacked, NULL, NULL, context);
+}
+
+static void unpack_headers(List *unpacked, Octstr *text, const char *eol,
+                           Octstr *headers, int content_type_present)
 {
     ParseContext *context;
     int byte;
-    List *unpacked;
     int code_page;
 
-    unpacked = http_create_empty_headers();
     context = parse_context_create(headers);
 
     if (octstr_len(headers) > 0) {
@@ -1344,8 +1380,8 @@ List *wsp_headers_unpack(Octstr *headers, int content_type_present)
     }
 
     if (content_type_present)
-        wsp_unpack_well_known_field(unpacked,
-                                    WSP_HEADER_CONTENT_TYPE, context);
+        unpack_well_known_field(unpacked, text, eol,
+                                WSP_HEADER_CONTENT_TYPE, context);
 
     code_page = 1;   /* default */
 
@@ -1367,7 +1403,8 @@ List *wsp_headers_unpack(Octstr *headers, int content_type_present)
             }
         } else if (byte >= 128) {  /* well-known-header */
             if (code_page == 1)
-                wsp_unpack_well_known_field(unpacked, byte - 128, context);
+                unpack_well_known_field(unpacked, text, eol, byte - 128,
+                                        context);
             else {
                 debug("wsp", 0, "Skipping field 0x%02x.", byte);
                 wsp_skip_field_value(context);
@@ -1375,14 +1412,14 @@ List *wsp_headers_unpack(Octstr *headers, int content_type_present)
         } else if (byte > 31 && byte < 127) {
             /* Un-parse the character we just read */
             parse_skip(context, -1);
-            wsp_unpack_app_header(unpacked, context);
+            unpack_app_header(unpacked, text, eol, context);
         } else {
             warning(0, "Unsupported token or header (start 0x%x)", byte);
             break;
         }
     }
 
-    if (gwlist_len(unpacked) > 0) {
+    if (unpacked != NULL && gwlist_len(unpacked) > 0) {
         long i;
 
         debug("wsp", 0, "WSP: decoded headers:");
@@ -1391,12 +1428,30 @@ List *wsp_headers_unpack(Octstr *headers, int content_type_present)
             debug("wsp", 0, "%s", octstr_get_cstr(header));
         }
         debug("wsp", 0, "WSP: End of decoded headers.");
+    } else if (text != NULL && octstr_len(text) > 0) {
+        debug("wsp", 0, "WSP: decoded headers:");
+        debug("wsp", 0, "%s", octstr_get_cstr(text));
+        debug("wsp", 0, "WSP: End of decoded headers.");
     }
 
     parse_context_destroy(context);
+}
+
+List *wsp_headers_unpack(Octstr *headers, int content_type_present)
+{
+    List *unpacked;
+
+    unpacked = http_create_empty_headers();
+    unpack_headers(unpacked, NULL, NULL, headers, content_type_present);
     return unpacked;
 }
 
+void wsp_headers_unpack_text(Octstr *text, Octstr *headers,
+                             int content_type_present, const char *eol)
+{
+    unpack_headers(NULL, text, eol, headers, content_type_present);
+}
+
 
 /**********************************************************************/
 /* Start of header packing code (HTTP to WSP)                         */
@@ -2962,21 +3017,35 @@ int wsp_pack_application_header(Octstr *packed,
 
 Octstr *wsp_headers_pack(List *headers, int separate_content_type, int wsp_version)
 {
-    Octstr *packed;
-    long i, len;
+    Octstr *packed, *line, *fieldname, *value;
+    long i, len, colon, fieldnum;
     int errors;
 
     packed = octstr_create("");
     if (separate_content_type)
         wsp_pack_separate_content_type(packed, headers);
 
+    /*
+     * Split each header line into the same two buffers, instead of
+     * copying the name and value into new ones as http_header_get does.
+     */
+    fieldname = octstr_create("");
+    value = octstr_create("");
     len = gwlist_len(headers);
     for (i = 0; i < len; i++) {
-        Octstr *fieldname;
-        Octstr *value;
-        long fieldnum;
-
-        http_header_get(headers, i, &fieldname, &value);
+        line = gwlist_get(headers, i);
+        octstr_truncate(fieldname, 0);
+        octstr_truncate(value, 0);
+        if ((colon = octstr_search_char(line, ':', 0)) == -1) {
+            error(0, "HTTP: Header does not contain a colon. BAD.");
+            octstr_append_cstr(fieldname, "X-Unknown");
+            octstr_append(value, line);
+        } else {
+            octstr_append_data(fieldname, octstr_get_cstr(line), colon);
+            octstr_append_data(value, octstr_get_cstr(line) + colon + 1,
+                               octstr_len(line) - colon - 1);
+            octstr_strip_blanks(value);
+        }
         /* XXX we need to obey which WSP encoding-version to use */
         /* fieldnum = wsp_string_to_header(fieldname); */
         fieldnum = wsp_string_to_versioned_header(fieldname, wsp_version);
@@ -2998,10 +3067,9 @@ Octstr *wsp_headers_pack(List *headers, int separate_content_type, int wsp_versi
             warning(0, "Skipping header: %s: %s",
                     octstr_get_cstr(fieldname),
                     octstr_get_cstr(value));
-
-        octstr_destroy(fieldname);
-        octstr_destroy(value);
     }
+    octstr_destroy(fieldname);
+    octstr_destroy(value);
 
     /*
     http_header_dump(headers);
@@ -165,6 +165,12 @@ void wsp_pack_long_integer(Octstr *packed, unsigned long integer);
  */
 List *wsp_headers_unpack(Octstr *headers, int content_type);
 
+/* Like wsp_headers_unpack, but append the decoded headers to `text' as
+ * header lines, each terminated by `eol' ("\r\n" for HTTP), without
+ * building a List. */
+void wsp_headers_unpack_text(Octstr *text, Octstr *headers, int content_type,
+                             const char *eol);
+
 /* Take a List of headers, encode them according to the WSP spec,
  * and return the encoded headers as an Octstr. 
  * The second argument is true if the encoded headers should have
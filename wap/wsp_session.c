@@ -119,15 +119,40 @@ static wap_dispatch_func_t *dispatch_to_ota;
 
 static int resume_enabled = 1;
 
-static List *queue = NULL;
-static List *session_machines = NULL;
-static Counter *session_id_counter = NULL;
+/*
+ * The session layer is split into shards, each with a thread handling
+ * the events of its queue and owning the session machines created by it.
+ * Events from WTP go to the shard given by the hash of their address
+ * tuple, events referring to a session by its id to the shard the id
+ * tells: session_id % shard_count. A Resume PDU names the session it
+ * resumes, so it goes by the session id too.
+ *
+ * The sessions of a shard are indexed by session id and by address
+ * tuple. A client may have several sessions for a moment, when it makes
+ * a new Connect, so the tuple index holds a List of sessions for each
+ * tuple, the newest first.
+ */
+typedef struct {
+	List *queue;
+	Dict *sessions_by_id;
+	Dict *sessions_by_addr;
+	Counter *session_id_counter;
+} SessionShard;
+
+static SessionShard *shards = NULL;
+static long shard_count = 0;
+
+/* Number of session machines alive */
+static Counter *session_count = NULL;
+
+enum { SESSIONS_HINT = 1024 };
 
 
-static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu);
+static WSPMachine *find_session_machine(SessionShard *shard, WAPEvent *event,
+                                        WSP_PDU *pdu);
 static void handle_session_event(WSPMachine *machine, WAPEvent *event, 
 				 WSP_PDU *pdu);
-static WSPMachine *machine_create(void);
+static WSPMachine *machine_create(SessionShard *shard, WAPAddrTuple *tuple);
 static void machine_destroy(void *p);
 
 static void handle_method_event(WSPMachine *session, WSPMethodMachine *machine, WAPEvent *event, WSP_PDU *pdu);
@@ -141,7 +166,7 @@ static WSPPushMachine *push_machine_create(WSPMachine *session, long id);
 static void push_machine_destroy(void *p);
 
 static char *state_name(WSPState state);
-static unsigned long next_wsp_session_id(void);
+static unsigned long next_wsp_session_id(WSPMachine *sm);
 
 static List *make_capabilities_reply(WSPMachine *m);
 static List *make_reply_headers(WSPMachine *m);
@@ -150,9 +175,9 @@ static Octstr *make_resume_reply_pdu(WSPMachine *m, List *headers);
 static WSP_PDU *make_confirmedpush_pdu(WAPEvent *e);
 static WSP_PDU *make_push_pdu(WAPEvent *e);
 
-static int transaction_belongs_to_session(void *session, void *tuple);
-static int find_by_session_id(void *session, void *idp);
-static int same_client(void *sm1, void *sm2);
+static WSPMachine *find_by_session_id(SessionShard *shard, long session_id);
+static WSPMachine *find_by_addr_tuple(SessionShard *shard, WAPAddrTuple *tuple);
+static void register_session_id(WSPMachine *sm);
 static WSPMethodMachine *find_method_machine(WSPMachine *, long id);
 static WSPPushMachine *find_push_machine(WSPMachine *m, long id);
 
@@ -180,7 +205,6 @@ static void indicate_pushabort(WSPPushMachine *machine, long reason);
 static void confirm_push(WSPPushMachine *machine);
 
 static void main_thread(void *);
-static int id_belongs_to_session (void *, void *);
 static int wsp_encoding_string_to_version(Octstr *enc);
 static Octstr *wsp_encoding_version_to_string(int version);
 
@@ -193,41 +217,153 @@ static Octstr *wsp_encoding_version_to_string(int version);
 void wsp_session_init(wap_dispatch_func_t *responder_dispatch,
                       wap_dispatch_func_t *initiator_dispatch,
                       wap_dispatch_func_t *application_dispatch,
-                      wap_dispatch_func_t *push_ota_dispatch) {
-	queue = gwlist_create();
-	gwlist_add_producer(queue);
-	session_machines = gwlist_create();
-	session_id_counter = counter_create();
+                      wap_dispatch_func_t *push_ota_dispatch,
+                      long shard_num) {
+	long i;
+
+	shard_count = shard_num > 0 ? shard_num : 1;
+	shards = gw_malloc(shard_count * sizeof(shards[0]));
+	for (i = 0; i < shard_count; i++) {
+		shards[i].queue = gwlist_create();
+		gwlist_add_producer(shards[i].queue);
+		shards[i].sessions_by_id = dict_create(SESSIONS_HINT, NULL);
+		shards[i].sessions_by_addr = dict_create(SESSIONS_HINT, NULL);
+		shards[i].session_id_counter = counter_create();
+	}
+	session_count = counter_create();
 	dispatch_to_wtp_resp = responder_dispatch;
 	dispatch_to_wtp_init = initiator_dispatch;
 	dispatch_to_appl = application_dispatch;
         dispatch_to_ota = push_ota_dispatch;
         wsp_strings_init();
 	run_status = running;
-	gwthread_create(main_thread, NULL);
+	for (i = 0; i < shard_count; i++)
+		gwthread_create(main_thread, &shards[i]);
 }
 
 
 void wsp_session_shutdown(void) {
+	List *keys, *sessions;
+	Octstr *key;
+	long i;
+
 	gw_assert(run_status == running);
 	run_status = terminating;
-	gwlist_remove_producer(queue);
+	for (i = 0; i < shard_count; i++)
+		gwlist_remove_producer(shards[i].queue);
 	gwthread_join_every(main_thread);
 
-	gwlist_destroy(queue, wap_event_destroy_item);
+	for (i = 0; i < shard_count; i++) {
+		gwlist_destroy(shards[i].queue, wap_event_destroy_item);
+
+		keys = dict_keys(shards[i].sessions_by_addr);
+		while ((key = gwlist_extract_first(keys)) != NULL) {
+			sessions = dict_get(shards[i].sessions_by_addr, key);
+			while (sessions != NULL && gwlist_len(sessions) > 0) {
+				machine_destroy(gwlist_get(sessions, 0));
+				sessions = dict_get(shards[i].sessions_by_addr, key);
+			}
+			octstr_destroy(key);
+		}
+		gwlist_destroy(keys, NULL);
+		dict_destroy(shards[i].sessions_by_addr);
+		dict_destroy(shards[i].sessions_by_id);
 
-	debug("wap.wsp", 0, "WSP: %ld session machines left.",
-		gwlist_len(session_machines));
-	gwlist_destroy(session_machines, machine_destroy);
+		counter_destroy(shards[i].session_id_counter);
+	}
+	gw_free(shards);
+	shards = NULL;
 
-	counter_destroy(session_id_counter);
+	debug("wap.wsp", 0, "WSP: %lu session machines left.",
+		counter_value(session_count));
+	counter_destroy(session_count);
+	session_count = NULL;
         wsp_strings_shutdown();
 }
 
 
+/*
+ * Return the session id a TR-Invoke.ind with a Resume PDU refers to,
+ * or -1 if it is not one. Resume PDUs are handled by the shard owning
+ * the session, not by that of the address they come from.
+ */
+static long resume_session_id(WAPEvent *event) {
+	Octstr *data;
+	unsigned long session_id;
+
+	if (event->u.TR_Invoke_Ind.tcl != 2)
+		return -1;
+	data = event->u.TR_Invoke_Ind.user_data;
+	if (octstr_len(data) < 2 || octstr_get_char(data, 0) != 0x09)
+		return -1;
+	if (octstr_extract_uintvar(data, &session_id, 1) == -1)
+		return -1;
+	return session_id;
+}
+
+
+static long event_shard(WAPEvent *event) {
+	WAPAddrTuple *tuple = NULL;
+	long session_id = -1;
+
+	switch (event->type) {
+	case TR_Invoke_Ind:
+		session_id = resume_session_id(event);
+		tuple = event->u.TR_Invoke_Ind.addr_tuple;
+		break;
+	case TR_Invoke_Cnf:
+		tuple = event->u.TR_Invoke_Cnf.addr_tuple;
+		break;
+	case TR_Result_Cnf:
+		tuple = event->u.TR_Result_Cnf.addr_tuple;
+		break;
+	case TR_Abort_Ind:
+		tuple = event->u.TR_Abort_Ind.addr_tuple;
+		break;
+	case S_Connect_Res:
+		session_id = event->u.S_Connect_Res.session_id;
+		break;
+	case S_Resume_Res:
+		session_id = event->u.S_Resume_Res.session_id;
+		break;
+	case Disconnect_Event:
+		session_id = event->u.Disconnect_Event.session_handle;
+		break;
+	case Suspend_Event:
+		session_id = event->u.Suspend_Event.session_handle;
+		break;
+	case S_MethodInvoke_Res:
+		session_id = event->u.S_MethodInvoke_Res.session_id;
+		break;
+	case S_MethodResult_Req:
+		session_id = event->u.S_MethodResult_Req.session_id;
+		break;
+	case S_ConfirmedPush_Req:
+		session_id = event->u.S_ConfirmedPush_Req.session_id;
+		break;
+	case S_Push_Req:
+		session_id = event->u.S_Push_Req.session_id;
+		break;
+	default:
+		break;
+	}
+
+	if (session_id >= 0)
+		return session_id % shard_count;
+	if (tuple != NULL)
+		return wap_addr_tuple_hash(tuple) % shard_count;
+	return 0;
+}
+
+
 void wsp_session_dispatch_event(WAPEvent *event) {
 	wap_event_assert(event);
-	gwlist_produce(queue, event);
+	gwlist_produce(shards[event_shard(event)].queue, event);
+}
+
+
+long wsp_session_count(void) {
+	return session_count != NULL ? (long) counter_value(session_count) : 0;
 }
 
 
@@ -237,11 +373,13 @@ void wsp_session_dispatch_event(WAPEvent *event) {
 
 
 static void main_thread(void *arg) {
+	SessionShard *shard = arg;
 	WAPEvent *e;
 	WSPMachine *sm;
 	WSP_PDU *pdu;
 	
-	while (run_status == running && (e = gwlist_consume(queue)) != NULL) {
+	while (run_status == running &&
+	       (e = gwlist_consume(shard->queue)) != NULL) {
 		wap_event_assert(e);
 		switch (e->type) {
 		case TR_Invoke_Ind:
@@ -258,7 +396,7 @@ static void main_thread(void *arg) {
 			break;
 		}
 	
-		sm = find_session_machine(e, pdu);
+		sm = find_session_machine(shard, e, pdu);
 		if (sm == NULL) {
 			wap_event_destroy(e);
 		} else {
@@ -270,7 +408,8 @@ static void main_thread(void *arg) {
 }
 
 
-static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
+static WSPMachine *find_session_machine(SessionShard *shard, WAPEvent *event,
+                                        WSP_PDU *pdu) {
 	WSPMachine *sm;
 	long session_id;
 	WAPAddrTuple *tuple;
@@ -350,9 +489,8 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 			/* Create a new session, even if there is already
 			 * a session open for this address.  The new session
 			 * will take care of killing the old ones. */
-			sm = machine_create();
 			gw_assert(tuple != NULL);
-			sm->addr_tuple = wap_addr_tuple_duplicate(tuple);
+			sm = machine_create(shard, tuple);
 			sm->connect_handle = event->u.TR_Invoke_Ind.handle;
 	/* Third test is for class 2 TR-Invoke.ind with Resume PDU */
 	} else if (event->type == TR_Invoke_Ind &&
@@ -361,8 +499,7 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 		/* Pass to session identified by session id, not
 		 * the address tuple. */
 		session_id = pdu->u.Resume.sessionid;
-		sm = gwlist_search(session_machines, &session_id,
-				find_by_session_id);
+		sm = find_by_session_id(shard, session_id);
 		if (sm == NULL) {
 			/* No session; TR-Abort.req(DISCONNECT) */
 			send_abort(WSP_ABORT_DISCONNECT,
@@ -373,8 +510,7 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 	 * TR-Invoke.ind here by ignoring them; this seems to be
 	 * an omission in the spec table. */
 	} else if (event->type == TR_Invoke_Ind) {
-		sm = gwlist_search(session_machines, tuple,
-				 transaction_belongs_to_session);
+		sm = find_by_addr_tuple(shard, tuple);
 		if (sm == NULL && (event->u.TR_Invoke_Ind.tcl == 1 ||
 				event->u.TR_Invoke_Ind.tcl == 2)) {
 			send_abort(WSP_ABORT_DISCONNECT,
@@ -384,11 +520,9 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 	 * do those later, after we've tried to handle them. */
 	} else {
 		if (session_id != -1) {
-			sm = gwlist_search(session_machines, &session_id,
-				find_by_session_id);
+			sm = find_by_session_id(shard, session_id);
 		} else {
-			sm = gwlist_search(session_machines, tuple,
-				transaction_belongs_to_session);
+			sm = find_by_addr_tuple(shard, tuple);
 		}
 		/* The table doesn't really say what we should do with
 		 * non-Invoke events for which there is no session.  But
@@ -480,8 +614,10 @@ static void cant_handle_event(WSPMachine *sm, WAPEvent *event) {
 }
 
 
-static WSPMachine *machine_create(void) {
+static WSPMachine *machine_create(SessionShard *shard, WAPAddrTuple *tuple) {
 	WSPMachine *p;
+	List *sessions;
+	Octstr *key;
 	
 	p = gw_malloc(sizeof(WSPMachine));
 	debug("wap.wsp", 0, "WSP: Created WSPMachine %p", (void *) p);
@@ -504,11 +640,20 @@ static WSPMachine *machine_create(void) {
 	p->client_SDU_size = 1400;
 	p->MOR_push = 1;
 	
-	/* Insert new machine at the _front_, because 1) it's more likely
-	 * to get events than old machines are, so this speeds up the linear
-	 * search, and 2) we want the newest machine to get any method
-	 * invokes that come through before the Connect is established. */
-	gwlist_insert(session_machines, 0, p);
+	p->shard = shard - shards;
+	p->addr_tuple = wap_addr_tuple_duplicate(tuple);
+
+	/* Insert new machine at the _front_ of the ones of its tuple,
+	 * because we want the newest machine to get any method invokes
+	 * that come through before the Connect is established. */
+	key = wap_addr_tuple_key(tuple);
+	if ((sessions = dict_get(shard->sessions_by_addr, key)) == NULL) {
+		sessions = gwlist_create();
+		dict_put(shard->sessions_by_addr, key, sessions);
+	}
+	gwlist_insert(sessions, 0, p);
+	octstr_destroy(key);
+	counter_increase(session_count);
 
 	return p;
 }
@@ -534,10 +679,28 @@ static void destroy_pushmachines(List *machines) {
 
 static void machine_destroy(void *pp) {
 	WSPMachine *p;
+	SessionShard *shard;
+	List *sessions;
+	Octstr *key;
 	
 	p = pp;
 	debug("wap.wsp", 0, "Destroying WSPMachine %p", pp);
-	gwlist_delete_equal(session_machines, p);
+	shard = &shards[p->shard];
+	key = octstr_create_from_data((char *) &p->session_id,
+	                              sizeof(p->session_id));
+	if (dict_get(shard->sessions_by_id, key) == p)
+		dict_remove(shard->sessions_by_id, key);
+	octstr_destroy(key);
+	key = wap_addr_tuple_key(p->addr_tuple);
+	if ((sessions = dict_get(shard->sessions_by_addr, key)) != NULL) {
+		gwlist_delete_equal(sessions, p);
+		if (gwlist_len(sessions) == 0) {
+			dict_remove(shard->sessions_by_addr, key);
+			gwlist_destroy(sessions, NULL);
+		}
+	}
+	octstr_destroy(key);
+	counter_decrease(session_count);
 
 	#define INTEGER(name) p->name = 0;
 	#define OCTSTR(name) octstr_destroy(p->name);
@@ -746,8 +909,26 @@ static char *state_name(WSPState state) {
 }
 
 
-static unsigned long next_wsp_session_id(void) {
-	return counter_increase(session_id_counter);
+/*
+ * Session ids tell the shard of the session, so that the application
+ * can refer to it by the id alone.
+ */
+static unsigned long next_wsp_session_id(WSPMachine *sm) {
+	return counter_increase(shards[sm->shard].session_id_counter) *
+	       shard_count + sm->shard;
+}
+
+
+/*
+ * Enter the session in the index by session id, once it has one.
+ */
+static void register_session_id(WSPMachine *sm) {
+	Octstr *key;
+
+	key = octstr_create_from_data((char *) &sm->session_id,
+	                              sizeof(sm->session_id));
+	dict_put(shards[sm->shard].sessions_by_id, key, sm);
+	octstr_destroy(key);
 }
 
 
@@ -1134,22 +1315,30 @@ static WSP_PDU *make_push_pdu(WAPEvent *e)
         return pdu;
 }
 
-static int transaction_belongs_to_session(void *wsp_ptr, void *tuple_ptr) {
-	WSPMachine *wsp;
-	WAPAddrTuple *tuple;
-	
-	wsp = wsp_ptr;
-	tuple = tuple_ptr;
+/*
+ * Return the newest session of the address tuple.
+ */
+static WSPMachine *find_by_addr_tuple(SessionShard *shard, WAPAddrTuple *tuple) {
+	List *sessions;
+	Octstr *key;
+
+	key = wap_addr_tuple_key(tuple);
+	sessions = dict_get(shard->sessions_by_addr, key);
+	octstr_destroy(key);
 
-	return wap_addr_tuple_same(wsp->addr_tuple, tuple);
+	return sessions != NULL ? gwlist_get(sessions, 0) : NULL;
 }
 
 
-static int find_by_session_id(void *wsp_ptr, void *id_ptr) {
-	WSPMachine *wsp = wsp_ptr;
-	long *idp = id_ptr;
-	
-	return wsp->session_id == *idp;
+static WSPMachine *find_by_session_id(SessionShard *shard, long session_id) {
+	WSPMachine *sm;
+	Octstr *key;
+
+	key = octstr_create_from_data((char *) &session_id, sizeof(session_id));
+	sm = dict_get(shard->sessions_by_id, key);
+	octstr_destroy(key);
+
+	return sm;
 }
 
 
@@ -1176,25 +1365,26 @@ static WSPPushMachine *find_push_machine(WSPMachine *m, long id)
        return gwlist_search(m->pushmachines, &id, find_by_push_id);
 }
 
-static int same_client(void *a, void *b) {
-	WSPMachine *sm1, *sm2;
-	
-	sm1 = a;
-	sm2 = b;
-	return wap_addr_tuple_same(sm1->addr_tuple, sm2->addr_tuple);
-}
-
-
 static void disconnect_other_sessions(WSPMachine *sm) {
-	List *old_sessions;
+	List *sessions, *old_sessions;
 	WAPEvent *disconnect;
 	WSPMachine *sm2;
+	Octstr *key;
 	long i;
 
-	old_sessions = gwlist_search_all(session_machines, sm, same_client);
-	if (old_sessions == NULL)
+	key = wap_addr_tuple_key(sm->addr_tuple);
+	sessions = dict_get(shards[sm->shard].sessions_by_addr, key);
+	octstr_destroy(key);
+	if (sessions == NULL)
 		return;
 
+	/* disconnecting removes sessions from the index, take a copy */
+	old_sessions = gwlist_create();
+	gwlist_lock(sessions);
+	for (i = 0; i < gwlist_len(sessions); i++)
+		gwlist_append(old_sessions, gwlist_get(sessions, i));
+	gwlist_unlock(sessions);
+
 	for (i = 0; i < gwlist_len(old_sessions); i++) {
 		sm2 = gwlist_get(old_sessions, i);
 		if (sm2 != sm) {
@@ -1433,19 +1623,9 @@ static void abort_pushes(WSPMachine *sm, long reason)
 
 WSPMachine *find_session_machine_by_id (int id) {
 
-	return gwlist_search(session_machines, &id, id_belongs_to_session);
-}
-
-
-static int id_belongs_to_session (void *wsp_ptr, void *pid) {
-	WSPMachine *wsp;
-	int *id;
-
-	wsp = wsp_ptr;
-	id = (int *) pid;
-
-	if (*id == wsp->session_id) return 1;
-	return 0;
+	if (id < 0)
+		return NULL;
+	return find_by_session_id(&shards[id % shard_count], id);
 }
 
 
@@ -64,9 +64,14 @@
  * use with the C preprocessor, which we abuse liberally to get the
  * interface we want. 
  *
+ * Lookups go through perfect hash indexes built at initialization, so
+ * they take constant time however long the tables are.
+ *
  * Richard Braakman
  */
 
+#include <ctype.h>
+
 #include "gwlib/gwlib.h"
 #include "wsp_strings.h"
 
@@ -74,6 +79,20 @@
 
 static int initialized;
 
+/* A perfect hash index over the distinct keys of a table, built with
+ * the hash and displace method.  The keys are spread into buckets by a
+ * first hash, then each bucket, largest first, is given a displacement
+ * that moves all of its keys into slots not yet taken.  A slot holds the
+ * number of the first entry with its key, plus one; 0 marks a free slot.
+ */
+struct index
+{
+    unsigned long bucket_mask;
+    unsigned long *displacements;   /* One for each bucket */
+    unsigned long slot_mask;
+    long *slots;
+};
+
 /* The arrays in a table structure are all of equal length, and their
  * elements correspond.  The number for string 0 is in numbers[0], etc.
  * Table structures are initialized dynamically.
@@ -85,6 +104,9 @@ struct table
     long *numbers;      /* Assigned numbers, or NULL for linear tables */
     int *versions;      /* WSP Encoding-versions, or NULL if non-versioned */
     int linear;	        /* True for tables defined as LINEAR */
+    long *same_string;  /* Next entry with the same string, or -1 */
+    struct index by_string;
+    struct index by_number;     /* Only for numbered tables */
 };
 
 struct numbered_element
@@ -105,6 +127,12 @@ static Octstr *number_to_string(long number, struct table *table);
 static unsigned char *number_to_cstr(long number, struct table *table);
 static long string_to_number(Octstr *ostr, struct table *table);
 static long string_to_versioned_number(Octstr *ostr, struct table *table, int version);
+static void hash_string(Octstr *ostr, unsigned long *h1, unsigned long *h2);
+static void hash_number(long number, unsigned long *h1, unsigned long *h2);
+static long find_string(struct table *table, Octstr *ostr);
+static long find_number(struct table *table, long number);
+static void build_indexes(struct table *table);
+static void destroy_index(struct index *index);
 
 
 /* Declare the data.  For each table "foo", create a foo_strings array
@@ -157,10 +185,8 @@ static Octstr *number_to_string(long number, struct table *table)
         if (number >= 0 && number < table->size)
             return octstr_duplicate(table->strings[number]);
     } else {
-        for (i = 0; i < table->size; i++) {
-            if (table->numbers[i] == number)
-                return octstr_duplicate(table->strings[i]);
-        }
+        if ((i = find_number(table, number)) >= 0)
+            return octstr_duplicate(table->strings[i]);
     }
     return NULL;
 }
@@ -175,10 +201,8 @@ static unsigned char *number_to_cstr(long number, struct table *table)
 	if (number >= 0 && number < table->size)
 	    return (unsigned char *)octstr_get_cstr(table->strings[number]);
     } else {
-	for (i = 0; i < table->size; i++) {
-   	     if (table->numbers[i] == number)
-		return (unsigned char *)octstr_get_cstr(table->strings[i]);
-	}
+	if ((i = find_number(table, number)) >= 0)
+	    return (unsigned char *)octstr_get_cstr(table->strings[i]);
     }
     return NULL;
 }
@@ -190,11 +214,8 @@ static long string_to_number(Octstr *ostr, struct table *table)
 
     gw_assert(initialized);
 
-    for (i = 0; i < table->size; i++) {
-	if (octstr_case_compare(ostr, table->strings[i]) == 0) {
-	    return table->linear ? i : table->numbers[i];
-	}
-    }
+    if ((i = find_string(table, ostr)) >= 0)
+	return table->linear ? i : table->numbers[i];
 
     return -1;
 }
@@ -207,13 +228,11 @@ static long string_to_versioned_number(Octstr *ostr, struct table *table,
 
     gw_assert(initialized);
 
-    /* walk the whole table and pick the highest versioned token */
+    /* walk all entries of the string and pick the highest versioned token */
     ret = -1;
-    for (i = 0; i < table->size; i++) {
-        if (octstr_case_compare(ostr, table->strings[i]) == 0 &&
-            table->versions[i] <= version) {
-                ret = table->linear ? i : table->numbers[i];
-        }
+    for (i = find_string(table, ostr); i >= 0; i = table->same_string[i]) {
+        if (table->versions[i] <= version)
+            ret = table->linear ? i : table->numbers[i];
     }
 
     debug("wsp.strings",0,"WSP: Mapping `%s', WSP 1.%d to 0x%04lx.", 
@@ -222,6 +241,219 @@ static long string_to_versioned_number(Octstr *ostr, struct table *table,
     return ret;
 }
 
+/* Two hashes of a string, ignoring case, computed in one pass. */
+static void hash_string(Octstr *ostr, unsigned long *h1, unsigned long *h2)
+{
+    const unsigned char *data;
+    unsigned long a, b;
+    long i, len;
+
+    data = (const unsigned char *) octstr_get_cstr(ostr);
+    len = octstr_len(ostr);
+    a = 2166136261UL;
+    b = 5381;
+    for (i = 0; i < len; i++) {
+        a = ((a ^ tolower(data[i])) * 16777619UL) & 0xffffffffUL;
+        b = ((b * 33) ^ tolower(data[i])) & 0xffffffffUL;
+    }
+    *h1 = a ^ (a >> 16);
+    *h2 = b ^ (b >> 13);
+}
+
+/* Two hashes of a number. */
+static void hash_number(long number, unsigned long *h1, unsigned long *h2)
+{
+    unsigned long x;
+
+    x = (unsigned long) number & 0xffffffffUL;
+    x = ((x ^ (x >> 16)) * 0x45d9f3bUL) & 0xffffffffUL;
+    *h1 = x ^ (x >> 16);
+    x = ((*h1 ^ 0x9e3779b9UL) * 0x2c1b3c6dUL) & 0xffffffffUL;
+    *h2 = x ^ (x >> 15);
+}
+
+/* The slot of a key with hashes h1 and h2. */
+static long index_slot(struct index *index, unsigned long h1, unsigned long h2)
+{
+    unsigned long d;
+
+    d = index->displacements[h1 & index->bucket_mask];
+    return (h2 + d * ((h1 >> 16) | 1)) & index->slot_mask;
+}
+
+/* Return the first entry with the string, ignoring case, or -1. */
+static long find_string(struct table *table, Octstr *ostr)
+{
+    unsigned long h1, h2;
+    long i;
+
+    hash_string(ostr, &h1, &h2);
+    i = table->by_string.slots[index_slot(&table->by_string, h1, h2)] - 1;
+    if (i >= 0 && octstr_case_compare(table->strings[i], ostr) == 0)
+        return i;
+    return -1;
+}
+
+/* Return the first entry with the number, or -1. */
+static long find_number(struct table *table, long number)
+{
+    unsigned long h1, h2;
+    long i;
+
+    hash_number(number, &h1, &h2);
+    i = table->by_number.slots[index_slot(&table->by_number, h1, h2)] - 1;
+    if (i >= 0 && table->numbers[i] == number)
+        return i;
+    return -1;
+}
+
+/* Build the index of the given keys, the first entries of each distinct
+ * key of a table.  Returns 0 if a bucket could not be placed, in which
+ * case the caller retries with more slots. */
+static int build_index(struct index *index, long *keys, long nkeys,
+                       unsigned long *h1, unsigned long *h2, long nslots)
+{
+    long nbuckets, i, j, k, *order, *count, *taken;
+    unsigned long b, d;
+
+    for (nbuckets = 1; nbuckets * 2 < nkeys; nbuckets *= 2)
+        ;
+    index->bucket_mask = nbuckets - 1;
+    index->displacements = gw_malloc(nbuckets * sizeof(unsigned long));
+    index->slot_mask = nslots - 1;
+    index->slots = gw_malloc(nslots * sizeof(long));
+    for (i = 0; i < nslots; i++)
+        index->slots[i] = 0;
+
+    /* Sort the keys by bucket, the buckets by decreasing size. */
+    count = gw_malloc(nbuckets * sizeof(long));
+    for (b = 0; b < (unsigned long) nbuckets; b++)
+        count[b] = 0;
+    for (k = 0; k < nkeys; k++)
+        count[h1[k] & index->bucket_mask]++;
+    order = gw_malloc(nkeys * sizeof(long));
+    for (k = 0; k < nkeys; k++)
+        order[k] = k;
+    for (i = 1; i < nkeys; i++) {
+        for (j = i; j > 0; j--) {
+            long x = order[j - 1], y = order[j];
+            unsigned long bx = h1[x] & index->bucket_mask;
+            unsigned long by = h1[y] & index->bucket_mask;
+            if (count[bx] > count[by] || (count[bx] == count[by] && bx <= by))
+                break;
+            order[j - 1] = y;
+            order[j] = x;
+        }
+    }
+
+    taken = gw_malloc(nkeys * sizeof(long));
+    for (i = 0; i < nkeys; i = j) {
+        b = h1[order[i]] & index->bucket_mask;
+        for (j = i; j < nkeys && (h1[order[j]] & index->bucket_mask) == b; j++)
+            ;
+        /* Keys order[i..j-1] are in bucket b, find a displacement. */
+        for (d = 0; d < (unsigned long) nslots; d++) {
+            index->displacements[b] = d;
+            for (k = i; k < j; k++) {
+                taken[k] = index_slot(index, h1[order[k]], h2[order[k]]);
+                if (index->slots[taken[k]] != 0)
+                    break;
+                index->slots[taken[k]] = keys[order[k]] + 1;
+            }
+            if (k == j)
+                break;
+            while (--k >= i)
+                index->slots[taken[k]] = 0;
+        }
+        if (d == (unsigned long) nslots)
+            break;
+    }
+    /* Buckets without keys keep displacement 0. */
+    for (b = 0; b < (unsigned long) nbuckets; b++)
+        if (count[b] == 0)
+            index->displacements[b] = 0;
+
+    gw_free(taken);
+    gw_free(order);
+    gw_free(count);
+
+    if (i < nkeys) {
+        destroy_index(index);
+        return 0;
+    }
+    return 1;
+}
+
+/* Build the string index, the same_string chains and for numbered
+ * tables the number index. */
+static void build_indexes(struct table *table)
+{
+    long *keys, *tail, nkeys, nslots, i, j;
+    unsigned long *h1, *h2;
+
+    table->same_string = gw_malloc(table->size * sizeof(long));
+    tail = gw_malloc(table->size * sizeof(long));
+    keys = gw_malloc(table->size * sizeof(long));
+    h1 = gw_malloc(table->size * sizeof(unsigned long));
+    h2 = gw_malloc(table->size * sizeof(unsigned long));
+
+    /* Distinct strings, later entries with the same one are chained. */
+    nkeys = 0;
+    for (i = 0; i < table->size; i++) {
+        table->same_string[i] = -1;
+        for (j = 0; j < nkeys; j++)
+            if (octstr_case_compare(table->strings[keys[j]],
+                                    table->strings[i]) == 0)
+                break;
+        if (j < nkeys) {
+            table->same_string[tail[j]] = i;
+            tail[j] = i;
+        } else {
+            keys[nkeys] = i;
+            tail[nkeys] = i;
+            hash_string(table->strings[i], &h1[nkeys], &h2[nkeys]);
+            nkeys++;
+        }
+    }
+    for (nslots = 2; nslots < 2 * nkeys; nslots *= 2)
+        ;
+    while (!build_index(&table->by_string, keys, nkeys, h1, h2, nslots))
+        nslots *= 2;
+
+    table->by_number.slots = NULL;
+    table->by_number.displacements = NULL;
+    if (!table->linear) {
+        nkeys = 0;
+        for (i = 0; i < table->size; i++) {
+            for (j = 0; j < nkeys; j++)
+                if (table->numbers[keys[j]] == table->numbers[i])
+                    break;
+            if (j == nkeys) {
+                keys[nkeys] = i;
+                hash_number(table->numbers[i], &h1[nkeys], &h2[nkeys]);
+                nkeys++;
+            }
+        }
+        for (nslots = 2; nslots < 2 * nkeys; nslots *= 2)
+            ;
+        while (!build_index(&table->by_number, keys, nkeys, h1, h2, nslots))
+            nslots *= 2;
+    }
+
+    gw_free(h2);
+    gw_free(h1);
+    gw_free(keys);
+    gw_free(tail);
+}
+
+static void destroy_index(struct index *index)
+{
+    gw_free(index->displacements);
+    gw_free(index->slots);
+    index->displacements = NULL;
+    index->slots = NULL;
+}
+
 static void construct_linear_table(struct table *table, const struct linear_element *strings, 
                                    long size)
 {
@@ -237,6 +469,8 @@ static void construct_linear_table(struct table *table, const struct linear_elem
         table->strings[i] = octstr_imm(strings[i].str);
         table->versions[i] = strings[i].version;
     }
+
+    build_indexes(table);
 }
 
 static void construct_numbered_table(struct table *table, const struct numbered_element *strings, 
@@ -255,6 +489,8 @@ static void construct_numbered_table(struct table *table, const struct numbered_
         table->numbers[i] = strings[i].number;
         table->versions[i] = strings[i].version;
     }
+
+    build_indexes(table);
 }
 
 static void destroy_table(struct table *table)
@@ -264,6 +500,9 @@ static void destroy_table(struct table *table)
     gw_free(table->strings);
     gw_free(table->numbers);
     gw_free(table->versions);
+    gw_free(table->same_string);
+    destroy_index(&table->by_string);
+    destroy_index(&table->by_number);
 }
 
 void wsp_strings_init(void)
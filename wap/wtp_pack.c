@@ -168,7 +168,7 @@ WAPEvent *wtp_pack_sar_result(WTPRespMachine *machine, int psn)
 {
     WAPEvent *dgram = NULL;
     WTP_PDU *pdu = NULL;
-    Octstr *data = NULL;
+    long pos, len;
     int gtr, ttr;
 
     gw_assert(machine->sar && machine->sar->data);
@@ -182,7 +182,14 @@ WAPEvent *wtp_pack_sar_result(WTPRespMachine *machine, int psn)
     if (gtr || ttr) 
         machine->sar->tr = 1;
 
-    data = octstr_copy(machine->sar->data,psn*SAR_SEGM_SIZE,SAR_SEGM_SIZE);
+    /* 
+     * The segment is copied straight from the result into the datagram,
+     * after the header has been packed.
+     */
+    pos = psn * SAR_SEGM_SIZE;
+    len = octstr_len(machine->sar->data) - pos;
+    if (len > SAR_SEGM_SIZE)
+        len = SAR_SEGM_SIZE;
 
     if (!psn) {
         pdu = wtp_pdu_create(Result);
@@ -191,7 +198,6 @@ WAPEvent *wtp_pack_sar_result(WTPRespMachine *machine, int psn)
         pdu->u.Result.ttr = ttr;
         pdu->u.Result.rid = 0;
         pdu->u.Result.tid = send_tid(machine->tid);
-        pdu->u.Result.user_data = data;
     } else {
         pdu = wtp_pdu_create(Segmented_result);
         pdu->u.Segmented_result.con = 0;
@@ -200,13 +206,15 @@ WAPEvent *wtp_pack_sar_result(WTPRespMachine *machine, int psn)
         pdu->u.Segmented_result.rid = 0;
         pdu->u.Segmented_result.tid = send_tid(machine->tid);
         pdu->u.Segmented_result.psn = psn;
-        pdu->u.Segmented_result.user_data = data;
     }
 
     dgram = wap_event_create(T_DUnitdata_Req);
     dgram->u.T_DUnitdata_Req.addr_tuple =
         wap_addr_tuple_duplicate(machine->addr_tuple);
     dgram->u.T_DUnitdata_Req.user_data = wtp_pdu_pack(pdu);
+    if (len > 0)
+        octstr_append_data(dgram->u.T_DUnitdata_Req.user_data,
+                           octstr_get_cstr(machine->sar->data) + pos, len);
     wtp_pdu_destroy(pdu);
 
     return dgram;
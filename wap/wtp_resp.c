@@ -72,15 +72,34 @@
 /***********************************************************************
  * Internal data structures.
  *
- * List of responder WTP machines.
+ * The responder is split into shards, each with a thread of its own
+ * handling the events of its queue. Datagrams go to the shard given by
+ * the hash of their address tuple, everything else by the machine id,
+ * which tells the shard of the machine: mid % resp_shard_count. So all
+ * events of a machine are handled in order by the same thread, and the
+ * machines of a shard are only touched by its thread.
+ *
+ * Responder WTP machines are indexed both by the address tuple and tid
+ * of the transaction and by the machine id, so that finding the machine
+ * for an incoming datagram or a timer does not depend on how many
+ * transactions are going on.
  */
-static List *resp_machines = NULL;
+typedef struct {
+    List *queue;
+    Dict *machines;
+    Dict *machines_by_mid;
+    Counter *mid_counter;
+    long index;
+} RespShard;
 
+static RespShard *resp_shards = NULL;
+static long resp_shard_count = 0;
 
 /*
- * Counter for responder WTP machine id numbers, to make sure they are unique.
+ * Start with room for this many machines per shard, the dicts grow as
+ * needed.
  */
-static Counter *resp_machine_id_counter = NULL;
+enum { RESP_MACHINES_HINT = 1024 };
 
 
 /*
@@ -100,11 +119,6 @@ wap_dispatch_func_t *dispatch_to_wdp;
 wap_dispatch_func_t *dispatch_to_wsp;
 wap_dispatch_func_t *dispatch_to_push;
 
-/*
- * Queue of events to be handled by WTP responder.
- */
-static List *resp_queue = NULL;
-
 /*
  * Timer 'tick'. All wtp responder timer values are multiplies of this one
  */
@@ -117,7 +131,8 @@ static long resp_timer_freq = -1;
  * Create and destroy an uniniatilized wtp responder state machine.
  */
 
-static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid, 
+static WTPRespMachine *resp_machine_create(RespShard *shard,
+                                           WAPAddrTuple *tuple, long tid, 
                                            long tcl);
 static void resp_machine_destroy(void *sm);
 
@@ -133,7 +148,8 @@ static void resp_machine_destroy(void *sm);
  * validated and If the event was RcvAck or RcvAbort, the event is ignored. 
  * If the event is RcvErrorPDU, new machine is created.
  */
-static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event);
+static WTPRespMachine *resp_machine_find_or_create(RespShard *shard,
+                                                   WAPEvent *event);
 
 
 /*
@@ -154,7 +170,8 @@ static char *name_resp_state(int name);
  * addresses and ports and the transaction identifier. Return a pointer to 
  * the machine, or NULL if not found.
  */
-static WTPRespMachine *resp_machine_find(WAPAddrTuple *tuple, long tid, 
+static WTPRespMachine *resp_machine_find(RespShard *shard,
+                                         WAPAddrTuple *tuple, long tid, 
                                          long mid);
 static void main_thread(void *);
 
@@ -182,13 +199,12 @@ static void handle_wrong_version(WAPEvent *event);
  * SAR related functions.
  */
 static WAPEvent *assembly_sar_event (WTPRespMachine *machine, int last_psn);
-static int add_sar_transaction (WTPRespMachine *machine, Octstr *data, int psn);
-/* static int is_wanted_sar_data (void *a, void *b); */
+static int add_sar_transaction (WTPRespMachine *machine, Octstr **data, int psn);
 static int process_sar_transaction(WTPRespMachine *machine, WAPEvent **event);
 static void begin_sar_result(WTPRespMachine *machine, WAPEvent *event);
 static void continue_sar_result(WTPRespMachine *machine, WAPEvent *event);
 static void resend_sar_result(WTPRespMachine *resp_machine, WAPEvent *event);
-static void sar_info_destroy(void *sar_info);
+static void sar_buffer_destroy(WTPSARBuffer *sar_buffer);
 static void sardata_destroy(void *sardata);
 
 /*
@@ -211,13 +227,20 @@ static void send_ack(WTPRespMachine *machine, long ack_type, int rid_flag);
 void wtp_resp_init(wap_dispatch_func_t *datagram_dispatch,
                    wap_dispatch_func_t *session_dispatch,
                    wap_dispatch_func_t *push_dispatch, 
-                   long timer_freq) 
+                   long timer_freq, long shards) 
 {
-    resp_machines = gwlist_create();
-    resp_machine_id_counter = counter_create();
-
-    resp_queue = gwlist_create();
-    gwlist_add_producer(resp_queue);
+    long i;
+
+    resp_shard_count = shards > 0 ? shards : 1;
+    resp_shards = gw_malloc(resp_shard_count * sizeof(resp_shards[0]));
+    for (i = 0; i < resp_shard_count; i++) {
+        resp_shards[i].queue = gwlist_create();
+        gwlist_add_producer(resp_shards[i].queue);
+        resp_shards[i].machines = dict_create(RESP_MACHINES_HINT, NULL);
+        resp_shards[i].machines_by_mid = dict_create(RESP_MACHINES_HINT, NULL);
+        resp_shards[i].mid_counter = counter_create();
+        resp_shards[i].index = i;
+    }
 
     dispatch_to_wdp = datagram_dispatch;
     dispatch_to_wsp = session_dispatch;
@@ -229,30 +252,92 @@ void wtp_resp_init(wap_dispatch_func_t *datagram_dispatch,
 
     gw_assert(resp_run_status == limbo);
     resp_run_status = running;
-    gwthread_create(main_thread, NULL);
+    for (i = 0; i < resp_shard_count; i++)
+        gwthread_create(main_thread, &resp_shards[i]);
 }
 
 void wtp_resp_shutdown(void) 
 {
+    RespShard *shard;
+    List *keys;
+    Octstr *key;
+    long i;
+
     gw_assert(resp_run_status == running);
     resp_run_status = terminating;
-    gwlist_remove_producer(resp_queue);
+    for (i = 0; i < resp_shard_count; i++)
+        gwlist_remove_producer(resp_shards[i].queue);
     gwthread_join_every(main_thread);
 
-    debug("wap.wtp", 0, "wtp_resp_shutdown: %ld resp_machines left",
-     	  gwlist_len(resp_machines));
-    gwlist_destroy(resp_machines, resp_machine_destroy);
-    gwlist_destroy(resp_queue, wap_event_destroy_item);
-
-    counter_destroy(resp_machine_id_counter);
+    for (i = 0; i < resp_shard_count; i++) {
+        shard = &resp_shards[i];
+        debug("wap.wtp", 0, "wtp_resp_shutdown: %ld resp_machines left "
+              "in shard %ld", dict_key_count(shard->machines_by_mid), i);
+        keys = dict_keys(shard->machines_by_mid);
+        while ((key = gwlist_extract_first(keys)) != NULL) {
+            resp_machine_destroy(dict_get(shard->machines_by_mid, key));
+            octstr_destroy(key);
+        }
+        gwlist_destroy(keys, NULL);
+        dict_destroy(shard->machines);
+        dict_destroy(shard->machines_by_mid);
+        gwlist_destroy(shard->queue, wap_event_destroy_item);
+        counter_destroy(shard->mid_counter);
+    }
+    gw_free(resp_shards);
+    resp_shards = NULL;
 
     wtp_tid_cache_shutdown();
     timers_shutdown();
 }
 
+/*
+ * Datagrams go to the shard of their address tuple, the rest to the shard
+ * of the machine they are for.
+ */
+static long event_shard(WAPEvent *event)
+{
+    WAPAddrTuple *tuple = NULL;
+    long mid = 0;
+
+    switch (event->type) {
+        case RcvInvoke:
+            tuple = event->u.RcvInvoke.addr_tuple;
+            break;
+        case RcvSegInvoke:
+            tuple = event->u.RcvSegInvoke.addr_tuple;
+            break;
+        case RcvAck:
+        case RcvNegativeAck:
+            tuple = event->u.RcvAck.addr_tuple;
+            break;
+        case RcvAbort:
+            tuple = event->u.RcvAbort.addr_tuple;
+            break;
+        case RcvErrorPDU:
+            tuple = event->u.RcvErrorPDU.addr_tuple;
+            break;
+        case TR_Invoke_Res:
+            mid = event->u.TR_Invoke_Res.handle;
+            break;
+        case TR_Result_Req:
+            mid = event->u.TR_Result_Req.handle;
+            break;
+        case TR_Abort_Req:
+            mid = event->u.TR_Abort_Req.handle;
+            break;
+        default:
+            break;
+    }
+
+    if (tuple != NULL)
+        return wap_addr_tuple_hash(tuple) % resp_shard_count;
+    return mid >= 0 ? mid % resp_shard_count : 0;
+}
+
 void wtp_resp_dispatch_event(WAPEvent *event) 
 {
-    gwlist_produce(resp_queue, event);
+    gwlist_produce(resp_shards[event_shard(event)].queue, event);
 }
 
 
@@ -264,13 +349,14 @@ void wtp_resp_dispatch_event(WAPEvent *event)
 
 static void main_thread(void *arg) 
 {
+    RespShard *shard = arg;
     WTPRespMachine *sm;
     WAPEvent *e;
 
     while (resp_run_status == running && 
-           (e = gwlist_consume(resp_queue)) != NULL) {
+           (e = gwlist_consume(shard->queue)) != NULL) {
 
-        sm = resp_machine_find_or_create(e);
+        sm = resp_machine_find_or_create(shard, e);
         if (sm == NULL) {
             wap_event_destroy(e);
         } else {
@@ -394,7 +480,8 @@ static void handle_erroneous_field_in(WAPEvent *event)
  * new machine is created for handling this event. If the event is one of WSP 
  * primitives, we have an error.
  */
-static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event)
+static WTPRespMachine *resp_machine_find_or_create(RespShard *shard,
+                                                   WAPEvent *event)
 {
     WTPRespMachine *resp_machine = NULL;
     long tid, mid;
@@ -473,7 +560,7 @@ static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event)
     }
 
     gw_assert(tuple != NULL || mid != -1);
-    resp_machine = resp_machine_find(tuple, tid, mid);
+    resp_machine = resp_machine_find(shard, tuple, tid, mid);
            
     if (resp_machine == NULL){
 
@@ -488,12 +575,12 @@ static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event)
         case RcvErrorPDU:
             debug("wap.wtp_resp", 0, "an erronous pdu received");
             wap_event_dump(event);
-            resp_machine = resp_machine_create(tuple, tid, 
+            resp_machine = resp_machine_create(shard, tuple, tid, 
                                                event->u.RcvInvoke.tcl); 
             break;
            
         case RcvInvoke:
-            resp_machine = resp_machine_create(tuple, tid, 
+            resp_machine = resp_machine_create(shard, tuple, tid, 
                                                event->u.RcvInvoke.tcl);
             /* if SAR requested */
             if (!event->u.RcvInvoke.gtr || !event->u.RcvInvoke.ttr) {
@@ -552,63 +639,73 @@ static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event)
    return resp_machine;
 }
 
-static int is_wanted_resp_machine(void *a, void *b) 
+static Octstr *resp_machine_key(WAPAddrTuple *tuple, long tid)
 {
-    machine_pattern *pat;
-    WTPRespMachine *m;
-	
-    m = a;
-    pat = b;
+    Octstr *key;
 
-    if (m->mid == pat->mid)
-	return 1;
+    key = wap_addr_tuple_key(tuple);
+    octstr_append_data(key, (char *) &tid, sizeof(tid));
+    return key;
+}
 
-    if (pat->mid != -1)
-	return 0;
 
-    return m->tid == pat->tid && 
-           wap_addr_tuple_same(m->addr_tuple, pat->tuple);
+static Octstr *resp_machine_mid_key(long mid)
+{
+    return octstr_create_from_data((char *) &mid, sizeof(mid));
 }
 
 
-static WTPRespMachine *resp_machine_find(WAPAddrTuple *tuple, long tid, 
+static WTPRespMachine *resp_machine_find(RespShard *shard,
+                                         WAPAddrTuple *tuple, long tid, 
                                          long mid) 
 {
-    machine_pattern pat;
     WTPRespMachine *m;
-	
-    pat.tuple = tuple;
-    pat.tid = tid;
-    pat.mid = mid;
-	
-    m = gwlist_search(resp_machines, &pat, is_wanted_resp_machine);
+    Octstr *key;
+
+    if (mid != -1) {
+        key = resp_machine_mid_key(mid);
+        m = dict_get(shard->machines_by_mid, key);
+    } else {
+        key = resp_machine_key(tuple, tid);
+        m = dict_get(shard->machines, key);
+    }
+    octstr_destroy(key);
+
     return m;
 }
 
 
-static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid, 
+static WTPRespMachine *resp_machine_create(RespShard *shard,
+                                           WAPAddrTuple *tuple, long tid, 
                                            long tcl) 
 {
     WTPRespMachine *resp_machine;
+    Octstr *key;
 	
     resp_machine = gw_malloc(sizeof(WTPRespMachine)); 
         
     #define ENUM(name) resp_machine->name = LISTEN;
     #define EVENT(name) resp_machine->name = NULL;
     #define INTEGER(name) resp_machine->name = 0; 
-    #define TIMER(name) resp_machine->name = gwtimer_create(resp_queue); 
+    #define TIMER(name) resp_machine->name = gwtimer_create(shard->queue); 
     #define ADDRTUPLE(name) resp_machine->name = NULL; 
-    #define LIST(name) resp_machine->name = NULL;
+    #define SARBUFFER(name) resp_machine->name = NULL;
     #define SARDATA(name) resp_machine->name = NULL;
     #define MACHINE(field) field
     #include "wtp_resp_machine.def"
 
-    gwlist_append(resp_machines, resp_machine);
-
-    resp_machine->mid = counter_increase(resp_machine_id_counter);
+    resp_machine->mid = counter_increase(shard->mid_counter) * resp_shard_count
+                        + shard->index;
     resp_machine->addr_tuple = wap_addr_tuple_duplicate(tuple);
     resp_machine->tid = tid;
     resp_machine->tcl = tcl;
+
+    key = resp_machine_key(tuple, tid);
+    dict_put(shard->machines, key, resp_machine);
+    octstr_destroy(key);
+    key = resp_machine_mid_key(resp_machine->mid);
+    dict_put(shard->machines_by_mid, key, resp_machine);
+    octstr_destroy(key);
 	
     debug("wap.wtp", 0, "WTP: Created WTPRespMachine %p (%ld)", 
 	  (void *) resp_machine, resp_machine->mid);
@@ -618,25 +715,34 @@ static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid,
 
 
 /*
- * Destroys a WTPRespMachine. Assumes it is safe to do so. Assumes it has 
- * already been deleted from the machines list.
+ * Destroys a WTPRespMachine. Assumes it is safe to do so. Removes it from
+ * the machine indexes.
  */
 static void resp_machine_destroy(void * p)
 {
     WTPRespMachine *resp_machine;
+    RespShard *shard;
+    Octstr *key;
 
     resp_machine = p;
     debug("wap.wtp", 0, "WTP: Destroying WTPRespMachine %p (%ld)", 
 	  (void *) resp_machine, resp_machine->mid);
 	
-    gwlist_delete_equal(resp_machines, resp_machine);
+    shard = &resp_shards[resp_machine->mid % resp_shard_count];
+    key = resp_machine_key(resp_machine->addr_tuple, resp_machine->tid);
+    if (dict_get(shard->machines, key) == resp_machine)
+        dict_remove(shard->machines, key);
+    octstr_destroy(key);
+    key = resp_machine_mid_key(resp_machine->mid);
+    dict_remove(shard->machines_by_mid, key);
+    octstr_destroy(key);
         
     #define ENUM(name) resp_machine->name = LISTEN;
     #define EVENT(name) wap_event_destroy(resp_machine->name);
     #define INTEGER(name) resp_machine->name = 0; 
     #define TIMER(name) gwtimer_destroy(resp_machine->name); 
     #define ADDRTUPLE(name) wap_addr_tuple_destroy(resp_machine->name); 
-    #define LIST(name) gwlist_destroy(resp_machine->name,sar_info_destroy);
+    #define SARBUFFER(name) sar_buffer_destroy(resp_machine->name);
     #define SARDATA(name) sardata_destroy(resp_machine->name);
     #define MACHINE(field) field
     #include "wtp_resp_machine.def"
@@ -765,12 +871,13 @@ static int process_sar_transaction(WTPRespMachine *machine, WAPEvent **event)
             if (orig_event->u.RcvInvoke.ttr == 1) {
                 return 1; /* Not SAR although TTR flag was set */
             } else {
+                /* move data into the buffer with psn = 0 */
+                add_sar_transaction(machine, &orig_event->u.RcvInvoke.user_data, 0);
+
                 /* save initial event */
+                wap_event_destroy(machine->sar_invoke);
                 machine->sar_invoke = wap_event_duplicate(orig_event);
 
-                /* save data into list with psn = 0 */
-                add_sar_transaction(machine, orig_event->u.RcvInvoke.user_data, 0);
-
                 if (orig_event->u.RcvInvoke.gtr == 1) { /* Need to acknowledge */
                     e = wtp_pack_sar_ack(ACKNOWLEDGEMENT, machine->tid,
                                          machine->addr_tuple, 0);
@@ -784,7 +891,7 @@ static int process_sar_transaction(WTPRespMachine *machine, WAPEvent **event)
     }
 
     if (orig_event->type == RcvSegInvoke) {
-        add_sar_transaction(machine, orig_event->u.RcvSegInvoke.user_data, 
+        add_sar_transaction(machine, &orig_event->u.RcvSegInvoke.user_data, 
                             orig_event->u.RcvSegInvoke.psn);
 
         if (orig_event->u.RcvSegInvoke.gtr == 1) { /* Need to acknowledge */
@@ -812,72 +919,78 @@ static int process_sar_transaction(WTPRespMachine *machine, WAPEvent **event)
     return 1;
 }
 
-static int is_wanted_sar_data(void *a, void *b)
+/* 
+ * Keep the data of a segment, taking it from the event. Return 0 if the
+ * segment was added suscessufully, 1 otherwise.
+ */
+static int add_sar_transaction(WTPRespMachine *machine, Octstr **data, int psn) 
 {
-    sar_info_t *s;
-    int *i;
-
-    s = a;
-    i = b;
+    WTPSARBuffer *buf;
 
-    if (*i == s->sar_psn) {
+    if (psn < 0 || psn >= SAR_MAX_SEGM) {
+        debug("wap.wtp", 0, "Illegal psn %d, ignore packet", psn);
         return 1;
-    } else {
-        return 0;
     }
-}
 
-/* 
- * Return 0 if transaction added suscessufully, 1 otherwise.
- */
-static int add_sar_transaction(WTPRespMachine *machine, Octstr *data, int psn) 
-{
-    sar_info_t *sar_info;
-
-    if (machine->sar_info == NULL) {
-        machine->sar_info = gwlist_create();
+    if ((buf = machine->sar_buffer) == NULL) {
+        buf = machine->sar_buffer = gw_malloc(sizeof(WTPSARBuffer));
+        memset(buf->segm, 0, sizeof(buf->segm));
+        buf->last = -1;
     }
 
-    if (gwlist_search(machine->sar_info, &psn, is_wanted_sar_data) == NULL) {
-        sar_info = gw_malloc(sizeof(sar_info_t));
-        sar_info->sar_psn = psn;
-        sar_info->sar_data = octstr_duplicate(data);
-        gwlist_append(machine->sar_info, sar_info);
-        return 0;
-    } else {
+    if (buf->segm[psn] != NULL) {
         debug("wap.wtp", 0, "Duplicated psn found, ignore packet");
         return 1;
     } 
+
+    /* events require user data, leave an empty one */
+    buf->segm[psn] = *data;
+    *data = octstr_create("");
+    if (psn > buf->last)
+        buf->last = psn;
+
+    return 0;
 }
 
+/*
+ * Create the invoke of the whole message. Segments are copied once, into a
+ * buffer of their total length. If a segment is missing, the message ends
+ * before it.
+ */
 static WAPEvent *assembly_sar_event(WTPRespMachine *machine, int last_psn) 
 {
     WAPEvent *e;
-    int i;
-    sar_info_t *sar_info;
+    WTPSARBuffer *buf;
+    Octstr *data;
+    int n;
 
-    e = wap_event_duplicate(machine->sar_invoke);
+    buf = machine->sar_buffer;
+    gw_assert(buf != NULL);
 
-    for (i = 1; i <= last_psn; i++) {
-        if ((sar_info = gwlist_search(machine->sar_info, &i, is_wanted_sar_data)) != NULL) {
-            octstr_append(e->u.RcvInvoke.user_data,sar_info->sar_data);
-        } else {
-            debug("wap.wtp", 0, "Packet with psn %d not found", i);
-            return e;
-        }
-    }
+    /* the segments are appended in order right into the user data */
+    data = octstr_create("");
+    for (n = 0; n <= last_psn && n < SAR_MAX_SEGM && buf->segm[n] != NULL; n++)
+        octstr_append(data, buf->segm[n]);
+    if (n <= last_psn)
+        debug("wap.wtp", 0, "Packet with psn %d not found", n);
+
+    e = wap_event_duplicate(machine->sar_invoke);
+    octstr_destroy(e->u.RcvInvoke.user_data);
+    e->u.RcvInvoke.user_data = data;
 
     return e;
 }
 
-static void sar_info_destroy(void *p) 
+static void sar_buffer_destroy(WTPSARBuffer *buf) 
 {
-    sar_info_t *sar_info;
+    int i;
 
-    sar_info = p;
-  
-    octstr_destroy(sar_info->sar_data);
-    gw_free(sar_info);
+    if (buf == NULL)
+        return;
+
+    for (i = 0; i <= buf->last; i++)
+        octstr_destroy(buf->segm[i]);
+    gw_free(buf);
 }
 
 static void sardata_destroy(void *p) 
@@ -900,7 +1013,10 @@ static void begin_sar_result(WTPRespMachine *resp_machine, WAPEvent *event)
     gw_assert(resp_machine->sar != NULL);
 
     sar = resp_machine->sar;
-    sar->data = octstr_duplicate(event->u.TR_Result_Req.user_data);
+    /* the event is destroyed after this, so its data can be taken */
+    octstr_destroy(sar->data);
+    sar->data = event->u.TR_Result_Req.user_data;
+    event->u.TR_Result_Req.user_data = octstr_create("");
     sar->nsegm = (octstr_len(sar->data)-1)/SAR_SEGM_SIZE;
     sar->tr = sar->lsegm = 0;
     sar->csegm = -1;
@@ -69,10 +69,20 @@ typedef struct WTPRespMachine WTPRespMachine;
 #include "wap_events.h"
 #include "timers.h"
 
-typedef struct sar_info_t {
-    int sar_psn;
-    Octstr *sar_data;
-} sar_info_t;
+/*
+ * Maximum number of segments in a message. Packet sequence number is one
+ * octet.
+ */
+#define SAR_MAX_SEGM 256
+
+/*
+ * Structure to keep segments of an incoming message until the last one
+ * arrives. Segments are indexed by their packet sequence number.
+ */
+typedef struct WTPSARBuffer {
+    Octstr *segm[SAR_MAX_SEGM];
+    int last;   /* highest psn received */
+} WTPSARBuffer;
 
 
 /*
@@ -119,7 +129,7 @@ struct WTPRespMachine {
        #define ADDRTUPLE(name) WAPAddrTuple *name;
        #define ENUM(name) resp_states name;
        #define EVENT(name) WAPEvent *name;
-       #define LIST(name) List *name;
+       #define SARBUFFER(name) WTPSARBuffer *name;
        #define SARDATA(name) WTPSARData *name;
        #define MACHINE(field) field
        #include "wtp_resp_machine.def"
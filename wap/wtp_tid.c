@@ -77,9 +77,17 @@ enum {
 /*
  * Global data structure:
  *
- * Tid cache is implemented by using a library object List
+ * Tid cache is implemented by using a library object Dict, keyed by the
+ * address four-tuple of the initiator. The items are also kept on a list
+ * in the order they were last used, so that items of initiators not heard
+ * of in WTP_TID_CACHE_LIFETIME seconds can be dropped from its head.
  */
- static List *tid_cache = NULL;   
+static Dict *tid_cache = NULL;
+static Mutex *tid_cache_lock = NULL;
+static WTPCached_tid *tid_cache_oldest = NULL;
+static WTPCached_tid *tid_cache_newest = NULL;
+
+enum { TID_CACHE_HINT = 1024 };
 
 /*****************************************************************************
  * Prototypes of internal functions
@@ -91,6 +99,9 @@ static void cache_item_dump(WTPCached_tid *item);
 */
 static void add_tid(WTPRespMachine *resp_machine, long tid);
 static void set_tid_by_item(WTPCached_tid *item, long tid);
+static void cache_item_unlink(WTPCached_tid *item);
+static void cache_item_touch(WTPCached_tid *item);
+static void expire_tids(void);
 static int tid_in_window(long rcv_tid, long last_tid);
 static WTPCached_tid *tid_cached(WTPRespMachine *resp_machine);
 
@@ -101,14 +112,23 @@ static WTPCached_tid *tid_cached(WTPRespMachine *resp_machine);
 
 void wtp_tid_cache_init(void) 
 {
-    tid_cache = gwlist_create();
+    tid_cache = dict_create(TID_CACHE_HINT, NULL);
+    tid_cache_lock = mutex_create();
+    tid_cache_oldest = tid_cache_newest = NULL;
 }
 
 void wtp_tid_cache_shutdown(void) 
 {
+    WTPCached_tid *item;
+
     debug("wap.wtp_tid", 0, "%ld items left in the tid cache", 
-          gwlist_len(tid_cache));
-    gwlist_destroy(tid_cache, cache_item_destroy);
+          dict_key_count(tid_cache));
+    while ((item = tid_cache_oldest) != NULL) {
+        cache_item_unlink(item);
+        cache_item_destroy(item);
+    }
+    dict_destroy(tid_cache);
+    mutex_destroy(tid_cache_lock);
 }
 
 /*
@@ -163,6 +183,7 @@ int wtp_tid_is_valid(WAPEvent *event, WTPRespMachine *resp_machine)
     } else {
         info(0, "WTP_TID: tid_new flag on");
         rcv_tid = 0;
+        item = tid_cached(resp_machine);
 
         if (item == NULL) {
             add_tid(resp_machine, rcv_tid);
@@ -187,7 +208,10 @@ void wtp_tid_set_by_machine(WTPRespMachine *resp_machine, long tid)
     WTPCached_tid *item = NULL;
        
     item = tid_cached(resp_machine);
-    set_tid_by_item(item, tid);
+    if (item != NULL)
+        set_tid_by_item(item, tid);
+    else
+        add_tid(resp_machine, tid);
 }
 
 /*****************************************************************************
@@ -239,7 +263,10 @@ static WTPCached_tid *cache_item_create_empty(void)
 
     item = gw_malloc(sizeof(*item));
     item->addr_tuple = NULL;
+    item->key = NULL;
     item->tid = 0;
+    item->last_used = 0;
+    item->prev = item->next = NULL;
 
     return item;
 }
@@ -250,32 +277,82 @@ static void cache_item_destroy(void *p)
 	
     item = p;
     wap_addr_tuple_destroy(item->addr_tuple);
+    octstr_destroy(item->key);
     gw_free(item);
 }
 
 /*
- * Checking whether there is an item stored for a specific initiator. Receives 
- * address quadruplet - the identifier it uses - from object WTPRespMachine. 
- * Ditto tid. Returns the item or NULL, if there is not one. Initiator is 
- * identified by the address four-tuple.
+ * Take an item off the use order list. Called with the cache locked.
  */
+static void cache_item_unlink(WTPCached_tid *item)
+{
+    if (item->prev != NULL)
+        item->prev->next = item->next;
+    else
+        tid_cache_oldest = item->next;
+    if (item->next != NULL)
+        item->next->prev = item->prev;
+    else
+        tid_cache_newest = item->prev;
+    item->prev = item->next = NULL;
+}
 
-static int tid_is_cached(void *a, void *b)
+/*
+ * Mark an item used now, moving it to the tail of the use order list.
+ * Called with the cache locked.
+ */
+static void cache_item_touch(WTPCached_tid *item)
 {
-    WAPAddrTuple *initiator_profile;
-    WTPCached_tid *item;
+    if (item != tid_cache_newest) {
+        if (item->prev != NULL || item == tid_cache_oldest)
+            cache_item_unlink(item);
+        item->prev = tid_cache_newest;
+        if (tid_cache_newest != NULL)
+            tid_cache_newest->next = item;
+        else
+            tid_cache_oldest = item;
+        tid_cache_newest = item;
+    }
+    item->last_used = time(NULL);
+}
 
-    item = a;
-    initiator_profile = b;
+/*
+ * Drop the items of initiators which have not been heard of for
+ * WTP_TID_CACHE_LIFETIME seconds. They will have their tid verified
+ * again, should they come back. Called with the cache locked.
+ */
+static void expire_tids(void)
+{
+    WTPCached_tid *item;
+    time_t limit;
 
-    return wap_addr_tuple_same(item->addr_tuple, initiator_profile);
+    limit = time(NULL) - WTP_TID_CACHE_LIFETIME;
+    while ((item = tid_cache_oldest) != NULL && item->last_used < limit) {
+        cache_item_unlink(item);
+        dict_remove(tid_cache, item->key);
+        cache_item_destroy(item);
+    }
 }
 
+/*
+ * Checking whether there is an item stored for a specific initiator. Receives 
+ * address quadruplet - the identifier it uses - from object WTPRespMachine. 
+ * Ditto tid. Returns the item or NULL, if there is not one. Initiator is 
+ * identified by the address four-tuple.
+ */
 static WTPCached_tid *tid_cached(WTPRespMachine *resp_machine)
 {
     WTPCached_tid *item = NULL;
+    Octstr *key;
 
-    item = gwlist_search(tid_cache, resp_machine->addr_tuple, tid_is_cached);
+    key = wap_addr_tuple_key(resp_machine->addr_tuple);
+    mutex_lock(tid_cache_lock);
+    expire_tids();
+    item = dict_get(tid_cache, key);
+    if (item != NULL)
+        cache_item_touch(item);
+    mutex_unlock(tid_cache_lock);
+    octstr_destroy(key);
 
     return item;
 }
@@ -290,9 +367,19 @@ static void add_tid(WTPRespMachine *resp_machine, long tid)
        
     new_item = cache_item_create_empty(); 
     new_item->addr_tuple = wap_addr_tuple_duplicate(resp_machine->addr_tuple);
+    new_item->key = wap_addr_tuple_key(new_item->addr_tuple);
     new_item->tid = tid; 
 
-    gwlist_append(tid_cache, new_item);
+    mutex_lock(tid_cache_lock);
+    expire_tids();
+    if (dict_put_once(tid_cache, new_item->key, new_item)) {
+        cache_item_touch(new_item);
+    } else {
+        /* somebody was first, just update its item */
+        set_tid_by_item(dict_get(tid_cache, new_item->key), tid);
+        cache_item_destroy(new_item);
+    }
+    mutex_unlock(tid_cache_lock);
 }
 
 /*
@@ -300,7 +387,5 @@ static void add_tid(WTPRespMachine *resp_machine, long tid)
  */
 static void set_tid_by_item(WTPCached_tid *item, long tid)
 {
-    gwlist_lock(tid_cache);
     item->tid = tid;
-    gwlist_unlock(tid_cache);
 }
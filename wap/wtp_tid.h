@@ -74,6 +74,11 @@ typedef struct WTPCached_tid WTPCached_tid;
 
 #define WTP_TID_WINDOW_SIZE (1L << 14)
 
+/*
+ * Seconds after which an initiator not heard of is dropped from the cache.
+ */
+#define WTP_TID_CACHE_LIFETIME 3600
+
 /*
  * Constants defining the result of tid validation
  */
@@ -84,11 +89,16 @@ enum {
 };
 
 /*
- * Tid cache item consists of initiator identifier and cached tid.
+ * Tid cache item consists of initiator identifier and cached tid. The key
+ * of the initiator, the time it was last heard of and the links of the
+ * use order list are kept for the cache itself.
  */
 struct WTPCached_tid {
     WAPAddrTuple *addr_tuple;
+    Octstr *key;
     long tid;
+    time_t last_used;
+    WTPCached_tid *prev, *next;
 };
 
 /* 
@@ -78,6 +78,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "gwlib/gwlib.h"
 #include "ws.h"
@@ -86,6 +87,7 @@
 /* XXX This module, as well, should use the gwmem wrappers. We'll change
    this later. --liw */
 #undef malloc
+#undef calloc
 #undef realloc
 #undef free
 
@@ -101,6 +103,12 @@ static void pragma_meta(const WsUtf8String *property_name,
                         const WsUtf8String *scheme,
                         void *context);
 
+/* Compile the files `files' `count' times over and report the
+   compilation throughput.  Exits with an error if a compilation fails
+   or does not give the same byte-code as the first one. */
+static void benchmark(WsCompilerParams *params, char **files, int num_files,
+                      long count);
+
 /********************* Static variables *********************************/
 
 /* The name of the compiler program. */
@@ -109,6 +117,14 @@ static char *program;
 /* Use ws_compile_data() instead of ws_compile_file(). */
 static int eval_data = 0;
 
+/* Benchmark: compile the input files this many times, 0 for no
+   benchmark. */
+static long bench_count = 0;
+
+/* Benchmark: create a new compiler for each compilation instead of
+   reusing one. */
+static int bench_new_compiler = 0;
+
 /********************* Global functions *********************************/
 
 int main(int argc, char *argv[])
@@ -130,12 +146,20 @@ int main(int argc, char *argv[])
     memset(&params, 0, sizeof(params));
 
     /* Process command line arguments. */
-    while ((opt = getopt(argc, argv, "adhsv")) != EOF) {
+    while ((opt = getopt(argc, argv, "ab:dhnsv")) != EOF) {
         switch (opt) {
         case 'a':
             params.print_assembler = 1;
             break;
 
+        case 'b':
+            bench_count = strtol(optarg, NULL, 10);
+            if (bench_count < 1) {
+                fprintf(stderr, "wmlsc: bad benchmark count `%s'\n", optarg);
+                exit(1);
+            }
+            break;
+
         case 'd':
             eval_data = 1;
             break;
@@ -145,6 +169,10 @@ int main(int argc, char *argv[])
             exit(0);
             break;
 
+        case 'n':
+            bench_new_compiler = 1;
+            break;
+
         case 'l':
             params.use_latin1_strings = 1;
             break;
@@ -172,6 +200,11 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (bench_count > 0) {
+        benchmark(&params, argv + optind, argc - optind, bench_count);
+        return 0;
+    }
+
     /* Create compiler. */
 
     compiler = ws_create(&params);
@@ -277,8 +310,11 @@ static void usage(void)
            \n\
            -a            disassemble resulting byte-code and print it to the\n\
            standard output\n\
+           -b COUNT      benchmark: compile the files COUNT times and print\n\
+           the throughput, no output files are written\n\
            -d		 use ws_eval_data() function instead of ws_eval_file()\n\
            -h            print this help message and exit successfully\n\
+           -n            benchmark with a new compiler for each compilation\n\
            -l            encode strings in ISO-8859/1 (ISO latin1) instead of using\n\
            UTF-8\n\
            -p            print pragmas\n\
@@ -314,3 +350,116 @@ static void pragma_meta(const WsUtf8String *property_name,
     ws_utf8_free_data((unsigned char *) content_l);
     ws_utf8_free_data((unsigned char *) scheme_l);
 }
+
+
+static void benchmark(WsCompilerParams *params, char **files, int num_files,
+                      long count)
+{
+    WsCompilerPtr compiler;
+    WsResult result;
+    struct stat stat_st;
+    struct timeval start, end;
+    unsigned char **data, **first, *output;
+    size_t *data_len, *first_len, output_len, total_len;
+    FILE *ifp;
+    double seconds;
+    long n;
+    int i;
+
+    if (num_files < 1) {
+        fprintf(stderr, "wmlsc: no input files to benchmark\n");
+        exit(1);
+    }
+
+    /* The compiler output is not interesting here. */
+    params->print_assembler = 0;
+    params->print_symbolic_assembler = 0;
+    params->verbose = 0;
+
+    data = calloc(num_files, sizeof(data[0]));
+    data_len = calloc(num_files, sizeof(data_len[0]));
+    first = calloc(num_files, sizeof(first[0]));
+    first_len = calloc(num_files, sizeof(first_len[0]));
+    if (data == NULL || data_len == NULL || first == NULL ||
+        first_len == NULL) {
+        fprintf(stderr, "wmlsc: out of memory\n");
+        exit(1);
+    }
+
+    /* Read all the input files in advance. */
+    total_len = 0;
+    for (i = 0; i < num_files; i++) {
+        if ((ifp = fopen(files[i], "rb")) == NULL ||
+            fstat(fileno(ifp), &stat_st) == -1) {
+            fprintf(stderr, "wmlsc: could not open input file `%s': %s\n",
+                    files[i], strerror(errno));
+            exit(1);
+        }
+        data_len[i] = stat_st.st_size;
+        data[i] = malloc(data_len[i] + 1);
+        if (data[i] == NULL ||
+            fread(data[i], 1, data_len[i], ifp) < data_len[i]) {
+            fprintf(stderr, "wmlsc: could not read input file `%s'\n",
+                    files[i]);
+            exit(1);
+        }
+        fclose(ifp);
+        total_len += data_len[i];
+    }
+
+    compiler = NULL;
+    gettimeofday(&start, NULL);
+    for (n = 0; n < count; n++) {
+        for (i = 0; i < num_files; i++) {
+            if (compiler == NULL && (compiler = ws_create(params)) == NULL) {
+                fprintf(stderr, "wmlsc: could not create compiler\n");
+                exit(1);
+            }
+            result = ws_compile_data(compiler, files[i], data[i], data_len[i],
+                                     &output, &output_len);
+            if (result != WS_OK) {
+                fprintf(stderr, "wmlsc: compilation of `%s' failed: %s\n",
+                        files[i], ws_result_to_string(result));
+                exit(1);
+            }
+            if (first[i] == NULL) {
+                first[i] = output;
+                first_len[i] = output_len;
+            } else {
+                if (output_len != first_len[i] ||
+                    memcmp(output, first[i], output_len) != 0) {
+                    fprintf(stderr, "wmlsc: compilation %ld of `%s' gave "
+                            "different byte-code\n", n + 1, files[i]);
+                    exit(1);
+                }
+                ws_free_byte_code(output);
+            }
+            if (bench_new_compiler) {
+                ws_destroy(compiler);
+                compiler = NULL;
+            }
+        }
+    }
+    gettimeofday(&end, NULL);
+    ws_destroy(compiler);
+
+    seconds = (end.tv_sec - start.tv_sec) +
+              (end.tv_usec - start.tv_usec) / 1000000.0;
+    if (seconds <= 0)
+        seconds = 0.000001;
+    printf("%ld compilations of %d files (%lu bytes) with %s compiler "
+           "in %.3f s: %.1f compilations/s, %.1f KB/s\n",
+           count * num_files, num_files, (unsigned long) total_len,
+           bench_new_compiler ? "a new" : "one", seconds,
+           count * num_files / seconds,
+           count * total_len / seconds / 1024);
+
+    for (i = 0; i < num_files; i++) {
+        free(data[i]);
+        ws_free_byte_code(first[i]);
+    }
+    free(data);
+    free(data_len);
+    free(first);
+    free(first_len);
+}
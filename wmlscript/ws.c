@@ -165,6 +165,11 @@ void ws_destroy(WsCompilerPtr compiler)
     if (compiler == NULL)
         return;
 
+    ws_f_destroy(compiler->pool_stree);
+    ws_f_destroy(compiler->pool_asm);
+    ws_hash_destroy(compiler->pragma_use_hash);
+    ws_hash_destroy(compiler->functions_hash);
+    ws_hash_destroy(compiler->variables_hash);
     ws_free(compiler);
 
 #if WS_MEM_DEBUG
@@ -336,9 +341,16 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
     compiler->errors = 0;
     compiler->last_syntax_error_line = 0;
 
-    /* Allocate fast-malloc pool for the syntax tree. */
+    compiler->num_functions = 0;
+    compiler->functions = NULL;
+    compiler->lexer_active_list_size = 0;
+    compiler->cont_break = NULL;
+
+    /* Allocate fast-malloc pool for the syntax tree, unless we have one
+       from an earlier compilation. */
 
-    compiler->pool_stree = ws_f_create(1024 * 1024);
+    if (compiler->pool_stree == NULL)
+        compiler->pool_stree = ws_f_create(1024 * 1024);
     if (compiler->pool_stree == NULL) {
         result = WS_ERROR_OUT_OF_MEMORY;
         goto out;
@@ -346,13 +358,15 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
 
     /* Allocate hash tables. */
 
-    compiler->pragma_use_hash = ws_pragma_use_hash_create();
+    if (compiler->pragma_use_hash == NULL)
+        compiler->pragma_use_hash = ws_pragma_use_hash_create();
     if (compiler->pragma_use_hash == NULL) {
         result = WS_ERROR_OUT_OF_MEMORY;
         goto out;
     }
 
-    compiler->functions_hash = ws_function_hash_create();
+    if (compiler->functions_hash == NULL)
+        compiler->functions_hash = ws_function_hash_create();
     if (compiler->functions_hash == NULL) {
         result = WS_ERROR_OUT_OF_MEMORY;
         goto out;
@@ -426,7 +440,8 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
 
         ws_info(compiler, "linearizing function `%s'...", func->name);
 
-        compiler->pool_asm = ws_f_create(100 * 1024);
+        if (compiler->pool_asm == NULL)
+            compiler->pool_asm = ws_f_create(100 * 1024);
         if (compiler->pool_asm == NULL) {
             result = WS_ERROR_OUT_OF_MEMORY;
             goto out;
@@ -437,7 +452,8 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
 
         /* Create variables namespace. */
         compiler->next_vindex = 0;
-        compiler->variables_hash = ws_variable_hash_create();
+        if (compiler->variables_hash == NULL)
+            compiler->variables_hash = ws_variable_hash_create();
         if (compiler->variables_hash == NULL) {
             result = WS_ERROR_OUT_OF_MEMORY;
             goto out;
@@ -498,11 +514,8 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
 
         ws_buffer_uninit(&compiler->byte_code);
 
-        ws_hash_destroy(compiler->variables_hash);
-        compiler->variables_hash = NULL;
-
-        ws_f_destroy(compiler->pool_asm);
-        compiler->pool_asm = NULL;
+        ws_hash_clear(compiler->variables_hash);
+        ws_f_reset(compiler->pool_asm);
     }
 
     /* Linearize the byte-code structure. */
@@ -511,32 +524,33 @@ static WsResult compile_stream(WsCompilerPtr compiler, const char *input_name,
 
 out:
 
-    /* Cleanup. */
+    /* Cleanup.  The pools and hash tables are only emptied, they are
+       kept for the next compilation. */
 
-    ws_f_destroy(compiler->pool_stree);
-    compiler->pool_stree = NULL;
+    ws_f_reset(compiler->pool_stree);
 
-    ws_hash_destroy(compiler->pragma_use_hash);
-    compiler->pragma_use_hash = NULL;
+    if (compiler->pragma_use_hash)
+        ws_hash_clear(compiler->pragma_use_hash);
 
     /* Free functions. */
     for (i = 0; i < compiler->num_functions; i++)
         ws_free(compiler->functions[i].name);
     ws_free(compiler->functions);
+    compiler->functions = NULL;
+    compiler->num_functions = 0;
 
-    ws_hash_destroy(compiler->functions_hash);
-    compiler->functions_hash = NULL;
+    if (compiler->functions_hash)
+        ws_hash_clear(compiler->functions_hash);
 
     ws_bc_free(compiler->bc);
     compiler->bc = NULL;
 
     compiler->input = NULL;
 
-    ws_f_destroy(compiler->pool_asm);
-    compiler->pool_asm = NULL;
+    ws_f_reset(compiler->pool_asm);
 
-    ws_hash_destroy(compiler->variables_hash);
-    compiler->variables_hash = NULL;
+    if (compiler->variables_hash)
+        ws_hash_clear(compiler->variables_hash);
 
     ws_buffer_uninit(&compiler->byte_code);
 
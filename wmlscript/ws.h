@@ -197,6 +197,11 @@ WsCompilerPtr ws_create(WsCompilerParams *params);
    has allocated. */
 void ws_destroy(WsCompilerPtr compiler);
 
+/* A compiler can compile any number of inputs, one at a time.  It keeps
+   its memory pools and hash tables from one compilation to the next, so
+   reusing a compiler is cheaper than creating a new one for each input.
+   A compiler may not be used by several threads at the same time. */
+
 /********************* Compiling WMLScript ******************************/
 
 /* Returns codes for the compiler functions. */
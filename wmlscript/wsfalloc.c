@@ -95,10 +95,36 @@ void ws_f_destroy(WsFastMalloc *pool)
         bnext = b->next;
         ws_free(b);
     }
+    for (b = pool->free_blocks; b; b = bnext) {
+        bnext = b->next;
+        ws_free(b);
+    }
     ws_free(pool);
 }
 
 
+void ws_f_reset(WsFastMalloc *pool)
+{
+    WsFastMallocBlock *b, *bnext;
+
+    if (pool == NULL)
+        return;
+
+    for (b = pool->blocks; b; b = bnext) {
+        bnext = b->next;
+        if (b->size == pool->block_size) {
+            b->next = pool->free_blocks;
+            pool->free_blocks = b;
+        } else
+            ws_free(b);
+    }
+    pool->blocks = NULL;
+    pool->ptr = NULL;
+    pool->size = 0;
+    pool->user_bytes_allocated = 0;
+}
+
+
 void *ws_f_malloc(WsFastMalloc *pool, size_t size)
 {
     unsigned char *result;
@@ -119,12 +145,20 @@ void *ws_f_malloc(WsFastMalloc *pool, size_t size)
         if (alloc_size < size)
             alloc_size = size;
 
-        /* Allocate the block and remember to add the header size. */
-        b = ws_malloc(alloc_size + sizeof(WsFastMallocBlock));
+        if (alloc_size == pool->block_size && pool->free_blocks != NULL) {
+            /* Reuse a block kept by ws_f_reset(). */
+            b = pool->free_blocks;
+            pool->free_blocks = b->next;
+        } else {
+            /* Allocate the block and remember to add the header size. */
+            b = ws_malloc(alloc_size + sizeof(WsFastMallocBlock));
+
+            if (b == NULL)
+                /* No memory available. */
+                return NULL;
 
-        if (b == NULL)
-            /* No memory available. */
-            return NULL;
+            b->size = alloc_size;
+        }
 
         /* Add this block to the memory pool. */
         b->next = pool->blocks;
@@ -75,6 +75,10 @@
 struct WsFastMallocBlockRec
 {
     struct WsFastMallocBlockRec *next;
+
+    /* The number of data bytes in this block. */
+    size_t size;
+
     /* The data follows immediately here. */
 };
 
@@ -95,6 +99,9 @@ struct WsFastMallocRec
 
     /* And it has this much space. */
     size_t size;
+
+    /* Blocks of `block_size' bytes, kept over ws_f_reset() for reuse. */
+    WsFastMallocBlock *free_blocks;
 };
 
 typedef struct WsFastMallocRec WsFastMalloc;
@@ -111,6 +118,12 @@ WsFastMalloc *ws_f_create(size_t block_size);
    invalidated with this call. */
 void ws_f_destroy(WsFastMalloc *pool);
 
+/* Invalidate all memory chunks allocated from the pool `pool', but
+   keep its blocks of the default size for the following allocations,
+   so that a pool used over and over again does not go to the system
+   allocator each time.  Blocks of bigger size are freed. */
+void ws_f_reset(WsFastMalloc *pool);
+
 /* Allocate `size' bytes of memory from the pool `pool'.  The function
    returns NULL if the allocation fails. */
 void *ws_f_malloc(WsFastMalloc *pool, size_t size);